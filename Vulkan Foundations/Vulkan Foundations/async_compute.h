@@ -0,0 +1,143 @@
+#pragma once
+
+#include "timeline_semaphore.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Compute work submitted to a dedicated compute family, so dispatches run on the compute units the graphics queue leaves idle while
+ * it rasterizes. Every frame in flight owns a command pool, the work of a frame is recorded between begin() and submit() and signals
+ * the next value of the compute timeline, which the graphics submit that consumes the results waits on.
+ * Resources shared with the graphics queue must be created with VK_SHARING_MODE_CONCURRENT for both families, there are no queue
+ * family ownership transfers. Not thread safe, everything runs on the render thread
+ */
+class async_compute_queue
+{
+public:
+	void init(const VkDevice device, const uint32_t queue_family, const VkQueue queue, const uint32_t frame_count)
+	{
+		device_ = device;
+		queue_family_ = queue_family;
+		queue_ = queue;
+
+		frames_.resize(frame_count);
+		for (auto& frame : frames_)
+		{
+			VkCommandPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			pool_info.queueFamilyIndex = queue_family_;
+
+			if (vkCreateCommandPool(device_, &pool_info, nullptr, &frame.command_pool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create async compute command pool!");
+			}
+
+			VkCommandBufferAllocateInfo alloc_info{};
+			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			alloc_info.commandPool = frame.command_pool;
+			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			alloc_info.commandBufferCount = 1;
+
+			if (vkAllocateCommandBuffers(device_, &alloc_info, &frame.command_buffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to allocate async compute command buffer!");
+			}
+		}
+
+		timeline_.init(device_);
+	}
+
+	void destroy()
+	{
+		timeline_.wait(timeline_.submitted());
+		timeline_.destroy();
+
+		for (auto& frame : frames_)
+		{
+			vkDestroyCommandPool(device_, frame.command_pool, nullptr);
+		}
+		frames_.clear();
+	}
+
+	uint32_t queue_family() const
+	{
+		return queue_family_;
+	}
+
+	/**
+	 * Start recording the compute work of a frame slot. Waits for the previous work of the slot, which is normally long done
+	 */
+	VkCommandBuffer begin(const uint32_t frame_index)
+	{
+		frame_resources& frame = frames_[frame_index];
+		timeline_.wait(frame.timeline_value);
+		vkResetCommandPool(device_, frame.command_pool, 0);
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (vkBeginCommandBuffer(frame.command_buffer, &begin_info) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to begin recording async compute command buffer!");
+		}
+		recording_frame_ = frame_index;
+		pending_ = queue_submission{};
+
+		return frame.command_buffer;
+	}
+
+	/**
+	 * Make the work being recorded wait on another queue, e.g. on the transfer timeline for the data it reads
+	 */
+	void wait(const timeline_wait& dependency)
+	{
+		pending_.wait(dependency);
+	}
+
+	/**
+	 * Submit the work recorded since begin(). The returned wait is what a consumer of the results waits on, at the stages it reads them
+	 */
+	timeline_wait submit(const VkPipelineStageFlags consumer_stages)
+	{
+		frame_resources& frame = frames_[recording_frame_];
+		if (vkEndCommandBuffer(frame.command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record async compute command buffer!");
+		}
+
+		frame.timeline_value = timeline_.signal_next();
+		pending_.signal(timeline_.semaphore(), frame.timeline_value);
+		if (pending_.submit(queue_, 1, &frame.command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit async compute command buffer!");
+		}
+
+		return { timeline_.semaphore(), frame.timeline_value, consumer_stages };
+	}
+
+private:
+	struct frame_resources
+	{
+		VkCommandPool command_pool = VK_NULL_HANDLE;
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		uint64_t timeline_value = 0; // Signaled once the last work recorded in this slot is done
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	uint32_t queue_family_ = 0;
+	VkQueue queue_ = VK_NULL_HANDLE;
+	gpu_timeline timeline_; // Of the compute queue, one value per submit
+	std::vector<frame_resources> frames_;
+	uint32_t recording_frame_ = 0;
+	queue_submission pending_;
+};
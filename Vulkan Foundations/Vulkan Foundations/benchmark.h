@@ -0,0 +1,167 @@
+#pragma once
+
+#include "frame_statistics.h"
+#include "gpu_timestamp_profiler.h"
+
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//	********************************************
+//	******** BENCHMARK GLOBAL VARIABLES ********
+//	********************************************
+
+const uint64_t DEFAULT_BENCHMARK_FRAMES = 1000; // Measured frames when neither a frame count nor a duration is given
+const uint64_t DEFAULT_BENCHMARK_WARMUP_FRAMES = 100; // Enough to fill the pipeline, the caches and to let clocks ramp up
+const uint32_t MAX_BENCHMARK_GPU_SAMPLES = 1 << 16; // Per scope, GPU percentiles of longer runs cover the latest frames only
+
+// Bump when fields of the JSON report are added, removed, reordered or change meaning:
+// 1 first report
+// 2 settings.gpu_culling
+// 3 settings.present_policy and settings.swap_chain_images, cpu.present_wait between frame_fence_wait and acquire
+// 4 settings.async_compute
+// 5 settings.recording_workers is the size of the shared job system, which also runs the pipeline compiles and the frame tasks
+const uint32_t BENCHMARK_REPORT_VERSION = 5;
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * How a benchmark run is measured. A run stops at frame_count frames or after duration_seconds, whichever comes first,
+ * a zero disables that limit
+ */
+struct benchmark_settings
+{
+	bool enabled = false;
+	uint64_t frame_count = 0;
+	double duration_seconds = 0.0;
+	uint64_t warmup_frames = DEFAULT_BENCHMARK_WARMUP_FRAMES;
+	std::string output_path; // Empty writes the report to the standard output
+};
+
+struct benchmark_result
+{
+	std::string device_name;
+	uint32_t driver_version = 0;
+	std::string mode; // "windowed" or "headless"
+	std::string present_mode; // "none" in headless mode
+	std::string present_policy; // "none" in headless mode
+	uint32_t swap_chain_images = 0;
+	uint32_t frames_in_flight = 0;
+	uint32_t recording_workers = 0;
+	uint32_t draw_count = 0;
+	uint32_t instance_count = 0;
+	bool gpu_culling = false;
+	bool async_compute = false;
+
+	bool completed = false; // False when the window was closed before the end of the run
+	double startup_ms = 0.0; // From run() to the end of init_vulkan()
+	uint64_t warmup_frames = 0;
+	uint64_t measured_frames = 0;
+	double measured_seconds = 0.0;
+	double fps = 0.0;
+
+	frame_statistics_summary cpu;
+	uint64_t dropped_cpu_samples = 0;
+	std::vector<gpu_scope_statistics> gpu;
+};
+
+//	***************************
+//	******** FUNCTIONS ********
+//	***************************
+
+inline void write_json_string(std::ostream& out, const std::string& value)
+{
+	out << '"';
+	for (const char c : value)
+	{
+		switch (c)
+		{
+		case '"': out << "\\\""; break;
+		case '\\': out << "\\\\"; break;
+		case '\n': out << "\\n"; break;
+		case '\t': out << "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+			}
+			else
+			{
+				out << c;
+			}
+		}
+	}
+	out << '"';
+}
+
+inline void write_json_percentiles(std::ostream& out, const frame_time_percentiles& percentiles)
+{
+	out << "{ \"p50_ms\": " << percentiles.p50_ms << ", \"p90_ms\": " << percentiles.p90_ms
+		<< ", \"p99_ms\": " << percentiles.p99_ms << ", \"max_ms\": " << percentiles.max_ms << " }";
+}
+
+/**
+ * Machine readable report of a benchmark run. Keys are stable across builds so results can be compared by scripts
+ */
+inline void write_benchmark_json(std::ostream& out, const benchmark_result& result)
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::setprecision(6);
+
+	out << "{\n";
+	out << "\t\"report_version\": " << BENCHMARK_REPORT_VERSION << ",\n";
+	out << "\t\"device\": { \"name\": ";
+	write_json_string(out, result.device_name);
+	out << ", \"driver_version\": " << result.driver_version << " },\n";
+
+	out << "\t\"settings\": { \"mode\": ";
+	write_json_string(out, result.mode);
+	out << ", \"present_mode\": ";
+	write_json_string(out, result.present_mode);
+	out << ", \"present_policy\": ";
+	write_json_string(out, result.present_policy);
+	out << ", \"swap_chain_images\": " << result.swap_chain_images;
+	out << ", \"frames_in_flight\": " << result.frames_in_flight << ", \"recording_workers\": " << result.recording_workers
+		<< ", \"draw_count\": " << result.draw_count << ", \"instance_count\": " << result.instance_count
+		<< ", \"gpu_culling\": " << (result.gpu_culling ? "true" : "false") << ", \"async_compute\": " << (result.async_compute ? "true" : "false")
+		<< ", \"warmup_frames\": " << result.warmup_frames << " },\n";
+
+	out << "\t\"completed\": " << (result.completed ? "true" : "false") << ",\n";
+	out << "\t\"startup_ms\": " << result.startup_ms << ",\n";
+	out << "\t\"measured_frames\": " << result.measured_frames << ",\n";
+	out << "\t\"measured_seconds\": " << result.measured_seconds << ",\n";
+	out << "\t\"fps\": " << result.fps << ",\n";
+
+	out << "\t\"cpu\": {\n\t\t\"sampled_frames\": " << result.cpu.sample_count << ",\n\t\t\"dropped_samples\": " << result.dropped_cpu_samples;
+	out << ",\n\t\t\"frame_interval\": ";
+	write_json_percentiles(out, result.cpu.interval);
+	out << ",\n\t\t\"draw_frame\": ";
+	write_json_percentiles(out, result.cpu.cpu);
+	for (size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+	{
+		out << ",\n\t\t\"" << FRAME_PHASE_NAMES[phase] << "\": ";
+		write_json_percentiles(out, result.cpu.phases[phase]);
+	}
+	out << ",\n\t\t\"interval_stddev_ms\": " << result.cpu.interval_stddev_ms
+		<< ",\n\t\t\"interval_jitter_ms\": " << result.cpu.interval_jitter_ms << "\n\t},\n";
+
+	out << "\t\"gpu\": [";
+	for (size_t i = 0; i < result.gpu.size(); i++)
+	{
+		const gpu_scope_statistics& scope = result.gpu[i];
+		out << (i > 0 ? "," : "") << "\n\t\t{ \"scope\": ";
+		write_json_string(out, scope.label);
+		out << ", \"samples\": " << scope.sample_count << ", \"min_ms\": " << scope.min_ms << ", \"avg_ms\": " << scope.avg_ms
+			<< ", \"p99_ms\": " << scope.p99_ms << " }";
+	}
+	out << (result.gpu.empty() ? "]\n" : "\n\t]\n");
+	out << "}\n";
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+//	******************************************************
+//	******** BINDLESS DESCRIPTOR GLOBAL VARIABLES ********
+//	******************************************************
+
+const uint32_t MAX_BINDLESS_STORAGE_BUFFERS = 1024;
+const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+const uint32_t BINDLESS_STORAGE_BUFFER_BINDING = 0;
+const uint32_t BINDLESS_TEXTURE_BINDING = 1;
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * One descriptor set, allocated once and bound once per command buffer, holding every storage buffer and texture of the application in
+ * two large arrays. Shaders index the arrays with a slot passed in push constants or read from a buffer, so changing resources between
+ * draws changes no binding. Built on VK_EXT_descriptor_indexing: the arrays are partially bound, and slots can be written while frames
+ * using the set are in flight as long as those frames don't read them (update after bind, update unused while pending).
+ * Every function is called from the render thread
+ */
+class bindless_descriptors
+{
+public:
+	/**
+	 * Whether the device has everything the set needs. The device must be Vulkan 1.1 and expose VK_EXT_descriptor_indexing
+	 */
+	static bool is_supported(const VkPhysicalDevice physical_device)
+	{
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+		if (device_properties.apiVersion < VK_API_VERSION_1_1)
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features{};
+		indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &indexing_features;
+		vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+		return features.features.shaderStorageBufferArrayDynamicIndexing && features.features.shaderSampledImageArrayDynamicIndexing &&
+			indexing_features.shaderSampledImageArrayNonUniformIndexing && indexing_features.runtimeDescriptorArray &&
+			indexing_features.descriptorBindingPartiallyBound && indexing_features.descriptorBindingUpdateUnusedWhilePending &&
+			indexing_features.descriptorBindingStorageBufferUpdateAfterBind && indexing_features.descriptorBindingSampledImageUpdateAfterBind;
+	}
+
+	/**
+	 * Turn on the features checked by is_supported(), indexing_features goes in the pNext chain of VkDeviceCreateInfo
+	 */
+	static void enable_features(VkPhysicalDeviceFeatures& device_features, VkPhysicalDeviceDescriptorIndexingFeaturesEXT& indexing_features)
+	{
+		device_features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+		device_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+		indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		indexing_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE; // shader.frag picks the texture per material
+		indexing_features.runtimeDescriptorArray = VK_TRUE;
+		indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+		indexing_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		indexing_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	}
+
+	void init(const VkPhysicalDevice physical_device, const VkDevice device, const VkShaderStageFlags stages)
+	{
+		device_ = device;
+
+		// The arrays are sized by the update after bind limits, which are far above the regular per-stage ones
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing_properties{};
+		indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexing_properties;
+		vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+		capacities_[STORAGE_BUFFER_ARRAY] = std::min({ MAX_BINDLESS_STORAGE_BUFFERS,
+			indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers, indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers });
+		capacities_[TEXTURE_ARRAY] = std::min({ MAX_BINDLESS_TEXTURES,
+			indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages, indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages });
+
+		create_descriptor_set(stages);
+	}
+
+	void destroy()
+	{
+		vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+		vkDestroyDescriptorSetLayout(device_, descriptor_set_layout_, nullptr);
+		for (auto& free_slots : free_slots_)
+		{
+			free_slots.clear();
+		}
+		next_slots_ = {};
+	}
+
+	VkDescriptorSetLayout descriptor_set_layout() const
+	{
+		return descriptor_set_layout_;
+	}
+
+	VkDescriptorSet descriptor_set() const
+	{
+		return descriptor_set_;
+	}
+
+	/**
+	 * Write a storage buffer in a free slot of the buffer array and return the slot
+	 */
+	uint32_t register_storage_buffer(const VkDescriptorBufferInfo& buffer_info)
+	{
+		const uint32_t slot = allocate_slot(STORAGE_BUFFER_ARRAY);
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptor_set_;
+		write.dstBinding = BINDLESS_STORAGE_BUFFER_BINDING;
+		write.dstArrayElement = slot;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &buffer_info;
+		vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+
+		return slot;
+	}
+
+	/**
+	 * Write a sampled texture in a free slot of the texture array and return the slot. The image must be in layout when it is sampled
+	 */
+	uint32_t register_texture(const VkImageView image_view, const VkSampler sampler,
+		const VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		const uint32_t slot = allocate_slot(TEXTURE_ARRAY);
+
+		VkDescriptorImageInfo image_info{};
+		image_info.sampler = sampler;
+		image_info.imageView = image_view;
+		image_info.imageLayout = layout;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptor_set_;
+		write.dstBinding = BINDLESS_TEXTURE_BINDING;
+		write.dstArrayElement = slot;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &image_info;
+		vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+
+		return slot;
+	}
+
+	/**
+	 * Make a slot reusable. No frame in flight may still read it
+	 */
+	void release_storage_buffer(const uint32_t slot)
+	{
+		free_slots_[STORAGE_BUFFER_ARRAY].push_back(slot);
+	}
+
+	void release_texture(const uint32_t slot)
+	{
+		free_slots_[TEXTURE_ARRAY].push_back(slot);
+	}
+
+	uint32_t storage_buffer_capacity() const
+	{
+		return capacities_[STORAGE_BUFFER_ARRAY];
+	}
+
+	uint32_t texture_capacity() const
+	{
+		return capacities_[TEXTURE_ARRAY];
+	}
+
+private:
+	enum array_index : uint32_t
+	{
+		STORAGE_BUFFER_ARRAY,
+		TEXTURE_ARRAY,
+		ARRAY_COUNT
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+	VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+	VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+
+	std::array<uint32_t, ARRAY_COUNT> capacities_{};
+	std::array<uint32_t, ARRAY_COUNT> next_slots_{}; // Slots below were handed out at least once
+	std::array<std::vector<uint32_t>, ARRAY_COUNT> free_slots_;
+
+	uint32_t allocate_slot(const array_index array)
+	{
+		if (!free_slots_[array].empty())
+		{
+			const uint32_t slot = free_slots_[array].back();
+			free_slots_[array].pop_back();
+			return slot;
+		}
+
+		if (next_slots_[array] == capacities_[array])
+		{
+			throw std::runtime_error("Bindless descriptor array is full!");
+		}
+
+		return next_slots_[array]++;
+	}
+
+	void create_descriptor_set(const VkShaderStageFlags stages)
+	{
+		std::array<VkDescriptorSetLayoutBinding, ARRAY_COUNT> bindings{};
+		bindings[STORAGE_BUFFER_ARRAY].binding = BINDLESS_STORAGE_BUFFER_BINDING;
+		bindings[STORAGE_BUFFER_ARRAY].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[STORAGE_BUFFER_ARRAY].descriptorCount = capacities_[STORAGE_BUFFER_ARRAY];
+		bindings[STORAGE_BUFFER_ARRAY].stageFlags = stages;
+
+		bindings[TEXTURE_ARRAY].binding = BINDLESS_TEXTURE_BINDING;
+		bindings[TEXTURE_ARRAY].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[TEXTURE_ARRAY].descriptorCount = capacities_[TEXTURE_ARRAY];
+		bindings[TEXTURE_ARRAY].stageFlags = stages;
+
+		// Unwritten slots are fine as long as no shader reads them, written slots can change while the set is in use
+		const VkDescriptorBindingFlagsEXT binding_flag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+		const std::array<VkDescriptorBindingFlagsEXT, ARRAY_COUNT> binding_flags = { binding_flag, binding_flag };
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_info{};
+		binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		binding_flags_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+		binding_flags_info.pBindingFlags = binding_flags.data();
+
+		VkDescriptorSetLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.pNext = &binding_flags_info;
+		layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+		layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+		layout_info.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create bindless descriptor set layout!");
+		}
+
+		std::array<VkDescriptorPoolSize, ARRAY_COUNT> pool_sizes{};
+		pool_sizes[STORAGE_BUFFER_ARRAY].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		pool_sizes[STORAGE_BUFFER_ARRAY].descriptorCount = capacities_[STORAGE_BUFFER_ARRAY];
+		pool_sizes[TEXTURE_ARRAY].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pool_sizes[TEXTURE_ARRAY].descriptorCount = capacities_[TEXTURE_ARRAY];
+
+		VkDescriptorPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+		pool_info.maxSets = 1;
+		pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+		pool_info.pPoolSizes = pool_sizes.data();
+
+		if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create bindless descriptor pool!");
+		}
+
+		VkDescriptorSetAllocateInfo allocate_info{};
+		allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocate_info.descriptorPool = descriptor_pool_;
+		allocate_info.descriptorSetCount = 1;
+		allocate_info.pSetLayouts = &descriptor_set_layout_;
+
+		if (vkAllocateDescriptorSets(device_, &allocate_info, &descriptor_set_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate bindless descriptor set!");
+		}
+	}
+};
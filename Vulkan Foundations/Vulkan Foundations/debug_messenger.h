@@ -0,0 +1,363 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//	**************************************************
+//	******** DEBUG MESSENGER GLOBAL VARIABLES ********
+//	**************************************************
+
+// Same comma separated list as --validation, read before the command line, which overrides it
+const char* const VALIDATION_ENVIRONMENT_VARIABLE = "VF_VALIDATION";
+
+// Messages of one message id logged per rate window, the next ones are only counted and reported once the window ends
+const uint32_t DEBUG_MESSAGES_PER_ID = 8;
+const std::chrono::milliseconds DEBUG_MESSAGE_RATE_WINDOW(1000);
+
+// The writer thread wakes up this often, or as soon as half of the queue is used, and writes every queued message at once
+const std::chrono::milliseconds DEBUG_LOG_FLUSH_INTERVAL(100);
+const size_t DEBUG_LOG_QUEUE_CAPACITY = 1024; // Messages past it are dropped instead of blocking the thread that caused them
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+struct validation_settings
+{
+	bool validation = false; // VK_LAYER_KHRONOS_validation, its messages go through a debug_log_sink
+	bool gpu_assisted = false; // GPU-assisted validation of the shader accesses, implies validation
+	bool debug_utils = false; // Object names and command buffer labels, for captures as well as for the validation messages
+	std::string log_path; // Where the messages go, empty for std::cerr
+};
+
+/**
+ * Apply a comma separated list of off, on, gpu and labels to the settings, e.g. "gpu,labels". off clears everything the list set before it
+ */
+inline void parse_validation_settings(const std::string& option, const char* value, validation_settings& settings)
+{
+	if (value == nullptr)
+	{
+		throw std::invalid_argument("Missing value for " + option + "!");
+	}
+
+	const std::string list = value;
+	size_t begin = 0;
+	while (begin <= list.size())
+	{
+		const size_t end = std::min(list.find(',', begin), list.size());
+		const std::string token = list.substr(begin, end - begin);
+
+		if (token == "off" || token == "0")
+		{
+			settings.validation = false;
+			settings.gpu_assisted = false;
+			settings.debug_utils = false;
+		}
+		else if (token == "on" || token == "1")
+		{
+			settings.validation = true;
+		}
+		else if (token == "gpu")
+		{
+			settings.validation = true;
+			settings.gpu_assisted = true;
+		}
+		else if (token == "labels")
+		{
+			settings.debug_utils = true;
+		}
+		else
+		{
+			throw std::invalid_argument("Invalid value for " + option + ": " + token + ", expected off, on, gpu or labels!");
+		}
+
+		begin = end + 1;
+	}
+}
+
+inline void apply_validation_environment(validation_settings& settings)
+{
+	const char* value = std::getenv(VALIDATION_ENVIRONMENT_VARIABLE);
+	if (value != nullptr && *value != '\0')
+	{
+		parse_validation_settings(VALIDATION_ENVIRONMENT_VARIABLE, value, settings);
+	}
+}
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Destination of the debug messenger. The callback runs on whichever thread made the call the layer complains about, recording
+ * workers included, so it only formats the message and queues it under a short lock; a writer thread writes the queue out in
+ * batches. Every message id is rate limited, a message flooding every draw costs a counter increment after the first few
+ */
+class debug_log_sink
+{
+public:
+	debug_log_sink() = default;
+	debug_log_sink(const debug_log_sink&) = delete;
+	debug_log_sink& operator=(const debug_log_sink&) = delete;
+
+	~debug_log_sink()
+	{
+		stop();
+	}
+
+	void start(const std::string& path)
+	{
+		if (!path.empty())
+		{
+			file_.open(path, std::ios::out | std::ios::trunc);
+			if (!file_)
+			{
+				throw std::runtime_error("Failed to open debug log " + path + "!");
+			}
+		}
+
+		stopping_ = false;
+		writer_ = std::thread([this] { write_loop(); });
+	}
+
+	/**
+	 * Write what is still queued along with the totals, and join the writer thread. No message may arrive after it
+	 */
+	void stop()
+	{
+		if (!writer_.joinable())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		wake_.notify_one();
+		writer_.join();
+
+		if (suppressed_ > 0 || dropped_ > 0)
+		{
+			output() << "Debug messenger: " << received_ << " messages, " << suppressed_ << " suppressed by the rate limit, " << dropped_
+				<< " dropped by a full queue" << std::endl;
+		}
+		file_.close();
+	}
+
+	static VKAPI_ATTR VkBool32 VKAPI_CALL callback(const VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
+		const VkDebugUtilsMessageTypeFlagsEXT message_type, const VkDebugUtilsMessengerCallbackDataEXT* p_callback_data, void* p_user_data)
+	{
+		static_cast<debug_log_sink*>(p_user_data)->push(message_severity, p_callback_data);
+
+		return VK_FALSE;
+	}
+
+private:
+	struct message_id_state
+	{
+		std::chrono::steady_clock::time_point window_start;
+		uint32_t logged = 0;
+		uint64_t suppressed = 0; // In the current window
+		std::string name;
+	};
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::vector<std::string> pending_;
+	std::unordered_map<int32_t, message_id_state> message_ids_;
+	uint64_t received_ = 0;
+	uint64_t suppressed_ = 0;
+	uint64_t dropped_ = 0;
+	bool stopping_ = false;
+	std::thread writer_;
+	std::ofstream file_;
+
+	std::ostream& output()
+	{
+		return file_.is_open() ? static_cast<std::ostream&>(file_) : std::cerr;
+	}
+
+	void push(const VkDebugUtilsMessageSeverityFlagBitsEXT message_severity, const VkDebugUtilsMessengerCallbackDataEXT* data)
+	{
+		const auto now = std::chrono::steady_clock::now();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		received_++;
+
+		message_id_state& id = message_ids_[data->messageIdNumber];
+		if (id.name.empty() && data->pMessageIdName != nullptr)
+		{
+			id.name = data->pMessageIdName;
+		}
+		if (now - id.window_start >= DEBUG_MESSAGE_RATE_WINDOW)
+		{
+			queue_suppressed(id);
+			id.window_start = now;
+			id.logged = 0;
+		}
+		if (id.logged == DEBUG_MESSAGES_PER_ID)
+		{
+			id.suppressed++;
+			suppressed_++;
+			return;
+		}
+		id.logged++;
+
+		if (pending_.size() == DEBUG_LOG_QUEUE_CAPACITY)
+		{
+			dropped_++;
+			return;
+		}
+
+		const char* severity = message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT ? "error" :
+			message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT ? "warning" :
+			message_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT ? "info" : "verbose";
+		pending_.push_back(std::string("validation layer (") + severity + "): " + (data->pMessage != nullptr ? data->pMessage : ""));
+
+		if (pending_.size() == DEBUG_LOG_QUEUE_CAPACITY / 2)
+		{
+			wake_.notify_one();
+		}
+	}
+
+	/**
+	 * Report the messages of an id the rate limit held back during the window that ends. Called with the lock held
+	 */
+	void queue_suppressed(message_id_state& id)
+	{
+		if (id.suppressed > 0 && pending_.size() < DEBUG_LOG_QUEUE_CAPACITY)
+		{
+			pending_.push_back("validation layer: " + std::to_string(id.suppressed) + " more " + (id.name.empty() ? "" : id.name + " ") +
+				"messages suppressed");
+		}
+		id.suppressed = 0;
+	}
+
+	void write_loop()
+	{
+		std::vector<std::string> batch;
+		std::string text;
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (true)
+		{
+			wake_.wait_for(lock, DEBUG_LOG_FLUSH_INTERVAL, [this] { return stopping_ || pending_.size() >= DEBUG_LOG_QUEUE_CAPACITY / 2; });
+
+			// The windows that ended without a new message of their id are reported here
+			const auto now = std::chrono::steady_clock::now();
+			for (auto& id : message_ids_)
+			{
+				if (id.second.suppressed > 0 && now - id.second.window_start >= DEBUG_MESSAGE_RATE_WINDOW)
+				{
+					queue_suppressed(id.second);
+				}
+			}
+
+			batch.swap(pending_);
+			const bool stopping = stopping_;
+			lock.unlock();
+
+			// One write per batch, the console is the slow part
+			text.clear();
+			for (const auto& message : batch)
+			{
+				text += message;
+				text += '\n';
+			}
+			if (!text.empty())
+			{
+				output() << text;
+				output().flush();
+			}
+			batch.clear();
+
+			lock.lock();
+			if (stopping && pending_.empty())
+			{
+				return;
+			}
+		}
+	}
+};
+
+/**
+ * VK_EXT_debug_utils object names and command buffer labels, shown by the validation messages and by capture tools. Without the
+ * extension the functions are not loaded and every call is a null check
+ */
+class debug_utils
+{
+public:
+	void init(const VkInstance instance, const VkDevice device)
+	{
+		device_ = device;
+		set_object_name_ = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(vkGetInstanceProcAddr(instance, "vkSetDebugUtilsObjectNameEXT"));
+		begin_label_ = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT"));
+		end_label_ = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT"));
+	}
+
+	bool is_enabled() const
+	{
+		return set_object_name_ != nullptr;
+	}
+
+	/**
+	 * Handle is any Vulkan handle, dispatchable or not
+	 */
+	template <typename Handle>
+	void set_name(const VkObjectType type, const Handle handle, const std::string& name) const
+	{
+		if (set_object_name_ == nullptr)
+		{
+			return;
+		}
+
+		VkDebugUtilsObjectNameInfoEXT name_info{};
+		name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+		name_info.objectType = type;
+		name_info.objectHandle = reinterpret_cast<uint64_t>(handle);
+		name_info.pObjectName = name.c_str();
+		set_object_name_(device_, &name_info);
+	}
+
+	void begin_label(const VkCommandBuffer command_buffer, const char* name) const
+	{
+		if (begin_label_ == nullptr)
+		{
+			return;
+		}
+
+		VkDebugUtilsLabelEXT label{};
+		label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+		label.pLabelName = name;
+		begin_label_(command_buffer, &label);
+	}
+
+	void end_label(const VkCommandBuffer command_buffer) const
+	{
+		if (end_label_ != nullptr)
+		{
+			end_label_(command_buffer);
+		}
+	}
+
+private:
+	VkDevice device_ = VK_NULL_HANDLE;
+	PFN_vkSetDebugUtilsObjectNameEXT set_object_name_ = nullptr;
+	PFN_vkCmdBeginDebugUtilsLabelEXT begin_label_ = nullptr;
+	PFN_vkCmdEndDebugUtilsLabelEXT end_label_ = nullptr;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "vulkan_handle.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Objects released while frames that use them may still be in flight. Each entry is keyed on the graphics timeline value that has
+ * to complete before it can go, normally the number of frames submitted when it was released, and flush() destroys the entries the
+ * GPU is done with, oldest first, so nothing waits for the device. Entries released together are destroyed in release order.
+ * Not thread safe, everything is released and flushed on the render thread
+ */
+class deletion_queue
+{
+public:
+	void push(const uint64_t value, std::function<void()> destroy)
+	{
+		entries_.push_back({ value, std::move(destroy) });
+	}
+
+	template <typename Handle, void (VKAPI_PTR* Destroy)(VkDevice, Handle, const VkAllocationCallbacks*)>
+	void retire(const uint64_t value, unique_handle<Handle, Destroy>&& handle)
+	{
+		if (!handle)
+		{
+			return;
+		}
+
+		const VkDevice device = handle.parent();
+		const Handle released = handle.release();
+		push(value, [device, released] { Destroy(device, released, nullptr); });
+	}
+
+	/**
+	 * Retire every handle of handles, which is left empty
+	 */
+	template <typename Handle, void (VKAPI_PTR* Destroy)(VkDevice, Handle, const VkAllocationCallbacks*)>
+	void retire(const uint64_t value, std::vector<unique_handle<Handle, Destroy>>&& handles)
+	{
+		for (auto& handle : handles)
+		{
+			retire(value, std::move(handle));
+		}
+		handles.clear();
+	}
+
+	/**
+	 * Destroy the entries whose value the GPU reached. Values are pushed in increasing order, so the first entry still in use ends the flush
+	 */
+	void flush(const uint64_t completed_value)
+	{
+		while (!entries_.empty() && entries_.front().value <= completed_value)
+		{
+			entries_.front().destroy();
+			entries_.pop_front();
+		}
+	}
+
+	/**
+	 * Destroy everything, the device must be idle
+	 */
+	void flush_all()
+	{
+		flush(UINT64_MAX);
+	}
+
+	size_t size() const
+	{
+		return entries_.size();
+	}
+
+private:
+	struct entry
+	{
+		uint64_t value = 0;
+		std::function<void()> destroy;
+	};
+
+	std::deque<entry> entries_;
+};
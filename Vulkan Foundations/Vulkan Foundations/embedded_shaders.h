@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * SPIR-V compiled into the executable, registered in the shader_module_cache under the path of the .spv it was built with
+ */
+struct embedded_shader
+{
+	const char* path;
+	const uint32_t* code;
+	size_t size; // In bytes
+};
+
+//	***************************************************
+//	******** EMBEDDED SHADERS GLOBAL VARIABLES ********
+//	***************************************************
+
+// The .inc files are written by the shader build step of the project (glslc -mfmt=num). They are required: the .spv next to them are
+// outputs of the same step, there is no older SPIR-V to fall back on that would still match the pipelines
+#if !__has_include("shaders/generated/vert.spv.inc") || !__has_include("shaders/generated/frag.spv.inc") || \
+	!__has_include("shaders/generated/cull.spv.inc")
+#error "Missing shaders/generated/*.spv.inc, build the shaders of the project (glslc from the Vulkan SDK) before main.cpp"
+#endif
+
+constexpr uint32_t EMBEDDED_VERT_SPV[] = {
+#include "shaders/generated/vert.spv.inc"
+};
+
+constexpr uint32_t EMBEDDED_FRAG_SPV[] = {
+#include "shaders/generated/frag.spv.inc"
+};
+
+constexpr uint32_t EMBEDDED_CULL_SPV[] = {
+#include "shaders/generated/cull.spv.inc"
+};
+
+//	***************************
+//	******** FUNCTIONS ********
+//	***************************
+
+inline std::vector<embedded_shader> get_embedded_shaders()
+{
+	return {
+		{ "shaders/vert.spv", EMBEDDED_VERT_SPV, sizeof(EMBEDDED_VERT_SPV) },
+		{ "shaders/frag.spv", EMBEDDED_FRAG_SPV, sizeof(EMBEDDED_FRAG_SPV) },
+		{ "shaders/cull.spv", EMBEDDED_CULL_SPV, sizeof(EMBEDDED_CULL_SPV) },
+	};
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//	**********************************************
+//	******** FRAME ARENA GLOBAL VARIABLES ********
+//	**********************************************
+
+const size_t DEFAULT_FRAME_ARENA_SIZE = size_t(64) << 10; // 64 kb of transient host data per frame in flight
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+struct frame_arena_statistics
+{
+	size_t capacity = 0; // Bytes of the largest block of a frame slot
+	size_t high_water_mark = 0; // Most bytes a single frame allocated since the last reset_statistics()
+	uint64_t overflows = 0; // Allocations that did not fit the block and went to the heap
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Bump allocator for the host data a frame only needs while it is recorded and submitted: barrier arrays, rendering infos, clear
+ * values... One block per frame in flight, rewound by begin_frame() once the previous frame of the slot is done, so whatever a frame
+ * allocates stays valid while it is in flight. An allocation that doesn't fit goes to the heap, and the block grows past it the
+ * next time the slot is rewound: steady state frames never touch the heap. Render thread only, and nothing allocated here is ever
+ * destroyed, hence the trivially destructible types
+ */
+class frame_arena
+{
+public:
+	void init(const uint32_t frame_count, const size_t frame_size = DEFAULT_FRAME_ARENA_SIZE)
+	{
+		blocks_.clear();
+		blocks_.resize(frame_count);
+		for (auto& block : blocks_)
+		{
+			block.memory = std::make_unique<std::byte[]>(frame_size);
+			block.capacity = frame_size;
+		}
+		current_ = &blocks_.front();
+		reset_statistics();
+	}
+
+	/**
+	 * Rewind the block of a frame slot. The previous frame of the slot must be done with everything it allocated
+	 */
+	void begin_frame(const uint32_t frame_index)
+	{
+		frame_block& block = blocks_.at(frame_index);
+		if (!block.overflow.empty())
+		{
+			block.capacity = std::max(block.capacity * 2, block.used + block.overflow_bytes);
+			block.memory = std::make_unique<std::byte[]>(block.capacity);
+			block.overflow.clear();
+		}
+		block.used = 0;
+		block.overflow_bytes = 0;
+		current_ = &block;
+	}
+
+	/**
+	 * Value initialized array of count elements in the current frame block
+	 */
+	template <typename T>
+	T* allocate(const size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Frame arena objects are never destroyed");
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Frame arena blocks are only aligned on std::max_align_t");
+
+		if (count == 0)
+		{
+			return nullptr;
+		}
+
+		const size_t size = count * sizeof(T);
+		const size_t offset = (current_->used + alignof(T) - 1) / alignof(T) * alignof(T);
+
+		void* memory;
+		if (current_->memory != nullptr && offset + size <= current_->capacity)
+		{
+			memory = current_->memory.get() + offset;
+			current_->used = offset + size;
+		}
+		else
+		{
+			current_->overflow.push_back(std::make_unique<std::byte[]>(size));
+			current_->overflow_bytes += size;
+			memory = current_->overflow.back().get();
+			overflows_++;
+		}
+		high_water_mark_ = std::max(high_water_mark_, current_->used + current_->overflow_bytes);
+
+		T* objects = static_cast<T*>(memory);
+		for (size_t i = 0; i < count; i++)
+		{
+			new (objects + i) T();
+		}
+
+		return objects;
+	}
+
+	frame_arena_statistics statistics() const
+	{
+		frame_arena_statistics statistics;
+		for (const auto& block : blocks_)
+		{
+			statistics.capacity = std::max(statistics.capacity, block.capacity);
+		}
+		statistics.high_water_mark = high_water_mark_;
+		statistics.overflows = overflows_;
+
+		return statistics;
+	}
+
+	void reset_statistics()
+	{
+		high_water_mark_ = 0;
+		overflows_ = 0;
+	}
+
+	void print_statistics()
+	{
+		const frame_arena_statistics statistics = this->statistics();
+
+		const std::ios::fmtflags flags = std::cout.flags();
+		const std::streamsize precision = std::cout.precision();
+
+		std::cout << std::fixed << std::setprecision(1);
+		std::cout << "Frame arena: " << statistics.high_water_mark / 1024.0 << " kb high water mark of " << statistics.capacity / 1024.0
+			<< " kb per frame, " << statistics.overflows << " heap overflows" << std::endl;
+
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+		reset_statistics();
+	}
+
+private:
+	struct frame_block
+	{
+		std::unique_ptr<std::byte[]> memory;
+		size_t capacity = 0;
+		size_t used = 0;
+		size_t overflow_bytes = 0;
+		std::vector<std::unique_ptr<std::byte[]>> overflow; // Freed when the slot is rewound
+	};
+
+	std::vector<frame_block> blocks_;
+	frame_block* current_ = nullptr;
+	size_t high_water_mark_ = 0;
+	uint64_t overflows_ = 0;
+};
@@ -0,0 +1,1206 @@
+#pragma once
+
+#include "debug_messenger.h"
+#include "frame_arena.h"
+#include "gpu_memory_allocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+//	**********************************************
+//	******** FRAME GRAPH GLOBAL VARIABLES ********
+//	**********************************************
+
+// Access bits that write memory, only those need to be made available by a barrier
+const VkAccessFlags FRAME_GRAPH_WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+using frame_resource_handle = uint32_t;
+using frame_pass_handle = uint32_t;
+const frame_resource_handle INVALID_FRAME_RESOURCE = UINT32_MAX;
+
+enum class frame_pass_type
+{
+	graphics, // Records a render pass created by frame_graph::create_render_pass(), or dynamic rendering begun with rendering_info()
+	compute,
+	transfer
+};
+
+/**
+ * How a pass touches a resource. The layout is ignored for buffers. An empty access (no stage) stands for "nothing to wait for"
+ */
+struct frame_resource_access
+{
+	VkPipelineStageFlags stages = 0;
+	VkAccessFlags access = 0;
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+struct frame_image_desc
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+/**
+ * The transient images of a frame graph, created by frame_graph::create_targets(). Images whose lifetimes don't overlap share one
+ * allocation. Kept per framebuffer by the application, and still valid after the graph that created them was rebuilt
+ */
+struct frame_graph_targets
+{
+	std::vector<VkImage> images; // Indexed by transient index
+	std::vector<VkImageView> image_views;
+	std::vector<gpu_allocation> allocations; // Indexed by alias slot
+};
+
+/**
+ * Attachment formats of a graphics pass, what a pipeline and a secondary command buffer rendering dynamically are created for
+ * instead of a render pass
+ */
+struct frame_rendering_formats
+{
+	std::vector<VkFormat> color_formats;
+	VkFormat depth_format = VK_FORMAT_UNDEFINED;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * The GPU work of a frame as a list of passes, each declaring the resources it reads and writes. compile() culls the passes nothing
+ * consumes and derives the synchronization from the declarations: one pipeline barrier at most in front of every compute and
+ * transfer pass, and the external subpass dependency, initial and final layouts of every graphics pass. The state a frame leaves a
+ * resource in is the one the next frame starts from, unless the resource is imported with an explicit initial state (a swapchain
+ * image, whose previous use is ordered by the acquire semaphore).
+ * With dynamic rendering there is no render pass to change the layouts of the attachments nor to hold the dependency, the graphics
+ * passes then get a pipeline barrier like the other passes and the outputs are transitioned by the final barrier.
+ * Transient images are created by the graph, discarded at the end of the frame, and alias the memory of the transient images whose
+ * lifetimes came before theirs. Declared and compiled from the render thread, rebuilt when the attachments change
+ */
+class frame_graph
+{
+public:
+	void init(const VkDevice device)
+	{
+		device_ = device;
+	}
+
+	/**
+	 * Synchronize the graphics passes for dynamic rendering instead of render passes, kept across reset(). Takes effect with the next compile()
+	 */
+	void set_dynamic_rendering(const bool enabled)
+	{
+		dynamic_rendering_ = enabled;
+		compiled_ = false;
+	}
+
+	/**
+	 * Name the transient images after their resources and label every pass with its name, when the extension is loaded
+	 */
+	void set_debug_utils(const debug_utils* utils)
+	{
+		debug_utils_ = utils;
+	}
+
+	/**
+	 * Drop every pass and resource, before declaring a new graph
+	 */
+	void reset()
+	{
+		resources_.clear();
+		passes_.clear();
+		live_passes_.clear();
+		transient_resources_.clear();
+		alias_slot_count_ = 0;
+		final_barrier_ = {};
+		compiled_ = false;
+	}
+
+	//	******** DECLARATION ********
+
+	/**
+	 * Image owned by the application, whose VkImage is given each frame with bind_image()
+	 */
+	frame_resource_handle import_image(const std::string& name, const frame_image_desc& desc,
+		const std::optional<frame_resource_access>& initial_state = std::nullopt)
+	{
+		resource_node resource;
+		resource.name = name;
+		resource.image = true;
+		resource.desc = desc;
+		resource.initial_state = initial_state;
+		return add_resource(std::move(resource));
+	}
+
+	/**
+	 * Buffer owned by the application. Buffers are synchronized with global memory barriers, so the graph never needs their handle
+	 */
+	frame_resource_handle import_buffer(const std::string& name, const std::optional<frame_resource_access>& initial_state = std::nullopt)
+	{
+		resource_node resource;
+		resource.name = name;
+		resource.initial_state = initial_state;
+		return add_resource(std::move(resource));
+	}
+
+	/**
+	 * Image created by the graph with create_targets(), whose content does not outlive the frame
+	 */
+	frame_resource_handle create_image(const std::string& name, const frame_image_desc& desc)
+	{
+		resource_node resource;
+		resource.name = name;
+		resource.image = true;
+		resource.transient = true;
+		resource.desc = desc;
+		return add_resource(std::move(resource));
+	}
+
+	/**
+	 * Mark a resource as consumed after the graph (presented, read by the host...). Passes are only kept when their results reach an
+	 * output, and the graph leaves the output in final_state
+	 */
+	void set_output(const frame_resource_handle resource, const frame_resource_access& final_state)
+	{
+		resources_.at(resource).output_state = final_state;
+	}
+
+	frame_pass_handle add_pass(const std::string& name, const frame_pass_type type, std::function<void(VkCommandBuffer)> record)
+	{
+		pass_node pass;
+		pass.name = name;
+		pass.type = type;
+		pass.record = std::move(record);
+		passes_.push_back(std::move(pass));
+		compiled_ = false;
+
+		return static_cast<frame_pass_handle>(passes_.size() - 1);
+	}
+
+	void read(const frame_pass_handle pass, const frame_resource_handle resource, const frame_resource_access& access)
+	{
+		passes_.at(pass).uses.push_back({ resource, access, false, UINT32_MAX });
+	}
+
+	void write(const frame_pass_handle pass, const frame_resource_handle resource, const frame_resource_access& access)
+	{
+		passes_.at(pass).uses.push_back({ resource, access, true, UINT32_MAX });
+	}
+
+	/**
+	 * Color attachment of a graphics pass, with the multisampled image it resolves into when resolve is set. Attachment indices follow
+	 * the declaration order, a resolve attachment right after its color attachment
+	 */
+	void add_color_attachment(const frame_pass_handle pass, const frame_resource_handle resource, const VkAttachmentLoadOp load_op,
+		const VkAttachmentStoreOp store_op, const VkClearColorValue& clear_color = {}, const frame_resource_handle resolve = INVALID_FRAME_RESOURCE)
+	{
+		VkClearValue clear_value{};
+		clear_value.color = clear_color;
+		// Blended draws read the attachment as well
+		add_attachment(pass, resource, attachment_kind::color, load_op, store_op, clear_value,
+			{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+
+		if (resolve != INVALID_FRAME_RESOURCE)
+		{
+			// Fully overwritten by the resolve, its previous content is never loaded
+			add_attachment(pass, resolve, attachment_kind::resolve, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, {},
+				{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+		}
+	}
+
+	void set_depth_attachment(const frame_pass_handle pass, const frame_resource_handle resource, const VkAttachmentLoadOp load_op,
+		const VkAttachmentStoreOp store_op, const VkClearDepthStencilValue& clear_depth = { 1.0f, 0 })
+	{
+		VkClearValue clear_value{};
+		clear_value.depthStencil = clear_depth;
+		add_attachment(pass, resource, attachment_kind::depth, load_op, store_op, clear_value,
+			{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL });
+	}
+
+	//	******** COMPILATION ********
+
+	void compile()
+	{
+		cull_passes();
+		derive_image_usage();
+		assign_alias_slots();
+
+		// The first run only finds the state every resource ends the frame in, which is where the next frame starts from
+		std::vector<resource_state> states = simulate(initial_states(nullptr), false);
+		simulate(initial_states(&states), true);
+
+		compiled_ = true;
+	}
+
+	bool is_culled(const frame_pass_handle pass) const
+	{
+		return !passes_.at(pass).live;
+	}
+
+	/**
+	 * Render pass of a compiled graphics pass, owned by the caller. Its attachments follow attachments(pass)
+	 */
+	VkRenderPass create_render_pass(const frame_pass_handle pass_handle) const
+	{
+		const pass_node& pass = compiled_pass(pass_handle, frame_pass_type::graphics);
+		if (dynamic_rendering_)
+		{
+			throw std::runtime_error("Failed to create render pass " + pass.name + ", the graph was compiled for dynamic rendering!");
+		}
+
+		std::vector<VkAttachmentDescription> attachments;
+		std::vector<VkAttachmentReference> color_refs;
+		std::vector<VkAttachmentReference> resolve_refs;
+		std::optional<VkAttachmentReference> depth_ref;
+		bool has_resolve = false;
+
+		for (uint32_t index = 0; index < pass.attachments.size(); index++)
+		{
+			const attachment_node& attachment = pass.attachments[index];
+			const use_node& use = pass.uses[attachment.use_index];
+			const resource_node& resource = resources_[attachment.resource];
+
+			VkAttachmentDescription description{};
+			description.format = resource.desc.format;
+			description.samples = resource.desc.samples;
+			description.loadOp = attachment.load_op;
+			description.storeOp = attachment.store_op;
+			description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			description.initialLayout = attachment.initial_layout;
+			description.finalLayout = attachment.final_layout;
+			attachments.push_back(description);
+
+			const VkAttachmentReference reference = { index, use.access.layout };
+			switch (attachment.kind)
+			{
+			case attachment_kind::color:
+				color_refs.push_back(reference);
+				resolve_refs.push_back({ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+				break;
+			case attachment_kind::resolve:
+				resolve_refs.back() = reference;
+				has_resolve = true;
+				break;
+			case attachment_kind::depth:
+				depth_ref = reference;
+				break;
+			}
+		}
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = static_cast<uint32_t>(color_refs.size());
+		subpass.pColorAttachments = color_refs.data();
+		subpass.pResolveAttachments = has_resolve ? resolve_refs.data() : nullptr;
+		subpass.pDepthStencilAttachment = depth_ref ? &depth_ref.value() : nullptr;
+
+		VkRenderPassCreateInfo render_pass_info{};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		render_pass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+		render_pass_info.pAttachments = attachments.data();
+		render_pass_info.subpassCount = 1;
+		render_pass_info.pSubpasses = &subpass;
+
+		// Everything the pass waits for, attachments and buffers alike, goes in the one external dependency
+		VkSubpassDependency dependency{};
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass = 0;
+		dependency.srcStageMask = pass.barrier.src_stages;
+		dependency.srcAccessMask = pass.barrier.src_access;
+		dependency.dstStageMask = pass.barrier.dst_stages;
+		dependency.dstAccessMask = pass.barrier.dst_access;
+		if (pass.barrier.src_stages != 0)
+		{
+			render_pass_info.dependencyCount = 1;
+			render_pass_info.pDependencies = &dependency;
+		}
+
+		VkRenderPass render_pass;
+		if (vkCreateRenderPass(device_, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create render pass!");
+		}
+
+		return render_pass;
+	}
+
+	uint32_t attachment_count(const frame_pass_handle pass_handle) const
+	{
+		return static_cast<uint32_t>(passes_.at(pass_handle).attachments.size());
+	}
+
+	/**
+	 * Resource of an attachment of a graphics pass, by attachment index
+	 */
+	frame_resource_handle attachment(const frame_pass_handle pass_handle, const uint32_t index) const
+	{
+		return passes_.at(pass_handle).attachments.at(index).resource;
+	}
+
+	/**
+	 * Formats of the color and depth attachments of a graphics pass, the resolve attachments don't count
+	 */
+	frame_rendering_formats rendering_formats(const frame_pass_handle pass_handle) const
+	{
+		frame_rendering_formats formats;
+		for (const auto& attachment : passes_.at(pass_handle).attachments)
+		{
+			const frame_image_desc& desc = resources_[attachment.resource].desc;
+			switch (attachment.kind)
+			{
+			case attachment_kind::color:
+				formats.color_formats.push_back(desc.format);
+				formats.samples = desc.samples;
+				break;
+			case attachment_kind::depth:
+				formats.depth_format = desc.format;
+				formats.samples = desc.samples;
+				break;
+			case attachment_kind::resolve:
+				break;
+			}
+		}
+
+		return formats;
+	}
+
+#ifdef VK_KHR_dynamic_rendering
+	/**
+	 * Rendering info of a compiled graphics pass on the image views of its attachments, indexed by attachment. The barrier in front of
+	 * the pass already brought every attachment into the layout it is rendered in. Allocated from the frame arena with its attachments
+	 */
+	const VkRenderingInfoKHR* rendering_info(const frame_pass_handle pass_handle, const VkImageView* image_views, const VkExtent2D extent,
+		const VkRenderingFlagsKHR flags, frame_arena& arena) const
+	{
+		const pass_node& pass = compiled_pass(pass_handle, frame_pass_type::graphics);
+		if (!dynamic_rendering_)
+		{
+			throw std::runtime_error("Failed to begin rendering " + pass.name + ", the graph is not compiled for dynamic rendering!");
+		}
+
+		// At most one color attachment per attachment, resolves and depth included
+		VkRenderingAttachmentInfoKHR* color_attachments = arena.allocate<VkRenderingAttachmentInfoKHR>(pass.attachments.size());
+		VkRenderingAttachmentInfoKHR* depth_attachment = nullptr;
+		uint32_t color_attachment_count = 0;
+
+		for (uint32_t index = 0; index < pass.attachments.size(); index++)
+		{
+			const attachment_node& attachment = pass.attachments[index];
+			const VkImageLayout layout = pass.uses[attachment.use_index].access.layout;
+
+			VkRenderingAttachmentInfoKHR attachment_info{};
+			attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+			attachment_info.imageView = image_views[index];
+			attachment_info.imageLayout = layout;
+			attachment_info.resolveMode = VK_RESOLVE_MODE_NONE_KHR;
+			attachment_info.loadOp = attachment.load_op;
+			attachment_info.storeOp = attachment.store_op;
+			attachment_info.clearValue = attachment.clear_value;
+
+			switch (attachment.kind)
+			{
+			case attachment_kind::color:
+				color_attachments[color_attachment_count++] = attachment_info;
+				break;
+			case attachment_kind::resolve:
+				// Resolves the color attachment declared right before it, like pResolveAttachments of a subpass
+				color_attachments[color_attachment_count - 1].resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT_KHR;
+				color_attachments[color_attachment_count - 1].resolveImageView = image_views[index];
+				color_attachments[color_attachment_count - 1].resolveImageLayout = layout;
+				break;
+			case attachment_kind::depth:
+				depth_attachment = arena.allocate<VkRenderingAttachmentInfoKHR>(1);
+				*depth_attachment = attachment_info;
+				break;
+			}
+		}
+
+		VkRenderingInfoKHR* info = arena.allocate<VkRenderingInfoKHR>(1);
+		info->sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+		info->flags = flags;
+		info->renderArea = { { 0, 0 }, extent };
+		info->layerCount = 1;
+		info->colorAttachmentCount = color_attachment_count;
+		info->pColorAttachments = color_attachments;
+		info->pDepthAttachment = depth_attachment;
+
+		return info;
+	}
+#endif
+
+	/**
+	 * Clear values of a graphics pass, indexed by attachment and allocated from the frame arena
+	 */
+	const VkClearValue* clear_values(const frame_pass_handle pass_handle, frame_arena& arena) const
+	{
+		const pass_node& pass = passes_.at(pass_handle);
+		VkClearValue* values = arena.allocate<VkClearValue>(pass.attachments.size());
+		for (size_t index = 0; index < pass.attachments.size(); index++)
+		{
+			values[index] = pass.attachments[index].clear_value;
+		}
+
+		return values;
+	}
+
+	//	******** TRANSIENT IMAGES ********
+
+	/**
+	 * Create the transient images of the compiled graph. The images sharing an alias slot are bound to the same memory, and the
+	 * images only ever used as attachments that are never loaded nor stored prefer lazily allocated memory
+	 */
+	frame_graph_targets create_targets(gpu_memory_allocator& allocator, const VkExtent2D extent) const
+	{
+		frame_graph_targets targets;
+		targets.images.resize(transient_resources_.size(), VK_NULL_HANDLE);
+		targets.image_views.resize(transient_resources_.size(), VK_NULL_HANDLE);
+
+		std::vector<VkMemoryRequirements> slot_requirements(alias_slot_count_);
+		std::vector<bool> slot_lazy(alias_slot_count_, true);
+		std::vector<bool> slot_used(alias_slot_count_, false);
+
+		for (uint32_t transient_index = 0; transient_index < transient_resources_.size(); transient_index++)
+		{
+			const resource_node& resource = resources_[transient_resources_[transient_index]];
+
+			VkImageCreateInfo image_info{};
+			image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			image_info.imageType = VK_IMAGE_TYPE_2D;
+			image_info.format = resource.desc.format;
+			image_info.extent = { extent.width, extent.height, 1 };
+			image_info.mipLevels = 1;
+			image_info.arrayLayers = 1;
+			image_info.samples = resource.desc.samples;
+			image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_info.usage = resource.usage;
+			image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			if (vkCreateImage(device_, &image_info, nullptr, &targets.images[transient_index]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create " + resource.name + " image!");
+			}
+
+			VkMemoryRequirements requirements;
+			vkGetImageMemoryRequirements(device_, targets.images[transient_index], &requirements);
+
+			VkMemoryRequirements& slot = slot_requirements[resource.alias_slot];
+			if (!slot_used[resource.alias_slot])
+			{
+				slot = requirements;
+				slot_used[resource.alias_slot] = true;
+			}
+			else
+			{
+				slot.size = std::max(slot.size, requirements.size);
+				slot.alignment = std::max(slot.alignment, requirements.alignment);
+				slot.memoryTypeBits &= requirements.memoryTypeBits;
+			}
+			slot_lazy[resource.alias_slot] = slot_lazy[resource.alias_slot] && (resource.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+		}
+
+		targets.allocations.resize(alias_slot_count_);
+		for (uint32_t slot = 0; slot < alias_slot_count_; slot++)
+		{
+			if (slot_requirements[slot].memoryTypeBits == 0)
+			{
+				throw std::runtime_error("Failed to alias frame graph images, they have no memory type in common!");
+			}
+			// Desktop GPUs have no lazily allocated memory type, the images then land in regular device local memory
+			targets.allocations[slot] = allocator.allocate(slot_requirements[slot], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				slot_lazy[slot] ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0, resource_tiling::optimal);
+		}
+
+		for (uint32_t transient_index = 0; transient_index < transient_resources_.size(); transient_index++)
+		{
+			const resource_node& resource = resources_[transient_resources_[transient_index]];
+			const gpu_allocation& allocation = targets.allocations[resource.alias_slot];
+
+			if (vkBindImageMemory(device_, targets.images[transient_index], allocation.memory, allocation.offset) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to bind " + resource.name + " image memory!");
+			}
+
+			VkImageViewCreateInfo view_info{};
+			view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			view_info.image = targets.images[transient_index];
+			view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			view_info.format = resource.desc.format;
+			view_info.subresourceRange = { resource.desc.aspect, 0, 1, 0, 1 };
+
+			if (vkCreateImageView(device_, &view_info, nullptr, &targets.image_views[transient_index]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create " + resource.name + " image view!");
+			}
+
+			if (debug_utils_ != nullptr && debug_utils_->is_enabled())
+			{
+				debug_utils_->set_name(VK_OBJECT_TYPE_IMAGE, targets.images[transient_index], resource.name);
+				debug_utils_->set_name(VK_OBJECT_TYPE_IMAGE_VIEW, targets.image_views[transient_index], resource.name);
+			}
+		}
+
+		return targets;
+	}
+
+	void destroy_targets(gpu_memory_allocator& allocator, frame_graph_targets& targets) const
+	{
+		for (auto image_view : targets.image_views)
+		{
+			vkDestroyImageView(allocator.device(), image_view, nullptr);
+		}
+		for (auto image : targets.images)
+		{
+			vkDestroyImage(allocator.device(), image, nullptr);
+		}
+		for (auto& allocation : targets.allocations)
+		{
+			allocator.free(allocation);
+		}
+		targets = {};
+	}
+
+	VkImageView target_view(const frame_graph_targets& targets, const frame_resource_handle resource) const
+	{
+		return targets.image_views.at(resources_.at(resource).transient_index);
+	}
+
+	//	******** EXECUTION ********
+
+	void bind_image(const frame_resource_handle resource, const VkImage image)
+	{
+		resources_.at(resource).bound_image = image;
+	}
+
+	/**
+	 * Bind the transient images of one framebuffer for the frame being recorded
+	 */
+	void bind_targets(const frame_graph_targets& targets)
+	{
+		for (uint32_t transient_index = 0; transient_index < transient_resources_.size(); transient_index++)
+		{
+			resources_[transient_resources_[transient_index]].bound_image = targets.images[transient_index];
+		}
+	}
+
+	/**
+	 * Record the live passes in declaration order, each one behind the barrier compile() derived for it. The barrier arrays come
+	 * from the frame arena
+	 */
+	void execute(const VkCommandBuffer command_buffer, frame_arena& arena) const
+	{
+		if (!compiled_)
+		{
+			throw std::runtime_error("Failed to execute the frame graph, it was not compiled!");
+		}
+
+		for (const frame_pass_handle pass_handle : live_passes_)
+		{
+			const pass_node& pass = passes_[pass_handle];
+			// The barrier of a graphics pass is its subpass dependency, only layout changes of sampled images are left to record
+			if (debug_utils_ != nullptr)
+			{
+				debug_utils_->begin_label(command_buffer, pass.name.c_str());
+			}
+			record_barrier(command_buffer, pass.barrier, pass.type == frame_pass_type::graphics && !dynamic_rendering_, arena);
+			pass.record(command_buffer);
+			if (debug_utils_ != nullptr)
+			{
+				debug_utils_->end_label(command_buffer);
+			}
+		}
+
+		record_barrier(command_buffer, final_barrier_, false, arena);
+	}
+
+private:
+	enum class attachment_kind
+	{
+		color,
+		resolve,
+		depth
+	};
+
+	struct resource_node
+	{
+		std::string name;
+		bool image = false;
+		bool transient = false;
+		frame_image_desc desc;
+		std::optional<frame_resource_access> initial_state;
+		std::optional<frame_resource_access> output_state;
+		VkImage bound_image = VK_NULL_HANDLE;
+
+		// Filled by compile()
+		VkImageUsageFlags usage = 0;
+		uint32_t transient_index = UINT32_MAX;
+		uint32_t alias_slot = UINT32_MAX;
+		uint32_t first_use = UINT32_MAX; // Positions in live_passes_
+		uint32_t last_use = 0;
+	};
+
+	struct use_node
+	{
+		frame_resource_handle resource;
+		frame_resource_access access;
+		bool write;
+		uint32_t attachment_index; // UINT32_MAX when the use is not an attachment, a loaded attachment has a read and a write use
+	};
+
+	struct attachment_node
+	{
+		frame_resource_handle resource;
+		attachment_kind kind;
+		VkAttachmentLoadOp load_op;
+		VkAttachmentStoreOp store_op;
+		VkClearValue clear_value;
+		uint32_t use_index;
+
+		// Filled by compile()
+		VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	struct image_transition
+	{
+		frame_resource_handle resource;
+		VkImageLayout old_layout;
+		VkImageLayout new_layout;
+		VkAccessFlags src_access;
+		VkAccessFlags dst_access;
+	};
+
+	struct pass_barrier
+	{
+		VkPipelineStageFlags src_stages = 0;
+		VkAccessFlags src_access = 0;
+		VkPipelineStageFlags dst_stages = 0;
+		VkAccessFlags dst_access = 0;
+		std::vector<image_transition> transitions;
+	};
+
+	struct pass_node
+	{
+		std::string name;
+		frame_pass_type type;
+		std::function<void(VkCommandBuffer)> record;
+		std::vector<use_node> uses; // Attachments included
+		std::vector<attachment_node> attachments;
+
+		// Filled by compile()
+		bool live = false;
+		pass_barrier barrier;
+	};
+
+	/**
+	 * What is pending on a resource, or on the memory of an alias slot for transient images
+	 */
+	struct resource_state
+	{
+		VkPipelineStageFlags write_stages = 0; // Last write, or layout transition
+		VkAccessFlags write_access = 0;
+		VkPipelineStageFlags read_stages = 0; // Reads since then
+		VkAccessFlags read_access = 0;
+		VkPipelineStageFlags visible_stages = 0; // Stages and accesses the last write was already made visible to
+		VkAccessFlags visible_access = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		frame_resource_handle occupant = INVALID_FRAME_RESOURCE; // Transient image currently living in the alias slot
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+
+	std::vector<resource_node> resources_;
+	std::vector<pass_node> passes_;
+	std::vector<frame_pass_handle> live_passes_;
+	std::vector<frame_resource_handle> transient_resources_; // Indexed by transient index
+	uint32_t alias_slot_count_ = 0;
+	pass_barrier final_barrier_; // Leaves the outputs in their final state
+	bool dynamic_rendering_ = false;
+	const debug_utils* debug_utils_ = nullptr;
+	bool compiled_ = false;
+
+	frame_resource_handle add_resource(resource_node resource)
+	{
+		resources_.push_back(std::move(resource));
+		compiled_ = false;
+
+		return static_cast<frame_resource_handle>(resources_.size() - 1);
+	}
+
+	void add_attachment(const frame_pass_handle pass_handle, const frame_resource_handle resource, const attachment_kind kind,
+		const VkAttachmentLoadOp load_op, const VkAttachmentStoreOp store_op, const VkClearValue& clear_value, const frame_resource_access& access)
+	{
+		pass_node& pass = passes_.at(pass_handle);
+		if (pass.type != frame_pass_type::graphics)
+		{
+			throw std::runtime_error("Failed to add attachment " + resources_.at(resource).name + ", " + pass.name + " is not a graphics pass!");
+		}
+
+		// The attachment is written, and read first when its content is loaded: a loaded attachment keeps its producers alive
+		const uint32_t attachment_index = static_cast<uint32_t>(pass.attachments.size());
+		if (load_op == VK_ATTACHMENT_LOAD_OP_LOAD)
+		{
+			pass.uses.push_back({ resource, access, false, attachment_index });
+		}
+		pass.uses.push_back({ resource, access, true, attachment_index });
+		pass.attachments.push_back({ resource, kind, load_op, store_op, clear_value, static_cast<uint32_t>(pass.uses.size() - 1) });
+		compiled_ = false;
+	}
+
+	const pass_node& compiled_pass(const frame_pass_handle pass_handle, const frame_pass_type type) const
+	{
+		const pass_node& pass = passes_.at(pass_handle);
+		if (!compiled_ || pass.type != type)
+		{
+			throw std::runtime_error("Failed to use pass " + pass.name + ", the graph is not compiled or the pass has the wrong type!");
+		}
+
+		return pass;
+	}
+
+	/**
+	 * Walk the passes backwards from the outputs, a pass is kept when it writes a resource that is consumed later on
+	 */
+	void cull_passes()
+	{
+		std::vector<bool> needed(resources_.size(), false);
+		for (size_t resource = 0; resource < resources_.size(); resource++)
+		{
+			needed[resource] = resources_[resource].output_state.has_value();
+		}
+
+		for (auto pass = passes_.rbegin(); pass != passes_.rend(); ++pass)
+		{
+			pass->live = std::any_of(pass->uses.begin(), pass->uses.end(), [&](const use_node& use) { return use.write && needed[use.resource]; });
+			if (!pass->live)
+			{
+				continue;
+			}
+
+			for (const auto& use : pass->uses)
+			{
+				if (!use.write)
+				{
+					needed[use.resource] = true;
+				}
+			}
+		}
+
+		live_passes_.clear();
+		for (frame_pass_handle pass = 0; pass < passes_.size(); pass++)
+		{
+			if (passes_[pass].live)
+			{
+				live_passes_.push_back(pass);
+			}
+		}
+	}
+
+	/**
+	 * Usage flags of the transient images from the way the live passes touch them
+	 */
+	void derive_image_usage()
+	{
+		std::vector<bool> attachment_only(resources_.size(), true);
+
+		for (auto& resource : resources_)
+		{
+			resource.usage = 0;
+			resource.first_use = UINT32_MAX;
+			resource.last_use = 0;
+		}
+
+		for (uint32_t position = 0; position < live_passes_.size(); position++)
+		{
+			const pass_node& pass = passes_[live_passes_[position]];
+			for (const auto& use : pass.uses)
+			{
+				resource_node& resource = resources_[use.resource];
+				resource.first_use = std::min(resource.first_use, position);
+				resource.last_use = std::max(resource.last_use, position);
+
+				if (use.attachment_index != UINT32_MAX)
+				{
+					const attachment_node& attachment = pass.attachments[use.attachment_index];
+					resource.usage |= attachment.kind == attachment_kind::depth ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+					// A transient attachment may not be loaded from nor stored to memory
+					attachment_only[use.resource] = attachment_only[use.resource] && attachment.load_op != VK_ATTACHMENT_LOAD_OP_LOAD &&
+						attachment.store_op == VK_ATTACHMENT_STORE_OP_DONT_CARE;
+					continue;
+				}
+
+				attachment_only[use.resource] = false;
+				resource.usage |= image_usage(use.access);
+			}
+		}
+
+		for (size_t resource = 0; resource < resources_.size(); resource++)
+		{
+			if (resources_[resource].transient && attachment_only[resource] && resources_[resource].usage != 0)
+			{
+				resources_[resource].usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			}
+		}
+	}
+
+	static VkImageUsageFlags image_usage(const frame_resource_access& access)
+	{
+		VkImageUsageFlags usage = 0;
+		if (access.access & VK_ACCESS_TRANSFER_READ_BIT)
+		{
+			usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+		if (access.access & VK_ACCESS_TRANSFER_WRITE_BIT)
+		{
+			usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
+		if (access.access & VK_ACCESS_INPUT_ATTACHMENT_READ_BIT)
+		{
+			usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		}
+		if (access.access & VK_ACCESS_SHADER_WRITE_BIT)
+		{
+			usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+		}
+		else if (access.access & VK_ACCESS_SHADER_READ_BIT)
+		{
+			usage |= access.layout == VK_IMAGE_LAYOUT_GENERAL ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_SAMPLED_BIT;
+		}
+
+		return usage;
+	}
+
+	/**
+	 * Greedy interval packing: a transient image reuses the slot of an image with the same sample count that is dead before it is
+	 * first used. It must be written first, reading an aliased slot would see the content of the previous image
+	 */
+	void assign_alias_slots()
+	{
+		transient_resources_.clear();
+		for (frame_resource_handle resource = 0; resource < resources_.size(); resource++)
+		{
+			if (resources_[resource].transient && resources_[resource].first_use != UINT32_MAX)
+			{
+				transient_resources_.push_back(resource);
+			}
+		}
+		std::stable_sort(transient_resources_.begin(), transient_resources_.end(),
+			[&](const frame_resource_handle a, const frame_resource_handle b) { return resources_[a].first_use < resources_[b].first_use; });
+
+		struct alias_slot
+		{
+			VkSampleCountFlagBits samples;
+			uint32_t last_use;
+		};
+		std::vector<alias_slot> slots;
+
+		for (uint32_t transient_index = 0; transient_index < transient_resources_.size(); transient_index++)
+		{
+			resource_node& resource = resources_[transient_resources_[transient_index]];
+			resource.transient_index = transient_index;
+			resource.alias_slot = UINT32_MAX;
+
+			if (first_use_writes(transient_resources_[transient_index]))
+			{
+				for (uint32_t slot = 0; slot < slots.size(); slot++)
+				{
+					if (slots[slot].samples == resource.desc.samples && slots[slot].last_use < resource.first_use)
+					{
+						resource.alias_slot = slot;
+						break;
+					}
+				}
+			}
+
+			if (resource.alias_slot == UINT32_MAX)
+			{
+				resource.alias_slot = static_cast<uint32_t>(slots.size());
+				slots.push_back({ resource.desc.samples, 0 });
+			}
+			slots[resource.alias_slot].last_use = resource.last_use;
+		}
+
+		alias_slot_count_ = static_cast<uint32_t>(slots.size());
+	}
+
+	bool first_use_writes(const frame_resource_handle resource) const
+	{
+		const pass_node& pass = passes_[live_passes_[resources_[resource].first_use]];
+		for (const auto& use : pass.uses)
+		{
+			if (use.resource == resource)
+			{
+				return use.write;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * Index in the state list: a transient image shares the state of its alias slot, since a new image in the slot has to wait
+	 * for the previous one to be done with the memory
+	 */
+	size_t state_index(const frame_resource_handle resource) const
+	{
+		const resource_node& node = resources_[resource];
+		return node.transient ? resources_.size() + node.alias_slot : resource;
+	}
+
+	std::vector<resource_state> initial_states(const std::vector<resource_state>* previous_frame) const
+	{
+		std::vector<resource_state> states(resources_.size() + alias_slot_count_);
+		if (previous_frame != nullptr)
+		{
+			states = *previous_frame;
+		}
+
+		for (frame_resource_handle resource = 0; resource < resources_.size(); resource++)
+		{
+			const resource_node& node = resources_[resource];
+			if (node.transient || !node.initial_state)
+			{
+				continue;
+			}
+
+			resource_state state;
+			state.write_stages = node.initial_state->stages;
+			state.write_access = node.initial_state->access & FRAME_GRAPH_WRITE_ACCESS;
+			state.layout = node.initial_state->layout;
+			states[resource] = state;
+		}
+
+		return states;
+	}
+
+	/**
+	 * Run through the live passes, accumulating in every pass the barrier its uses need. Only the last run writes the barriers
+	 * and layouts into the passes
+	 */
+	std::vector<resource_state> simulate(std::vector<resource_state> states, const bool record)
+	{
+		for (const frame_pass_handle pass_handle : live_passes_)
+		{
+			pass_node& pass = passes_[pass_handle];
+			pass_barrier barrier;
+
+			for (auto& use : pass.uses)
+			{
+				resource_state& state = states[state_index(use.resource)];
+				const resource_node& resource = resources_[use.resource];
+
+				if (resource.transient && state.occupant != use.resource)
+				{
+					// A new image in the slot, the memory has to be free but its content and layout are gone
+					state.occupant = use.resource;
+					state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				}
+
+				if (use.attachment_index != UINT32_MAX)
+				{
+					// A loaded attachment starts in the layout it was left in, its first use being the read that loads it
+					attachment_node& attachment = pass.attachments[use.attachment_index];
+					if (attachment.load_op != VK_ATTACHMENT_LOAD_OP_LOAD)
+					{
+						attachment.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+					}
+					else if (!use.write)
+					{
+						attachment.initial_layout = state.layout;
+					}
+					attachment.final_layout = use.access.layout;
+				}
+
+				// The render pass transitions its attachments itself, any other image changing layout needs an image barrier. Rendering
+				// dynamically, an attachment that isn't loaded is transitioned from undefined every frame: the steady state the barriers
+				// are derived for is not the layout of a newly created image
+				const bool dynamic_attachment = dynamic_rendering_ && use.attachment_index != UINT32_MAX;
+				const bool discard = dynamic_attachment && pass.attachments[use.attachment_index].load_op != VK_ATTACHMENT_LOAD_OP_LOAD;
+				const bool transition = resource.image && (state.layout != use.access.layout || discard) &&
+					(use.attachment_index == UINT32_MAX || dynamic_attachment) && use.access.layout != VK_IMAGE_LAYOUT_UNDEFINED;
+				const VkImageLayout old_layout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+				add_dependency(barrier, state, use.access, use.write || transition || (resource.image && use.attachment_index != UINT32_MAX &&
+					old_layout != use.access.layout));
+
+				if (transition)
+				{
+					barrier.transitions.push_back({ use.resource, old_layout, use.access.layout, state.write_access, use.access.access });
+				}
+				update_state(state, use.access, use.write || transition, resource.image);
+			}
+
+			if (record)
+			{
+				pass.barrier = std::move(barrier);
+			}
+		}
+
+		// Outputs end in their final state. An output last written as an attachment changes layout at the end of its render pass
+		pass_barrier final_barrier;
+		for (frame_resource_handle resource = 0; resource < resources_.size(); resource++)
+		{
+			const resource_node& node = resources_[resource];
+			if (!node.output_state || node.first_use == UINT32_MAX)
+			{
+				continue;
+			}
+
+			resource_state& state = states[state_index(resource)];
+			const frame_resource_access& output = *node.output_state;
+
+			attachment_node* last_attachment = dynamic_rendering_ ? nullptr : last_attachment_use(resource);
+			if (node.image && last_attachment != nullptr && output.layout != VK_IMAGE_LAYOUT_UNDEFINED)
+			{
+				last_attachment->final_layout = output.layout;
+				state.layout = output.layout;
+			}
+
+			const bool transition = node.image && output.layout != VK_IMAGE_LAYOUT_UNDEFINED && state.layout != output.layout;
+			if (output.access != 0 || transition)
+			{
+				add_dependency(final_barrier, state, output, transition);
+			}
+			if (transition)
+			{
+				final_barrier.transitions.push_back({ resource, state.layout, output.layout, state.write_access, output.access });
+			}
+			update_state(state, output, transition, node.image);
+		}
+
+		if (record)
+		{
+			final_barrier_ = std::move(final_barrier);
+		}
+
+		return states;
+	}
+
+	/**
+	 * The attachment the resource is last used as, when its last use is a graphics pass writing it
+	 */
+	attachment_node* last_attachment_use(const frame_resource_handle resource)
+	{
+		pass_node& pass = passes_[live_passes_[resources_[resource].last_use]];
+		attachment_node* last = nullptr;
+		for (const auto& use : pass.uses)
+		{
+			if (use.resource != resource)
+			{
+				continue;
+			}
+			last = use.attachment_index != UINT32_MAX ? &pass.attachments[use.attachment_index] : nullptr;
+		}
+
+		return last;
+	}
+
+	/**
+	 * Add what a use waits for to the barrier in front of its pass. A write (or a layout change) waits for the previous write and
+	 * every read since, a read only waits for the previous write, and only if it wasn't already made visible to it
+	 */
+	static void add_dependency(pass_barrier& barrier, const resource_state& state, const frame_resource_access& access, const bool writes)
+	{
+		VkPipelineStageFlags src_stages = 0;
+		VkAccessFlags src_access = 0;
+
+		if (writes)
+		{
+			src_stages = state.write_stages | state.read_stages;
+			src_access = state.write_access;
+		}
+		else if ((access.stages & ~state.visible_stages) || (access.access & ~state.visible_access))
+		{
+			src_stages = state.write_stages;
+			src_access = state.write_access;
+		}
+
+		if (src_stages == 0)
+		{
+			return; // Nothing in flight on the resource
+		}
+
+		barrier.src_stages |= src_stages;
+		barrier.src_access |= src_access;
+		barrier.dst_stages |= access.stages;
+		barrier.dst_access |= src_access != 0 || writes ? access.access : 0;
+	}
+
+	static void update_state(resource_state& state, const frame_resource_access& access, const bool writes, const bool image)
+	{
+		if (writes)
+		{
+			state.write_stages = access.stages;
+			state.write_access = access.access & FRAME_GRAPH_WRITE_ACCESS;
+			state.read_stages = 0;
+			state.read_access = 0;
+			state.visible_stages = access.stages;
+			state.visible_access = access.access;
+		}
+		else
+		{
+			state.read_stages |= access.stages;
+			state.read_access |= access.access;
+			state.visible_stages |= access.stages;
+			state.visible_access |= access.access;
+		}
+
+		if (image && access.layout != VK_IMAGE_LAYOUT_UNDEFINED)
+		{
+			state.layout = access.layout;
+		}
+	}
+
+	void record_barrier(const VkCommandBuffer command_buffer, const pass_barrier& barrier, const bool transitions_only, frame_arena& arena) const
+	{
+		if (barrier.src_stages == 0 || (transitions_only && barrier.transitions.empty()))
+		{
+			return;
+		}
+
+		VkImageMemoryBarrier* image_barriers = arena.allocate<VkImageMemoryBarrier>(barrier.transitions.size());
+		for (size_t index = 0; index < barrier.transitions.size(); index++)
+		{
+			const image_transition& transition = barrier.transitions[index];
+			const resource_node& resource = resources_[transition.resource];
+
+			VkImageMemoryBarrier& image_barrier = image_barriers[index];
+			image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			image_barrier.srcAccessMask = transition.src_access;
+			image_barrier.dstAccessMask = transition.dst_access;
+			image_barrier.oldLayout = transition.old_layout;
+			image_barrier.newLayout = transition.new_layout;
+			image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			image_barrier.image = resource.bound_image;
+			image_barrier.subresourceRange = { resource.desc.aspect, 0, 1, 0, 1 };
+		}
+
+		// Buffers and the images that keep their layout are covered by a single global memory barrier
+		VkMemoryBarrier memory_barrier{};
+		memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memory_barrier.srcAccessMask = barrier.src_access;
+		memory_barrier.dstAccessMask = barrier.dst_access;
+		const bool has_memory_barrier = !transitions_only && (barrier.src_access != 0 || barrier.dst_access != 0);
+
+		vkCmdPipelineBarrier(command_buffer, barrier.src_stages, barrier.dst_stages, 0, has_memory_barrier ? 1 : 0, &memory_barrier, 0, nullptr,
+			static_cast<uint32_t>(barrier.transitions.size()), image_barriers);
+	}
+};
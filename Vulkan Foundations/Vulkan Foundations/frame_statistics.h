@@ -0,0 +1,499 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//	***************************************************
+//	******** FRAME STATISTICS GLOBAL VARIABLES ********
+//	***************************************************
+
+const size_t FRAME_SAMPLE_RING_CAPACITY = 4096; // Frames the ring holds between two collect() calls before dropping samples
+const size_t FRAME_STATISTICS_WINDOW = 1024; // Latest frames the percentiles and the jitter are computed over
+const size_t FRAME_TRACE_CAPACITY = 1 << 18; // Latest frames kept for the trace written at exit, older ones only feed the histogram
+const double FRAME_HISTOGRAM_BUCKET_MS = 0.5;
+const size_t FRAME_HISTOGRAM_BUCKETS = 100; // Plus one overflow bucket, so frame intervals up to 50 ms are bucketed
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * CPU side phases of draw_frame(). The two GPU waits are split because a long image wait means the swapchain hands out
+ * images out of order, while a long frame slot wait means the GPU is the bottleneck
+ */
+enum class frame_phase : uint32_t
+{
+	frame_fence_wait, // Graphics timeline wait for the previous frame of the slot
+	present_wait, // vkWaitForPresentKHR of the low latency present policy
+	acquire, // vkAcquireNextImageKHR
+	image_fence_wait, // Graphics timeline wait for the last frame rendering to the acquired image
+	record,
+	submit,
+	present,
+	count
+};
+
+const size_t FRAME_PHASE_COUNT = static_cast<size_t>(frame_phase::count);
+const char* const FRAME_PHASE_NAMES[FRAME_PHASE_COUNT] = { "frame_fence_wait", "present_wait", "acquire", "image_fence_wait", "record", "submit", "present" };
+
+struct frame_sample
+{
+	uint64_t frame_number = 0;
+	double start_ms = 0.0; // Since the first frame
+	double interval_ms = 0.0; // Since the start of the previous frame, what the user perceives as frame time
+	double cpu_ms = 0.0; // Time spent in draw_frame()
+	std::array<double, FRAME_PHASE_COUNT> phase_ms{};
+};
+
+struct frame_time_percentiles
+{
+	double p50_ms = 0.0;
+	double p90_ms = 0.0;
+	double p99_ms = 0.0;
+	double max_ms = 0.0;
+};
+
+struct frame_statistics_summary
+{
+	size_t sample_count = 0;
+	frame_time_percentiles interval;
+	frame_time_percentiles cpu;
+	std::array<frame_time_percentiles, FRAME_PHASE_COUNT> phases;
+	double interval_stddev_ms = 0.0;
+	double interval_jitter_ms = 0.0; // Mean absolute difference between consecutive frame intervals
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Wait-free single producer, single consumer ring. try_push() only ever runs on the producer thread and try_pop()
+ * on the consumer thread
+ */
+template <typename T, size_t capacity>
+class spsc_ring
+{
+public:
+	bool try_push(const T& value)
+	{
+		const size_t head = head_.load(std::memory_order_relaxed);
+		if (head - tail_.load(std::memory_order_acquire) == capacity)
+		{
+			return false;
+		}
+
+		slots_[head % capacity] = value;
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T& value)
+	{
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail == head_.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		value = slots_[tail % capacity];
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::array<T, capacity> slots_;
+	alignas(64) std::atomic<size_t> head_{ 0 }; // Separate cache lines so producer and consumer don't false share
+	alignas(64) std::atomic<size_t> tail_{ 0 };
+};
+
+/**
+ * CPU frame time instrumentation. The render thread times the phases of every frame and pushes a sample to a lock-free ring,
+ * whoever reports the statistics drains it with collect(), so the hot path never takes a lock. Nothing allocates once
+ * reserve_trace() sized the trace, collect() included
+ */
+class frame_statistics
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	frame_statistics() : samples_(std::make_unique<spsc_ring<frame_sample, FRAME_SAMPLE_RING_CAPACITY>>())
+	{
+	}
+
+	//	******** PRODUCER ********
+
+	void begin_frame()
+	{
+		const clock::time_point now = clock::now();
+		current_ = frame_sample{};
+		if (has_previous_frame_)
+		{
+			current_.interval_ms = milliseconds(previous_frame_start_, now);
+		}
+		else
+		{
+			first_frame_start_ = now;
+			has_previous_frame_ = true;
+		}
+		current_.start_ms = milliseconds(first_frame_start_, now);
+		previous_frame_start_ = now;
+	}
+
+	void begin_phase(const frame_phase phase)
+	{
+		current_phase_ = phase;
+		phase_start_ = clock::now();
+	}
+
+	void end_phase()
+	{
+		current_.phase_ms[static_cast<size_t>(current_phase_)] += milliseconds(phase_start_, clock::now());
+	}
+
+	/**
+	 * Publish the sample of a frame that was presented. Frames abandoned halfway, e.g. on an out of date swapchain, are not published
+	 */
+	void end_frame(const uint64_t frame_number)
+	{
+		current_.frame_number = frame_number;
+		current_.cpu_ms = milliseconds(previous_frame_start_, clock::now());
+
+		if (!samples_->try_push(current_))
+		{
+			dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	//	******** CONSUMER ********
+
+	/**
+	 * Keep the latest capacity frames for write_trace() and get_trace_summary(). Allocated once, without it no trace is kept
+	 */
+	void reserve_trace(const size_t capacity)
+	{
+		trace_.assign(capacity, frame_sample{});
+		trace_next_ = 0;
+		trace_count_ = 0;
+	}
+
+	/**
+	 * Move the published samples out of the ring into the statistics window, the histogram and the trace
+	 */
+	void collect()
+	{
+		frame_sample sample;
+		while (samples_->try_pop(sample))
+		{
+			// The first frame has no interval, it only goes to the trace
+			if (sample.interval_ms > 0.0)
+			{
+				window_[window_next_] = sample;
+				window_next_ = (window_next_ + 1) % FRAME_STATISTICS_WINDOW;
+				window_count_ = std::min(window_count_ + 1, FRAME_STATISTICS_WINDOW);
+
+				const size_t bucket = static_cast<size_t>(sample.interval_ms / FRAME_HISTOGRAM_BUCKET_MS);
+				histogram_[std::min(bucket, FRAME_HISTOGRAM_BUCKETS)]++;
+			}
+
+			if (!trace_.empty())
+			{
+				trace_[trace_next_] = sample;
+				trace_next_ = (trace_next_ + 1) % trace_.size();
+				trace_count_ = std::min(trace_count_ + 1, trace_.size());
+			}
+		}
+	}
+
+	/**
+	 * Statistics of the latest FRAME_STATISTICS_WINDOW frames
+	 */
+	frame_statistics_summary get_summary() const
+	{
+		// Window in chronological order
+		std::vector<frame_sample> samples;
+		samples.reserve(window_count_);
+		for (size_t i = 0; i < window_count_; i++)
+		{
+			samples.push_back(window_[(window_next_ + FRAME_STATISTICS_WINDOW - window_count_ + i) % FRAME_STATISTICS_WINDOW]);
+		}
+
+		return summarize(samples);
+	}
+
+	/**
+	 * Statistics of the frames collected since the last reset(), the latest ones when there were more than the trace holds
+	 */
+	frame_statistics_summary get_trace_summary() const
+	{
+		std::vector<frame_sample> samples;
+		samples.reserve(trace_count_);
+		for (size_t i = 0; i < trace_count_; i++)
+		{
+			const frame_sample& sample = trace_sample(i);
+			if (sample.interval_ms > 0.0)
+			{
+				samples.push_back(sample);
+			}
+		}
+
+		return summarize(samples);
+	}
+
+	/**
+	 * Forget everything collected so far, e.g. the warm-up frames of a benchmark. Call collect() first to also drop the samples
+	 * still in the ring
+	 */
+	void reset()
+	{
+		window_next_ = 0;
+		window_count_ = 0;
+		histogram_.fill(0);
+		trace_next_ = 0;
+		trace_count_ = 0;
+		dropped_samples_.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t dropped_samples() const
+	{
+		return dropped_samples_.load(std::memory_order_relaxed);
+	}
+
+	void print_summary() const
+	{
+		const frame_statistics_summary summary = get_summary();
+		if (summary.sample_count == 0)
+		{
+			return;
+		}
+
+		const std::ios::fmtflags flags = std::cout.flags();
+		const std::streamsize precision = std::cout.precision();
+
+		std::cout << std::fixed << std::setprecision(3)
+			<< "CPU frame timings (ms, last " << summary.sample_count << " frames, p50/p90/p99/max):" << std::endl;
+		print_percentiles("interval", summary.interval);
+		print_percentiles("draw_frame", summary.cpu);
+		for (size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+		{
+			print_percentiles(FRAME_PHASE_NAMES[phase], summary.phases[phase]);
+		}
+		std::cout << "\tinterval stddev " << summary.interval_stddev_ms << " jitter " << summary.interval_jitter_ms << std::endl;
+
+		const uint64_t dropped = dropped_samples_.load(std::memory_order_relaxed);
+		if (dropped > 0)
+		{
+			std::cout << "\t" << dropped << " samples dropped, collect() is not called often enough" << std::endl;
+		}
+
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+	}
+
+	/**
+	 * Write every collected frame to path, as CSV when the path ends with .csv and as JSON, with the summary and the
+	 * frame interval histogram, otherwise
+	 */
+	void write_trace(const std::string& path) const
+	{
+		std::ofstream file(path, std::ios::trunc);
+		if (!file)
+		{
+			throw std::runtime_error("Failed to open frame trace file " + path + "!");
+		}
+		file << std::setprecision(6);
+
+		const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+		if (csv)
+		{
+			write_csv(file);
+		}
+		else
+		{
+			write_json(file);
+		}
+
+		if (!file)
+		{
+			throw std::runtime_error("Failed to write frame trace file " + path + "!");
+		}
+		std::cout << "Frame trace of " << trace_count_ << " frames written to " << path << std::endl;
+	}
+
+private:
+	std::unique_ptr<spsc_ring<frame_sample, FRAME_SAMPLE_RING_CAPACITY>> samples_; // Heap allocated, it is too big for the stack
+	std::atomic<uint64_t> dropped_samples_{ 0 };
+
+	// Producer state
+	frame_sample current_;
+	frame_phase current_phase_ = frame_phase::frame_fence_wait;
+	clock::time_point phase_start_;
+	clock::time_point first_frame_start_;
+	clock::time_point previous_frame_start_;
+	bool has_previous_frame_ = false;
+
+	// Consumer state
+	std::array<frame_sample, FRAME_STATISTICS_WINDOW> window_;
+	size_t window_next_ = 0;
+	size_t window_count_ = 0;
+	std::array<uint64_t, FRAME_HISTOGRAM_BUCKETS + 1> histogram_{};
+	std::vector<frame_sample> trace_; // Ring sized by reserve_trace()
+	size_t trace_next_ = 0;
+	size_t trace_count_ = 0;
+
+	/**
+	 * index-th sample of the trace in chronological order
+	 */
+	const frame_sample& trace_sample(const size_t index) const
+	{
+		return trace_[(trace_next_ + trace_.size() - trace_count_ + index) % trace_.size()];
+	}
+
+	static double milliseconds(const clock::time_point begin, const clock::time_point end)
+	{
+		return std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	static frame_statistics_summary summarize(const std::vector<frame_sample>& samples)
+	{
+		frame_statistics_summary summary;
+		summary.sample_count = samples.size();
+		if (samples.empty())
+		{
+			return summary;
+		}
+
+		std::vector<double> values(samples.size());
+		const auto percentiles_of = [&](auto&& value_of)
+		{
+			std::transform(samples.begin(), samples.end(), values.begin(), value_of);
+			return compute_percentiles(values);
+		};
+
+		summary.interval = percentiles_of([](const frame_sample& sample) { return sample.interval_ms; });
+		summary.cpu = percentiles_of([](const frame_sample& sample) { return sample.cpu_ms; });
+		for (size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+		{
+			summary.phases[phase] = percentiles_of([phase](const frame_sample& sample) { return sample.phase_ms[phase]; });
+		}
+
+		double mean = 0.0;
+		for (const auto& sample : samples)
+		{
+			mean += sample.interval_ms;
+		}
+		mean /= samples.size();
+
+		double variance = 0.0;
+		double jitter = 0.0;
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			variance += (samples[i].interval_ms - mean) * (samples[i].interval_ms - mean);
+			if (i > 0)
+			{
+				jitter += std::abs(samples[i].interval_ms - samples[i - 1].interval_ms);
+			}
+		}
+		summary.interval_stddev_ms = std::sqrt(variance / samples.size());
+		summary.interval_jitter_ms = samples.size() > 1 ? jitter / (samples.size() - 1) : 0.0;
+
+		return summary;
+	}
+
+	static frame_time_percentiles compute_percentiles(std::vector<double>& values)
+	{
+		std::sort(values.begin(), values.end());
+
+		const auto at = [&](const size_t permille) { return values[std::min(values.size() - 1, values.size() * permille / 1000)]; };
+
+		frame_time_percentiles percentiles;
+		percentiles.p50_ms = at(500);
+		percentiles.p90_ms = at(900);
+		percentiles.p99_ms = at(990);
+		percentiles.max_ms = values.back();
+		return percentiles;
+	}
+
+	static void print_percentiles(const char* name, const frame_time_percentiles& percentiles)
+	{
+		std::cout << "\t" << name << " " << percentiles.p50_ms << " / " << percentiles.p90_ms << " / "
+			<< percentiles.p99_ms << " / " << percentiles.max_ms << std::endl;
+	}
+
+	static void write_json_percentiles(std::ofstream& file, const char* name, const frame_time_percentiles& percentiles)
+	{
+		file << "\"" << name << "\": { \"p50_ms\": " << percentiles.p50_ms << ", \"p90_ms\": " << percentiles.p90_ms
+			<< ", \"p99_ms\": " << percentiles.p99_ms << ", \"max_ms\": " << percentiles.max_ms << " }";
+	}
+
+	void write_csv(std::ofstream& file) const
+	{
+		file << "frame,start_ms,interval_ms,cpu_ms";
+		for (const char* name : FRAME_PHASE_NAMES)
+		{
+			file << "," << name << "_ms";
+		}
+		file << "\n";
+
+		for (size_t i = 0; i < trace_count_; i++)
+		{
+			const frame_sample& sample = trace_sample(i);
+			file << sample.frame_number << "," << sample.start_ms << "," << sample.interval_ms << "," << sample.cpu_ms;
+			for (const double phase_ms : sample.phase_ms)
+			{
+				file << "," << phase_ms;
+			}
+			file << "\n";
+		}
+	}
+
+	void write_json(std::ofstream& file) const
+	{
+		const frame_statistics_summary summary = get_summary();
+
+		file << "{\n\t\"summary\": {\n\t\t\"window_frames\": " << summary.sample_count << ",\n\t\t";
+		write_json_percentiles(file, "interval", summary.interval);
+		file << ",\n\t\t";
+		write_json_percentiles(file, "cpu", summary.cpu);
+		for (size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+		{
+			file << ",\n\t\t";
+			write_json_percentiles(file, FRAME_PHASE_NAMES[phase], summary.phases[phase]);
+		}
+		file << ",\n\t\t\"interval_stddev_ms\": " << summary.interval_stddev_ms
+			<< ",\n\t\t\"interval_jitter_ms\": " << summary.interval_jitter_ms
+			<< ",\n\t\t\"dropped_samples\": " << dropped_samples_.load(std::memory_order_relaxed) << "\n\t},\n";
+
+		file << "\t\"interval_histogram\": { \"bucket_ms\": " << FRAME_HISTOGRAM_BUCKET_MS << ", \"counts\": [";
+		for (size_t bucket = 0; bucket < histogram_.size(); bucket++)
+		{
+			file << (bucket > 0 ? ", " : "") << histogram_[bucket];
+		}
+		file << "] },\n";
+
+		file << "\t\"frames\": [";
+		for (size_t i = 0; i < trace_count_; i++)
+		{
+			const frame_sample& sample = trace_sample(i);
+			file << (i > 0 ? "," : "") << "\n\t\t{ \"frame\": " << sample.frame_number << ", \"start_ms\": " << sample.start_ms
+				<< ", \"interval_ms\": " << sample.interval_ms << ", \"cpu_ms\": " << sample.cpu_ms;
+			for (size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+			{
+				file << ", \"" << FRAME_PHASE_NAMES[phase] << "_ms\": " << sample.phase_ms[phase];
+			}
+			file << " }";
+		}
+		file << "\n\t]\n}\n";
+	}
+};
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "gpu_memory_allocator.h"
+#include "instance_buffer.h"
+#include "staging_uploader.h"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+//	******************************************
+//	******** CULLING GLOBAL VARIABLES ********
+//	******************************************
+
+const uint32_t CULLING_WORKGROUP_SIZE = 64; // Must match local_size_x of cull.comp
+const uint32_t CULLING_DESCRIPTOR_COUNT = 4; // Objects, instance transforms, output draws, output draw count
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * One drawable object as read by cull.comp (std430 layout). The object is kept when any of its instances overlaps the viewport
+ */
+struct culling_object
+{
+	uint32_t index_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t first_instance;
+	uint32_t instance_count;
+	float bounding_radius; // Of the mesh, in mesh space, scaled by every instance transform
+	uint32_t padding[2];
+};
+
+/**
+ * Which indirect commands are available on the device, from the most to the least GPU-driven
+ */
+struct culling_capabilities
+{
+	bool draw_indirect_count = false; // VK_KHR_draw_indirect_count: survivors are compacted and the GPU decides the draw count
+	bool multi_draw_indirect = false; // Otherwise one indirect call with a zero instance count for every culled object
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Compute pre-pass that frustum culls every object against the viewport and writes the survivors as indirect draws, so the graphics
+ * pass records the same few commands whatever the number of objects. Every frame in flight owns its output buffers, which are only
+ * written by the GPU: the CPU never touches per-object data after init(). With two or more sharing_families every buffer is
+ * VK_SHARING_MODE_CONCURRENT, so the culling can be recorded on an async compute queue and drawn from on the graphics queue
+ */
+class gpu_culling_pass
+{
+public:
+	void init(gpu_memory_allocator& allocator, staging_uploader& uploader, const VkPipelineCache pipeline_cache, const VkShaderModule compute_module,
+		const std::vector<culling_object>& objects, const instance_buffer& instances, const uint32_t frame_count,
+		const culling_capabilities& capabilities, const std::vector<uint32_t>& sharing_families = {})
+	{
+		allocator_ = &allocator;
+		device_ = allocator.device();
+		capabilities_ = capabilities;
+		sharing_families_ = sharing_families;
+		object_count_ = static_cast<uint32_t>(objects.size());
+
+		if (capabilities_.draw_indirect_count)
+		{
+			cmd_draw_indexed_indirect_count_ = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+				vkGetDeviceProcAddr(device_, "vkCmdDrawIndexedIndirectCountKHR"));
+			capabilities_.draw_indirect_count = cmd_draw_indexed_indirect_count_ != nullptr;
+		}
+
+		object_buffer_ = create_buffer(sizeof(culling_object) * objects.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			object_allocation_);
+		uploader.upload_buffer(object_buffer_, 0, objects.data(), sizeof(culling_object) * objects.size(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_SHADER_READ_BIT, is_concurrent());
+
+		create_pipeline(pipeline_cache, compute_module);
+		create_frames(instances, frame_count);
+	}
+
+	void destroy()
+	{
+		for (auto& frame : frames_)
+		{
+			vkDestroyBuffer(device_, frame.draw_buffer, nullptr);
+			allocator_->free(frame.draw_allocation);
+			vkDestroyBuffer(device_, frame.count_buffer, nullptr);
+			allocator_->free(frame.count_allocation);
+		}
+		frames_.clear();
+
+		vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+		vkDestroyPipeline(device_, pipeline_, nullptr);
+		vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
+		vkDestroyDescriptorSetLayout(device_, descriptor_set_layout_, nullptr);
+
+		vkDestroyBuffer(device_, object_buffer_, nullptr);
+		allocator_->free(object_allocation_);
+	}
+
+	const culling_capabilities& capabilities() const
+	{
+		return capabilities_;
+	}
+
+	/**
+	 * Cull the objects into the draw buffers of a frame slot. Recorded outside of a render pass, after the instance transforms of
+	 * the frame were written. The draws are written by VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, the caller makes them visible to
+	 * VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT before they are drawn
+	 */
+	void record_culling(const VkCommandBuffer command_buffer, const uint32_t frame_index)
+	{
+		frame_resources& frame = frames_[frame_index];
+
+		if (capabilities_.draw_indirect_count)
+		{
+			vkCmdFillBuffer(command_buffer, frame.count_buffer, 0, sizeof(uint32_t), 0);
+
+			VkBufferMemoryBarrier reset_barrier = make_barrier(frame.count_buffer, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				0, nullptr, 1, &reset_barrier, 0, nullptr);
+		}
+
+		const push_constants constants = { object_count_, capabilities_.draw_indirect_count ? 1u : 0u };
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1, &frame.descriptor_set, 0, nullptr);
+		vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(command_buffer, (object_count_ + CULLING_WORKGROUP_SIZE - 1) / CULLING_WORKGROUP_SIZE, 1, 1);
+	}
+
+	/**
+	 * Record the draws of a frame slot, with the pipeline and the vertex and index buffers already bound
+	 */
+	void record_draws(const VkCommandBuffer command_buffer, const uint32_t frame_index) const
+	{
+		const frame_resources& frame = frames_[frame_index];
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		if (capabilities_.draw_indirect_count)
+		{
+			cmd_draw_indexed_indirect_count_(command_buffer, frame.draw_buffer, 0, frame.count_buffer, 0, object_count_, stride);
+		}
+		else if (capabilities_.multi_draw_indirect)
+		{
+			vkCmdDrawIndexedIndirect(command_buffer, frame.draw_buffer, 0, object_count_, stride);
+		}
+		else
+		{
+			// Without multiDrawIndirect the draw count is limited to 1, culled objects still cost a call but no GPU work
+			for (uint32_t object = 0; object < object_count_; object++)
+			{
+				vkCmdDrawIndexedIndirect(command_buffer, frame.draw_buffer, VkDeviceSize(object) * stride, 1, stride);
+			}
+		}
+	}
+
+private:
+	struct frame_resources
+	{
+		VkBuffer draw_buffer = VK_NULL_HANDLE; // One VkDrawIndexedIndirectCommand per object
+		gpu_allocation draw_allocation;
+		VkBuffer count_buffer = VK_NULL_HANDLE; // Number of surviving objects, only read with draw_indirect_count
+		gpu_allocation count_allocation;
+		VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+	};
+
+	struct push_constants
+	{
+		uint32_t object_count;
+		uint32_t compact; // Non zero: survivors are packed at the front and counted, zero: culled objects get no instances
+	};
+
+	gpu_memory_allocator* allocator_ = nullptr;
+	VkDevice device_ = VK_NULL_HANDLE;
+	culling_capabilities capabilities_;
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmd_draw_indexed_indirect_count_ = nullptr;
+	uint32_t object_count_ = 0;
+	std::vector<uint32_t> sharing_families_;
+
+	VkBuffer object_buffer_ = VK_NULL_HANDLE;
+	gpu_allocation object_allocation_;
+
+	VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+	VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+	VkPipeline pipeline_ = VK_NULL_HANDLE;
+	VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+	std::vector<frame_resources> frames_;
+
+	VkBuffer create_buffer(const VkDeviceSize size, const VkBufferUsageFlags usage, gpu_allocation& allocation)
+	{
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = size;
+		buffer_info.usage = usage;
+		buffer_info.sharingMode = is_concurrent() ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		buffer_info.queueFamilyIndexCount = is_concurrent() ? static_cast<uint32_t>(sharing_families_.size()) : 0;
+		buffer_info.pQueueFamilyIndices = sharing_families_.data();
+
+		VkBuffer buffer;
+		if (vkCreateBuffer(device_, &buffer_info, nullptr, &buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create culling buffer!");
+		}
+		allocation = allocator_->allocate_for_buffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		return buffer;
+	}
+
+	bool is_concurrent() const
+	{
+		return sharing_families_.size() > 1;
+	}
+
+	void create_pipeline(const VkPipelineCache pipeline_cache, const VkShaderModule compute_module)
+	{
+		std::array<VkDescriptorSetLayoutBinding, CULLING_DESCRIPTOR_COUNT> bindings{};
+		for (uint32_t binding = 0; binding < CULLING_DESCRIPTOR_COUNT; binding++)
+		{
+			bindings[binding].binding = binding;
+			bindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[binding].descriptorCount = 1;
+			bindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+		layout_info.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create culling descriptor set layout!");
+		}
+
+		VkPushConstantRange push_constant_range{};
+		push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		push_constant_range.offset = 0;
+		push_constant_range.size = sizeof(push_constants);
+
+		VkPipelineLayoutCreateInfo pipeline_layout_info{};
+		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout_info.setLayoutCount = 1;
+		pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+		if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create culling pipeline layout!");
+		}
+
+		VkComputePipelineCreateInfo pipeline_info{};
+		pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeline_info.stage.module = compute_module;
+		pipeline_info.stage.pName = "main";
+		pipeline_info.layout = pipeline_layout_;
+
+		if (vkCreateComputePipelines(device_, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create culling pipeline!");
+		}
+	}
+
+	void create_frames(const instance_buffer& instances, const uint32_t frame_count)
+	{
+		VkDescriptorPoolSize pool_size{};
+		pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		pool_size.descriptorCount = CULLING_DESCRIPTOR_COUNT * frame_count;
+
+		VkDescriptorPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = frame_count;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes = &pool_size;
+
+		if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create culling descriptor pool!");
+		}
+
+		frames_.resize(frame_count);
+		for (uint32_t frame_index = 0; frame_index < frame_count; frame_index++)
+		{
+			frame_resources& frame = frames_[frame_index];
+			frame.draw_buffer = create_buffer(sizeof(VkDrawIndexedIndirectCommand) * object_count_,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, frame.draw_allocation);
+			frame.count_buffer = create_buffer(sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, frame.count_allocation);
+
+			VkDescriptorSetAllocateInfo alloc_info{};
+			alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			alloc_info.descriptorPool = descriptor_pool_;
+			alloc_info.descriptorSetCount = 1;
+			alloc_info.pSetLayouts = &descriptor_set_layout_;
+
+			if (vkAllocateDescriptorSets(device_, &alloc_info, &frame.descriptor_set) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to allocate culling descriptor set!");
+			}
+
+			// The instance buffer keeps its per-frame copies for its whole life, so the sets are written once
+			const std::array<VkDescriptorBufferInfo, CULLING_DESCRIPTOR_COUNT> buffer_infos = {
+				VkDescriptorBufferInfo{ object_buffer_, 0, VK_WHOLE_SIZE },
+				instances.transform_stream(frame_index),
+				VkDescriptorBufferInfo{ frame.draw_buffer, 0, VK_WHOLE_SIZE },
+				VkDescriptorBufferInfo{ frame.count_buffer, 0, VK_WHOLE_SIZE }
+			};
+
+			std::array<VkWriteDescriptorSet, CULLING_DESCRIPTOR_COUNT> writes{};
+			for (uint32_t binding = 0; binding < CULLING_DESCRIPTOR_COUNT; binding++)
+			{
+				writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[binding].dstSet = frame.descriptor_set;
+				writes[binding].dstBinding = binding;
+				writes[binding].descriptorCount = 1;
+				writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[binding].pBufferInfo = &buffer_infos[binding];
+			}
+			vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+
+	static VkBufferMemoryBarrier make_barrier(const VkBuffer buffer, const VkAccessFlags src_access, const VkAccessFlags dst_access)
+	{
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = src_access;
+		barrier.dstAccessMask = dst_access;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+
+		return barrier;
+	}
+};
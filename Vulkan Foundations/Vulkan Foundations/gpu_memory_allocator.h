@@ -0,0 +1,776 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//	********************************************
+//	******** ALLOCATOR GLOBAL VARIABLES ********
+//	********************************************
+
+const VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = VkDeviceSize(64) << 20; // 64 mb, rounded down to a power of two by the allocator
+const VkDeviceSize MIN_BUDDY_ALLOCATION_SIZE = 256; // Smallest node handed out by the buddy allocator
+const VkDeviceSize SMALL_HEAP_SIZE = VkDeviceSize(1) << 30; // Heaps below 1 gb get blocks of 1/8 of the heap instead
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+enum class allocation_kind
+{
+	buddy, // long-lived resource carved out of a shared block
+	dedicated, // resource big enough to get its own VkDeviceMemory
+	linear // per-frame resource bumped out of a gpu_linear_pool, freed all at once by reset()
+};
+
+/**
+ * Kind of resource that is going to be bound to the memory. Linear (buffers) and optimal (images) resources live in different blocks,
+ * so neighbouring sub-allocations never violate bufferImageGranularity
+ */
+enum class resource_tiling
+{
+	linear,
+	optimal
+};
+
+/**
+ * A sub-allocation handed out by gpu_memory_allocator or gpu_linear_pool. Bind resources with memory + offset
+ */
+struct gpu_allocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	VkDeviceSize memory_size = 0; // Of the whole VkDeviceMemory, flush and invalidate ranges never run past it
+	void* mapped = nullptr; // Persistently mapped host pointer to offset, nullptr when the memory is not host visible
+	uint32_t memory_type_index = 0;
+
+	allocation_kind kind = allocation_kind::buddy;
+	uint32_t pool_index = 0; // Index of the block list the allocation came from
+	uint32_t block_id = 0;
+	uint32_t order = 0; // Buddy order, the node size is MIN_BUDDY_ALLOCATION_SIZE << order
+
+	bool is_valid() const
+	{
+		return memory != VK_NULL_HANDLE;
+	}
+};
+
+struct memory_heap_statistics
+{
+	VkDeviceSize heap_size = 0;
+	VkDeviceSize reserved_bytes = 0; // Bytes allocated from the driver (blocks + dedicated allocations)
+	VkDeviceSize used_bytes = 0; // Bytes handed out to resources
+	uint32_t device_memory_count = 0; // Live VkDeviceMemory objects on this heap
+	uint32_t allocation_count = 0; // Live sub-allocations on this heap
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Device memory allocator built on the memory types and heaps reported by vkGetPhysicalDeviceMemoryProperties.
+ * Long-lived resources are sub-allocated from large blocks with a buddy allocator, resources larger than half a block get a dedicated allocation,
+ * and per-frame data goes through gpu_linear_pool. Every VkDeviceMemory is counted against maxMemoryAllocationCount
+ */
+class gpu_memory_allocator
+{
+public:
+	void init(const VkPhysicalDevice physical_device, const VkDevice device, const VkDeviceSize preferred_block_size = DEFAULT_MEMORY_BLOCK_SIZE)
+	{
+		device_ = device;
+
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+		max_memory_allocation_count_ = device_properties.limits.maxMemoryAllocationCount;
+		non_coherent_atom_size_ = std::max<VkDeviceSize>(device_properties.limits.nonCoherentAtomSize, 1);
+
+		vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+
+		preferred_block_size_ = round_down_to_power_of_two(std::max(preferred_block_size, MIN_BUDDY_ALLOCATION_SIZE));
+		heap_statistics_.assign(memory_properties_.memoryHeapCount, memory_heap_statistics{});
+		for (uint32_t heap_index = 0; heap_index < memory_properties_.memoryHeapCount; heap_index++)
+		{
+			heap_statistics_[heap_index].heap_size = memory_properties_.memoryHeaps[heap_index].size;
+		}
+
+		// One block list per memory type and resource tiling
+		block_lists_.clear();
+		block_lists_.resize(static_cast<size_t>(memory_properties_.memoryTypeCount) * 2);
+	}
+
+	void destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		for (auto& block_list : block_lists_)
+		{
+			for (auto& block : block_list)
+			{
+				if (block != nullptr)
+				{
+					if (block->allocation_count > 0)
+					{
+						std::cerr << "Memory allocator: " << block->allocation_count << " allocations leaked in memory type " << block->memory_type_index << std::endl;
+					}
+					release_device_memory(block->memory, block->size, block->memory_type_index);
+				}
+			}
+		}
+		block_lists_.clear();
+
+		if (device_memory_count_ > 0)
+		{
+			std::cerr << "Memory allocator: " << device_memory_count_ << " device memory objects still alive at shutdown" << std::endl;
+		}
+	}
+
+	/**
+	 * Pick the memory type allowed by type_bits that has every required flag, favouring the one that also has the most preferred flags
+	 */
+	uint32_t find_memory_type(const uint32_t type_bits, const VkMemoryPropertyFlags required, const VkMemoryPropertyFlags preferred = 0) const
+	{
+		uint32_t best_index = UINT32_MAX;
+		uint32_t best_score = 0;
+
+		for (uint32_t memory_index = 0; memory_index < memory_properties_.memoryTypeCount; memory_index++)
+		{
+			const VkMemoryPropertyFlags flags = memory_properties_.memoryTypes[memory_index].propertyFlags;
+			if (!(type_bits & (1u << memory_index)) || (flags & required) != required)
+			{
+				continue;
+			}
+
+			const uint32_t score = count_bits(flags & preferred) + 1;
+			if (score > best_score)
+			{
+				best_score = score;
+				best_index = memory_index;
+			}
+		}
+
+		if (best_index == UINT32_MAX)
+		{
+			throw std::runtime_error("Failed to find a suitable memory type!");
+		}
+
+		return best_index;
+	}
+
+	bool has_memory_type(const uint32_t type_bits, const VkMemoryPropertyFlags required) const
+	{
+		for (uint32_t memory_index = 0; memory_index < memory_properties_.memoryTypeCount; memory_index++)
+		{
+			if ((type_bits & (1u << memory_index)) && (memory_properties_.memoryTypes[memory_index].propertyFlags & required) == required)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * The size allocate() gives the allocation for requirements: the buddy node, a power of two, or the requirements of a dedicated
+	 * allocation. Lets a caller hold memory to a budget before allocating
+	 */
+	VkDeviceSize get_allocation_size(const VkMemoryRequirements& requirements, const VkMemoryPropertyFlags required,
+		const VkMemoryPropertyFlags preferred = 0) const
+	{
+		const uint32_t memory_type_index = find_memory_type(requirements.memoryTypeBits, required, preferred);
+		const VkDeviceSize node_size = get_node_size(requirements);
+
+		return node_size > block_size_for_type(memory_type_index) / 2 ? requirements.size : node_size;
+	}
+
+	gpu_allocation allocate(const VkMemoryRequirements& requirements, const VkMemoryPropertyFlags required, const VkMemoryPropertyFlags preferred,
+		const resource_tiling tiling)
+	{
+		const uint32_t memory_type_index = find_memory_type(requirements.memoryTypeBits, required, preferred);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		const VkDeviceSize block_size = block_size_for_type(memory_type_index);
+		const VkDeviceSize node_size = get_node_size(requirements);
+
+		if (node_size > block_size / 2)
+		{
+			return allocate_dedicated(requirements.size, memory_type_index);
+		}
+
+		const uint32_t order = order_for_size(node_size);
+		const uint32_t pool_index = memory_type_index * 2 + (tiling == resource_tiling::optimal ? 1 : 0);
+		auto& block_list = block_lists_[pool_index];
+
+		for (auto& block : block_list)
+		{
+			VkDeviceSize offset;
+			if (block != nullptr && try_allocate_from_block(*block, order, offset))
+			{
+				return make_allocation(*block, pool_index, offset, node_size, order);
+			}
+		}
+
+		auto block = create_block(memory_type_index, block_size);
+		VkDeviceSize offset = 0;
+		try_allocate_from_block(*block, order, offset);
+
+		const uint32_t block_id = next_block_id_++;
+		block->id = block_id;
+		block_list.push_back(std::move(block));
+
+		return make_allocation(*block_list.back(), pool_index, offset, node_size, order);
+	}
+
+	gpu_allocation allocate_for_buffer(const VkBuffer buffer, const VkMemoryPropertyFlags required, const VkMemoryPropertyFlags preferred = 0)
+	{
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(device_, buffer, &requirements);
+
+		gpu_allocation allocation = allocate(requirements, required, preferred, resource_tiling::linear);
+		if (vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+		{
+			free(allocation);
+			throw std::runtime_error("Failed to bind buffer memory!");
+		}
+
+		return allocation;
+	}
+
+	gpu_allocation allocate_for_image(const VkImage image, const VkMemoryPropertyFlags required, const VkMemoryPropertyFlags preferred = 0)
+	{
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(device_, image, &requirements);
+
+		gpu_allocation allocation = allocate(requirements, required, preferred, resource_tiling::optimal);
+		if (vkBindImageMemory(device_, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+		{
+			free(allocation);
+			throw std::runtime_error("Failed to bind image memory!");
+		}
+
+		return allocation;
+	}
+
+	void free(gpu_allocation& allocation)
+	{
+		if (!allocation.is_valid() || allocation.kind == allocation_kind::linear)
+		{
+			allocation = {};
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		const uint32_t heap_index = memory_properties_.memoryTypes[allocation.memory_type_index].heapIndex;
+		heap_statistics_[heap_index].used_bytes -= allocation.size;
+		heap_statistics_[heap_index].allocation_count--;
+
+		if (allocation.kind == allocation_kind::dedicated)
+		{
+			release_device_memory(allocation.memory, allocation.size, allocation.memory_type_index);
+			allocation = {};
+			return;
+		}
+
+		auto& block_list = block_lists_[allocation.pool_index];
+		for (auto& block : block_list)
+		{
+			if (block != nullptr && block->id == allocation.block_id)
+			{
+				free_in_block(*block, allocation.offset, allocation.order);
+				block->allocation_count--;
+				block->used_bytes -= allocation.size;
+
+				// Keep one empty block around per list so a resource churning at the boundary doesn't hit vkAllocateMemory every frame
+				if (block->allocation_count == 0 && count_empty_blocks(block_list) > 1)
+				{
+					release_device_memory(block->memory, block->size, block->memory_type_index);
+					block.reset();
+				}
+				break;
+			}
+		}
+
+		block_list.erase(std::remove(block_list.begin(), block_list.end(), nullptr), block_list.end());
+		allocation = {};
+	}
+
+	/**
+	 * Make host writes visible to the device. Only needed when the memory type is not HOST_COHERENT
+	 */
+	void flush(const gpu_allocation& allocation, const VkDeviceSize offset = 0, const VkDeviceSize size = VK_WHOLE_SIZE) const
+	{
+		if (is_host_coherent(allocation.memory_type_index))
+		{
+			return;
+		}
+
+		const VkMappedMemoryRange range = make_atom_aligned_range(allocation, offset, size);
+		vkFlushMappedMemoryRanges(device_, 1, &range);
+	}
+
+	/**
+	 * Make device writes visible to the host. Only needed when the memory type is not HOST_COHERENT
+	 */
+	void invalidate(const gpu_allocation& allocation, const VkDeviceSize offset = 0, const VkDeviceSize size = VK_WHOLE_SIZE) const
+	{
+		if (is_host_coherent(allocation.memory_type_index))
+		{
+			return;
+		}
+
+		const VkMappedMemoryRange range = make_atom_aligned_range(allocation, offset, size);
+		vkInvalidateMappedMemoryRanges(device_, 1, &range);
+	}
+
+	bool is_host_coherent(const uint32_t memory_type_index) const
+	{
+		return memory_properties_.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	}
+
+	VkMemoryPropertyFlags memory_type_flags(const uint32_t memory_type_index) const
+	{
+		return memory_properties_.memoryTypes[memory_type_index].propertyFlags;
+	}
+
+	const VkPhysicalDeviceMemoryProperties& memory_properties() const
+	{
+		return memory_properties_;
+	}
+
+	std::vector<memory_heap_statistics> get_heap_statistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return heap_statistics_;
+	}
+
+	void print_heap_statistics()
+	{
+		const std::vector<memory_heap_statistics> statistics = get_heap_statistics();
+
+		std::cout << "-- Memory Allocator Heap Usage --" << std::endl;
+		for (size_t heap_index = 0; heap_index < statistics.size(); heap_index++)
+		{
+			const memory_heap_statistics& heap = statistics[heap_index];
+			std::cout << "Memory Heaps [" << heap_index << "]:" << std::endl;
+			std::cout << "\t Used: " << (heap.used_bytes >> 10) << " kb in " << heap.allocation_count << " allocations" << std::endl;
+			std::cout << "\t Reserved: " << (heap.reserved_bytes >> 10) << " kb in " << heap.device_memory_count << " device memory objects" << std::endl;
+			std::cout << "\t Size: " << (heap.heap_size >> 20) << " mb" << std::endl;
+		}
+		std::cout << "Device memory objects: " << device_memory_count_ << " / " << max_memory_allocation_count_ << std::endl;
+	}
+
+	/**
+	 * Allocate a whole VkDeviceMemory for gpu_linear_pool. Counted in the heap statistics as reserved and used at once, like a
+	 * dedicated allocation
+	 */
+	gpu_allocation allocate_linear_chunk(const uint32_t memory_type_index, const VkDeviceSize size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		gpu_allocation allocation{};
+		allocation.memory = acquire_device_memory(memory_type_index, size, allocation.mapped);
+		allocation.size = size;
+		allocation.memory_size = size;
+		allocation.memory_type_index = memory_type_index;
+		allocation.kind = allocation_kind::linear;
+
+		memory_heap_statistics& heap = heap_statistics_[memory_properties_.memoryTypes[memory_type_index].heapIndex];
+		heap.used_bytes += size;
+		heap.allocation_count++;
+
+		return allocation;
+	}
+
+	void free_linear_chunk(gpu_allocation& allocation)
+	{
+		if (!allocation.is_valid())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		memory_heap_statistics& heap = heap_statistics_[memory_properties_.memoryTypes[allocation.memory_type_index].heapIndex];
+		heap.used_bytes -= allocation.size;
+		heap.allocation_count--;
+
+		release_device_memory(allocation.memory, allocation.size, allocation.memory_type_index);
+		allocation = {};
+	}
+
+	VkDevice device() const
+	{
+		return device_;
+	}
+
+private:
+	struct memory_block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		uint32_t memory_type_index = 0;
+		uint32_t id = 0;
+		uint32_t allocation_count = 0;
+		VkDeviceSize used_bytes = 0;
+		std::vector<std::set<VkDeviceSize>> free_lists; // Free node offsets per buddy order
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memory_properties_{};
+	VkDeviceSize preferred_block_size_ = DEFAULT_MEMORY_BLOCK_SIZE;
+	VkDeviceSize non_coherent_atom_size_ = 1;
+	uint32_t max_memory_allocation_count_ = 0;
+	uint32_t device_memory_count_ = 0;
+	uint32_t next_block_id_ = 0;
+
+	std::vector<std::vector<std::unique_ptr<memory_block>>> block_lists_;
+	std::vector<memory_heap_statistics> heap_statistics_;
+	std::mutex mutex_;
+
+	static uint32_t count_bits(uint32_t value)
+	{
+		uint32_t count = 0;
+		for (; value != 0; value &= value - 1)
+		{
+			count++;
+		}
+		return count;
+	}
+
+	static VkDeviceSize round_up_to_power_of_two(const VkDeviceSize value)
+	{
+		VkDeviceSize power = 1;
+		while (power < value)
+		{
+			power <<= 1;
+		}
+		return power;
+	}
+
+	static VkDeviceSize round_down_to_power_of_two(const VkDeviceSize value)
+	{
+		VkDeviceSize power = 1;
+		while ((power << 1) <= value)
+		{
+			power <<= 1;
+		}
+		return power;
+	}
+
+	static VkDeviceSize get_node_size(const VkMemoryRequirements& requirements)
+	{
+		return round_up_to_power_of_two(std::max({ requirements.size, requirements.alignment, MIN_BUDDY_ALLOCATION_SIZE }));
+	}
+
+	static uint32_t order_for_size(const VkDeviceSize node_size)
+	{
+		uint32_t order = 0;
+		while ((MIN_BUDDY_ALLOCATION_SIZE << order) < node_size)
+		{
+			order++;
+		}
+		return order;
+	}
+
+	VkDeviceSize block_size_for_type(const uint32_t memory_type_index) const
+	{
+		const VkDeviceSize heap_size = memory_properties_.memoryHeaps[memory_properties_.memoryTypes[memory_type_index].heapIndex].size;
+		if (heap_size < SMALL_HEAP_SIZE)
+		{
+			return std::max(MIN_BUDDY_ALLOCATION_SIZE, std::min(preferred_block_size_, round_down_to_power_of_two(heap_size / 8)));
+		}
+		return preferred_block_size_;
+	}
+
+	VkDeviceMemory acquire_device_memory(const uint32_t memory_type_index, const VkDeviceSize size, void*& mapped)
+	{
+		if (device_memory_count_ >= max_memory_allocation_count_)
+		{
+			throw std::runtime_error("Failed to allocate device memory, maxMemoryAllocationCount reached!");
+		}
+
+		VkMemoryAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		alloc_info.allocationSize = size;
+		alloc_info.memoryTypeIndex = memory_type_index;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device_, &alloc_info, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate device memory!");
+		}
+
+		mapped = nullptr;
+		if (memory_properties_.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			if (vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+			{
+				vkFreeMemory(device_, memory, nullptr);
+				throw std::runtime_error("Failed to map device memory!");
+			}
+		}
+
+		device_memory_count_++;
+		memory_heap_statistics& heap = heap_statistics_[memory_properties_.memoryTypes[memory_type_index].heapIndex];
+		heap.reserved_bytes += size;
+		heap.device_memory_count++;
+
+		return memory;
+	}
+
+	void release_device_memory(const VkDeviceMemory memory, const VkDeviceSize size, const uint32_t memory_type_index)
+	{
+		// Freeing a mapped allocation implicitly unmaps it
+		vkFreeMemory(device_, memory, nullptr);
+
+		device_memory_count_--;
+		memory_heap_statistics& heap = heap_statistics_[memory_properties_.memoryTypes[memory_type_index].heapIndex];
+		heap.reserved_bytes -= size;
+		heap.device_memory_count--;
+	}
+
+	std::unique_ptr<memory_block> create_block(const uint32_t memory_type_index, const VkDeviceSize block_size)
+	{
+		auto block = std::make_unique<memory_block>();
+		block->memory = acquire_device_memory(memory_type_index, block_size, block->mapped);
+		block->size = block_size;
+		block->memory_type_index = memory_type_index;
+
+		const uint32_t max_order = order_for_size(block_size);
+		block->free_lists.resize(static_cast<size_t>(max_order) + 1);
+		block->free_lists[max_order].insert(0);
+
+		return block;
+	}
+
+	bool try_allocate_from_block(memory_block& block, const uint32_t order, VkDeviceSize& offset)
+	{
+		uint32_t available_order = order;
+		while (available_order < block.free_lists.size() && block.free_lists[available_order].empty())
+		{
+			available_order++;
+		}
+
+		if (available_order >= block.free_lists.size())
+		{
+			return false;
+		}
+
+		offset = *block.free_lists[available_order].begin();
+		block.free_lists[available_order].erase(block.free_lists[available_order].begin());
+
+		// Split the node in halves until it has the requested size, returning the upper halves to the free lists
+		while (available_order > order)
+		{
+			available_order--;
+			block.free_lists[available_order].insert(offset + (MIN_BUDDY_ALLOCATION_SIZE << available_order));
+		}
+
+		return true;
+	}
+
+	void free_in_block(memory_block& block, VkDeviceSize offset, uint32_t order)
+	{
+		// Merge with the buddy node as long as it is free too
+		while (order + 1 < block.free_lists.size())
+		{
+			const VkDeviceSize buddy = offset ^ (MIN_BUDDY_ALLOCATION_SIZE << order);
+			auto buddy_it = block.free_lists[order].find(buddy);
+			if (buddy_it == block.free_lists[order].end())
+			{
+				break;
+			}
+
+			block.free_lists[order].erase(buddy_it);
+			offset = std::min(offset, buddy);
+			order++;
+		}
+
+		block.free_lists[order].insert(offset);
+	}
+
+	gpu_allocation make_allocation(memory_block& block, const uint32_t pool_index, const VkDeviceSize offset, const VkDeviceSize size, const uint32_t order)
+	{
+		block.allocation_count++;
+		block.used_bytes += size;
+
+		memory_heap_statistics& heap = heap_statistics_[memory_properties_.memoryTypes[block.memory_type_index].heapIndex];
+		heap.used_bytes += size;
+		heap.allocation_count++;
+
+		gpu_allocation allocation{};
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.memory_size = block.size;
+		allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + offset : nullptr;
+		allocation.memory_type_index = block.memory_type_index;
+		allocation.kind = allocation_kind::buddy;
+		allocation.pool_index = pool_index;
+		allocation.block_id = block.id;
+		allocation.order = order;
+
+		return allocation;
+	}
+
+	gpu_allocation allocate_dedicated(const VkDeviceSize size, const uint32_t memory_type_index)
+	{
+		gpu_allocation allocation{};
+		allocation.memory = acquire_device_memory(memory_type_index, size, allocation.mapped);
+		allocation.size = size;
+		allocation.memory_size = size;
+		allocation.memory_type_index = memory_type_index;
+		allocation.kind = allocation_kind::dedicated;
+
+		memory_heap_statistics& heap = heap_statistics_[memory_properties_.memoryTypes[memory_type_index].heapIndex];
+		heap.used_bytes += size;
+		heap.allocation_count++;
+
+		return allocation;
+	}
+
+	static size_t count_empty_blocks(const std::vector<std::unique_ptr<memory_block>>& block_list)
+	{
+		return std::count_if(block_list.begin(), block_list.end(), [](const std::unique_ptr<memory_block>& block)
+			{
+				return block != nullptr && block->allocation_count == 0;
+			});
+	}
+
+	VkMappedMemoryRange make_atom_aligned_range(const gpu_allocation& allocation, const VkDeviceSize offset, const VkDeviceSize size) const
+	{
+		const VkDeviceSize begin = allocation.offset + offset;
+		const VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + size;
+
+		VkMappedMemoryRange range{};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = allocation.memory;
+		range.offset = begin / non_coherent_atom_size_ * non_coherent_atom_size_;
+		range.size = (end - range.offset + non_coherent_atom_size_ - 1) / non_coherent_atom_size_ * non_coherent_atom_size_;
+
+		// Rounding up may pass the end of the memory, e.g. of a dedicated allocation whose size isn't a whole number of atoms. A range
+		// ending exactly at the end of the memory is valid whatever its size
+		if (range.offset + range.size > allocation.memory_size)
+		{
+			range.size = allocation.memory_size - range.offset;
+		}
+
+		return range;
+	}
+};
+
+/**
+ * Bump allocator for data that lives for a single frame. Use one pool per frame in flight and reset() it once that frame is done on the GPU.
+ * When a frame needs more than the current chunk, extra chunks are chained and reset() merges them into a single bigger chunk,
+ * so after a few frames the pool settles on one VkDeviceMemory sized for the peak
+ */
+class gpu_linear_pool
+{
+public:
+	void init(gpu_memory_allocator* allocator, const uint32_t memory_type_index, const VkDeviceSize chunk_size)
+	{
+		allocator_ = allocator;
+		memory_type_index_ = memory_type_index;
+		chunk_size_ = chunk_size;
+		chunks_.push_back(allocator_->allocate_linear_chunk(memory_type_index_, chunk_size_));
+		offset_ = 0;
+	}
+
+	void destroy()
+	{
+		for (auto& chunk : chunks_)
+		{
+			allocator_->free_linear_chunk(chunk);
+		}
+		chunks_.clear();
+	}
+
+	gpu_allocation allocate(const VkMemoryRequirements& requirements)
+	{
+		if (!(requirements.memoryTypeBits & (1u << memory_type_index_)))
+		{
+			throw std::runtime_error("Linear pool memory type is not compatible with the resource!");
+		}
+
+		return allocate(requirements.size, requirements.alignment);
+	}
+
+	gpu_allocation allocate(const VkDeviceSize size, const VkDeviceSize alignment)
+	{
+		VkDeviceSize aligned_offset = align_up(offset_, alignment);
+		if (aligned_offset + size > chunks_.back().size)
+		{
+			chunks_.push_back(allocator_->allocate_linear_chunk(memory_type_index_, std::max(chunk_size_, size)));
+			aligned_offset = 0;
+		}
+
+		const gpu_allocation& chunk = chunks_.back();
+		offset_ = aligned_offset + size;
+		used_bytes_ += size;
+		high_water_mark_ = std::max(high_water_mark_, used_bytes_);
+
+		gpu_allocation allocation{};
+		allocation.memory = chunk.memory;
+		allocation.offset = aligned_offset;
+		allocation.size = size;
+		allocation.memory_size = chunk.memory_size;
+		allocation.mapped = chunk.mapped != nullptr ? static_cast<char*>(chunk.mapped) + aligned_offset : nullptr;
+		allocation.memory_type_index = memory_type_index_;
+		allocation.kind = allocation_kind::linear;
+
+		return allocation;
+	}
+
+	/**
+	 * Release every allocation at once. The caller must make sure the GPU is done with them, e.g. by waiting on the frame slot
+	 */
+	void reset()
+	{
+		if (chunks_.size() > 1)
+		{
+			VkDeviceSize total_size = 0;
+			for (auto& chunk : chunks_)
+			{
+				total_size += chunk.size;
+				allocator_->free_linear_chunk(chunk);
+			}
+			chunks_.clear();
+
+			chunk_size_ = total_size;
+			chunks_.push_back(allocator_->allocate_linear_chunk(memory_type_index_, chunk_size_));
+		}
+
+		offset_ = 0;
+		used_bytes_ = 0;
+	}
+
+	VkDeviceSize high_water_mark() const
+	{
+		return high_water_mark_;
+	}
+
+private:
+	gpu_memory_allocator* allocator_ = nullptr;
+	uint32_t memory_type_index_ = 0;
+	VkDeviceSize chunk_size_ = 0;
+	VkDeviceSize offset_ = 0;
+	VkDeviceSize used_bytes_ = 0;
+	VkDeviceSize high_water_mark_ = 0;
+	std::vector<gpu_allocation> chunks_;
+
+	static VkDeviceSize align_up(const VkDeviceSize value, const VkDeviceSize alignment)
+	{
+		return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+	}
+};
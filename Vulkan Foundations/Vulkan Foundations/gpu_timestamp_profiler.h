@@ -0,0 +1,330 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//	***********************************************
+//	******** GPU PROFILER GLOBAL VARIABLES ********
+//	***********************************************
+
+const uint32_t MAX_GPU_TIMESTAMP_SCOPES = 32; // Per frame, every scope uses two queries
+const uint32_t GPU_TIMESTAMP_HISTORY_SIZE = 256; // Default number of samples kept per scope for the rolling statistics
+const uint32_t INVALID_GPU_TIMESTAMP_SCOPE = UINT32_MAX;
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * Rolling statistics of one labeled scope over the last history_size() frames, in milliseconds
+ */
+struct gpu_scope_statistics
+{
+	std::string label;
+	double last_ms = 0.0;
+	double min_ms = 0.0;
+	double avg_ms = 0.0;
+	double p99_ms = 0.0;
+	uint32_t sample_count = 0;
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Measures GPU time of labeled scopes with timestamp queries. Every frame in flight owns a query pool, which is only read back
+ * in begin_frame() after the frame is done on the GPU, so vkGetQueryPoolResults never waits on the GPU.
+ * Not thread safe: scopes are written from the thread recording the primary command buffer
+ */
+class gpu_timestamp_profiler
+{
+public:
+	/**
+	 * queue_family_index is the family the timed command buffers are submitted to. Profiling turns itself off
+	 * when that family doesn't support timestamps
+	 */
+	void init(const VkPhysicalDevice physical_device, const VkDevice device, const uint32_t queue_family_index, const uint32_t frame_count)
+	{
+		device_ = device;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physical_device, &properties);
+		timestamp_period_ns_ = static_cast<double>(properties.limits.timestampPeriod);
+
+		uint32_t queue_family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+		std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+		const uint32_t valid_bits = queue_family_index < queue_family_count ? queue_families[queue_family_index].timestampValidBits : 0;
+		if (valid_bits == 0 || timestamp_period_ns_ <= 0.0)
+		{
+			std::cout << "Timestamp queries are not supported on this queue, GPU profiling is disabled" << std::endl;
+			return;
+		}
+		timestamp_mask_ = valid_bits >= 64 ? UINT64_MAX : (uint64_t(1) << valid_bits) - 1;
+
+		VkQueryPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		pool_info.queryCount = MAX_GPU_TIMESTAMP_SCOPES * 2;
+
+		frames_.resize(frame_count);
+		for (auto& frame : frames_)
+		{
+			if (vkCreateQueryPool(device_, &pool_info, nullptr, &frame.query_pool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create timestamp query pool!");
+			}
+		}
+	}
+
+	void destroy()
+	{
+		for (auto& frame : frames_)
+		{
+			vkDestroyQueryPool(device_, frame.query_pool, nullptr);
+		}
+		frames_.clear();
+		scopes_.clear();
+	}
+
+	bool is_enabled() const
+	{
+		return !frames_.empty();
+	}
+
+	/**
+	 * Collect the timestamps this frame slot wrote the last time it was used and reset its queries.
+	 * Must be recorded outside of a render pass, once the previous frame of the slot has been waited on
+	 */
+	void begin_frame(const VkCommandBuffer command_buffer, const uint32_t frame_index)
+	{
+		if (!is_enabled())
+		{
+			return;
+		}
+
+		current_frame_ = frame_index;
+		frame_queries& frame = frames_[current_frame_];
+		collect_results(frame);
+
+		vkCmdResetQueryPool(command_buffer, frame.query_pool, 0, MAX_GPU_TIMESTAMP_SCOPES * 2);
+		frame.written_scopes.clear();
+	}
+
+	/**
+	 * Collect the timestamps of a frame slot outside of begin_frame(), e.g. for the frames still in flight at the end of a run.
+	 * The frame must be done on the GPU
+	 */
+	void collect_frame(const uint32_t frame_index)
+	{
+		if (!is_enabled())
+		{
+			return;
+		}
+
+		frame_queries& frame = frames_[frame_index];
+		collect_results(frame);
+		frame.written_scopes.clear();
+	}
+
+	/**
+	 * Write the starting timestamp of a labeled scope. Returns the handle to give to end_scope()
+	 */
+	uint32_t begin_scope(const VkCommandBuffer command_buffer, const char* label,
+		const VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT)
+	{
+		if (!is_enabled())
+		{
+			return INVALID_GPU_TIMESTAMP_SCOPE;
+		}
+
+		frame_queries& frame = frames_[current_frame_];
+		if (frame.written_scopes.size() == MAX_GPU_TIMESTAMP_SCOPES)
+		{
+			return INVALID_GPU_TIMESTAMP_SCOPE;
+		}
+
+		const uint32_t scope = static_cast<uint32_t>(frame.written_scopes.size());
+		frame.written_scopes.push_back(find_or_add_scope(label));
+		vkCmdWriteTimestamp(command_buffer, stage, frame.query_pool, scope * 2);
+		return scope;
+	}
+
+	void end_scope(const VkCommandBuffer command_buffer, const uint32_t scope,
+		const VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT)
+	{
+		if (scope == INVALID_GPU_TIMESTAMP_SCOPE)
+		{
+			return;
+		}
+
+		vkCmdWriteTimestamp(command_buffer, stage, frames_[current_frame_].query_pool, scope * 2 + 1);
+	}
+
+	/**
+	 * Drop the samples collected so far and keep the last history_size ones from now on, e.g. every measured frame of a benchmark
+	 */
+	void reset_statistics(const uint32_t history_size = GPU_TIMESTAMP_HISTORY_SIZE)
+	{
+		history_size_ = std::max(history_size, 1u);
+		for (auto& scope : scopes_)
+		{
+			scope.samples_ms.assign(history_size_, 0.0);
+			scope.next_sample = 0;
+			scope.sample_count = 0;
+		}
+
+		// Timestamps of frames still in flight belong to the old samples
+		for (auto& frame : frames_)
+		{
+			frame.written_scopes.clear();
+		}
+	}
+
+	uint32_t history_size() const
+	{
+		return history_size_;
+	}
+
+	std::vector<gpu_scope_statistics> get_statistics() const
+	{
+		std::vector<gpu_scope_statistics> statistics;
+		statistics.reserve(scopes_.size());
+
+		std::vector<double> sorted;
+		for (const auto& scope : scopes_)
+		{
+			gpu_scope_statistics scope_statistics;
+			scope_statistics.label = scope.label;
+			scope_statistics.sample_count = scope.sample_count;
+
+			if (scope.sample_count > 0)
+			{
+				sorted.assign(scope.samples_ms.begin(), scope.samples_ms.begin() + scope.sample_count);
+				std::sort(sorted.begin(), sorted.end());
+
+				double total = 0.0;
+				for (const double sample : sorted)
+				{
+					total += sample;
+				}
+
+				scope_statistics.last_ms = scope.samples_ms[(scope.next_sample + history_size_ - 1) % history_size_];
+				scope_statistics.min_ms = sorted.front();
+				scope_statistics.avg_ms = total / sorted.size();
+				scope_statistics.p99_ms = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+			}
+
+			statistics.push_back(scope_statistics);
+		}
+
+		return statistics;
+	}
+
+	void print_statistics() const
+	{
+		if (!is_enabled())
+		{
+			return;
+		}
+
+		const std::ios::fmtflags flags = std::cout.flags();
+		const std::streamsize precision = std::cout.precision();
+
+		std::cout << "GPU timings (ms, last " << history_size_ << " frames):" << std::endl;
+		for (const auto& scope : get_statistics())
+		{
+			std::cout << "\t" << scope.label << std::fixed << std::setprecision(3)
+				<< ": min " << scope.min_ms << " avg " << scope.avg_ms << " p99 " << scope.p99_ms << std::endl;
+		}
+
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+	}
+
+private:
+	struct frame_queries
+	{
+		VkQueryPool query_pool = VK_NULL_HANDLE;
+		std::vector<uint32_t> written_scopes; // Index in scopes_ of every scope written in the frame, in query order
+	};
+
+	struct scope_history
+	{
+		std::string label;
+		std::vector<double> samples_ms;
+		uint32_t next_sample = 0;
+		uint32_t sample_count = 0;
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	double timestamp_period_ns_ = 0.0; // Nanoseconds per timestamp tick
+	uint64_t timestamp_mask_ = UINT64_MAX; // Only timestampValidBits of a timestamp are meaningful
+	std::vector<frame_queries> frames_;
+	std::vector<scope_history> scopes_;
+	uint32_t current_frame_ = 0;
+	uint32_t history_size_ = GPU_TIMESTAMP_HISTORY_SIZE;
+
+	uint32_t find_or_add_scope(const char* label)
+	{
+		for (uint32_t i = 0; i < scopes_.size(); i++)
+		{
+			if (scopes_[i].label == label)
+			{
+				return i;
+			}
+		}
+
+		scopes_.push_back({});
+		scopes_.back().label = label;
+		scopes_.back().samples_ms.resize(history_size_);
+		return static_cast<uint32_t>(scopes_.size() - 1);
+	}
+
+	void collect_results(const frame_queries& frame)
+	{
+		if (frame.written_scopes.empty())
+		{
+			return;
+		}
+
+		// One (timestamp, availability) pair per query. Without VK_QUERY_RESULT_WAIT_BIT the call returns VK_NOT_READY
+		// instead of blocking when a query is not available yet, which only happens if the frame was never submitted
+		const uint32_t query_count = static_cast<uint32_t>(frame.written_scopes.size()) * 2;
+		std::array<uint64_t, MAX_GPU_TIMESTAMP_SCOPES * 4> results;
+		const VkResult result = vkGetQueryPoolResults(device_, frame.query_pool, 0, query_count, query_count * 2 * sizeof(uint64_t),
+			results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		if (result != VK_SUCCESS && result != VK_NOT_READY)
+		{
+			throw std::runtime_error("Failed to read timestamp queries!");
+		}
+
+		for (size_t scope = 0; scope < frame.written_scopes.size(); scope++)
+		{
+			const uint64_t* begin = &results[scope * 4];
+			const uint64_t* end = begin + 2;
+			if (begin[1] == 0 || end[1] == 0)
+			{
+				continue;
+			}
+
+			const uint64_t ticks = (end[0] - begin[0]) & timestamp_mask_;
+			scope_history& history = scopes_[frame.written_scopes[scope]];
+			history.samples_ms[history.next_sample] = static_cast<double>(ticks) * timestamp_period_ns_ / 1e6;
+			history.next_sample = (history.next_sample + 1) % history_size_;
+			history.sample_count = std::min(history.sample_count + 1, history_size_);
+		}
+	}
+};
@@ -0,0 +1,297 @@
+#pragma once
+
+#include "gpu_memory_allocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+//	*********************************************
+//	******** INSTANCING GLOBAL VARIABLES ********
+//	*********************************************
+
+const uint32_t MAX_INSTANCE_CAPACITY = 1 << 20; // 36 mb of instance data per frame in flight
+const VkDeviceSize INSTANCE_STREAM_ALIGNMENT = 16; // Every stream starts on a vec4 boundary of the buffer
+const uint32_t INSTANCE_STREAM_COUNT = 3; // Transforms, colors and material indices
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * 2D placement of an instance: the mesh is scaled, rotated by rotation radians, then moved by offset
+ */
+struct instance_transform
+{
+	float offset[2] = { 0.0f, 0.0f };
+	float scale = 1.0f;
+	float rotation = 0.0f;
+};
+
+/**
+ * Tint multiplied with the vertex colors
+ */
+struct instance_color
+{
+	float rgba[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Per-instance data stored as a structure of arrays: the transforms, the colors and the material indices are packed in their own
+ * vertex stream, so a pass that only changes transforms writes nothing else and the vertex fetch of each attribute stays dense.
+ * Every frame in flight owns a copy of the streams in host visible memory, device local when the device exposes such memory.
+ * The setters only record dirty ranges, update() copies the ranges a frame slot is missing right before the slot is recorded
+ */
+class instance_buffer
+{
+public:
+	/**
+	 * With two or more sharing_families the copies are VK_SHARING_MODE_CONCURRENT, for queues of other families reading them
+	 */
+	void init(gpu_memory_allocator& allocator, const uint32_t capacity, const uint32_t frame_count,
+		const std::vector<uint32_t>& sharing_families = {})
+	{
+		if (capacity == 0 || capacity > MAX_INSTANCE_CAPACITY)
+		{
+			throw std::runtime_error("Invalid instance buffer capacity!");
+		}
+
+		allocator_ = &allocator;
+		capacity_ = capacity;
+
+		transforms_.resize(capacity_);
+		colors_.resize(capacity_);
+		materials_.resize(capacity_, 0);
+
+		VkDeviceSize buffer_size = 0;
+		for (uint32_t stream = 0; stream < INSTANCE_STREAM_COUNT; stream++)
+		{
+			stream_offsets_[stream] = buffer_size;
+			buffer_size = align_up(buffer_size + STREAM_STRIDES[stream] * capacity_, INSTANCE_STREAM_ALIGNMENT);
+		}
+
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = buffer_size;
+		buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT; // Storage for the GPU culling pass
+		buffer_info.sharingMode = sharing_families.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		buffer_info.queueFamilyIndexCount = sharing_families.size() > 1 ? static_cast<uint32_t>(sharing_families.size()) : 0;
+		buffer_info.pQueueFamilyIndices = sharing_families.data();
+
+		frames_.resize(frame_count);
+		for (auto& frame : frames_)
+		{
+			if (vkCreateBuffer(allocator_->device(), &buffer_info, nullptr, &frame.buffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create instance buffer!");
+			}
+			// Written by the CPU every frame and read once per vertex by the GPU, device local host visible memory avoids a copy
+			frame.allocation = allocator_->allocate_for_buffer(frame.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		}
+
+		// Every slot starts with the whole content to write
+		for (uint32_t stream = 0; stream < INSTANCE_STREAM_COUNT; stream++)
+		{
+			pending_[stream].add(0, capacity_);
+		}
+	}
+
+	void destroy()
+	{
+		for (auto& frame : frames_)
+		{
+			vkDestroyBuffer(allocator_->device(), frame.buffer, nullptr);
+			allocator_->free(frame.allocation);
+		}
+		frames_.clear();
+	}
+
+	uint32_t capacity() const
+	{
+		return capacity_;
+	}
+
+	/**
+	 * Transform stream of a frame slot, as a buffer range for the passes reading the transforms from a storage buffer
+	 */
+	VkDescriptorBufferInfo transform_stream(const uint32_t frame_index) const
+	{
+		VkDescriptorBufferInfo buffer_info{};
+		buffer_info.buffer = frames_[frame_index].buffer;
+		buffer_info.offset = stream_offsets_[TRANSFORM_STREAM];
+		buffer_info.range = STREAM_STRIDES[TRANSFORM_STREAM] * capacity_;
+
+		return buffer_info;
+	}
+
+	const instance_transform& transform(const uint32_t instance) const
+	{
+		return transforms_[instance];
+	}
+
+	void set_transform(const uint32_t instance, const instance_transform& transform)
+	{
+		transforms_[instance] = transform;
+		pending_[TRANSFORM_STREAM].add(instance, instance + 1);
+	}
+
+	void set_color(const uint32_t instance, const instance_color& color)
+	{
+		colors_[instance] = color;
+		pending_[COLOR_STREAM].add(instance, instance + 1);
+	}
+
+	void set_material(const uint32_t instance, const uint32_t material_index)
+	{
+		materials_[instance] = material_index;
+		pending_[MATERIAL_STREAM].add(instance, instance + 1);
+	}
+
+	/**
+	 * Bring the copy of a frame slot up to date. The previous frame of the slot must be done, the GPU stopped reading that copy
+	 */
+	void update(const uint32_t frame_index)
+	{
+		for (uint32_t stream = 0; stream < INSTANCE_STREAM_COUNT; stream++)
+		{
+			// Ranges dirtied since the last update are missing from every slot, each slot catches up the next time it is recorded
+			if (!pending_[stream].is_empty())
+			{
+				for (auto& frame : frames_)
+				{
+					frame.dirty[stream].add(pending_[stream].begin, pending_[stream].end);
+				}
+				pending_[stream] = dirty_range{};
+			}
+
+			frame_copy& frame = frames_[frame_index];
+			dirty_range& dirty = frame.dirty[stream];
+			if (dirty.is_empty())
+			{
+				continue;
+			}
+
+			const VkDeviceSize source_offset = STREAM_STRIDES[stream] * dirty.begin;
+			const VkDeviceSize offset = stream_offsets_[stream] + source_offset;
+			const VkDeviceSize size = STREAM_STRIDES[stream] * (dirty.end - dirty.begin);
+			std::memcpy(static_cast<uint8_t*>(frame.allocation.mapped) + offset, stream_data(stream) + source_offset, static_cast<size_t>(size));
+			allocator_->flush(frame.allocation, offset, size);
+
+			dirty = dirty_range{};
+		}
+	}
+
+	/**
+	 * Bind the streams of a frame slot to first_binding and the two following bindings
+	 */
+	void bind(const VkCommandBuffer command_buffer, const uint32_t frame_index, const uint32_t first_binding) const
+	{
+		const std::array<VkBuffer, INSTANCE_STREAM_COUNT> buffers = { frames_[frame_index].buffer, frames_[frame_index].buffer, frames_[frame_index].buffer };
+		vkCmdBindVertexBuffers(command_buffer, first_binding, INSTANCE_STREAM_COUNT, buffers.data(), stream_offsets_.data());
+	}
+
+	static std::array<VkVertexInputBindingDescription, INSTANCE_STREAM_COUNT> get_binding_descriptions(const uint32_t first_binding)
+	{
+		std::array<VkVertexInputBindingDescription, INSTANCE_STREAM_COUNT> binding_descriptions{};
+		for (uint32_t stream = 0; stream < INSTANCE_STREAM_COUNT; stream++)
+		{
+			binding_descriptions[stream].binding = first_binding + stream;
+			binding_descriptions[stream].stride = static_cast<uint32_t>(STREAM_STRIDES[stream]);
+			binding_descriptions[stream].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+		}
+
+		return binding_descriptions;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, INSTANCE_STREAM_COUNT> get_attribute_descriptions(const uint32_t first_binding,
+		const uint32_t first_location)
+	{
+		const std::array<VkFormat, INSTANCE_STREAM_COUNT> formats = { VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32_UINT };
+
+		std::array<VkVertexInputAttributeDescription, INSTANCE_STREAM_COUNT> attribute_descriptions{};
+		for (uint32_t stream = 0; stream < INSTANCE_STREAM_COUNT; stream++)
+		{
+			attribute_descriptions[stream].binding = first_binding + stream;
+			attribute_descriptions[stream].location = first_location + stream;
+			attribute_descriptions[stream].format = formats[stream];
+			attribute_descriptions[stream].offset = 0;
+		}
+
+		return attribute_descriptions;
+	}
+
+private:
+	enum stream_index : uint32_t
+	{
+		TRANSFORM_STREAM,
+		COLOR_STREAM,
+		MATERIAL_STREAM
+	};
+
+	static constexpr std::array<VkDeviceSize, INSTANCE_STREAM_COUNT> STREAM_STRIDES = {
+		sizeof(instance_transform), sizeof(instance_color), sizeof(uint32_t)
+	};
+
+	/**
+	 * Half open range of instances, a single range per stream keeps the update to one memcpy and one flush
+	 */
+	struct dirty_range
+	{
+		uint32_t begin = UINT32_MAX;
+		uint32_t end = 0;
+
+		bool is_empty() const
+		{
+			return begin >= end;
+		}
+
+		void add(const uint32_t range_begin, const uint32_t range_end)
+		{
+			begin = std::min(begin, range_begin);
+			end = std::max(end, range_end);
+		}
+	};
+
+	struct frame_copy
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		gpu_allocation allocation;
+		std::array<dirty_range, INSTANCE_STREAM_COUNT> dirty;
+	};
+
+	gpu_memory_allocator* allocator_ = nullptr;
+	uint32_t capacity_ = 0;
+
+	std::vector<instance_transform> transforms_;
+	std::vector<instance_color> colors_;
+	std::vector<uint32_t> materials_;
+
+	std::array<VkDeviceSize, INSTANCE_STREAM_COUNT> stream_offsets_{}; // Byte offset of every stream in the buffers
+	std::array<dirty_range, INSTANCE_STREAM_COUNT> pending_; // Dirtied since the last update()
+	std::vector<frame_copy> frames_;
+
+	const uint8_t* stream_data(const uint32_t stream) const
+	{
+		switch (stream)
+		{
+		case TRANSFORM_STREAM: return reinterpret_cast<const uint8_t*>(transforms_.data());
+		case COLOR_STREAM: return reinterpret_cast<const uint8_t*>(colors_.data());
+		default: return reinterpret_cast<const uint8_t*>(materials_.data());
+		}
+	}
+
+	static VkDeviceSize align_up(const VkDeviceSize value, const VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+};
@@ -0,0 +1,666 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//	*********************************************
+//	******** JOB SYSTEM GLOBAL VARIABLES ********
+//	*********************************************
+
+const uint32_t MAX_BACKGROUND_WORKERS = 4; // Background jobs running at once, the other workers stay free for the jobs of the frame
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+enum class job_priority
+{
+	frame, // Waited on while the frame is built: work-stealing deques, waiting threads help with them
+	background // Long and not waited on by the frame, like pipeline compiles. Only idle workers take them, a few at a time
+};
+
+/**
+ * Counters of one worker since the last reset_statistics(). Worker 0 is every thread that is not a worker, normally the render thread
+ */
+struct job_worker_statistics
+{
+	uint64_t jobs_run = 0;
+	uint64_t jobs_stolen = 0; // Frame jobs taken from the deque of another worker
+	uint64_t background_jobs = 0;
+	double busy_ms = 0.0; // Spent inside jobs
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Completion counter of a group of jobs, given to job_system::submit() and waited on with job_system::wait(). The first exception
+ * thrown by one of its jobs is kept and rethrown by the wait. Must outlive its jobs
+ */
+class job_counter
+{
+public:
+	bool is_done() const
+	{
+		return pending_.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class job_system;
+
+	std::atomic<uint32_t> pending_{ 0 };
+	std::mutex exception_mutex_;
+	std::exception_ptr first_exception_;
+};
+
+/**
+ * Work-stealing scheduler shared by everything that runs in parallel, so subsystems going wide at the same time share one set of
+ * threads instead of oversubscribing the cores. Every worker owns a deque of frame jobs: it pushes and pops at the back, so a job
+ * and the continuations it submits run hot in the same cache, and idle workers steal from the front of the others. Background jobs
+ * wait in a shared queue that only idle workers look at, at most MAX_BACKGROUND_WORKERS at once, so a long compile never delays the
+ * frame. The thread that created the system counts as worker 0 and only runs jobs while it waits, a system of N workers owns
+ * N - 1 threads. With no thread at all, background jobs run inline in submit()
+ */
+class job_system
+{
+public:
+	explicit job_system(const uint32_t worker_count)
+	{
+		const uint32_t thread_count = std::max(worker_count, 1u) - 1;
+		max_background_ = std::clamp(thread_count / 2, 1u, MAX_BACKGROUND_WORKERS);
+		statistics_start_ = std::chrono::steady_clock::now();
+
+		for (uint32_t worker_index = 0; worker_index <= thread_count; worker_index++)
+		{
+			workers_.push_back(std::make_unique<worker>());
+		}
+		threads_.reserve(thread_count);
+		for (uint32_t worker_index = 1; worker_index <= thread_count; worker_index++)
+		{
+			threads_.emplace_back([this, worker_index] { worker_loop(worker_index); });
+		}
+	}
+
+	/**
+	 * Every frame job must have been waited on. Background jobs that did not start are dropped
+	 */
+	~job_system()
+	{
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+			stopping_ = true;
+		}
+		wake_.notify_all();
+
+		for (auto& thread : threads_)
+		{
+			thread.join();
+		}
+	}
+
+	job_system(const job_system&) = delete;
+	job_system& operator=(const job_system&) = delete;
+
+	uint32_t worker_count() const
+	{
+		return static_cast<uint32_t>(workers_.size());
+	}
+
+	/**
+	 * Index of the calling worker, 0 on any thread that is not one of the workers
+	 */
+	uint32_t worker_index() const
+	{
+		const current_worker& current = current_thread();
+		return current.system == this ? current.index : 0;
+	}
+
+	/**
+	 * Queue function, counter (optional) counts it until it returned. A frame job goes to the deque of the calling worker. An empty
+	 * function is counted and skipped, it never reaches a worker as std::bad_function_call
+	 */
+	void submit(std::function<void()> function, job_counter* counter = nullptr, const job_priority priority = job_priority::frame)
+	{
+		if (counter != nullptr)
+		{
+			counter->pending_.fetch_add(1, std::memory_order_relaxed);
+		}
+		job new_job{ std::move(function), counter };
+
+		if (priority == job_priority::background)
+		{
+			if (threads_.empty())
+			{
+				run(new_job, 0, true);
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(wake_mutex_);
+				background_jobs_.push_back(std::move(new_job));
+			}
+			wake_.notify_all(); // One notify could land on a waiting thread, which never takes background jobs
+			return;
+		}
+
+		worker& own = *workers_[worker_index()];
+		{
+			std::lock_guard<std::mutex> lock(own.mutex);
+			own.jobs.push_back(std::move(new_job));
+		}
+		{
+			// Counted under the mutex the sleepers check it with, so no wake-up is lost
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+			queued_frame_jobs_.fetch_add(1, std::memory_order_relaxed);
+		}
+		wake_.notify_one();
+	}
+
+	/**
+	 * Run frame jobs until every job of counter is done, then rethrow the first exception one of them threw
+	 */
+	void wait(job_counter& counter)
+	{
+		const uint32_t index = worker_index();
+
+		while (!counter.is_done())
+		{
+			job next;
+			bool stolen = false;
+			if (take_frame_job(index, next, stolen))
+			{
+				run(next, index, false, stolen);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			wake_.wait(lock, [&] { return counter.is_done() || queued_frame_jobs_.load(std::memory_order_relaxed) > 0; });
+		}
+
+		std::exception_ptr exception;
+		{
+			std::lock_guard<std::mutex> lock(counter.exception_mutex_);
+			exception = std::exchange(counter.first_exception_, nullptr);
+		}
+		if (exception)
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+
+	/**
+	 * Run task(task_index) for every index in [0, task_count) across the workers and return once all of them are done.
+	 * Every task index runs exactly once on exactly one thread, which makes it safe to give each task index its own externally
+	 * synchronized Vulkan object, such as a command pool. The first exception thrown by a task is rethrown here
+	 */
+	void parallel_for(const uint32_t task_count, const std::function<void(uint32_t)>& task)
+	{
+		if (task_count == 1 || threads_.empty())
+		{
+			for (uint32_t task_index = 0; task_index < task_count; task_index++)
+			{
+				task(task_index);
+			}
+			return;
+		}
+
+		job_counter counter;
+		for (uint32_t task_index = 0; task_index < task_count; task_index++)
+		{
+			submit([&task, task_index] { task(task_index); }, &counter);
+		}
+		wait(counter);
+	}
+
+	std::vector<job_worker_statistics> statistics() const
+	{
+		std::vector<job_worker_statistics> statistics;
+		statistics.reserve(workers_.size());
+		for (const auto& worker : workers_)
+		{
+			job_worker_statistics worker_statistics;
+			worker_statistics.jobs_run = worker->jobs_run.load(std::memory_order_relaxed);
+			worker_statistics.jobs_stolen = worker->jobs_stolen.load(std::memory_order_relaxed);
+			worker_statistics.background_jobs = worker->background_jobs.load(std::memory_order_relaxed);
+			worker_statistics.busy_ms = worker->busy_ns.load(std::memory_order_relaxed) / 1e6;
+			statistics.push_back(worker_statistics);
+		}
+
+		return statistics;
+	}
+
+	void reset_statistics()
+	{
+		for (auto& worker : workers_)
+		{
+			worker->jobs_run.store(0, std::memory_order_relaxed);
+			worker->jobs_stolen.store(0, std::memory_order_relaxed);
+			worker->background_jobs.store(0, std::memory_order_relaxed);
+			worker->busy_ns.store(0, std::memory_order_relaxed);
+		}
+		statistics_start_ = std::chrono::steady_clock::now();
+	}
+
+	/**
+	 * One line per worker covering the time since the last call, then resets the counters
+	 */
+	void print_statistics()
+	{
+		const double interval_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - statistics_start_).count();
+		const std::vector<job_worker_statistics> statistics = this->statistics();
+
+		const std::ios::fmtflags flags = std::cout.flags();
+		const std::streamsize precision = std::cout.precision();
+
+		std::cout << "Job workers:" << std::endl;
+		std::cout << std::fixed << std::setprecision(1);
+		for (size_t worker_index = 0; worker_index < statistics.size(); worker_index++)
+		{
+			const job_worker_statistics& worker = statistics[worker_index];
+			std::cout << "\tworker " << worker_index << ": " << worker.jobs_run << " jobs, " << worker.jobs_stolen << " stolen, "
+				<< worker.background_jobs << " background, busy " << (interval_ms > 0.0 ? 100.0 * worker.busy_ms / interval_ms : 0.0) << "%" << std::endl;
+		}
+
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+		reset_statistics();
+	}
+
+private:
+	struct job
+	{
+		std::function<void()> function;
+		job_counter* counter = nullptr;
+	};
+
+	/**
+	 * Jobs taken from both ends of one ring that only grows, a steady state of pushes and pops never allocates, unlike the blocks
+	 * of a std::deque
+	 */
+	class job_ring
+	{
+	public:
+		bool empty() const
+		{
+			return count_ == 0;
+		}
+
+		void push_back(job&& new_job)
+		{
+			if (count_ == jobs_.size())
+			{
+				grow();
+			}
+			jobs_[(front_ + count_) % jobs_.size()] = std::move(new_job);
+			count_++;
+		}
+
+		job pop_back()
+		{
+			count_--;
+			return std::move(jobs_[(front_ + count_) % jobs_.size()]);
+		}
+
+		job pop_front()
+		{
+			job front = std::move(jobs_[front_]);
+			front_ = (front_ + 1) % jobs_.size();
+			count_--;
+
+			return front;
+		}
+
+	private:
+		std::vector<job> jobs_;
+		size_t front_ = 0;
+		size_t count_ = 0;
+
+		void grow()
+		{
+			std::vector<job> grown(std::max<size_t>(jobs_.size() * 2, 64));
+			for (size_t i = 0; i < count_; i++)
+			{
+				grown[i] = std::move(jobs_[(front_ + i) % jobs_.size()]);
+			}
+			jobs_ = std::move(grown);
+			front_ = 0;
+		}
+	};
+
+	// Own cache lines, the deque of one worker is locked by the thieves while the counters of its neighbour are written
+	struct alignas(64) worker
+	{
+		std::mutex mutex;
+		job_ring jobs; // The owner works at the back, thieves take from the front
+		std::atomic<uint64_t> jobs_run{ 0 };
+		std::atomic<uint64_t> jobs_stolen{ 0 };
+		std::atomic<uint64_t> background_jobs{ 0 };
+		std::atomic<uint64_t> busy_ns{ 0 };
+	};
+
+	struct current_worker
+	{
+		const job_system* system = nullptr;
+		uint32_t index = 0;
+	};
+
+	std::vector<std::unique_ptr<worker>> workers_; // Indexed by worker, 0 is the threads that are not workers
+	std::vector<std::thread> threads_; // Of workers 1 to N - 1
+
+	std::mutex wake_mutex_;
+	std::condition_variable wake_; // Sleeping workers and waiting threads, on new jobs and on finished counters
+	std::atomic<int32_t> queued_frame_jobs_{ 0 }; // Can briefly lag behind the deques, never ahead of them
+	job_ring background_jobs_; // Guarded by wake_mutex_
+	uint32_t running_background_ = 0; // Guarded by wake_mutex_
+	uint32_t max_background_ = 1;
+	bool stopping_ = false;
+	std::chrono::steady_clock::time_point statistics_start_;
+
+	static current_worker& current_thread()
+	{
+		static thread_local current_worker current;
+		return current;
+	}
+
+	void worker_loop(const uint32_t index)
+	{
+		current_thread() = { this, index };
+
+		for (;;)
+		{
+			job next;
+			bool stolen = false;
+			if (take_frame_job(index, next, stolen))
+			{
+				run(next, index, false, stolen);
+				continue;
+			}
+			if (take_background_job(next))
+			{
+				run(next, index, true);
+				finish_background_job();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			wake_.wait(lock, [this]
+				{
+					return stopping_ || queued_frame_jobs_.load(std::memory_order_relaxed) > 0 ||
+						(!background_jobs_.empty() && running_background_ < max_background_);
+				});
+			if (stopping_)
+			{
+				return;
+			}
+		}
+	}
+
+	/**
+	 * Newest job of the own deque, otherwise the oldest job of the first other worker that has one
+	 */
+	bool take_frame_job(const uint32_t index, job& next, bool& stolen)
+	{
+		const uint32_t worker_count = static_cast<uint32_t>(workers_.size());
+
+		for (uint32_t offset = 0; offset < worker_count; offset++)
+		{
+			worker& victim = *workers_[(index + offset) % worker_count];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (victim.jobs.empty())
+			{
+				continue;
+			}
+
+			next = offset == 0 ? victim.jobs.pop_back() : victim.jobs.pop_front();
+			queued_frame_jobs_.fetch_sub(1, std::memory_order_relaxed);
+			stolen = offset != 0;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool take_background_job(job& next)
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		if (background_jobs_.empty() || running_background_ >= max_background_)
+		{
+			return false;
+		}
+
+		next = background_jobs_.pop_front();
+		running_background_++;
+		return true;
+	}
+
+	void finish_background_job()
+	{
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+			running_background_--;
+		}
+		wake_.notify_all(); // The next queued background job can start on any idle worker
+	}
+
+	void run(job& current, const uint32_t index, const bool background, const bool stolen = false)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		try
+		{
+			if (current.function)
+			{
+				current.function();
+			}
+		}
+		catch (...)
+		{
+			if (current.counter != nullptr)
+			{
+				std::lock_guard<std::mutex> lock(current.counter->exception_mutex_);
+				if (!current.counter->first_exception_)
+				{
+					current.counter->first_exception_ = std::current_exception();
+				}
+			}
+			else
+			{
+				std::cerr << "Job without a counter threw, the exception is dropped" << std::endl;
+			}
+		}
+		current.function = nullptr; // Release the captures before the counter says the job is done
+
+		worker& own = *workers_[index];
+		own.jobs_run.fetch_add(1, std::memory_order_relaxed);
+		own.jobs_stolen.fetch_add(stolen ? 1 : 0, std::memory_order_relaxed);
+		own.background_jobs.fetch_add(background ? 1 : 0, std::memory_order_relaxed);
+		own.busy_ns.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()),
+			std::memory_order_relaxed);
+
+		// The counter may be gone as soon as it reaches zero, it is not touched after the decrement
+		if (current.counter != nullptr && current.counter->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+			wake_.notify_all();
+		}
+	}
+};
+
+/**
+ * Dependency graph of jobs, rebuilt every frame over the nodes of the last build and run once. run() submits the tasks without predecessors, and a finished task
+ * submits the successors it was the last predecessor of onto its own deque, so a chain of tasks stays on one worker unless someone
+ * steals it. A task that threw releases none of its successors, run() rethrows the first exception once the rest is done
+ */
+class task_graph
+{
+public:
+	using task_id = uint32_t;
+
+	/**
+	 * Reuses the node of an earlier build when there is one. A function capturing no more than two pointers fits the small buffer of
+	 * std::function, the graph a frame rebuilds with the same shape then never allocates
+	 */
+	task_id add(std::function<void()> function)
+	{
+		if (node_count_ == nodes_.size())
+		{
+			nodes_.emplace_back();
+		}
+		node& added = nodes_[node_count_];
+		added.function = std::move(function);
+		added.successors.clear();
+		added.predecessor_count = 0;
+
+		return static_cast<task_id>(node_count_++);
+	}
+
+	/**
+	 * after starts once before returned
+	 */
+	void precede(const task_id before, const task_id after)
+	{
+		nodes_[before].successors.push_back(after);
+		nodes_[after].predecessor_count++;
+	}
+
+	/**
+	 * Keeps the nodes for the next build
+	 */
+	void clear()
+	{
+		node_count_ = 0;
+	}
+
+	size_t size() const
+	{
+		return node_count_;
+	}
+
+	/**
+	 * Run every task on jobs and return once they are all done
+	 */
+	void run(job_system& jobs)
+	{
+		start(jobs);
+		wait();
+	}
+
+	/**
+	 * Submit the tasks and return right away, so the calling thread can do work of its own before wait(). The graph must not be
+	 * changed in between
+	 */
+	void start(job_system& jobs)
+	{
+		check_acyclic();
+
+		for (size_t task = 0; task < node_count_; task++)
+		{
+			nodes_[task].remaining_predecessors.store(nodes_[task].predecessor_count, std::memory_order_relaxed);
+		}
+
+		jobs_ = &jobs;
+		for (task_id task = 0; task < static_cast<task_id>(node_count_); task++)
+		{
+			if (nodes_[task].predecessor_count == 0)
+			{
+				submit(task);
+			}
+		}
+	}
+
+	/**
+	 * Run jobs until every task of the last start() is done, then rethrow the first exception one of them threw
+	 */
+	void wait()
+	{
+		jobs_->wait(counter_);
+	}
+
+private:
+	struct node
+	{
+		std::function<void()> function;
+		std::vector<task_id> successors;
+		uint32_t predecessor_count = 0;
+		std::atomic<uint32_t> remaining_predecessors{ 0 };
+	};
+
+	std::deque<node> nodes_; // A deque, growing it never moves the atomics. Past node_count_ they wait for the next build
+	size_t node_count_ = 0;
+	job_system* jobs_ = nullptr; // Of the current run(), so the jobs only capture the graph and a task
+	job_counter counter_;
+	std::vector<uint32_t> remaining_; // Scratch of check_acyclic()
+	std::vector<task_id> ready_;
+
+	void submit(const task_id task)
+	{
+		jobs_->submit([this, task]
+			{
+				node& current = nodes_[task];
+				if (current.function)
+				{
+					current.function();
+				}
+
+				// Submitted before this job is counted as done, so the counter never drops to zero early
+				for (const task_id successor : current.successors)
+				{
+					if (nodes_[successor].remaining_predecessors.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					{
+						submit(successor);
+					}
+				}
+			}, &counter_);
+	}
+
+	/**
+	 * Kahn's algorithm, a cycle would leave run() waiting forever
+	 */
+	void check_acyclic()
+	{
+		remaining_.resize(node_count_);
+		ready_.clear();
+		for (task_id task = 0; task < static_cast<task_id>(node_count_); task++)
+		{
+			remaining_[task] = nodes_[task].predecessor_count;
+			if (remaining_[task] == 0)
+			{
+				ready_.push_back(task);
+			}
+		}
+
+		size_t visited = 0;
+		while (!ready_.empty())
+		{
+			const task_id task = ready_.back();
+			ready_.pop_back();
+			visited++;
+			for (const task_id successor : nodes_[task].successors)
+			{
+				if (--remaining_[successor] == 0)
+				{
+					ready_.push_back(successor);
+				}
+			}
+		}
+
+		if (visited != node_count_)
+		{
+			throw std::runtime_error("Task graph has a cycle!");
+		}
+	}
+};
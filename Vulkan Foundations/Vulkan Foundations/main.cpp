@@ -1,19 +1,118 @@
 #define GLFW_INCLUDE_VULKAN // Load Vulkan Header
 #include <GLFW/glfw3.h> // GLFW definitions
 
+#include "gpu_memory_allocator.h"
+#include "job_system.h"
+#include "gpu_timestamp_profiler.h"
+#include "frame_statistics.h"
+#include "benchmark.h"
+#include "staging_uploader.h"
+#include "mesh.h"
+#include "mesh_file.h"
+#include "instance_buffer.h"
+#include "gpu_culling.h"
+#include "shader_module_cache.h"
+#include "embedded_shaders.h"
+#include "pipeline_registry.h"
+#include "uniform_ring.h"
+#include "bindless_descriptors.h"
+#include "frame_arena.h"
+#include "frame_graph.h"
+#include "timeline_semaphore.h"
+#include "async_compute.h"
+#include "deletion_queue.h"
+#include "debug_messenger.h"
+#include "texture_streamer.h"
+
 #include <iostream> // report and propagate errors
 #include <stdexcept> // report and propagate errors
 #include <fstream> 
 #include <algorithm>
 #include <vector>
+#include <array>
 #include <cstring>
 #include <cstdlib> // EXIT_SUCCESS and EXIT_FAILURE macros
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
+#include <string>
+#include <filesystem>
+#include <utility>
+#include <iterator>
+#include <chrono>
+#include <cmath>
+#include <cctype>
+
+//	***********************************************
+//	******** FRAME PACING GLOBAL VARIABLES ********
+//	***********************************************
+
+// Default number of frames the CPU may record ahead of the GPU, can be overridden with --frames-in-flight
+const uint32_t DEFAULT_MAX_FRAMES_IN_FLIGHT = 2;
+const uint32_t MAX_SUPPORTED_FRAMES_IN_FLIGHT = 8;
+
+// Low latency present policy: presents still waiting for the display when the next frame samples its input
+const uint64_t LOW_LATENCY_QUEUED_PRESENTS = 1;
+// Bounds vkWaitForPresentKHR, an occluded or minimized window may never display the present being waited on
+const uint64_t PRESENT_WAIT_TIMEOUT_NS = 100000000;
+
+//	****************************************************
+//	******** COMMAND RECORDING GLOBAL VARIABLES ********
+//	****************************************************
+
+const uint32_t MAX_RECORDING_WORKERS = 8; // Workers of the job system, which the recording, the pipeline compiles and the frame tasks share
+const uint32_t MIN_DRAWS_PER_RECORDING_WORKER = 64; // Below this, handing a slice to another thread costs more than recording it
+
+//	*********************************************
+//	******** INSTANCING GLOBAL VARIABLES ********
+//	*********************************************
+
+const uint32_t INSTANCE_FIRST_BINDING = 1; // Binding 0 is the mesh vertices
+const uint32_t INSTANCE_FIRST_LOCATION = 2; // Matches the instance inputs of shader.vert
+const float INSTANCE_ROTATION_PER_FRAME = 0.02f; // Radians, animation steps per frame so captures and benchmarks are reproducible
+const uint32_t ROTATE_INSTANCES_CONSTANT_ID = 0; // Specialization constant of shader.vert, only the animated instances are rotated
+
+//	*************************************************
+//	******** PIPELINE CACHE GLOBAL VARIABLES ********
+//	*************************************************
+
+const char* const DEFAULT_PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+const uint32_t PIPELINE_CACHE_FILE_MAGIC = 0x43505646; // "FVPC"
+const uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+//	*****************************************
+//	******** SHADER GLOBAL VARIABLES ********
+//	*****************************************
+
+const std::chrono::milliseconds SHADER_WATCH_INTERVAL(250); // Between two checks of the shader files with --watch-shaders
+
+//	********************************************
+//	******** PROFILING GLOBAL VARIABLES ********
+//	********************************************
+
+const std::chrono::seconds STATISTICS_REPORT_INTERVAL(1);
+
+//	************************************************
+//	******** RENDER TARGET GLOBAL VARIABLES ********
+//	************************************************
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// Tried in order, the first one the device supports as an optimal tiling depth attachment is used
+const std::array<VkFormat, 4> DEPTH_FORMAT_CANDIDATES = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT,
+	VK_FORMAT_D16_UNORM };
+const uint32_t MAX_MSAA_SAMPLES = 64;
+
+//	***************************************************
+//	******** DEVICE SELECTION GLOBAL VARIABLES ********
+//	***************************************************
+
+// Scores of rate_device_suitability(), dedicated video memory counts one point per mb on top of them
+const uint64_t DISCRETE_GPU_SCORE = 4096;
+const uint64_t INTEGRATED_GPU_SCORE = 1024;
+const uint64_t SHARED_MEMORY_SCORE_DIVISOR = 8; // Device local memory carved out of system memory is worth an eighth of dedicated memory
+const uint64_t DEDICATED_QUEUE_FAMILY_SCORE = 512; // Per dedicated transfer or compute family
+const uint64_t OPTIONAL_FEATURE_SCORE = 256; // Per optional feature the renderer takes advantage of
 
 //	*****************************************
 //	******** WINDOW GLOBAL VARIABLES ********
@@ -22,6 +121,14 @@ const int MAX_FRAMES_IN_FLIGHT = 2;
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+//	*******************************************
+//	******** HEADLESS GLOBAL VARIABLES ********
+//	*******************************************
+
+// Offscreen color target of the headless mode, widely supported as a color attachment and as a copy source
+const VkFormat HEADLESS_IMAGE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+const uint32_t HEADLESS_BYTES_PER_PIXEL = 4;
+
 //	***************************************************************
 //	******** VALIDATION LAYERS/EXTENSIONS GLOBAL VARIABLES ********
 //	***************************************************************
@@ -29,10 +136,11 @@ const uint32_t HEIGHT = 600;
 const std::vector<const char*> validation_layers = { "VK_LAYER_KHRONOS_validation" }; // the simplest one
 const std::vector<const char*> device_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
+// Default of the validation settings, VF_VALIDATION and --validation turn it on in a release build or off in a debug one
 #ifdef NDEBUG
-const bool enable_validation_layers = false;
+const bool enable_validation_layers_by_default = false;
 #else
-const bool enable_validation_layers = true;
+const bool enable_validation_layers_by_default = true;
 #endif
 
 //	*********************************
@@ -54,7 +162,8 @@ VkResult create_debug_utils_messenger_ext(const VkInstance instance, const VkDeb
 	}
 }
 
-void destroy_debug_utils_messenger_ext(const VkInstance instance, const VkDebugUtilsMessengerEXT debug_messenger, const VkAllocationCallbacks* p_allocator)
+VKAPI_ATTR void VKAPI_CALL destroy_debug_utils_messenger_ext(const VkInstance instance, const VkDebugUtilsMessengerEXT debug_messenger,
+	const VkAllocationCallbacks* p_allocator)
 {
 	const auto func = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(
 		instance, "vkDestroyDebugUtilsMessengerEXT"));
@@ -64,14 +173,32 @@ void destroy_debug_utils_messenger_ext(const VkInstance instance, const VkDebugU
 	}
 }
 
+using unique_debug_messenger = basic_unique_handle<VkInstance, VkDebugUtilsMessengerEXT, destroy_debug_utils_messenger_ext>;
+
 //	*************************
 //	******** STRUCTS ********
 //	*************************
 
+/**
+ * Destroys the window and terminates GLFW, the window is the only one and glfwInit() came right before it
+ */
+struct glfw_window_deleter
+{
+	void operator()(GLFWwindow* window) const
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+};
+
+using unique_glfw_window = std::unique_ptr<GLFWwindow, glfw_window_deleter>;
+
 struct queue_family_indices
 {
 	std::optional<uint32_t> graphics_family;
 	std::optional<uint32_t> present_family;
+	std::optional<uint32_t> transfer_family; // Dedicated transfer family when there is one, the graphics family otherwise
+	std::optional<uint32_t> compute_family; // Compute family without graphics when there is one, the graphics family otherwise
 
 	bool is_complete() const
 	{
@@ -79,6 +206,17 @@ struct queue_family_indices
 	}
 };
 
+/**
+ * What the swapchain is tuned for, picks the present mode and the image count. An explicit --present-mode still wins over the mode
+ */
+enum class present_policy
+{
+	balanced, // Mailbox when available, FIFO otherwise, one image above the minimum
+	low_latency, // Immediate or FIFO relaxed, the minimum image count and present wait pacing before input is sampled
+	throughput, // Mailbox or immediate with two images above the minimum, the GPU never waits on the display
+	power_saving // FIFO, rendering is capped at the refresh rate
+};
+
 struct swap_chain_support_details
 {
 	VkSurfaceCapabilitiesKHR capabilities;
@@ -86,799 +224,3272 @@ struct swap_chain_support_details
 	std::vector<VkPresentModeKHR> present_modes;
 };
 
-//	*************************
-//	******** CLASSES ********
-//	*************************
-
 /**
- * Class that holds Vulkan objects as private class members and have functions to initialize all of them. This functions is called from init_vulkan();
- * After everything is prepared the main loop and draw functions begin rendering frames
+ * Runtime options of the application, filled from the command line by parse_command_line()
  */
-class hello_triangle_application
+struct application_config
 {
-public:
-	void run()
+	uint32_t max_frames_in_flight = DEFAULT_MAX_FRAMES_IN_FLIGHT; // More frames trade input latency for CPU/GPU overlap
+	std::string pipeline_cache_path = DEFAULT_PIPELINE_CACHE_PATH; // Empty disables the on-disk pipeline cache
+	uint32_t recording_workers = default_recording_workers(); // Workers of the job system, the main thread included
+	bool print_gpu_timings = false; // Report the GPU scope timings from the main loop every STATISTICS_REPORT_INTERVAL
+	bool print_frame_statistics = false; // Report the CPU frame timings from the main loop every STATISTICS_REPORT_INTERVAL
+	std::string frame_trace_path; // Per-frame CPU timings written at exit, CSV for a .csv path and JSON otherwise. Empty disables it
+	bool headless = false; // Render offscreen without GLFW, a surface or a swapchain
+	uint64_t frame_limit = 0; // Exit after this many frames, 0 runs until the window is closed
+	std::string capture_path; // Headless only, the last rendered frame is written there as a binary PPM
+	present_policy present = present_policy::balanced;
+	std::optional<VkPresentModeKHR> present_mode; // Overrides the present mode of the policy when the surface supports it
+	uint32_t draw_count = 1; // Triangles drawn per frame, each one its own draw
+	uint32_t instance_count = 1; // Instances per draw
+	uint32_t animated_instances = 0; // Instances whose transform and color change every frame, the others are written once
+	bool gpu_culling = false; // Cull the draws in a compute pass and draw the survivors with indirect draws
+	bool async_compute = false; // Submit the culling to a dedicated compute queue, where it overlaps the rendering of the previous frame
+	std::string device; // Device UUID as printed at startup, or deviceID in decimal or 0x hex. Empty picks the best scored device
+	bool watch_shaders = false; // Rebuild the pipelines in the background when a SPIR-V file they use changes on disk
+	uint32_t msaa_samples = 1; // Lowered to the highest count the device supports for both color and depth attachments
+	bool depth_prepass = false; // Lay the depth down with a depth-only pass first, the color pass then only shades the visible fragments
+	bool dynamic_rendering = true; // Render the main pass on image views with VK_KHR_dynamic_rendering when supported, without render pass nor framebuffers
+	std::string texture_directory; // KTX2 and DDS textures streamed onto the instances. Empty draws untextured
+	std::string mesh_path; // Mesh file drawn instead of the built-in triangle, see mesh_file_header for the layout
+	VkDeviceSize texture_budget = DEFAULT_TEXTURE_BUDGET; // Device memory the resident mip levels may use
+	benchmark_settings benchmark;
+	validation_settings validation = { enable_validation_layers_by_default, false, false, {} };
+
+	static uint32_t default_recording_workers()
 	{
-		init_window();
-		init_vulkan();
-		main_loop();
-		cleanup();
+		return std::clamp(std::thread::hardware_concurrency(), 1u, MAX_RECORDING_WORKERS);
 	}
+};
 
-private:
-#pragma region class_members
-	GLFWwindow* window_; // GLFW window
+/**
+ * Uniform block of set 0 in shader.vert, pushed to the uniform ring once per frame
+ */
+struct frame_uniforms
+{
+	float view_scale[2]; // Applied to the instance positions, identity until there is a camera
+	float view_offset[2];
+};
 
-	VkInstance instance_;
-	VkDebugUtilsMessengerEXT debug_messenger_;
-	VkSurfaceKHR surface_;
+/**
+ * Push constant block of the graphics pipelines, visible to both stages and read by shader.frag
+ */
+struct draw_push_constants
+{
+	uint32_t material_buffer; // Bindless storage buffer slot of the materials
+	uint32_t texture_table; // Bindless storage buffer slot of the texture slot table of the frame, see texture_streamer.h
+};
 
-	VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
-	VkDevice device_;
+/**
+ * Material parameters read by shader.frag, indexed by the material stream of the instances
+ */
+struct material
+{
+	float tint[4];
+	texture_handle texture; // NO_TEXTURE for an untextured material
+	uint32_t padding[3]; // std430 rounds the struct up to the alignment of the vec4
+};
 
-	VkQueue graphics_queue_;
-	VkQueue present_queue_;
+/**
+ * Indexed draw of the mesh recorded by one of the command recording workers
+ */
+struct draw_command
+{
+	uint32_t index_count;
+	uint32_t instance_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t first_instance;
+};
 
-	VkSwapchainKHR swap_chain_;
-	VkFormat swap_chain_image_format_;
-	VkExtent2D swap_chain_extent_;
-	std::vector<VkImage> swap_chain_images_;
-	std::vector<VkImageView> swap_chain_image_views_;
-	std::vector<VkFramebuffer> swap_chain_frame_buffers_;
+/**
+ * Host visible buffer the offscreen image of a frame is copied to. The headless mode keeps one per frame in flight, so a frame is
+ * read back the next time its slot comes around, once the graphics timeline passed it, and the CPU never waits for a fresh copy
+ */
+struct offscreen_readback
+{
+	unique_buffer buffer;
+	gpu_allocation allocation;
+	uint64_t frame_number = 0;
+	bool pending = false; // A copy was submitted that has not been read back yet
+};
 
-	VkRenderPass render_pass_;
-	VkPipelineLayout pipeline_layout_;
-	VkPipeline graphics_pipeline_;
+/**
+ * Command pools and buffers owned by one frame in flight. worker_pools[i] is only ever touched by the recording task i
+ */
+struct frame_command_resources
+{
+	unique_command_pool primary_pool; // Destroying a pool frees the command buffers allocated from it
+	VkCommandBuffer primary_buffer = VK_NULL_HANDLE;
+	std::vector<unique_command_pool> worker_pools;
+	std::vector<VkCommandBuffer> worker_buffers;
+	std::vector<VkCommandBuffer> depth_prepass_buffers; // Only with --depth-prepass, recorded by the same tasks from the same pools
+};
 
-	VkCommandPool command_pool_;
-	std::vector<VkCommandBuffer> command_buffers_;
+/**
+ * Prefix written in front of the driver's pipeline cache blob. The driver blob already starts with a VkPipelineCacheHeaderVersionOne,
+ * but that header has no driver version, and a driver update is the most common reason for a cache to go stale
+ */
+struct pipeline_cache_file_header
+{
+	uint32_t magic;
+	uint32_t file_version;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+	uint64_t data_size;
+};
 
-	std::vector<VkSemaphore> image_avaiable_semaphores_;
-	std::vector<VkSemaphore> render_finished_semaphores_;
-	std::vector<VkFence> in_flight_fences_;
-	std::vector<VkFence> images_in_flight_;
-	size_t current_frame_ = 0;
-#pragma endregion class_members
+//	**************************************
+//	******** COMMAND LINE PARSING ********
+//	**************************************
 
-	//	********************************
-	//	******** CORE FUNCTIONS ********
-	//	********************************
-	void init_vulkan()
+uint32_t parse_unsigned_argument(const std::string& option, const char* value)
+{
+	if (value == nullptr)
 	{
-		create_instance();
-		setup_debug_messenger();
-		create_surface();
-		pick_physical_device();
-		create_logical_device();
-		create_swap_chain();
-		create_image_views();
-		create_render_pass();
-		create_graphics_pipeline();
-		create_frame_buffers();
-		create_command_pool();
-		create_command_buffers();
-		create_sync_objects();
+		throw std::invalid_argument("Missing value for " + option + "!");
 	}
 
-	/**
-	 *  Contains a loop that iterates until the window is closed in a moment.
-	 *  Once the window is closed we call the cleanup function to deallocate the resources we've used
-	 */
-	void main_loop()
+	try
 	{
-		while (!glfwWindowShouldClose(window_))
+		size_t parsed_length = 0;
+		const unsigned long parsed = std::stoul(value, &parsed_length);
+		if (parsed_length != strlen(value) || parsed > UINT32_MAX)
 		{
-			glfwPollEvents();
-			draw_frame();
+			throw std::invalid_argument(option);
 		}
-
-		vkDeviceWaitIdle(device_);
+		return static_cast<uint32_t>(parsed);
 	}
-
-	/**
-	 * Deallocate the resources we've used
-	 */
-	void cleanup()
+	catch (const std::logic_error&)
 	{
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-		{
-			vkDestroySemaphore(device_, render_finished_semaphores_[i], nullptr);
-			vkDestroySemaphore(device_, image_avaiable_semaphores_[i], nullptr);
-			vkDestroyFence(device_, in_flight_fences_[i], nullptr);
-		}
-
-		vkDestroyCommandPool(device_, command_pool_, nullptr);
-
-		for (auto framebuffer : swap_chain_frame_buffers_)
-		{
-			vkDestroyFramebuffer(device_, framebuffer, nullptr);
-		}
-
-		vkDestroyPipeline(device_, graphics_pipeline_, nullptr);
-		vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
-		vkDestroyRenderPass(device_, render_pass_, nullptr);
-
-		for (auto image_view : swap_chain_image_views_)
-		{
-			vkDestroyImageView(device_, image_view, nullptr);
-		}
-
-		vkDestroySwapchainKHR(device_, swap_chain_, nullptr);
-		vkDestroyDevice(device_, nullptr);
-
-		if (enable_validation_layers)
-		{
-			destroy_debug_utils_messenger_ext(instance_, debug_messenger_, nullptr);
-		}
-
-		vkDestroySurfaceKHR(instance_, surface_, nullptr);
-		vkDestroyInstance(instance_, nullptr);
-
-		glfwDestroyWindow(window_);
-
-		glfwTerminate();
+		throw std::invalid_argument("Invalid value for " + option + ": " + value + "!");
 	}
+}
 
-	void create_instance()
+double parse_double_argument(const std::string& option, const char* value)
+{
+	if (value == nullptr)
 	{
-		if (enable_validation_layers && !check_validation_layer_support())
-		{
-			throw std::runtime_error("validation layers requested, but not available!");
-		}
-
-		VkApplicationInfo app_info{};
-		app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-		app_info.pApplicationName = "Hello Triangle";
-		app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-		app_info.pEngineName = "No Engine";
-		app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		app_info.apiVersion = VK_API_VERSION_1_0;
-
-		VkInstanceCreateInfo create_info{};
-		create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-		create_info.pApplicationInfo = &app_info;
-
-		auto extensions = get_required_extensions();
-		create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-		create_info.ppEnabledExtensionNames = extensions.data();
-
-		VkDebugUtilsMessengerCreateInfoEXT debug_create_info;
-		if (enable_validation_layers)
-		{
-			create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
-			create_info.ppEnabledLayerNames = validation_layers.data();
-
-			populate_debug_messenger_create_info(debug_create_info);
-			create_info.pNext = static_cast<VkDebugUtilsMessengerCreateInfoEXT*>(&debug_create_info);
-		}
-		else
-		{
-			create_info.enabledLayerCount = 0;
-
-			create_info.pNext = nullptr;
-		}
-
-		if (vkCreateInstance(&create_info, nullptr, &instance_) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to create instance!");
-		}
+		throw std::invalid_argument("Missing value for " + option + "!");
 	}
 
-	//	******************************************
-	//	******** WINDOW RELATED FUNCTIONS ********
-	//	******************************************
-
-	/**
-	 * Initialize GLFW and create a window
-	 */
-	void init_window()
-	{
-		glfwInit();
-
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // We must specify that we're not using OpenGL
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE); // Disable resizeble windows since it need a special care in Vulkan
-
-		// The fourth parameter allows you to optionally specify a monitor to open the window, and the last one is used in OpenGL
-		window_ = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
-	}
-	void create_surface()
+	char* end = nullptr;
+	const double parsed = std::strtod(value, &end);
+	if (end == value || *end != '\0' || !(parsed >= 0.0))
 	{
-		if (glfwCreateWindowSurface(instance_, window_, nullptr, &surface_) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to create window surface!");
-		}
+		throw std::invalid_argument("Invalid value for " + option + ": " + value + "!");
 	}
 
-	//	*****************************************
-	//	******** DEBUG RELATED FUNCTIONS ********
-	//	*****************************************
+	return parsed;
+}
 
-	void populate_debug_messenger_create_info(VkDebugUtilsMessengerCreateInfoEXT& create_info)
+VkPresentModeKHR parse_present_mode_argument(const std::string& option, const char* value)
+{
+	static const std::map<std::string, VkPresentModeKHR> present_modes = {
+		{ "immediate", VK_PRESENT_MODE_IMMEDIATE_KHR },
+		{ "mailbox", VK_PRESENT_MODE_MAILBOX_KHR },
+		{ "fifo", VK_PRESENT_MODE_FIFO_KHR },
+		{ "fifo_relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR }
+	};
+
+	if (value == nullptr)
 	{
-		create_info = {};
-		create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-		create_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-		create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-		create_info.pfnUserCallback = debug_callback;
+		throw std::invalid_argument("Missing value for " + option + "!");
 	}
 
-	void setup_debug_messenger()
+	const auto present_mode = present_modes.find(value);
+	if (present_mode == present_modes.end())
 	{
-		if (!enable_validation_layers) return;
+		throw std::invalid_argument("Invalid value for " + option + ": " + value + ", expected immediate, mailbox, fifo or fifo_relaxed!");
+	}
 
-		VkDebugUtilsMessengerCreateInfoEXT create_info;
-		populate_debug_messenger_create_info(create_info);
+	return present_mode->second;
+}
 
-		if (create_debug_utils_messenger_ext(instance_, &create_info, nullptr, &debug_messenger_) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to set up debug messenger!");
-		}
+present_policy parse_present_policy_argument(const std::string& option, const char* value)
+{
+	static const std::map<std::string, present_policy> present_policies = {
+		{ "balanced", present_policy::balanced },
+		{ "low_latency", present_policy::low_latency },
+		{ "throughput", present_policy::throughput },
+		{ "power_saving", present_policy::power_saving }
+	};
+
+	if (value == nullptr)
+	{
+		throw std::invalid_argument("Missing value for " + option + "!");
 	}
 
-	static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
-		VkDebugUtilsMessageTypeFlagsEXT message_type, const VkDebugUtilsMessengerCallbackDataEXT* p_callback_data, void* p_user_data)
+	const auto policy = present_policies.find(value);
+	if (policy == present_policies.end())
 	{
-		std::cerr << "validation layer: " << p_callback_data->pMessage << std::endl;
-
-		return VK_FALSE;
+		throw std::invalid_argument("Invalid value for " + option + ": " + value + ", expected balanced, low_latency, throughput or power_saving!");
 	}
 
-	//	**************************************************************************
-	//	******** REQUIRED EXTENSIONS/ VALIDATION LAYERS RELATED FUNCTIONS ********
-	//	**************************************************************************
+	return policy->second;
+}
 
-	std::vector<const char*> get_required_extensions()
-	{
-		uint32_t glfw_extension_count = 0;
-		const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+application_config parse_command_line(const int argc, char* argv[])
+{
+	application_config config;
+	apply_validation_environment(config.validation);
 
-		std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string option = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
 
-		if (enable_validation_layers)
+		if (option == "--frames-in-flight")
 		{
-			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+			config.max_frames_in_flight = parse_unsigned_argument(option, value);
+			i++;
 		}
-
-		return extensions;
-	}
-
-	bool check_validation_layer_support()
-	{
-		uint32_t layer_count;
-		vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
-
-		std::vector<VkLayerProperties> available_layers(layer_count);
-		vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
-
-		for (const char* layer_name : validation_layers)
+		else if (option == "--recording-workers")
 		{
-			bool layer_found = false;
-
-			for (const auto& layer_properties : available_layers)
+			config.recording_workers = parse_unsigned_argument(option, value);
+			i++;
+		}
+		else if (option == "--gpu-timings")
+		{
+			config.print_gpu_timings = true;
+		}
+		else if (option == "--frame-stats")
+		{
+			config.print_frame_statistics = true;
+		}
+		else if (option == "--frame-trace")
+		{
+			if (value == nullptr)
 			{
-				if (strcmp(layer_name, layer_properties.layerName) == 0)
-				{
-					layer_found = true;
-					break;
-				}
+				throw std::invalid_argument("Missing value for " + option + "!");
 			}
-
-			if (!layer_found)
+			config.frame_trace_path = value;
+			i++;
+		}
+		else if (option == "--headless")
+		{
+			config.headless = true;
+		}
+		else if (option == "--frames")
+		{
+			config.frame_limit = parse_unsigned_argument(option, value);
+			i++;
+		}
+		else if (option == "--capture")
+		{
+			if (value == nullptr)
 			{
-				return false;
+				throw std::invalid_argument("Missing value for " + option + "!");
 			}
+			config.capture_path = value;
+			i++;
 		}
-
-		return true;
-	}
-
+		else if (option == "--present-mode")
+		{
+			config.present_mode = parse_present_mode_argument(option, value);
+			i++;
+		}
+		else if (option == "--present-policy")
+		{
+			config.present = parse_present_policy_argument(option, value);
+			i++;
+		}
+		else if (option == "--triangles")
+		{
+			config.draw_count = parse_unsigned_argument(option, value);
+			i++;
+		}
+		else if (option == "--instances")
+		{
+			config.instance_count = parse_unsigned_argument(option, value);
+			i++;
+		}
+		else if (option == "--animated-instances")
+		{
+			config.animated_instances = parse_unsigned_argument(option, value);
+			i++;
+		}
+		else if (option == "--gpu-culling")
+		{
+			config.gpu_culling = true;
+		}
+		else if (option == "--async-compute")
+		{
+			config.async_compute = true;
+		}
+		else if (option == "--device")
+		{
+			if (value == nullptr)
+			{
+				throw std::invalid_argument("Missing value for " + option + "!");
+			}
+			config.device = value;
+			std::transform(config.device.begin(), config.device.end(), config.device.begin(), [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			i++;
+		}
+		else if (option == "--watch-shaders")
+		{
+			config.watch_shaders = true;
+		}
+		else if (option == "--msaa")
+		{
+			config.msaa_samples = parse_unsigned_argument(option, value);
+			i++;
+		}
+		else if (option == "--depth-prepass")
+		{
+			config.depth_prepass = true;
+		}
+		else if (option == "--no-dynamic-rendering")
+		{
+			config.dynamic_rendering = false;
+		}
+		else if (option == "--validation")
+		{
+			parse_validation_settings(option, value, config.validation);
+			i++;
+		}
+		else if (option == "--debug-log")
+		{
+			if (value == nullptr)
+			{
+				throw std::invalid_argument("Missing value for " + option + "!");
+			}
+			config.validation.log_path = value;
+			i++;
+		}
+		else if (option == "--benchmark")
+		{
+			config.benchmark.enabled = true;
+		}
+		else if (option == "--benchmark-frames")
+		{
+			config.benchmark.frame_count = parse_unsigned_argument(option, value);
+			i++;
+		}
+		else if (option == "--benchmark-seconds")
+		{
+			config.benchmark.duration_seconds = parse_double_argument(option, value);
+			i++;
+		}
+		else if (option == "--textures")
+		{
+			if (value == nullptr)
+			{
+				throw std::invalid_argument("Missing value for " + option + "!");
+			}
+			config.texture_directory = value;
+			i++;
+		}
+		else if (option == "--mesh")
+		{
+			if (value == nullptr)
+			{
+				throw std::invalid_argument("Missing value for " + option + "!");
+			}
+			config.mesh_path = value;
+			i++;
+		}
+		else if (option == "--texture-budget")
+		{
+			config.texture_budget = VkDeviceSize(parse_unsigned_argument(option, value)) << 20; // In mb
+			i++;
+		}
+		else if (option == "--warmup-frames")
+		{
+			config.benchmark.warmup_frames = parse_unsigned_argument(option, value);
+			i++;
+		}
+		else if (option == "--benchmark-output")
+		{
+			if (value == nullptr)
+			{
+				throw std::invalid_argument("Missing value for " + option + "!");
+			}
+			config.benchmark.output_path = value;
+			i++;
+		}
+		else if (option == "--pipeline-cache")
+		{
+			if (value == nullptr)
+			{
+				throw std::invalid_argument("Missing value for " + option + "!");
+			}
+			config.pipeline_cache_path = value;
+			i++;
+		}
+		else if (option == "--no-pipeline-cache")
+		{
+			config.pipeline_cache_path.clear();
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown command line option: " + option + "!");
+		}
+	}
+
+	if (config.max_frames_in_flight == 0 || config.max_frames_in_flight > MAX_SUPPORTED_FRAMES_IN_FLIGHT)
+	{
+		throw std::invalid_argument("--frames-in-flight must be between 1 and " + std::to_string(MAX_SUPPORTED_FRAMES_IN_FLIGHT) + "!");
+	}
+
+	if (config.recording_workers == 0 || config.recording_workers > MAX_RECORDING_WORKERS)
+	{
+		throw std::invalid_argument("--recording-workers must be between 1 and " + std::to_string(MAX_RECORDING_WORKERS) + "!");
+	}
+
+	if (!config.capture_path.empty() && !config.headless)
+	{
+		throw std::invalid_argument("--capture is only supported with --headless!");
+	}
+
+	if (config.async_compute && !config.gpu_culling)
+	{
+		throw std::invalid_argument("--async-compute needs --gpu-culling, the culling is the compute work it moves!");
+	}
+
+	if (config.draw_count == 0 || config.instance_count == 0)
+	{
+		throw std::invalid_argument("--triangles and --instances must be at least 1!");
+	}
+
+	const uint64_t total_instances = uint64_t(config.draw_count) * config.instance_count;
+	if (total_instances > MAX_INSTANCE_CAPACITY)
+	{
+		throw std::invalid_argument("--triangles times --instances must be at most " + std::to_string(MAX_INSTANCE_CAPACITY) + "!");
+	}
+
+	if (config.animated_instances > total_instances)
+	{
+		throw std::invalid_argument("--animated-instances must be at most --triangles times --instances!");
+	}
+
+	if (config.msaa_samples == 0 || config.msaa_samples > MAX_MSAA_SAMPLES || (config.msaa_samples & (config.msaa_samples - 1)) != 0)
+	{
+		throw std::invalid_argument("--msaa must be a power of two between 1 and " + std::to_string(MAX_MSAA_SAMPLES) + "!");
+	}
+
+	if (config.benchmark.enabled && config.benchmark.frame_count == 0 && config.benchmark.duration_seconds == 0.0)
+	{
+		config.benchmark.frame_count = DEFAULT_BENCHMARK_FRAMES;
+	}
+
+	return config;
+}
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Class that holds Vulkan objects as private class members and have functions to initialize all of them. This functions is called from init_vulkan();
+ * After everything is prepared the main loop and draw functions begin rendering frames
+ */
+class hello_triangle_application
+{
+public:
+	explicit hello_triangle_application(const application_config& config) :
+		validation_(config.validation),
+		requested_device_(config.device),
+		mesh_path_(config.mesh_path),
+		present_policy_(config.present),
+		requested_present_mode_(config.present_mode),
+		msaa_samples_(static_cast<VkSampleCountFlagBits>(config.msaa_samples)),
+		depth_prepass_(config.depth_prepass),
+		dynamic_rendering_(config.dynamic_rendering),
+		watch_shaders_(config.watch_shaders),
+		pipeline_cache_path_(config.pipeline_cache_path),
+		jobs_(config.recording_workers),
+		animated_instances_(config.animated_instances),
+		texture_directory_(config.texture_directory),
+		texture_budget_(config.texture_budget),
+		gpu_culling_(config.gpu_culling),
+		async_compute_(config.async_compute),
+		print_gpu_timings_(config.print_gpu_timings),
+		print_frame_statistics_(config.print_frame_statistics),
+		frame_trace_path_(config.frame_trace_path),
+		headless_(config.headless),
+		frame_limit_(config.frame_limit),
+		capture_path_(config.capture_path),
+		benchmark_(config.benchmark),
+		max_frames_in_flight_(config.max_frames_in_flight)
+	{
+		// Every draw covers its own range of the instance buffer
+		draw_commands_.reserve(config.draw_count);
+		for (uint32_t draw = 0; draw < config.draw_count; draw++)
+		{
+			// The index count is filled in by create_mesh()
+			draw_commands_.push_back({ 0, config.instance_count, 0, 0, draw * config.instance_count });
+		}
+
+		// Only the trace file and the benchmark report read the trace, the other runs don't pay for its memory
+		if (!frame_trace_path_.empty() || benchmark_.enabled)
+		{
+			frame_stats_.reserve_trace(FRAME_TRACE_CAPACITY);
+		}
+	}
+
+	void run()
+	{
+		const auto start_time = std::chrono::steady_clock::now();
+
+		if (!headless_)
+		{
+			init_window();
+		}
+		init_vulkan();
+
+		startup_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+
+		if (benchmark_.enabled)
+		{
+			run_benchmark();
+		}
+		else
+		{
+			main_loop();
+		}
+		cleanup();
+	}
+
+private:
+#pragma region class_members
+	// Members are destroyed in reverse order: every handle goes before the device it was created from, the device before the
+	// surface, the debug messenger and the instance, and the log sink and the window outlive them all
+	unique_glfw_window window_; // GLFW window, never created in headless mode
+
+	validation_settings validation_; // --validation or VF_VALIDATION, nothing is enabled nor loaded for what is off
+	debug_log_sink log_sink_; // Only started with validation, the debug messenger writes to it until it is destroyed
+	unique_instance instance_;
+	unique_debug_messenger debug_messenger_;
+	debug_utils debug_utils_; // Object names and labels, loaded when VK_EXT_debug_utils is enabled
+	unique_surface surface_;
+
+	VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
+	std::string requested_device_; // --device, UUID or deviceID, pins the process to one GPU of a multi-GPU machine
+	unique_device device_;
+
+	VkQueue graphics_queue_;
+	VkQueue present_queue_;
+	VkQueue transfer_queue_; // Same queue as graphics_queue_ when the device has no dedicated transfer family
+	VkQueue compute_queue_; // Same queue as graphics_queue_ when the device has no dedicated compute family
+
+	gpu_memory_allocator allocator_; // Every buffer and image memory goes through here instead of vkAllocateMemory
+	staging_uploader uploader_; // Every write to a device local buffer goes through here
+	timeline_wait frame_upload_wait_; // Uploads the frame being recorded acquires, its submit waits on them
+	std::string mesh_path_; // --mesh, empty draws the built-in triangle
+	host_memory_import_support host_memory_import_; // Only enabled with --mesh, the mesh file is the only host memory imported
+	gpu_mesh mesh_;
+
+	unique_swap_chain swap_chain_;
+	VkFormat swap_chain_image_format_;
+	VkExtent2D swap_chain_extent_;
+	std::vector<VkImage> swap_chain_images_; // In headless mode the offscreen images, one per frame in flight
+	std::vector<unique_image_view> swap_chain_image_views_;
+	std::vector<unique_framebuffer> swap_chain_frame_buffers_; // Empty with dynamic rendering
+	VkPresentModeKHR swap_chain_present_mode_;
+	present_policy present_policy_;
+	std::optional<VkPresentModeKHR> requested_present_mode_;
+	bool present_wait_enabled_ = false; // VK_KHR_present_id and VK_KHR_present_wait are enabled, only asked for by the low latency policy
+	uint64_t present_id_ = 0; // Id of the last present on swap_chain_, ids start over with every swapchain
+#ifdef VK_KHR_present_wait
+	PFN_vkWaitForPresentKHR wait_for_present_ = nullptr;
+#endif
+
+	VkFormat depth_format_;
+	VkSampleCountFlagBits msaa_samples_;
+	bool depth_prepass_;
+	std::vector<frame_graph_targets> render_targets_; // Transient images of the frame graph, one set per swapchain image like the framebuffers
+
+	frame_graph frame_graph_; // Passes of a frame and their synchronization, rebuilt with the render pass
+	frame_resource_handle color_target_ = INVALID_FRAME_RESOURCE; // The swapchain or offscreen image
+	frame_pass_handle main_pass_ = 0;
+	uint32_t recording_image_index_ = 0; // Image and slice count of the frame being recorded, read by the frame graph passes
+	uint32_t recording_slice_count_ = 0;
+	uint32_t recording_draws_per_slice_ = 0; // Read by the recording tasks, which only capture their slice
+	frame_arena frame_arena_; // Barriers, rendering infos and the like of the frames in flight, rewound with the frame slot
+
+	unique_render_pass render_pass_; // Not created with dynamic rendering
+	bool dynamic_rendering_; // VK_KHR_dynamic_rendering is enabled, the main pass renders on the image views directly
+#ifdef VK_KHR_dynamic_rendering
+	PFN_vkCmdBeginRenderingKHR begin_rendering_ = nullptr;
+	PFN_vkCmdEndRenderingKHR end_rendering_ = nullptr;
+#endif
+	frame_rendering_formats main_pass_formats_; // What the pipelines and secondary command buffers are created for without a render pass
+	unique_pipeline_layout pipeline_layout_;
+	shader_module_cache shader_modules_;
+	bool watch_shaders_;
+	pipeline_registry pipelines_; // Every graphics pipeline variant, compiled in the background
+	pipeline_handle graphics_pipeline_ = INVALID_PIPELINE_HANDLE;
+	pipeline_handle fallback_pipeline_ = INVALID_PIPELINE_HANDLE;
+	pipeline_handle depth_prepass_pipeline_ = INVALID_PIPELINE_HANDLE; // Only with --depth-prepass
+	VkPipeline recording_pipeline_ = VK_NULL_HANDLE; // Resolved once per frame, bound by every recording worker
+	VkPipeline recording_depth_pipeline_ = VK_NULL_HANDLE;
+	std::vector<VkPipeline> replaced_pipelines_; // Returned by swap_reloaded() once per frame, kept so the frame never allocates
+
+	unique_pipeline_cache pipeline_cache_;
+	std::string pipeline_cache_path_;
+
+	job_system jobs_; // Declared after everything its background jobs use, so its threads are joined first
+	task_graph frame_tasks_; // Rebuilt by every record_command_buffer()
+	std::vector<frame_command_resources> frame_commands_; // One set of command pools per frame in flight
+	std::vector<draw_command> draw_commands_;
+	instance_buffer instances_; // Per-instance data of every triangle drawn, one copy per frame in flight
+	uint32_t animated_instances_;
+	uniform_ring uniforms_; // Set 0 of the graphics pipelines
+	uint32_t frame_uniform_offset_ = 0; // Dynamic offset of the frame_uniforms of the frame being recorded
+	bindless_descriptors bindless_; // Set 1 of the graphics pipelines
+	unique_buffer material_buffer_;
+	gpu_allocation material_allocation_;
+	uint32_t material_buffer_slot_ = 0;
+	texture_streamer textures_; // Sampled through the bindless texture array
+	std::string texture_directory_;
+	VkDeviceSize texture_budget_;
+	gpu_culling_pass culling_;
+	bool gpu_culling_; // Turned off by create_logical_device() when the device can't draw indirect with a first instance
+	culling_capabilities culling_capabilities_;
+	bool async_compute_; // Turned off by create_logical_device() when there is no dedicated compute family
+	async_compute_queue async_compute_queue_;
+	timeline_wait frame_compute_wait_; // Compute work of the frame being recorded, its graphics submit waits on it
+
+	gpu_timestamp_profiler gpu_profiler_;
+	bool print_gpu_timings_;
+
+	frame_statistics frame_stats_; // Produced in draw_frame(), consumed in main_loop()
+	bool print_frame_statistics_;
+	std::string frame_trace_path_;
+
+	bool headless_;
+	uint64_t frame_limit_;
+	std::string capture_path_;
+	std::vector<unique_image> offscreen_images_; // Also in swap_chain_images_, which the frames index
+	std::vector<gpu_allocation> offscreen_image_allocations_;
+	std::vector<offscreen_readback> readbacks_; // Indexed by frame in flight
+	std::vector<uint8_t> captured_pixels_; // Latest frame read back, only kept when there is a capture path
+	uint64_t frames_read_back_ = 0;
+
+	benchmark_settings benchmark_;
+	double startup_ms_ = 0.0;
+
+	bool framebuffer_resized_ = false; // Set by the GLFW resize callback, some drivers don't report VK_ERROR_OUT_OF_DATE_KHR on resize
+	deletion_queue deletion_queue_; // Objects replaced at runtime, destroyed once the frames that used them are done on the GPU
+
+	std::vector<unique_semaphore> image_avaiable_semaphores_; // Binary, the swapchain can't signal or wait on timeline semaphores
+	std::vector<unique_semaphore> render_finished_semaphores_;
+	gpu_timeline graphics_timeline_; // Frame N signals N + 1, so the completed value is the number of frames done on the GPU
+	std::vector<uint64_t> images_in_flight_; // Graphics timeline value of the last frame rendering to each swapchain image, 0 for none
+	size_t current_frame_ = 0;
+	uint64_t frame_number_ = 0; // Number of frames submitted so far
+	uint32_t max_frames_in_flight_; // Only the graphics timeline waits throttle the CPU, so this is the real pipelining depth
+#pragma endregion class_members
+
+	//	********************************
+	//	******** CORE FUNCTIONS ********
+	//	********************************
+	void init_vulkan()
+	{
+		create_instance();
+		setup_debug_messenger();
+		if (!headless_)
+		{
+			create_surface();
+		}
+		pick_physical_device();
+		create_logical_device();
+		allocator_.init(physical_device_, device_.get());
+		create_uploader();
+		if (async_compute_)
+		{
+			async_compute_queue_.init(device_.get(), find_queue_families(physical_device_).compute_family.value(), compute_queue_, max_frames_in_flight_);
+		}
+		gpu_profiler_.init(physical_device_, device_.get(), find_queue_families(physical_device_).graphics_family.value(), max_frames_in_flight_);
+		create_pipeline_cache();
+		shader_modules_.init(device_.get());
+		for (const auto& shader : get_embedded_shaders())
+		{
+			shader_modules_.add_embedded(shader.path, shader.code, shader.size);
+		}
+		pipelines_.init(device_.get(), pipeline_cache_.get(), shader_modules_, jobs_);
+		if (headless_)
+		{
+			create_offscreen_targets();
+		}
+		else
+		{
+			create_swap_chain();
+		}
+		create_image_views();
+		choose_render_target_formats();
+		frame_graph_.init(device_.get());
+		frame_graph_.set_dynamic_rendering(dynamic_rendering_);
+		frame_graph_.set_debug_utils(&debug_utils_);
+		create_frame_graph();
+		create_render_targets();
+		create_render_pass();
+		create_descriptors();
+		create_pipeline_layout();
+		create_graphics_pipeline();
+		create_frame_buffers();
+		create_command_pools();
+		create_command_buffers();
+		frame_arena_.init(max_frames_in_flight_);
+		create_sync_objects();
+		create_mesh();
+		create_instances();
+		create_textures();
+		create_materials();
+		if (gpu_culling_)
+		{
+			create_culling_pipeline();
+		}
+	}
+
+	/**
+	 *  Contains a loop that iterates until the window is closed in a moment.
+	 *  Once the window is closed we call the cleanup function to deallocate the resources we've used
+	 */
+	void main_loop()
+	{
+		auto last_report = std::chrono::steady_clock::now();
+		auto last_shader_check = last_report;
+
+		while (!should_exit())
+		{
+			draw_next_frame();
+
+			if (watch_shaders_ && std::chrono::steady_clock::now() - last_shader_check >= SHADER_WATCH_INTERVAL)
+			{
+				reload_changed_shaders();
+				last_shader_check = std::chrono::steady_clock::now();
+			}
+
+			if (std::chrono::steady_clock::now() - last_report >= STATISTICS_REPORT_INTERVAL)
+			{
+				frame_stats_.collect();
+				if (print_frame_statistics_)
+				{
+					frame_stats_.print_summary();
+					jobs_.print_statistics();
+					frame_arena_.print_statistics();
+				}
+				if (print_gpu_timings_)
+				{
+					gpu_profiler_.print_statistics();
+				}
+				last_report = std::chrono::steady_clock::now();
+			}
+		}
+
+		finish_frames();
+	}
+
+	void draw_next_frame()
+	{
+		if (headless_)
+		{
+			draw_offscreen_frame();
+		}
+		else
+		{
+			draw_frame(); // Polls the window events itself, once it waited for the GPU
+		}
+	}
+
+	/**
+	 * Wait for the frames in flight and flush what is produced at exit
+	 */
+	void finish_frames()
+	{
+		vkDeviceWaitIdle(device_.get());
+
+		if (headless_)
+		{
+			finish_readbacks();
+		}
+
+		frame_stats_.collect();
+		if (!frame_trace_path_.empty())
+		{
+			frame_stats_.write_trace(frame_trace_path_);
+		}
+	}
+
+	/**
+	 * Fixed-length run for regression tracking: warm-up frames are drawn and thrown away, then the measured frames go through the
+	 * same draw path as main_loop() and a JSON report is written
+	 */
+	void run_benchmark()
+	{
+		using clock = std::chrono::steady_clock;
+
+		bool window_closed = false;
+		for (uint64_t frame = 0; frame < benchmark_.warmup_frames && !window_closed; frame++)
+		{
+			draw_next_frame();
+			window_closed = !headless_ && glfwWindowShouldClose(window_.get());
+			if (frame % (FRAME_SAMPLE_RING_CAPACITY / 2) == 0)
+			{
+				frame_stats_.collect();
+			}
+		}
+
+		// Start from an idle device so the measured frames don't include the tail of the warm-up
+		vkDeviceWaitIdle(device_.get());
+		frame_stats_.collect();
+		frame_stats_.reset();
+		const uint64_t expected_frames = benchmark_.frame_count > 0 ? benchmark_.frame_count : MAX_BENCHMARK_GPU_SAMPLES;
+		gpu_profiler_.reset_statistics(static_cast<uint32_t>(std::min<uint64_t>(expected_frames, MAX_BENCHMARK_GPU_SAMPLES)));
+
+		const uint64_t first_frame = frame_number_;
+		const clock::time_point start = clock::now();
+		const auto reached_limit = [&]
+		{
+			if (benchmark_.frame_count > 0 && frame_number_ - first_frame >= benchmark_.frame_count)
+			{
+				return true;
+			}
+			return benchmark_.duration_seconds > 0.0 && std::chrono::duration<double>(clock::now() - start).count() >= benchmark_.duration_seconds;
+		};
+
+		while (!window_closed && !reached_limit())
+		{
+			draw_next_frame();
+			window_closed = !headless_ && glfwWindowShouldClose(window_.get());
+			if ((frame_number_ - first_frame) % (FRAME_SAMPLE_RING_CAPACITY / 2) == 0)
+			{
+				frame_stats_.collect();
+			}
+		}
+
+		// The run ends when the last frame is done on the GPU, not when it was submitted
+		vkDeviceWaitIdle(device_.get());
+		const double measured_seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+		// Collect the timestamps of the frames that were still in flight before the report. The pending readbacks and the trace are
+		// handled by finish_frames()
+		for (uint32_t frame = 0; frame < max_frames_in_flight_; frame++)
+		{
+			gpu_profiler_.collect_frame(frame);
+		}
+		finish_frames();
+
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
+
+		benchmark_result result;
+		result.device_name = device_properties.deviceName;
+		result.driver_version = device_properties.driverVersion;
+		result.mode = headless_ ? "headless" : "windowed";
+		result.present_mode = headless_ ? "none" : present_mode_name(swap_chain_present_mode_);
+		result.present_policy = headless_ ? "none" : present_policy_name(present_policy_);
+		result.swap_chain_images = headless_ ? 0 : static_cast<uint32_t>(swap_chain_images_.size());
+		result.frames_in_flight = max_frames_in_flight_;
+		result.recording_workers = jobs_.worker_count();
+		result.draw_count = static_cast<uint32_t>(draw_commands_.size());
+		result.instance_count = draw_commands_.empty() ? 0 : draw_commands_.front().instance_count;
+		result.gpu_culling = gpu_culling_;
+		result.async_compute = async_compute_;
+		result.completed = !window_closed;
+		result.startup_ms = startup_ms_;
+		result.warmup_frames = benchmark_.warmup_frames;
+		result.measured_frames = frame_number_ - first_frame;
+		result.measured_seconds = measured_seconds;
+		result.fps = measured_seconds > 0.0 ? result.measured_frames / measured_seconds : 0.0;
+		result.cpu = frame_stats_.get_trace_summary();
+		result.dropped_cpu_samples = frame_stats_.dropped_samples();
+		result.gpu = gpu_profiler_.get_statistics();
+
+		if (benchmark_.output_path.empty())
+		{
+			write_benchmark_json(std::cout, result);
+		}
+		else
+		{
+			std::ofstream file(benchmark_.output_path, std::ios::trunc);
+			write_benchmark_json(file, result);
+			if (!file)
+			{
+				throw std::runtime_error("Failed to write benchmark report " + benchmark_.output_path + "!");
+			}
+			std::cout << "Benchmark report written to " << benchmark_.output_path << std::endl;
+		}
+	}
+
+	bool should_exit()
+	{
+		if (frame_limit_ > 0 && frame_number_ >= frame_limit_)
+		{
+			return true;
+		}
+
+		return !headless_ && glfwWindowShouldClose(window_.get());
+	}
+
+	/**
+	 * Deallocate the resources we've used
+	 */
+	void cleanup()
+	{
+		// The handles owned by the class go in its destructor, in reverse member order. Only the modules and the allocations are
+		// torn down here, the allocator has to outlive them
+		deletion_queue_.flush_all();
+		graphics_timeline_.destroy();
+
+		destroy_render_targets(render_targets_);
+		pipelines_.destroy();
+		shader_modules_.destroy();
+		save_pipeline_cache();
+
+		if (headless_)
+		{
+			free_offscreen_allocations();
+		}
+
+		if (validation_.validation)
+		{
+			allocator_.print_heap_statistics();
+		}
+		if (gpu_culling_)
+		{
+			culling_.destroy();
+		}
+		if (async_compute_)
+		{
+			async_compute_queue_.destroy();
+		}
+		instances_.destroy();
+		allocator_.free(material_allocation_);
+		textures_.destroy();
+		bindless_.destroy();
+		uniforms_.destroy();
+		destroy_gpu_mesh(allocator_, mesh_);
+		uploader_.destroy();
+		gpu_profiler_.destroy();
+		allocator_.destroy();
+	}
+
+	void create_instance()
+	{
+		if (validation_.validation && !check_validation_layer_support())
+		{
+			throw std::runtime_error("validation layers requested, but not available!");
+		}
+		if (validation_.gpu_assisted && !check_validation_features_support())
+		{
+			std::cout << "The validation layer has no VK_EXT_validation_features, GPU-assisted validation is disabled" << std::endl;
+			validation_.gpu_assisted = false;
+		}
+
+		VkApplicationInfo app_info{};
+		app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+		app_info.pApplicationName = "Hello Triangle";
+		app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+		app_info.pEngineName = "No Engine";
+		app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+		app_info.apiVersion = VK_API_VERSION_1_2; // Timeline semaphores, and vkGetPhysicalDeviceFeatures2 for VK_EXT_descriptor_indexing
+
+		VkInstanceCreateInfo create_info{};
+		create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+		create_info.pApplicationInfo = &app_info;
+
+		auto extensions = get_required_extensions();
+		create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		create_info.ppEnabledExtensionNames = extensions.data();
+
+		VkDebugUtilsMessengerCreateInfoEXT debug_create_info;
+		VkValidationFeaturesEXT validation_features{};
+		const VkValidationFeatureEnableEXT gpu_assisted_features[] = { VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_EXT,
+			VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_RESERVE_BINDING_SLOT_EXT };
+		if (validation_.validation)
+		{
+			create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
+			create_info.ppEnabledLayerNames = validation_layers.data();
+
+			// The messages of the instance creation already go through the sink
+			log_sink_.start(validation_.log_path);
+			populate_debug_messenger_create_info(debug_create_info);
+			create_info.pNext = static_cast<VkDebugUtilsMessengerCreateInfoEXT*>(&debug_create_info);
+
+			if (validation_.gpu_assisted)
+			{
+				validation_features.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT;
+				validation_features.pNext = &debug_create_info;
+				validation_features.enabledValidationFeatureCount = static_cast<uint32_t>(std::size(gpu_assisted_features));
+				validation_features.pEnabledValidationFeatures = gpu_assisted_features;
+				create_info.pNext = &validation_features;
+			}
+		}
+		else
+		{
+			create_info.enabledLayerCount = 0;
+
+			create_info.pNext = nullptr;
+		}
+
+		VkInstance instance;
+		if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create instance!");
+		}
+		instance_ = unique_instance(instance);
+	}
+
+	//	******************************************
+	//	******** WINDOW RELATED FUNCTIONS ********
+	//	******************************************
+
+	/**
+	 * Initialize GLFW and create a window
+	 */
+	void init_window()
+	{
+		glfwInit();
+
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // We must specify that we're not using OpenGL
+
+		// The fourth parameter allows you to optionally specify a monitor to open the window, and the last one is used in OpenGL
+		window_.reset(glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr));
+
+		glfwSetWindowUserPointer(window_.get(), this);
+		glfwSetFramebufferSizeCallback(window_.get(), framebuffer_resize_callback);
+	}
+
+	static void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
+	{
+		auto app = static_cast<hello_triangle_application*>(glfwGetWindowUserPointer(window));
+		app->framebuffer_resized_ = true;
+	}
+	void create_surface()
+	{
+		VkSurfaceKHR surface;
+		if (glfwCreateWindowSurface(instance_.get(), window_.get(), nullptr, &surface) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create window surface!");
+		}
+		surface_ = unique_surface(instance_.get(), surface);
+	}
+
+	//	*****************************************
+	//	******** DEBUG RELATED FUNCTIONS ********
+	//	*****************************************
+
+	void populate_debug_messenger_create_info(VkDebugUtilsMessengerCreateInfoEXT& create_info)
+	{
+		create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+		create_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+		create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		create_info.pfnUserCallback = debug_log_sink::callback;
+		create_info.pUserData = &log_sink_;
+	}
+
+	void setup_debug_messenger()
+	{
+		if (!validation_.validation) return;
+
+		VkDebugUtilsMessengerCreateInfoEXT create_info;
+		populate_debug_messenger_create_info(create_info);
+
+		VkDebugUtilsMessengerEXT debug_messenger;
+		if (create_debug_utils_messenger_ext(instance_.get(), &create_info, nullptr, &debug_messenger) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to set up debug messenger!");
+		}
+		debug_messenger_ = unique_debug_messenger(instance_.get(), debug_messenger);
+	}
+
+	/**
+	 * Validation features are an extension of the layer itself, GPU-assisted validation is dropped when the layer lacks it
+	 */
+	bool check_validation_features_support()
+	{
+		uint32_t extension_count;
+		vkEnumerateInstanceExtensionProperties(validation_layers.front(), &extension_count, nullptr);
+		std::vector<VkExtensionProperties> extensions(extension_count);
+		vkEnumerateInstanceExtensionProperties(validation_layers.front(), &extension_count, extensions.data());
+
+		return std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties& extension)
+			{
+				return strcmp(extension.extensionName, VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME) == 0;
+			});
+	}
+
+	/**
+	 * Names of the objects the validation messages are most likely to mention, once the device exists
+	 */
+	void name_device_objects()
+	{
+		debug_utils_.init(instance_.get(), device_.get());
+		debug_utils_.set_name(VK_OBJECT_TYPE_QUEUE, graphics_queue_, "graphics queue");
+		if (transfer_queue_ != graphics_queue_)
+		{
+			debug_utils_.set_name(VK_OBJECT_TYPE_QUEUE, transfer_queue_, "transfer queue");
+		}
+		if (compute_queue_ != graphics_queue_)
+		{
+			debug_utils_.set_name(VK_OBJECT_TYPE_QUEUE, compute_queue_, "compute queue");
+		}
+	}
+
+	//	**************************************************************************
+	//	******** REQUIRED EXTENSIONS/ VALIDATION LAYERS RELATED FUNCTIONS ********
+	//	**************************************************************************
+
+	std::vector<const char*> get_required_extensions()
+	{
+		std::vector<const char*> extensions;
+
+		// Headless mode never initializes GLFW and needs no surface extension
+		if (!headless_)
+		{
+			uint32_t glfw_extension_count = 0;
+			const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+			extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+		}
+
+		if (validation_.validation || validation_.debug_utils)
+		{
+			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		}
+		if (validation_.gpu_assisted)
+		{
+			extensions.push_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+		}
+
+		return extensions;
+	}
+
+	bool check_validation_layer_support()
+	{
+		uint32_t layer_count;
+		vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+
+		std::vector<VkLayerProperties> available_layers(layer_count);
+		vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+
+		for (const char* layer_name : validation_layers)
+		{
+			bool layer_found = false;
+
+			for (const auto& layer_properties : available_layers)
+			{
+				if (strcmp(layer_name, layer_properties.layerName) == 0)
+				{
+					layer_found = true;
+					break;
+				}
+			}
+
+			if (!layer_found)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	std::vector<const char*> get_required_device_extensions() const
+	{
+		// Nothing is presented in headless mode, so it doesn't need the swapchain extension
+		std::vector<const char*> extensions = headless_ ? std::vector<const char*>() : device_extensions;
+		extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+		return extensions;
+	}
+
 	bool check_device_extension_support(VkPhysicalDevice device)
 	{
-		uint32_t extension_count;
-		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+		uint32_t extension_count;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+
+		const std::vector<const char*> required_device_extensions = get_required_device_extensions();
+		std::set<std::string> required_extensions(required_device_extensions.begin(), required_device_extensions.end());
+
+		for (const auto& extension : available_extensions)
+		{
+			required_extensions.erase(extension.extensionName);
+		}
+
+		return required_extensions.empty();
+	}
+
+	//	***************************************************
+	//	******** PHYSICAL DEVICE RELATED FUNCTIONS ********
+	//	***************************************************
+
+	void pick_physical_device()
+	{
+		uint32_t device_count = 0;
+		vkEnumeratePhysicalDevices(instance_.get(), &device_count, nullptr);
+
+		if (device_count == 0)
+		{
+			throw std::runtime_error("Failed to find GPUs with Vulkan support!");
+		}
+
+		std::vector<VkPhysicalDevice> devices(device_count);
+		vkEnumeratePhysicalDevices(instance_.get(), &device_count, devices.data());
+
+		std::cout << "-- Selecting Physical Device --" << std::endl;
+
+		/*for (const auto& device : devices)
+		{
+			std::cout << std::endl;
+			get_physical_device_properties(device);
+			std::cout << std::endl;
+			get_physical_device_features(device);
+			std::cout << std::endl;
+			std::cout << "----------------------------------------------------------------------" << std::endl;
+			if (is_device_suitable(device))
+			{
+				physical_device_ = device;
+				break;
+			}
+		}
+
+		if (physical_device_ == VK_NULL_HANDLE)
+		{
+			throw std::runtime_error("Failed to find a suitable GPU!");
+		}*/
+
+		// new one
+
+		// Use an ordered map to automatically sort candidates by increasing score
+		std::multimap<uint64_t, VkPhysicalDevice> candidates;
+
+		for (const auto& device : devices)
+		{
+			VkPhysicalDeviceProperties device_properties;
+			vkGetPhysicalDeviceProperties(device, &device_properties);
+
+			const uint64_t score = rate_device_suitability(device);
+			candidates.insert(std::make_pair(score, device));
+			std::cout << "Device " << device_properties.deviceName << " (ID " << device_properties.deviceID << ", UUID " << get_device_uuid(device)
+				<< ") score: " << score << std::endl;
+
+			if (!requested_device_.empty() && matches_requested_device(device))
+			{
+				if (score == 0)
+				{
+					throw std::runtime_error("Requested device " + requested_device_ + " is not suitable!");
+				}
+				// The first match wins, identical GPUs share a deviceID and only their UUIDs tell them apart
+				if (physical_device_ == VK_NULL_HANDLE)
+				{
+					physical_device_ = device;
+				}
+			}
+		}
+
+		if (!requested_device_.empty())
+		{
+			if (physical_device_ == VK_NULL_HANDLE)
+			{
+				throw std::runtime_error("Failed to find the requested device " + requested_device_ + "!");
+			}
+		}
+		// Check if the best candidate is suitable at all
+		else if (candidates.rbegin()->first > 0)
+		{
+			physical_device_ = candidates.rbegin()->second;
+		}
+		else
+		{
+			throw std::runtime_error("Failed to find a suitable GPU!");
+		}
+
+		std::cout << "-- End Physical Device Selection --" << std::endl;
+	}
+
+	bool is_device_suitable(VkPhysicalDevice device)
+	{
+		queue_family_indices indices = find_queue_families(device);
+
+		bool extensions_supported = check_device_extension_support(device);
+
+		bool swap_chain_adequate = headless_;
+		if (extensions_supported && !headless_)
+		{
+			swap_chain_support_details swap_chain_support = query_swap_chain_support(device);
+			swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
+		}
+
+		return indices.is_complete() && extensions_supported && swap_chain_adequate && bindless_descriptors::is_supported(device) &&
+			gpu_timeline::is_supported(device);
+	}
+
+	void get_physical_device_properties(const VkPhysicalDevice device)
+	{
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(device, &device_properties);
+
+
+		std::cout << "-- Device Properties --" << std::endl;
+		std::cout << "Name: " << device_properties.deviceName << std::endl;
+		std::cout << "API version: " << device_properties.apiVersion << std::endl;
+		std::cout << "ID: " << device_properties.deviceID << std::endl;
+		std::cout << "Type: " << device_properties.deviceType << "(0-> Other, \n\t1-> Integrated GPU, \n\t2-> Discrete GPU, \n\t3-> Virtual GPU, \n\t4-> CPU)" << std::endl;
+		std::cout << "Driver Version: " << device_properties.driverVersion << std::endl;
+		//std::cout << "Limits: " << device_properties.limits << std::endl;
+		std::cout << "Pipeline Cache UUID: " << format_uuid(device_properties.pipelineCacheUUID) << std::endl;
+		//std::cout << "Sparse Properties - Residency Aligned Mip Size: " << device_properties.sparseProperties.residencyStandard2DBlockShape << std::endl;
+		std::cout << "Vendor ID: " << device_properties.vendorID << std::endl;
+		std::cout << std::endl;
+		get_physical_device_memory_properties(device);
+	}
+
+	void get_physical_device_features(const VkPhysicalDevice device)
+	{
+		VkPhysicalDeviceFeatures device_features;
+		vkGetPhysicalDeviceFeatures(device, &device_features);
+
+		std::cout << "-- Device Features --" << std::endl;
+		std::cout << "Texture Compression - ASTC_LDR: " << device_features.textureCompressionASTC_LDR << std::endl;
+		std::cout << "Texture Compression - BC: " << device_features.textureCompressionBC << std::endl;
+		std::cout << "Texture Compression - ETC2: " << device_features.textureCompressionETC2 << std::endl;
+		std::cout << "64 bit shader floats: " << device_features.shaderFloat64 << std::endl;
+		std::cout << "Multi viewport rendering: " << device_features.multiViewport << std::endl;
+	}
+
+	void get_physical_device_memory_properties(const VkPhysicalDevice device)
+	{
+		VkPhysicalDeviceMemoryProperties memory_properties;
+		vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+		std::cout << std::endl;
+		std::cout << "-- Memory Properties --" << std::endl;
+
+		const uint32_t memory_type_count = memory_properties.memoryTypeCount;
+		std::cout << "Memory Type Count: " << memory_type_count << std::endl;
+
+		for (uint32_t memory_index = 0; memory_index < memory_type_count; memory_index++)
+		{
+			std::cout << "Memory Types [" << memory_index << "]: " << std::endl;
+			std::cout << "\t Property Flags: " << memory_properties.memoryTypes[memory_index].propertyFlags << std::endl;
+			std::cout << "\t Heap Index: " << memory_properties.memoryTypes[memory_index].heapIndex << std::endl;
+		}
+
+		const uint32_t memory_heap_count = memory_properties.memoryHeapCount;
+		std::cout << std::endl;
+		std::cout << "Memory Heap Count: " << memory_heap_count << std::endl;
+
+		for (uint32_t memory_index = 0; memory_index < memory_heap_count; memory_index++)
+		{
+			std::cout << "Memory Heaps [" << memory_index << "]:" << std::endl;
+			std::cout << "\t Flags: " << memory_properties.memoryHeaps[memory_index].flags << std::endl;
+			std::cout << "\t Size: " << (memory_properties.memoryHeaps[memory_index].size >> 30) << " gb" << std::endl;
+		}
+	}
+
+	/**
+	 * 0 for a device the application can't run on. Otherwise the score grows with what the renderer is bound by: the device type,
+	 * the size of the video memory, the queue families it can spread work over and the optional features it uses
+	 */
+	uint64_t rate_device_suitability(const VkPhysicalDevice device)
+	{
+		// Application can't function without the required families queues, extensions, features and swapchains
+		if (!is_device_suitable(device))
+		{
+			return 0;
+		}
+
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(device, &device_properties);
+
+		uint64_t score = 0;
+		if (device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+		{
+			score += DISCRETE_GPU_SCORE;
+		}
+		else if (device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU)
+		{
+			score += INTEGRATED_GPU_SCORE;
+		}
+
+		// A heap is dedicated video memory when it has a device local type the host can't map, on a unified memory architecture every
+		// device local type is host visible and the heap is system memory
+		VkPhysicalDeviceMemoryProperties memory_properties;
+		vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+		for (uint32_t heap = 0; heap < memory_properties.memoryHeapCount; heap++)
+		{
+			if (!(memory_properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+			{
+				continue;
+			}
+
+			bool dedicated = false;
+			for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++)
+			{
+				const VkMemoryPropertyFlags flags = memory_properties.memoryTypes[type].propertyFlags;
+				dedicated |= memory_properties.memoryTypes[type].heapIndex == heap && (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) &&
+					!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			}
+
+			const uint64_t heap_mb = memory_properties.memoryHeaps[heap].size >> 20;
+			score += dedicated ? heap_mb : heap_mb / SHARED_MEMORY_SCORE_DIVISOR;
+		}
+
+		// Dedicated families let uploads and async compute run next to the graphics queue
+		const queue_family_indices indices = find_queue_families(device);
+		if (indices.transfer_family != indices.graphics_family)
+		{
+			score += DEDICATED_QUEUE_FAMILY_SCORE;
+		}
+		if (indices.compute_family != indices.graphics_family)
+		{
+			score += DEDICATED_QUEUE_FAMILY_SCORE;
+		}
+
+		// GPU culling, multi draw indirect and the sample counts of MSAA
+		VkPhysicalDeviceFeatures device_features;
+		vkGetPhysicalDeviceFeatures(device, &device_features);
+		if (device_features.drawIndirectFirstInstance)
+		{
+			score += OPTIONAL_FEATURE_SCORE;
+		}
+		if (device_features.multiDrawIndirect)
+		{
+			score += OPTIONAL_FEATURE_SCORE;
+		}
+		if ((device_properties.limits.framebufferColorSampleCounts & device_properties.limits.framebufferDepthSampleCounts) & VK_SAMPLE_COUNT_4_BIT)
+		{
+			score += OPTIONAL_FEATURE_SCORE;
+		}
+
+		return score;
+	}
+
+	/**
+	 * UUID of the device, in the format --device expects. Stable across reboots and driver reinstalls, unlike the enumeration order
+	 */
+	static std::string get_device_uuid(const VkPhysicalDevice device)
+	{
+		VkPhysicalDeviceIDProperties id_properties{};
+		id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &id_properties;
+		vkGetPhysicalDeviceProperties2(device, &properties);
+
+		return format_uuid(id_properties.deviceUUID);
+	}
+
+	/**
+	 * --device is either a device UUID or a deviceID, in decimal or 0x hex. Leading zeros stay decimal, "010" is 10 and not octal
+	 */
+	bool matches_requested_device(const VkPhysicalDevice device) const
+	{
+		if (requested_device_ == get_device_uuid(device))
+		{
+			return true;
+		}
+
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(device, &device_properties);
+
+		// --device is lower cased by the command line parser
+		const bool hex = requested_device_.compare(0, 2, "0x") == 0;
+		const char* digits = requested_device_.c_str() + (hex ? 2 : 0);
+		if (!std::isxdigit(static_cast<unsigned char>(*digits)))
+		{
+			return false; // strtoul would skip spaces and accept a sign
+		}
+
+		char* end = nullptr;
+		const unsigned long device_id = std::strtoul(digits, &end, hex ? 16 : 10);
+		return *end == '\0' && device_id == device_properties.deviceID;
+	}
+
+	queue_family_indices find_queue_families(VkPhysicalDevice device)
+	{
+		queue_family_indices indices;
+
+		uint32_t queue_family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
+
+		std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families.data());
+
+		uint32_t i = 0;
+		for (const auto& queue_family : queue_families)
+		{
+			// Every family is visited for the transfer one, the first graphics and present families found are kept
+			if (!indices.is_complete())
+			{
+				if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				{
+					indices.graphics_family = i;
+				}
+
+				if (headless_)
+				{
+					// Nothing is presented, the present queue aliases the graphics one so the rest of the setup doesn't change
+					indices.present_family = indices.graphics_family;
+				}
+				else
+				{
+					VkBool32 present_support = false;
+					vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_.get(), &present_support);
+
+					if (present_support)
+					{
+						indices.present_family = i;
+					}
+				}
+			}
+
+			// A transfer-only family maps to the DMA engines, which copy without taking time from the graphics queue
+			const VkQueueFlags transfer_only_mask = VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+			if (!indices.transfer_family.has_value() && (queue_family.queueFlags & transfer_only_mask) == VK_QUEUE_TRANSFER_BIT)
+			{
+				indices.transfer_family = i;
+			}
+
+			// A compute family without graphics runs its dispatches next to the graphics queue instead of between its submits
+			if (!indices.compute_family.has_value() && (queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+				!(queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			{
+				indices.compute_family = i;
+			}
+
+			i++;
+		}
+
+		// Graphics queues support transfers too, uploads go through them when there is no dedicated family
+		if (!indices.transfer_family.has_value())
+		{
+			indices.transfer_family = indices.graphics_family;
+		}
+		if (!indices.compute_family.has_value())
+		{
+			indices.compute_family = indices.graphics_family;
+		}
+
+		return indices;
+	}
+
+
+	//	**************************************************
+	//	******** LOGICAL DEVICE RELATED FUNCTIONS ********
+	//	**************************************************
+
+	void create_logical_device()
+	{
+		queue_family_indices indices = find_queue_families(physical_device_);
+
+		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
+		std::set<uint32_t> unique_queue_families = { indices.graphics_family.value(), indices.present_family.value(),
+			indices.transfer_family.value(), indices.compute_family.value() };
+
+		float queue_priority = 1.0f;
+		for (uint32_t queue_family : unique_queue_families)
+		{
+			VkDeviceQueueCreateInfo queue_create_info{};
+			queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queue_create_info.queueFamilyIndex = queue_family;
+			queue_create_info.queueCount = 1;
+			queue_create_info.pQueuePriorities = &queue_priority;
+			queue_create_infos.push_back(queue_create_info);
+		}
+
+		VkPhysicalDeviceFeatures device_features{};
+		device_features.fillModeNonSolid = VK_FALSE; // uncomment when draw in wireframe mode
+
+		texture_streamer::enable_features(physical_device_, device_features);
+
+		std::vector<const char*> required_device_extensions = get_required_device_extensions();
+		if (gpu_culling_)
+		{
+			enable_gpu_culling_support(device_features, required_device_extensions);
+		}
+		if (!mesh_path_.empty())
+		{
+			enable_host_memory_import(required_device_extensions);
+		}
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features{};
+		bindless_descriptors::enable_features(device_features, indexing_features);
+		VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features{};
+		gpu_timeline::enable_features(timeline_features);
+		timeline_features.pNext = &indexing_features;
+
+		VkDeviceCreateInfo create_info{};
+		create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		create_info.pNext = &timeline_features;
+
+#ifdef VK_KHR_present_wait
+		VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+		VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+		if (!headless_ && present_policy_ == present_policy::low_latency && is_present_wait_supported())
+		{
+			present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+			present_id_features.pNext = &timeline_features;
+			present_id_features.presentId = VK_TRUE;
+			present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+			present_wait_features.pNext = &present_id_features;
+			present_wait_features.presentWait = VK_TRUE;
+			create_info.pNext = &present_wait_features;
+
+			required_device_extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			required_device_extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			present_wait_enabled_ = true;
+		}
+#endif
+
+		const bool dynamic_rendering_requested = dynamic_rendering_;
+#ifdef VK_KHR_dynamic_rendering
+		VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features{};
+		dynamic_rendering_ = dynamic_rendering_ && is_dynamic_rendering_supported();
+		if (dynamic_rendering_)
+		{
+			dynamic_rendering_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+			dynamic_rendering_features.pNext = const_cast<void*>(create_info.pNext);
+			dynamic_rendering_features.dynamicRendering = VK_TRUE;
+			create_info.pNext = &dynamic_rendering_features;
+
+			required_device_extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+		}
+#else
+		dynamic_rendering_ = false;
+#endif
+
+		create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
+		create_info.pQueueCreateInfos = queue_create_infos.data();
+
+		create_info.pEnabledFeatures = &device_features;
+
+		create_info.enabledExtensionCount = static_cast<uint32_t>(required_device_extensions.size());
+		create_info.ppEnabledExtensionNames = required_device_extensions.data();
+
+		if (validation_.validation)
+		{
+			create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
+			create_info.ppEnabledLayerNames = validation_layers.data();
+		}
+		else
+		{
+			create_info.enabledLayerCount = 0;
+		}
+
+		VkDevice device;
+		if (vkCreateDevice(physical_device_, &create_info, nullptr, &device) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create logical device!");
+		}
+		device_ = unique_device(device);
+
+		vkGetDeviceQueue(device_.get(), indices.graphics_family.value(), 0, &graphics_queue_);
+		vkGetDeviceQueue(device_.get(), indices.present_family.value(), 0, &present_queue_);
+		vkGetDeviceQueue(device_.get(), indices.transfer_family.value(), 0, &transfer_queue_);
+		vkGetDeviceQueue(device_.get(), indices.compute_family.value(), 0, &compute_queue_);
+		if (validation_.validation || validation_.debug_utils)
+		{
+			name_device_objects();
+		}
+
+		if (async_compute_ && gpu_culling_ && indices.compute_family == indices.graphics_family)
+		{
+			std::cout << "No dedicated compute family, the culling stays on the graphics queue" << std::endl;
+		}
+		async_compute_ = async_compute_ && gpu_culling_ && indices.compute_family != indices.graphics_family;
+
+		if (host_memory_import_.min_pointer_alignment > 0)
+		{
+			host_memory_import_.get_memory_host_pointer_properties =
+				reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(vkGetDeviceProcAddr(device_.get(), "vkGetMemoryHostPointerPropertiesEXT"));
+		}
+
+#ifdef VK_KHR_present_wait
+		if (present_wait_enabled_)
+		{
+			wait_for_present_ = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device_.get(), "vkWaitForPresentKHR"));
+			present_wait_enabled_ = wait_for_present_ != nullptr;
+		}
+#endif
+		if (present_policy_ == present_policy::low_latency && !headless_ && !present_wait_enabled_)
+		{
+			std::cout << "Present wait is not supported, low latency pacing only waits on the frames in flight" << std::endl;
+		}
+
+#ifdef VK_KHR_dynamic_rendering
+		if (dynamic_rendering_)
+		{
+			begin_rendering_ = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(device_.get(), "vkCmdBeginRenderingKHR"));
+			end_rendering_ = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(device_.get(), "vkCmdEndRenderingKHR"));
+			dynamic_rendering_ = begin_rendering_ != nullptr && end_rendering_ != nullptr;
+		}
+#endif
+		if (dynamic_rendering_requested && !dynamic_rendering_)
+		{
+			std::cout << "Dynamic rendering is not supported, the main pass uses a render pass and framebuffers" << std::endl;
+		}
+	}
+
+#ifdef VK_KHR_dynamic_rendering
+	bool is_dynamic_rendering_supported() const
+	{
+		uint32_t extension_count;
+		vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available_extensions.data());
+
+		const bool extension = std::any_of(available_extensions.begin(), available_extensions.end(), [](const VkExtensionProperties& properties)
+			{
+				return strcmp(properties.extensionName, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) == 0;
+			});
+		if (!extension)
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features{};
+		dynamic_rendering_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &dynamic_rendering_features;
+		vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+
+		return dynamic_rendering_features.dynamicRendering == VK_TRUE;
+	}
+#endif
+
+#ifdef VK_KHR_present_wait
+	/**
+	 * Both extensions and both features are needed: present ids tag the presents and present wait blocks until one is displayed
+	 */
+	bool is_present_wait_supported() const
+	{
+		uint32_t extension_count;
+		vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available_extensions.data());
+
+		bool present_id_extension = false;
+		bool present_wait_extension = false;
+		for (const auto& extension : available_extensions)
+		{
+			present_id_extension |= strcmp(extension.extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0;
+			present_wait_extension |= strcmp(extension.extensionName, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0;
+		}
+		if (!present_id_extension || !present_wait_extension)
+		{
+			return false;
+		}
+
+		VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+		present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+		present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		present_wait_features.pNext = &present_id_features;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &present_wait_features;
+		vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+
+		return present_id_features.presentId && present_wait_features.presentWait;
+	}
+#endif
+
+	/**
+	 * GPU culling needs drawIndirectFirstInstance, since every draw starts at its own range of the instance buffer.
+	 * The indirect count extension and multiDrawIndirect are optional, gpu_culling_pass falls back to plain indirect draws
+	 */
+	void enable_gpu_culling_support(VkPhysicalDeviceFeatures& device_features, std::vector<const char*>& extensions)
+	{
+		VkPhysicalDeviceFeatures supported_features;
+		vkGetPhysicalDeviceFeatures(physical_device_, &supported_features);
+
+		if (!supported_features.drawIndirectFirstInstance)
+		{
+			std::cout << "drawIndirectFirstInstance is not supported, GPU culling is disabled" << std::endl;
+			gpu_culling_ = false;
+			return;
+		}
+		device_features.drawIndirectFirstInstance = VK_TRUE;
+		device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+		culling_capabilities_.multi_draw_indirect = supported_features.multiDrawIndirect == VK_TRUE;
+
+		uint32_t extension_count;
+		vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available_extensions.data());
+
+		for (const auto& extension : available_extensions)
+		{
+			if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+			{
+				extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				culling_capabilities_.draw_indirect_count = true;
+			}
+		}
+	}
+
+	/**
+	 * VK_EXT_external_memory_host is optional, without it the mesh file goes through the staging ring. Only records the alignment,
+	 * the entry point is loaded once the device exists
+	 */
+	void enable_host_memory_import(std::vector<const char*>& extensions)
+	{
+		uint32_t extension_count;
+		vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available_extensions.data());
+
+		const bool supported = std::any_of(available_extensions.begin(), available_extensions.end(),
+			[](const VkExtensionProperties& extension) { return strcmp(extension.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0; });
+		if (!supported)
+		{
+			return;
+		}
+
+		VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties{};
+		host_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &host_properties;
+		vkGetPhysicalDeviceProperties2(physical_device_, &properties);
+
+		extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+		host_memory_import_.min_pointer_alignment = std::max<VkDeviceSize>(host_properties.minImportedHostPointerAlignment, 1);
+	}
+
+	/**
+	 * Families of the queues touching the buffers the async compute queue reads or writes, empty without async compute so the
+	 * buffers stay VK_SHARING_MODE_EXCLUSIVE. Includes the transfer family, which uploads some of them
+	 */
+	std::vector<uint32_t> get_async_compute_sharing_families()
+	{
+		if (!async_compute_)
+		{
+			return {};
+		}
+
+		queue_family_indices indices = find_queue_families(physical_device_);
+		const std::set<uint32_t> families = { indices.graphics_family.value(), indices.compute_family.value(), indices.transfer_family.value() };
+
+		return std::vector<uint32_t>(families.begin(), families.end());
+	}
+
+	void create_uploader()
+	{
+		queue_family_indices indices = find_queue_families(physical_device_);
+		uploader_.init(allocator_, indices.transfer_family.value(), transfer_queue_, indices.graphics_family.value());
+
+		if (validation_.validation)
+		{
+			std::cout << "Uploads use " << (uploader_.uses_ownership_transfer() ? "a dedicated transfer queue" : "the graphics queue") << std::endl;
+		}
+	}
+
+	//	*********************************************
+	//	******** SWAPCHAIN RELATED FUNCTIONS ********
+	//	*********************************************
+
+	swap_chain_support_details query_swap_chain_support(VkPhysicalDevice device)
+	{
+		swap_chain_support_details details;
+
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface_.get(), &details.capabilities);
+
+		uint32_t format_count;
+		vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_.get(), &format_count, nullptr);
+
+		if (format_count != 0)
+		{
+			details.formats.resize(format_count);
+			vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_.get(), &format_count, details.formats.data());
+		}
+
+		uint32_t present_mode_count;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_.get(), &present_mode_count, nullptr);
+
+		if (present_mode_count != 0)
+		{
+			details.present_modes.resize(present_mode_count);
+			vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_.get(), &present_mode_count, details.present_modes.data());
+		}
+
+		return details;
+	}
+
+	VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& availableFormats)
+	{
+		for (const auto& available_format : availableFormats)
+		{
+			if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+			{
+				return available_format;
+			}
+		}
+
+		return availableFormats[0];
+	}
+
+	VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+	{
+		if (requested_present_mode_)
+		{
+			if (std::find(availablePresentModes.begin(), availablePresentModes.end(), *requested_present_mode_) != availablePresentModes.end())
+			{
+				return *requested_present_mode_;
+			}
+			std::cout << "Present mode " << present_mode_name(*requested_present_mode_) << " is not supported, falling back" << std::endl;
+		}
+
+		for (const auto preferred_present_mode : get_preferred_present_modes())
+		{
+			if (std::find(availablePresentModes.begin(), availablePresentModes.end(), preferred_present_mode) != availablePresentModes.end())
+			{
+				return preferred_present_mode;
+			}
+		}
+
+		// FIFO is the only mode every surface has to support
+		return VK_PRESENT_MODE_FIFO_KHR;
+	}
+
+	/**
+	 * Present modes of the present policy, best first
+	 */
+	std::vector<VkPresentModeKHR> get_preferred_present_modes() const
+	{
+		switch (present_policy_)
+		{
+		case present_policy::low_latency:
+			// Mailbox comes after the tearing modes, it still waits on a vertical blank before showing the newest image
+			return { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+		case present_policy::throughput:
+			return { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+		case present_policy::power_saving:
+			return { VK_PRESENT_MODE_FIFO_KHR };
+		default:
+			return { VK_PRESENT_MODE_MAILBOX_KHR };
+		}
+	}
+
+	/**
+	 * The fewer images, the fewer frames can queue up in front of the display. The throughput policy takes more so the GPU always
+	 * has an image to render to while the others wait for their vertical blank
+	 */
+	uint32_t choose_swap_image_count(const VkSurfaceCapabilitiesKHR& capabilities) const
+	{
+		uint32_t image_count = capabilities.minImageCount + 1;
+		if (present_policy_ == present_policy::low_latency)
+		{
+			image_count = capabilities.minImageCount;
+		}
+		else if (present_policy_ == present_policy::throughput)
+		{
+			image_count = capabilities.minImageCount + 2;
+		}
 
-		std::vector<VkExtensionProperties> available_extensions(extension_count);
-		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+		if (capabilities.maxImageCount > 0 && image_count > capabilities.maxImageCount)
+		{
+			image_count = capabilities.maxImageCount;
+		}
 
-		std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
+		return image_count;
+	}
 
-		for (const auto& extension : available_extensions)
+	VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities)
+	{
+		if (capabilities.currentExtent.width != UINT32_MAX)
 		{
-			required_extensions.erase(extension.extensionName);
+			return capabilities.currentExtent;
 		}
+		else
+		{
+			int width, height;
+			glfwGetFramebufferSize(window_.get(), &width, &height);
 
-		return required_extensions.empty();
+			VkExtent2D actual_extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+
+			actual_extent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actual_extent.width));
+			actual_extent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actual_extent.height));
+
+			return actual_extent;
+		}
 	}
 
-	//	***************************************************
-	//	******** PHYSICAL DEVICE RELATED FUNCTIONS ********
-	//	***************************************************
+	void create_image_views()
+	{
+		swap_chain_image_views_.clear();
 
-	void pick_physical_device()
+		for (size_t i = 0; i < swap_chain_images_.size(); i++)
+		{
+			VkImageViewCreateInfo create_info{};
+			create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			create_info.image = swap_chain_images_[i];
+			create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			create_info.format = swap_chain_image_format_;
+			create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+			create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+			create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+			create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+			create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			create_info.subresourceRange.baseMipLevel = 0;
+			create_info.subresourceRange.levelCount = 1;
+			create_info.subresourceRange.baseArrayLayer = 0;
+			create_info.subresourceRange.layerCount = 1;
+
+			VkImageView image_view;
+			if (vkCreateImageView(device_.get(), &create_info, nullptr, &image_view) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create image views!");
+			}
+			swap_chain_image_views_.emplace_back(device_.get(), image_view);
+		}
+	}
+
+	void create_swap_chain()
 	{
-		uint32_t device_count = 0;
-		vkEnumeratePhysicalDevices(instance_, &device_count, nullptr);
+		swap_chain_support_details swap_chain_support = query_swap_chain_support(physical_device_);
 
-		if (device_count == 0)
+		VkSurfaceFormatKHR surface_format = choose_swap_surface_format(swap_chain_support.formats);
+		VkPresentModeKHR present_mode = choose_swap_present_mode(swap_chain_support.present_modes);
+		VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities);
+
+		uint32_t image_count = choose_swap_image_count(swap_chain_support.capabilities);
+
+		VkSwapchainCreateInfoKHR create_info{};
+		create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+		create_info.surface = surface_.get();
+
+		create_info.minImageCount = image_count;
+		create_info.imageFormat = surface_format.format;
+		create_info.imageColorSpace = surface_format.colorSpace;
+		create_info.imageExtent = extent;
+		create_info.imageArrayLayers = 1;
+		create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+		queue_family_indices indices = find_queue_families(physical_device_);
+		uint32_t queue_family_indices[] = { indices.graphics_family.value(), indices.present_family.value() };
+
+		if (indices.graphics_family != indices.present_family)
 		{
-			throw std::runtime_error("Failed to find GPUs with Vulkan support!");
+			create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+			create_info.queueFamilyIndexCount = 2;
+			create_info.pQueueFamilyIndices = queue_family_indices;
+		}
+		else
+		{
+			create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		}
 
-		std::vector<VkPhysicalDevice> devices(device_count);
-		vkEnumeratePhysicalDevices(instance_, &device_count, devices.data());
+		create_info.preTransform = swap_chain_support.capabilities.currentTransform;
+		create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+		create_info.presentMode = present_mode;
+		create_info.clipped = VK_TRUE;
 
-		std::cout << "-- Selecting Physical Device --" << std::endl;
+		// Handing over the previous swapchain lets the presentation engine reuse its resources and keep presenting its queued images
+		create_info.oldSwapchain = swap_chain_.get();
 
-		/*for (const auto& device : devices)
+		VkSwapchainKHR new_swap_chain;
+		if (vkCreateSwapchainKHR(device_.get(), &create_info, nullptr, &new_swap_chain) != VK_SUCCESS)
 		{
-			std::cout << std::endl;
-			get_physical_device_properties(device);
-			std::cout << std::endl;
-			get_physical_device_features(device);
-			std::cout << std::endl;
-			std::cout << "----------------------------------------------------------------------" << std::endl;
-			if (is_device_suitable(device))
+			throw std::runtime_error("Failed to create swap chain!");
+		}
+		// The old swapchain can still have images queued for presentation by the frames in flight
+		deletion_queue_.retire(frame_number_, std::move(swap_chain_));
+		swap_chain_ = unique_swap_chain(device_.get(), new_swap_chain);
+
+		vkGetSwapchainImagesKHR(device_.get(), swap_chain_.get(), &image_count, nullptr);
+		swap_chain_images_.resize(image_count);
+		vkGetSwapchainImagesKHR(device_.get(), swap_chain_.get(), &image_count, swap_chain_images_.data());
+
+		swap_chain_image_format_ = surface_format.format;
+		swap_chain_extent_ = extent;
+		swap_chain_present_mode_ = present_mode;
+		present_id_ = 0;
+	}
+
+	/**
+	 * Rebuild the swapchain after a resize or when the surface went out of date. Only the objects that depend on the swapchain images are rebuilt,
+	 * the previous ones go to the deletion queue and are destroyed once the frames that used them are done, so there is no device stall
+	 */
+	void recreate_swap_chain()
+	{
+		// A minimized window has a zero sized framebuffer, wait until it is visible again
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(window_.get(), &width, &height);
+		while (width == 0 || height == 0)
+		{
+			if (glfwWindowShouldClose(window_.get()))
 			{
-				physical_device_ = device;
+				return;
+			}
+			glfwWaitEvents();
+			glfwGetFramebufferSize(window_.get(), &width, &height);
+		}
+
+		// Released in the order they have to be destroyed, the swapchain itself is released by create_swap_chain()
+		deletion_queue_.retire(frame_number_, std::move(swap_chain_frame_buffers_));
+		retire_render_targets(std::exchange(render_targets_, {}));
+		deletion_queue_.retire(frame_number_, std::move(swap_chain_image_views_));
+
+		const VkFormat old_image_format = swap_chain_image_format_;
+
+		create_swap_chain();
+		create_image_views();
+		// Viewport and scissor are dynamic, so the pipeline only depends on the render pass, or on the attachment formats with dynamic
+		// rendering, which only change with the image format
+		if (swap_chain_image_format_ != old_image_format)
+		{
+			for (const VkPipeline pipeline : pipelines_.retire(render_pass_.get()))
+			{
+				deletion_queue_.retire(frame_number_, unique_pipeline(device_.get(), pipeline));
+			}
+			deletion_queue_.retire(frame_number_, std::move(render_pass_));
+			create_frame_graph();
+			create_render_pass();
+			create_graphics_pipeline();
+		}
+		create_render_targets();
+		create_frame_buffers();
+
+		images_in_flight_.assign(swap_chain_images_.size(), 0);
+	}
+
+	/**
+	 * Dynamic rendering begins the main pass on the image views directly, there is no framebuffer to rebuild with the swapchain
+	 */
+	void create_frame_buffers()
+	{
+		swap_chain_frame_buffers_.clear();
+		if (dynamic_rendering_)
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < swap_chain_image_views_.size(); i++)
+		{
+			std::vector<VkImageView> attachments(frame_graph_.attachment_count(main_pass_));
+			main_pass_image_views(static_cast<uint32_t>(i), attachments.data());
+
+			VkFramebufferCreateInfo framebuffer_info{};
+			framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebuffer_info.renderPass = render_pass_.get();
+			framebuffer_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+			framebuffer_info.pAttachments = attachments.data();
+			framebuffer_info.width = swap_chain_extent_.width;
+			framebuffer_info.height = swap_chain_extent_.height;
+			framebuffer_info.layers = 1;
+
+			VkFramebuffer framebuffer;
+			if (vkCreateFramebuffer(device_.get(), &framebuffer_info, nullptr, &framebuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create framebuffer!");
+			}
+			swap_chain_frame_buffers_.emplace_back(device_.get(), framebuffer);
+		}
+	}
+
+	/**
+	 * Attachments of the main pass for one swapchain image, ordered like the attachments of the render pass
+	 */
+	void main_pass_image_views(const uint32_t image_index, VkImageView* image_views) const
+	{
+		for (uint32_t index = 0; index < frame_graph_.attachment_count(main_pass_); index++)
+		{
+			const frame_resource_handle resource = frame_graph_.attachment(main_pass_, index);
+			image_views[index] = resource == color_target_ ? swap_chain_image_views_[image_index].get() :
+				frame_graph_.target_view(render_targets_[image_index], resource);
+		}
+	}
+
+	//	*************************************************
+	//	******** RENDER TARGET RELATED FUNCTIONS ********
+	//	*************************************************
+
+	/**
+	 * Pick the depth format and lower the requested sample count to one the device supports for both color and depth attachments
+	 */
+	void choose_render_target_formats()
+	{
+		depth_format_ = VK_FORMAT_UNDEFINED;
+		for (const VkFormat candidate : DEPTH_FORMAT_CANDIDATES)
+		{
+			VkFormatProperties format_properties;
+			vkGetPhysicalDeviceFormatProperties(physical_device_, candidate, &format_properties);
+			if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			{
+				depth_format_ = candidate;
 				break;
 			}
 		}
 
-		if (physical_device_ == VK_NULL_HANDLE)
+		if (depth_format_ == VK_FORMAT_UNDEFINED)
+		{
+			throw std::runtime_error("Failed to find a supported depth format!");
+		}
+
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
+
+		const VkSampleCountFlags supported_samples = device_properties.limits.framebufferColorSampleCounts &
+			device_properties.limits.framebufferDepthSampleCounts;
+		while (msaa_samples_ > VK_SAMPLE_COUNT_1_BIT && !(supported_samples & msaa_samples_))
+		{
+			msaa_samples_ = static_cast<VkSampleCountFlagBits>(msaa_samples_ >> 1);
+		}
+	}
+
+	/**
+	 * Without separateDepthStencilLayouts the layout transitions of a combined depth stencil image have to cover both aspects
+	 */
+	VkImageAspectFlags get_depth_aspect() const
+	{
+		if (depth_format_ == VK_FORMAT_D32_SFLOAT_S8_UINT || depth_format_ == VK_FORMAT_D24_UNORM_S8_UINT ||
+			depth_format_ == VK_FORMAT_D16_UNORM_S8_UINT)
+		{
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+
+		return VK_IMAGE_ASPECT_DEPTH_BIT;
+	}
+
+	/**
+	 * Transient images of the frame graph for every framebuffer. Each framebuffer gets its own, so frames in flight never share an
+	 * attachment and no frame has to wait for the previous one to be done with it
+	 */
+	void create_render_targets()
+	{
+		render_targets_.clear();
+		for (size_t i = 0; i < swap_chain_image_views_.size(); i++)
+		{
+			render_targets_.push_back(frame_graph_.create_targets(allocator_, swap_chain_extent_));
+		}
+	}
+
+	void destroy_render_targets(std::vector<frame_graph_targets>& render_targets)
+	{
+		for (auto& targets : render_targets)
+		{
+			frame_graph_.destroy_targets(allocator_, targets);
+		}
+		render_targets.clear();
+	}
+
+	/**
+	 * Hand the render targets to the deletion queue, the frames in flight may still render to them
+	 */
+	void retire_render_targets(std::vector<frame_graph_targets> render_targets)
+	{
+		deletion_queue_.push(frame_number_, [this, render_targets]() mutable { destroy_render_targets(render_targets); });
+	}
+
+	//	********************************************
+	//	******** HEADLESS RELATED FUNCTIONS ********
+	//	********************************************
+
+	/**
+	 * Stand-ins for the swapchain in headless mode: one device local image per frame in flight, so the image index of a frame is
+	 * its frame slot, plus the ring of host visible buffers the images are copied to
+	 */
+	void create_offscreen_targets()
+	{
+		swap_chain_image_format_ = HEADLESS_IMAGE_FORMAT;
+		swap_chain_extent_ = { WIDTH, HEIGHT };
+
+		VkImageCreateInfo image_info{};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = swap_chain_image_format_;
+		image_info.extent = { swap_chain_extent_.width, swap_chain_extent_.height, 1 };
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		swap_chain_images_.resize(max_frames_in_flight_);
+		offscreen_images_.resize(max_frames_in_flight_);
+		offscreen_image_allocations_.resize(max_frames_in_flight_);
+		for (size_t i = 0; i < swap_chain_images_.size(); i++)
+		{
+			if (vkCreateImage(device_.get(), &image_info, nullptr, &swap_chain_images_[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create offscreen image!");
+			}
+			offscreen_images_[i] = unique_image(device_.get(), swap_chain_images_[i]);
+			offscreen_image_allocations_[i] = allocator_.allocate_for_image(swap_chain_images_[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
+
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = VkDeviceSize(swap_chain_extent_.width) * swap_chain_extent_.height * HEADLESS_BYTES_PER_PIXEL;
+		buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		readbacks_.resize(max_frames_in_flight_);
+		for (auto& readback : readbacks_)
+		{
+			VkBuffer buffer;
+			if (vkCreateBuffer(device_.get(), &buffer_info, nullptr, &buffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create readback buffer!");
+			}
+			readback.buffer = unique_buffer(device_.get(), buffer);
+			// Cached memory makes the CPU reads fast, allocator_.invalidate() takes care of it not being coherent
+			readback.allocation = allocator_.allocate_for_buffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+		}
+	}
+
+	/**
+	 * The images and buffers go with the class, their memory has to go back before the allocator is destroyed
+	 */
+	void free_offscreen_allocations()
+	{
+		for (auto& allocation : offscreen_image_allocations_)
+		{
+			allocator_.free(allocation);
+		}
+		offscreen_image_allocations_.clear();
+
+		for (auto& readback : readbacks_)
+		{
+			allocator_.free(readback.allocation);
+		}
+	}
+
+	/**
+	 * Copy the rendered image to the readback buffer of the current frame. The readback pass of the frame graph transitions the
+	 * image before the copy and makes the buffer visible to the host after it
+	 */
+	void record_readback_copy(const VkCommandBuffer command_buffer, const uint32_t image_index)
+	{
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0; // Tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { swap_chain_extent_.width, swap_chain_extent_.height, 1 };
+
+		const offscreen_readback& readback = readbacks_[current_frame_];
+		vkCmdCopyImageToBuffer(command_buffer, swap_chain_images_[image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer.get(), 1, &region);
+	}
+
+	/**
+	 * Consume the pixels of the frame last rendered in this slot. The caller must have waited for the slot with wait_for_frame_slot()
+	 */
+	void read_back_frame(offscreen_readback& readback)
+	{
+		if (!readback.pending)
+		{
+			return;
+		}
+
+		allocator_.invalidate(readback.allocation);
+		if (!capture_path_.empty())
+		{
+			const uint8_t* pixels = static_cast<const uint8_t*>(readback.allocation.mapped);
+			captured_pixels_.assign(pixels, pixels + VkDeviceSize(swap_chain_extent_.width) * swap_chain_extent_.height * HEADLESS_BYTES_PER_PIXEL);
+		}
+
+		readback.pending = false;
+		frames_read_back_++;
+	}
+
+	/**
+	 * Read back the frames still in flight in submission order, once the device is idle, and write the capture
+	 */
+	void finish_readbacks()
+	{
+		std::vector<offscreen_readback*> pending;
+		for (auto& readback : readbacks_)
+		{
+			if (readback.pending)
+			{
+				pending.push_back(&readback);
+			}
+		}
+		std::sort(pending.begin(), pending.end(), [](const offscreen_readback* a, const offscreen_readback* b) { return a->frame_number < b->frame_number; });
+
+		for (auto readback : pending)
 		{
-			throw std::runtime_error("Failed to find a suitable GPU!");
-		}*/
+			read_back_frame(*readback);
+		}
 
-		// new one
+		std::cout << "Headless: " << frames_read_back_ << " frames rendered and read back" << std::endl;
 
-		// Use an ordered map to automatically sort candidates by increasing score
-		std::multimap<uint32_t, VkPhysicalDevice> candidates;
+		if (!capture_path_.empty() && !captured_pixels_.empty())
+		{
+			write_capture();
+		}
+	}
 
-		for (const auto& device : devices)
+	void write_capture()
+	{
+		std::ofstream file(capture_path_, std::ios::binary | std::ios::trunc);
+		if (!file)
 		{
-			uint32_t score = rate_device_suitability(device);
-			candidates.insert(std::make_pair(score, device));
-			std::cout << "Device score: " << score << std::endl;
+			throw std::runtime_error("Failed to open capture file " + capture_path_ + "!");
 		}
 
-		// Check if the best candidate is suitable at all
-		if (candidates.rbegin()->first > 0)
+		// Binary PPM, the alpha channel is dropped. The values are already sRGB encoded, which is what image viewers expect
+		file << "P6\n" << swap_chain_extent_.width << " " << swap_chain_extent_.height << "\n255\n";
+		std::vector<char> row(size_t(swap_chain_extent_.width) * 3);
+		for (uint32_t y = 0; y < swap_chain_extent_.height; y++)
 		{
-			physical_device_ = candidates.rbegin()->second;
+			const uint8_t* source = &captured_pixels_[size_t(y) * swap_chain_extent_.width * HEADLESS_BYTES_PER_PIXEL];
+			for (uint32_t x = 0; x < swap_chain_extent_.width; x++)
+			{
+				row[x * 3 + 0] = static_cast<char>(source[x * HEADLESS_BYTES_PER_PIXEL + 0]);
+				row[x * 3 + 1] = static_cast<char>(source[x * HEADLESS_BYTES_PER_PIXEL + 1]);
+				row[x * 3 + 2] = static_cast<char>(source[x * HEADLESS_BYTES_PER_PIXEL + 2]);
+			}
+			file.write(row.data(), row.size());
 		}
-		else
+
+		if (!file)
 		{
-			throw std::runtime_error("Failed to find a suitable GPU!");
+			throw std::runtime_error("Failed to write capture file " + capture_path_ + "!");
 		}
+		std::cout << "Last frame written to " << capture_path_ << std::endl;
+	}
 
-		std::cout << "-- End Physical Device Selection --" << std::endl;
+	//	*****************************************************
+	//	******** GRAPHICS PIPELINE RELATED FUNCTIONS ********
+	//	*****************************************************
+
+	/**
+	 * Set 0 is the per-frame uniform ring, set 1 the bindless buffers and textures. Both are allocated once, recording a frame only
+	 * binds them with a new dynamic offset
+	 */
+	void create_descriptors()
+	{
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
+
+		const VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		uniforms_.init(allocator_, device_properties.limits.minUniformBufferOffsetAlignment, max_frames_in_flight_, stages);
+		bindless_.init(physical_device_, device_.get(), stages);
 	}
 
-	bool is_device_suitable(VkPhysicalDevice device)
+	/**
+	 * The layout doesn't depend on the swapchain, so it is created once and survives swapchain recreation
+	 */
+	void create_pipeline_layout()
 	{
-		queue_family_indices indices = find_queue_families(device);
+		const std::array<VkDescriptorSetLayout, 2> set_layouts = { uniforms_.descriptor_set_layout(), bindless_.descriptor_set_layout() };
 
-		bool extensions_supported = check_device_extension_support(device);
+		VkPushConstantRange push_constant_range{};
+		push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		push_constant_range.offset = 0;
+		push_constant_range.size = sizeof(draw_push_constants);
+
+		VkPipelineLayoutCreateInfo pipeline_layout_info{};
+		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+		pipeline_layout_info.pSetLayouts = set_layouts.data();
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
-		bool swap_chain_adequate = false;
-		if (extensions_supported)
+		VkPipelineLayout pipeline_layout;
+		if (vkCreatePipelineLayout(device_.get(), &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS)
 		{
-			swap_chain_support_details swap_chain_support = query_swap_chain_support(device);
-			swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
+			throw std::runtime_error("Failed to create pipeline layout!");
 		}
-
-		return indices.is_complete() && extensions_supported && swap_chain_adequate;
+		pipeline_layout_ = unique_pipeline_layout(device_.get(), pipeline_layout);
 	}
 
-	void get_physical_device_properties(const VkPhysicalDevice device)
+	/**
+	 * Register the pipeline variants of the current render pass. The opaque variant is compiled right away and drawn with until
+	 * the blended one, compiled in the background, is ready
+	 */
+	void create_graphics_pipeline()
 	{
-		VkPhysicalDeviceProperties device_properties;
-		vkGetPhysicalDeviceProperties(device, &device_properties);
+		graphics_pipeline_state state;
+		state.vertex_shader_path = "shaders/vert.spv";
+		state.fragment_shader_path = "shaders/frag.spv";
+
+		// Per-vertex mesh data first, then one binding per instance stream
+		state.vertex_bindings = { mesh_vertex::get_binding_description() };
+		const auto instance_bindings = instance_buffer::get_binding_descriptions(INSTANCE_FIRST_BINDING);
+		state.vertex_bindings.insert(state.vertex_bindings.end(), instance_bindings.begin(), instance_bindings.end());
+
+		const auto mesh_attributes = mesh_vertex::get_attribute_descriptions();
+		const auto instance_attributes = instance_buffer::get_attribute_descriptions(INSTANCE_FIRST_BINDING, INSTANCE_FIRST_LOCATION);
+		state.vertex_attributes.assign(mesh_attributes.begin(), mesh_attributes.end());
+		state.vertex_attributes.insert(state.vertex_attributes.end(), instance_attributes.begin(), instance_attributes.end());
+
+		state.layout = pipeline_layout_.get();
+		state.render_pass = render_pass_.get();
+		state.subpass = 0;
+		if (dynamic_rendering_)
+		{
+			state.color_format = main_pass_formats_.color_formats.front();
+			state.depth_format = main_pass_formats_.depth_format;
+		}
+		state.samples = msaa_samples_;
+		state.set_specialization_constant(ROTATE_INSTANCES_CONSTANT_ID, animated_instances_ > 0 ? VK_TRUE : VK_FALSE);
 
+		if (depth_prepass_)
+		{
+			// The pre-pass writes the depth of the closest surfaces, the color pass then only shades the fragments matching it
+			graphics_pipeline_state depth_state = state;
+			depth_state.blend_enable = false;
+			depth_state.color_write_enable = false;
+			depth_state.depth_compare_op = VK_COMPARE_OP_LESS_OR_EQUAL;
+			depth_prepass_pipeline_ = pipelines_.create(depth_state);
+
+			state.depth_write_enable = false;
+			state.depth_compare_op = VK_COMPARE_OP_EQUAL;
+		}
 
-		std::cout << "-- Device Properties --" << std::endl;
-		std::cout << "Name: " << device_properties.deviceName << std::endl;
-		std::cout << "API version: " << device_properties.apiVersion << std::endl;
-		std::cout << "ID: " << device_properties.deviceID << std::endl;
-		std::cout << "Type: " << device_properties.deviceType << "(0-> Other, \n\t1-> Integrated GPU, \n\t2-> Discrete GPU, \n\t3-> Virtual GPU, \n\t4-> CPU)" << std::endl;
-		std::cout << "Driver Version: " << device_properties.driverVersion << std::endl;
-		//std::cout << "Limits: " << device_properties.limits << std::endl;
-		//std::cout << "Pipeline Cache UUID: " << device_properties.pipelineCacheUUID << std::endl;
-		//std::cout << "Sparse Properties - Residency Aligned Mip Size: " << device_properties.sparseProperties.residencyStandard2DBlockShape << std::endl;
-		std::cout << "Vendor ID: " << device_properties.vendorID << std::endl;
-		std::cout << std::endl;
-		get_physical_device_memory_properties(device);
+		graphics_pipeline_state fallback_state = state;
+		fallback_state.blend_enable = false;
+
+		fallback_pipeline_ = pipelines_.create(fallback_state);
+		graphics_pipeline_ = pipelines_.request(state, fallback_pipeline_);
 	}
 
-	void get_physical_device_features(const VkPhysicalDevice device)
+	/**
+	 * Reload the shader files changed on disk and queue the rebuild of the pipelines using them. The rebuilt pipelines are swapped
+	 * in by record_command_buffer() once ready, the frame loop keeps drawing with the current ones meanwhile
+	 */
+	void reload_changed_shaders()
 	{
-		VkPhysicalDeviceFeatures device_features;
-		vkGetPhysicalDeviceFeatures(device, &device_features);
+		const std::vector<std::string> changed_shaders = shader_modules_.poll_changes();
+		if (changed_shaders.empty())
+		{
+			return;
+		}
 
-		std::cout << "-- Device Features --" << std::endl;
-		std::cout << "Texture Compression - ASTC_LDR: " << device_features.textureCompressionASTC_LDR << std::endl;
-		std::cout << "Texture Compression - BC: " << device_features.textureCompressionBC << std::endl;
-		std::cout << "Texture Compression - ETC2: " << device_features.textureCompressionETC2 << std::endl;
-		std::cout << "64 bit shader floats: " << device_features.shaderFloat64 << std::endl;
-		std::cout << "Multi viewport rendering: " << device_features.multiViewport << std::endl;
+		for (const auto& path : changed_shaders)
+		{
+			std::cout << "Shader changed: " << path << ", rebuilding its pipelines" << std::endl;
+		}
+		pipelines_.reload(changed_shaders);
 	}
 
-	void get_physical_device_memory_properties(const VkPhysicalDevice device)
+	/**
+	 * Compute pipeline of the GPU culling pre-pass, it shares the pipeline cache with the graphics pipeline.
+	 * One object per draw command, so the culled draws are exactly the ones the CPU path records
+	 */
+	void create_culling_pipeline()
 	{
-		VkPhysicalDeviceMemoryProperties memory_properties;
-		vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
-		std::cout << std::endl;
-		std::cout << "-- Memory Properties --" << std::endl;
+		std::vector<culling_object> objects;
+		objects.reserve(draw_commands_.size());
+		for (const auto& command : draw_commands_)
+		{
+			objects.push_back({ command.index_count, command.first_index, command.vertex_offset, command.first_instance, command.instance_count,
+				mesh_.bounding_radius, { 0, 0 } });
+		}
 
-		const uint32_t memory_type_count = memory_properties.memoryTypeCount;
-		std::cout << "Memory Type Count: " << memory_type_count << std::endl;
+		const VkShaderModule compute_shader_module = shader_modules_.acquire("shaders/cull.spv");
+		culling_.init(allocator_, uploader_, pipeline_cache_.get(), compute_shader_module, objects, instances_, max_frames_in_flight_, culling_capabilities_,
+			get_async_compute_sharing_families());
 
-		for (uint32_t memory_index = 0; memory_index < memory_type_count; memory_index++)
+		if (validation_.validation)
 		{
-			std::cout << "Memory Types [" << memory_index << "]: " << std::endl;
-			std::cout << "\t Property Flags: " << memory_properties.memoryTypes[memory_index].propertyFlags << std::endl;
-			std::cout << "\t Heap Index: " << memory_properties.memoryTypes[memory_index].heapIndex << std::endl;
+			std::cout << "GPU culling draws with " << (culling_.capabilities().draw_indirect_count ? "vkCmdDrawIndexedIndirectCountKHR" :
+				culling_.capabilities().multi_draw_indirect ? "a multi draw vkCmdDrawIndexedIndirect" : "one vkCmdDrawIndexedIndirect per object")
+				<< std::endl;
 		}
+	}
 
-		const uint32_t memory_heap_count = memory_properties.memoryHeapCount;
-		std::cout << std::endl;
-		std::cout << "Memory Heap Count: " << memory_heap_count << std::endl;
+	//	**************************************************
+	//	******** PIPELINE CACHE RELATED FUNCTIONS ********
+	//	**************************************************
 
-		for (uint32_t memory_index = 0; memory_index < memory_heap_count; memory_index++)
+	/**
+	 * Create the pipeline cache shared by every pipeline creation, seeded from pipeline_cache_path_ when the file on disk
+	 * was written by this same device and driver. A stale or corrupted file is ignored and will be overwritten by save_pipeline_cache()
+	 */
+	void create_pipeline_cache()
+	{
+		const std::vector<char> initial_data = load_pipeline_cache_data();
+
+		VkPipelineCacheCreateInfo cache_info{};
+		cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cache_info.initialDataSize = initial_data.size();
+		cache_info.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+
+		VkPipelineCache pipeline_cache;
+		if (vkCreatePipelineCache(device_.get(), &cache_info, nullptr, &pipeline_cache) != VK_SUCCESS)
 		{
-			std::cout << "Memory Heaps [" << memory_index << "]:" << std::endl;
-			std::cout << "\t Flags: " << memory_properties.memoryHeaps[memory_index].flags << std::endl;
-			std::cout << "\t Size: " << (memory_properties.memoryHeaps[memory_index].size >> 30) << " gb" << std::endl;
+			throw std::runtime_error("Failed to create pipeline cache!");
 		}
+		pipeline_cache_ = unique_pipeline_cache(device_.get(), pipeline_cache);
 	}
 
-	uint32_t rate_device_suitability(const VkPhysicalDevice device)
+	pipeline_cache_file_header make_pipeline_cache_file_header(const size_t data_size)
 	{
-		uint32_t score = 0;
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
+
+		pipeline_cache_file_header header{};
+		header.magic = PIPELINE_CACHE_FILE_MAGIC;
+		header.file_version = PIPELINE_CACHE_FILE_VERSION;
+		header.vendor_id = device_properties.vendorID;
+		header.device_id = device_properties.deviceID;
+		header.driver_version = device_properties.driverVersion;
+		memcpy(header.pipeline_cache_uuid, device_properties.pipelineCacheUUID, VK_UUID_SIZE);
+		header.data_size = data_size;
+
+		return header;
+	}
 
-		VkPhysicalDeviceFeatures device_features;
-		vkGetPhysicalDeviceFeatures(device, &device_features);
+	/**
+	 * Returns the driver blob stored in pipeline_cache_path_, or an empty vector when there is no usable cache for this device
+	 */
+	std::vector<char> load_pipeline_cache_data()
+	{
+		if (pipeline_cache_path_.empty())
+		{
+			return {};
+		}
 
-		VkPhysicalDeviceProperties device_properties;
-		vkGetPhysicalDeviceProperties(device, &device_properties);
+		std::ifstream file(pipeline_cache_path_, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cout << "Pipeline cache: no cache found at " << pipeline_cache_path_ << ", starting cold" << std::endl;
+			return {};
+		}
+
+		pipeline_cache_file_header file_header{};
+		file.read(reinterpret_cast<char*>(&file_header), sizeof(file_header));
 
-		// Application can't function without geometry shaders
-		if (!device_features.geometryShader)
+		const pipeline_cache_file_header expected_header = make_pipeline_cache_file_header(0);
+		if (!file || file_header.magic != expected_header.magic || file_header.file_version != expected_header.file_version ||
+			file_header.vendor_id != expected_header.vendor_id || file_header.device_id != expected_header.device_id ||
+			file_header.driver_version != expected_header.driver_version ||
+			memcmp(file_header.pipeline_cache_uuid, expected_header.pipeline_cache_uuid, VK_UUID_SIZE) != 0 ||
+			file_header.data_size < sizeof(VkPipelineCacheHeaderVersionOne))
 		{
-			return 0;
+			std::cout << "Pipeline cache: " << pipeline_cache_path_ << " is stale or from another device, discarding it" << std::endl;
+			return {};
 		}
-		// Application can't function without the required families queues, extensions and swapchains
-		if (!is_device_suitable(device))
+
+		// The header is read from the file itself, it must agree with the file size before it sizes anything
+		std::error_code error;
+		const uintmax_t file_size = std::filesystem::file_size(pipeline_cache_path_, error);
+		if (error || file_size < sizeof(file_header) || file_header.data_size != file_size - sizeof(file_header))
 		{
-			return 0;
+			std::cout << "Pipeline cache: size of " << pipeline_cache_path_ << " does not match its header, discarding it" << std::endl;
+			return {};
 		}
 
-		// Discrete GPUs have a significant performance advantage
-		if (device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+		std::vector<char> data(static_cast<size_t>(file_header.data_size));
+		file.read(data.data(), static_cast<std::streamsize>(data.size()));
+		if (!file)
 		{
-			score += 1000;
+			std::cout << "Pipeline cache: " << pipeline_cache_path_ << " is truncated, discarding it" << std::endl;
+			return {};
 		}
 
-		// Maximum possible size of textures affects graphics quality
-		score += device_properties.limits.maxImageDimension2D;
+		// The driver validates its own header too, but checking it here lets us report why a cache was thrown away
+		VkPipelineCacheHeaderVersionOne driver_header;
+		memcpy(&driver_header, data.data(), sizeof(driver_header));
+		if (driver_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || driver_header.vendorID != expected_header.vendor_id ||
+			driver_header.deviceID != expected_header.device_id ||
+			memcmp(driver_header.pipelineCacheUUID, expected_header.pipeline_cache_uuid, VK_UUID_SIZE) != 0)
+		{
+			std::cout << "Pipeline cache: driver header of " << pipeline_cache_path_ << " does not match this device, discarding it" << std::endl;
+			return {};
+		}
 
-		return score;
+		std::cout << "Pipeline cache: loaded " << data.size() << " bytes from " << pipeline_cache_path_ << std::endl;
+		return data;
 	}
 
-	queue_family_indices find_queue_families(VkPhysicalDevice device)
+	/**
+	 * Serialize pipeline_cache_ to pipeline_cache_path_. The data is written to a temporary file first and then renamed over the old one,
+	 * so a crash while saving never leaves a half written cache behind
+	 */
+	void save_pipeline_cache()
 	{
-		queue_family_indices indices;
-
-		uint32_t queue_family_count = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
+		if (pipeline_cache_path_.empty() || !pipeline_cache_)
+		{
+			return;
+		}
 
-		std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families.data());
+		size_t data_size = 0;
+		if (vkGetPipelineCacheData(device_.get(), pipeline_cache_.get(), &data_size, nullptr) != VK_SUCCESS || data_size == 0)
+		{
+			return;
+		}
 
-		int i = 0;
-		for (const auto& queue_family : queue_families)
+		std::vector<char> data(data_size);
+		if (vkGetPipelineCacheData(device_.get(), pipeline_cache_.get(), &data_size, data.data()) != VK_SUCCESS)
 		{
-			if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-			{
-				indices.graphics_family = i;
-			}
+			std::cerr << "Pipeline cache: failed to read back cache data, not saving it" << std::endl;
+			return;
+		}
 
-			VkBool32 present_support = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &present_support);
+		const pipeline_cache_file_header header = make_pipeline_cache_file_header(data_size);
+		const std::string temporary_path = pipeline_cache_path_ + ".tmp";
 
-			if (present_support)
-			{
-				indices.present_family = i;
-			}
+		std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), static_cast<std::streamsize>(data_size));
+		file.close();
 
-			if (indices.is_complete())
-			{
-				break;
-			}
+		std::error_code error;
+		if (file)
+		{
+			// Unlike std::rename, this replaces an existing cache file on Windows too
+			std::filesystem::rename(temporary_path, pipeline_cache_path_, error);
+		}
 
-			i++;
+		if (!file || error)
+		{
+			std::cerr << "Pipeline cache: failed to write " << pipeline_cache_path_ << std::endl;
+			std::filesystem::remove(temporary_path, error);
+			return;
 		}
 
-		return indices;
+		std::cout << "Pipeline cache: saved " << data_size << " bytes to " << pipeline_cache_path_ << std::endl;
 	}
 
+	//	***********************************************
+	//	******** FRAME GRAPH RELATED FUNCTIONS ********
+	//	***********************************************
 
-	//	**************************************************
-	//	******** LOGICAL DEVICE RELATED FUNCTIONS ********
-	//	**************************************************
-
-	void create_logical_device()
+	/**
+	 * Declare the passes of a frame. Only the swapchain image is stored: depth and the MSAA color are cleared on load and discarded at
+	 * the end of the pass, so the graph makes them transient and a tile-based GPU never writes them out to memory. With MSAA the
+	 * samples are resolved into the swapchain image on the tile
+	 */
+	void create_frame_graph()
 	{
-		queue_family_indices indices = find_queue_families(physical_device_);
+		frame_graph_.reset();
 
-		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
-		std::set<uint32_t> unique_queue_families = { indices.graphics_family.value(), indices.present_family.value() };
-
-		float queue_priority = 1.0f;
-		for (uint32_t queue_family : unique_queue_families)
+		const frame_image_desc color_desc = { swap_chain_image_format_, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_COLOR_BIT };
+		if (headless_)
 		{
-			VkDeviceQueueCreateInfo queue_create_info{};
-			queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queue_create_info.queueFamilyIndex = queue_family;
-			queue_create_info.queueCount = 1;
-			queue_create_info.pQueuePriorities = &queue_priority;
-			queue_create_infos.push_back(queue_create_info);
+			color_target_ = frame_graph_.import_image("offscreen image", color_desc);
+		}
+		else
+		{
+			// Ordered by the image available semaphore, which the submit waits on at the color attachment output stage
+			color_target_ = frame_graph_.import_image("swapchain image", color_desc,
+				frame_resource_access{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED });
+			frame_graph_.set_output(color_target_, { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR });
 		}
+		const frame_resource_handle depth_target = frame_graph_.create_image("depth", { depth_format_, msaa_samples_, get_depth_aspect() });
 
-		VkPhysicalDeviceFeatures device_features{};
-		device_features.fillModeNonSolid = VK_FALSE; // uncomment when draw in wireframe mode
+		// Every frame slot has its own indirect buffers, whose previous use is behind the timeline wait of the slot. On the async
+		// compute queue the culling is outside of the graph, the wait of the graphics submit on the compute timeline orders it
+		const frame_resource_handle culled_draws = frame_graph_.import_buffer("culled draws", frame_resource_access{});
+		if (gpu_culling_ && !async_compute_)
+		{
+			const frame_pass_handle culling_pass = frame_graph_.add_pass("culling", frame_pass_type::compute, [this](const VkCommandBuffer command_buffer)
+				{
+					const uint32_t culling_scope = gpu_profiler_.begin_scope(command_buffer, "culling");
+					culling_.record_culling(command_buffer, static_cast<uint32_t>(current_frame_));
+					gpu_profiler_.end_scope(command_buffer, culling_scope);
+				});
+			frame_graph_.write(culling_pass, culled_draws, { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT });
+		}
 
-		VkDeviceCreateInfo create_info{};
-		create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		main_pass_ = frame_graph_.add_pass("main render pass", frame_pass_type::graphics, [this](const VkCommandBuffer command_buffer)
+			{
+				record_main_render_pass(command_buffer);
+			});
+		const VkClearColorValue clear_color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		if (msaa_samples_ != VK_SAMPLE_COUNT_1_BIT)
+		{
+			const frame_resource_handle msaa_color_target = frame_graph_.create_image("msaa color",
+				{ swap_chain_image_format_, msaa_samples_, VK_IMAGE_ASPECT_COLOR_BIT });
+			frame_graph_.add_color_attachment(main_pass_, msaa_color_target, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				clear_color, color_target_);
+		}
+		else
+		{
+			frame_graph_.add_color_attachment(main_pass_, color_target_, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, clear_color);
+		}
+		frame_graph_.set_depth_attachment(main_pass_, depth_target, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE);
+		if (gpu_culling_)
+		{
+			frame_graph_.read(main_pass_, culled_draws, { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT });
+		}
 
-		create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
-		create_info.pQueueCreateInfos = queue_create_infos.data();
+		if (headless_)
+		{
+			const frame_resource_handle readback = frame_graph_.import_buffer("readback", frame_resource_access{});
+			const frame_pass_handle readback_pass = frame_graph_.add_pass("readback", frame_pass_type::transfer,
+				[this](const VkCommandBuffer command_buffer)
+				{
+					record_readback_copy(command_buffer, recording_image_index_);
+				});
+			frame_graph_.read(readback_pass, color_target_, { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL });
+			frame_graph_.write(readback_pass, readback, { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT });
+			// Read by read_back_frame() once the graphics timeline passed the frame
+			frame_graph_.set_output(readback, { VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT });
+		}
 
-		create_info.pEnabledFeatures = &device_features;
+		frame_graph_.compile();
+	}
 
+	/**
+	 * The render pass of the main pass, with the dependency and layouts the frame graph derived for it. With dynamic rendering there
+	 * is none, the graph then records the dependency and layout changes as barriers around the pass
+	 */
+	void create_render_pass()
+	{
+		main_pass_formats_ = frame_graph_.rendering_formats(main_pass_);
+		if (!dynamic_rendering_)
+		{
+			render_pass_ = unique_render_pass(device_.get(), frame_graph_.create_render_pass(main_pass_));
+		}
+	}
 
-		create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-		create_info.ppEnabledExtensionNames = device_extensions.data();
+	//	****************************************
+	//	******** MESH RELATED FUNCTIONS ********
+	//	****************************************
 
-		if (enable_validation_layers)
+	/**
+	 * The built-in triangle, or the mesh file given with --mesh. Every draw command draws the whole mesh
+	 */
+	void create_mesh()
+	{
+		if (mesh_path_.empty())
 		{
-			create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
-			create_info.ppEnabledLayerNames = validation_layers.data();
+			mesh_ = create_gpu_mesh(allocator_, uploader_, TRIANGLE_VERTICES, TRIANGLE_INDICES);
 		}
 		else
 		{
-			create_info.enabledLayerCount = 0;
+			// Nothing was submitted yet, the first frame is the one waiting on the copies
+			bool imported = false;
+			mesh_ = load_gpu_mesh(allocator_, uploader_, host_memory_import_, mesh_path_, deletion_queue_, frame_number_ + 1, imported);
+			std::cout << "Mesh " << mesh_path_ << ": " << mesh_.vertex_count << " vertices, " << mesh_.index_count / 3 << " triangles, "
+				<< mesh_.meshlet_count << " meshlets, " << (imported ? "copied from imported host memory" : "copied through the staging ring") << std::endl;
 		}
 
-		if (vkCreateDevice(physical_device_, &create_info, nullptr, &device_) != VK_SUCCESS)
+		for (auto& command : draw_commands_)
 		{
-			throw std::runtime_error("Failed to create logical device!");
+			command.index_count = mesh_.index_count;
 		}
-
-		vkGetDeviceQueue(device_, indices.graphics_family.value(), 0, &graphics_queue_);
-		vkGetDeviceQueue(device_, indices.present_family.value(), 0, &present_queue_);
 	}
 
-	//	*********************************************
-	//	******** SWAPCHAIN RELATED FUNCTIONS ********
-	//	*********************************************
+	//	**********************************************
+	//	******** INSTANCING RELATED FUNCTIONS ********
+	//	**********************************************
 
-	swap_chain_support_details query_swap_chain_support(VkPhysicalDevice device)
+	/**
+	 * Lay the instances out on a square grid covering the viewport, a single instance keeps the triangle at its original place and size
+	 */
+	void create_instances()
 	{
-		swap_chain_support_details details;
+		const uint32_t instance_count = static_cast<uint32_t>(draw_commands_.size()) * draw_commands_.front().instance_count;
+		instances_.init(allocator_, instance_count, max_frames_in_flight_, get_async_compute_sharing_families());
 
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface_, &details.capabilities);
+		const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instance_count))));
+		const float cell_size = 2.0f / columns;
 
-		uint32_t format_count;
-		vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &format_count, nullptr);
+		for (uint32_t instance = 0; instance < instance_count; instance++)
+		{
+			instance_transform transform;
+			transform.offset[0] = -1.0f + (instance % columns + 0.5f) * cell_size;
+			transform.offset[1] = -1.0f + (instance / columns + 0.5f) * cell_size;
+			transform.scale = 1.0f / columns;
+			instances_.set_transform(instance, transform);
+		}
+	}
 
-		if (format_count != 0)
+	/**
+	 * Stream every texture of texture_directory_. The encodings of one texture share the file name up to the first dot, e.g. brick.bc7.ktx2,
+	 * brick.astc.ktx2 and brick.dds, and the streamer keeps the one the device samples best
+	 */
+	void create_textures()
+	{
+		queue_family_indices indices = find_queue_families(physical_device_);
+		const std::set<uint32_t> families = { indices.graphics_family.value(), indices.transfer_family.value() };
+		textures_.init(physical_device_, allocator_, uploader_, bindless_, jobs_, max_frames_in_flight_,
+			std::vector<uint32_t>(families.begin(), families.end()), texture_budget_);
+
+		if (texture_directory_.empty())
 		{
-			details.formats.resize(format_count);
-			vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &format_count, details.formats.data());
+			return;
 		}
 
-		uint32_t present_mode_count;
-		vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_, &present_mode_count, nullptr);
+		std::map<std::string, std::vector<std::string>> candidates;
+		for (const auto& entry : std::filesystem::directory_iterator(texture_directory_))
+		{
+			const std::string extension = entry.path().extension().string();
+			if (entry.is_regular_file() && (extension == ".ktx2" || extension == ".dds"))
+			{
+				const std::string file_name = entry.path().filename().string();
+				candidates[file_name.substr(0, file_name.find('.'))].push_back(entry.path().string());
+			}
+		}
 
-		if (present_mode_count != 0)
+		for (auto& texture : candidates)
 		{
-			details.present_modes.resize(present_mode_count);
-			vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_, &present_mode_count, details.present_modes.data());
+			std::sort(texture.second.begin(), texture.second.end());
+			textures_.load(texture.second);
 		}
 
-		return details;
+		if (validation_.validation)
+		{
+			std::cout << "Streaming " << textures_.texture_count() << " textures, " << (textures_.resident_bytes() >> 20) << " of "
+				<< (textures_.budget() >> 20) << " mb resident" << std::endl;
+		}
 	}
 
-	VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& availableFormats)
+	/**
+	 * Request the streamed textures at the size they cover on screen. Every instance of the grid covers a cell and the triangle spans
+	 * the whole cell, a camera would project the bounds of the instances instead
+	 */
+	void stream_textures()
 	{
-		for (const auto& available_format : availableFormats)
+		const float cell_pixels = instances_.transform(0).scale * 0.5f * static_cast<float>(std::max(swap_chain_extent_.width, swap_chain_extent_.height));
+		const size_t used_textures = std::min<size_t>(textures_.texture_count(), instances_.capacity());
+		for (size_t texture = 0; texture < used_textures; texture++)
 		{
-			if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
-			{
-				return available_format;
-			}
+			textures_.request(static_cast<texture_handle>(texture), cell_pixels, frame_number_);
 		}
 
-		return availableFormats[0];
+		textures_.update(deletion_queue_, frame_number_, static_cast<uint32_t>(current_frame_));
 	}
 
-	VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+	/**
+	 * Upload the material table and expose it through the bindless buffer array. Material 0 is untextured, every streamed texture gets
+	 * a material of its own and the instances cycle through them
+	 */
+	void create_materials()
 	{
-		for (const auto& available_present_mode : availablePresentModes)
+		std::vector<material> materials = { { { 1.0f, 1.0f, 1.0f, 1.0f }, NO_TEXTURE, {} } };
+		for (size_t texture = 0; texture < textures_.texture_count(); texture++)
+		{
+			materials.push_back({ { 1.0f, 1.0f, 1.0f, 1.0f }, static_cast<texture_handle>(texture), {} });
+		}
+		if (textures_.texture_count() > 0)
 		{
-			if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR)
+			for (uint32_t instance = 0; instance < instances_.capacity(); instance++)
 			{
-				return available_present_mode;
+				instances_.set_material(instance, 1 + instance % static_cast<uint32_t>(textures_.texture_count()));
 			}
 		}
 
-		return VK_PRESENT_MODE_FIFO_KHR;
+		const VkDeviceSize size = sizeof(material) * materials.size();
+
+		material_buffer_ = unique_buffer(device_.get(), create_device_local_buffer(allocator_, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, material_allocation_));
+		uploader_.upload_buffer(material_buffer_.get(), 0, materials.data(), size, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		material_buffer_slot_ = bindless_.register_storage_buffer({ material_buffer_.get(), 0, size });
 	}
 
-	VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities)
+	/**
+	 * Animate the first animated_instances_ instances and write what changed into the copy of the current frame slot
+	 */
+	void update_instances()
 	{
-		if (capabilities.currentExtent.width != UINT32_MAX)
-		{
-			return capabilities.currentExtent;
-		}
-		else
-		{
-			VkExtent2D actual_extent = { WIDTH, HEIGHT };
+		const double two_pi = 6.283185307179586;
 
-			actual_extent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actual_extent.width));
-			actual_extent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actual_extent.height));
+		for (uint32_t instance = 0; instance < animated_instances_; instance++)
+		{
+			// Wrapped in double precision, a float angle would lose its fractional part after a few hours
+			instance_transform transform = instances_.transform(instance);
+			transform.rotation = static_cast<float>(std::fmod(frame_number_ * double(INSTANCE_ROTATION_PER_FRAME) + instance, two_pi));
+			instances_.set_transform(instance, transform);
 
-			return actual_extent;
+			const float pulse = 0.75f + 0.25f * std::sin(transform.rotation);
+			instances_.set_color(instance, { { pulse, pulse, pulse, 1.0f } });
 		}
+
+		instances_.update(static_cast<uint32_t>(current_frame_));
 	}
 
-	void create_image_views()
+	//	*******************************************
+	//	******** DRAWING RELATED FUNCTIONS ********
+	//	*******************************************
+
+	/**
+	 * Every frame in flight owns a transient pool for its primary command buffer and one transient pool per recording worker for the
+	 * secondary command buffers. Pools are reset as a whole once the frame is done on the GPU, individual buffers are never reset
+	 */
+	void create_command_pools()
 	{
-		swap_chain_image_views_.resize(swap_chain_images_.size());
+		queue_family_indices queue_family_indices = find_queue_families(physical_device_);
 
-		for (size_t i = 0; i < swap_chain_images_.size(); i++)
+		VkCommandPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
+		pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Buffers are re-recorded every frame
+
+		frame_commands_.resize(max_frames_in_flight_);
+		for (auto& frame_commands : frame_commands_)
 		{
-			VkImageViewCreateInfo create_info{};
-			create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			create_info.image = swap_chain_images_[i];
-			create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			create_info.format = swap_chain_image_format_;
-			create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-			create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-			create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-			create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-			create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			create_info.subresourceRange.baseMipLevel = 0;
-			create_info.subresourceRange.levelCount = 1;
-			create_info.subresourceRange.baseArrayLayer = 0;
-			create_info.subresourceRange.layerCount = 1;
+			frame_commands.primary_pool = create_command_pool(pool_info);
 
-			if (vkCreateImageView(device_, &create_info, nullptr, &swap_chain_image_views_[i]) != VK_SUCCESS)
+			frame_commands.worker_pools.resize(jobs_.worker_count());
+			for (auto& worker_pool : frame_commands.worker_pools)
 			{
-				throw std::runtime_error("Failed to create image views!");
+				worker_pool = create_command_pool(pool_info);
 			}
 		}
 	}
 
-	void create_swap_chain()
+	unique_command_pool create_command_pool(const VkCommandPoolCreateInfo& pool_info)
 	{
-		swap_chain_support_details swap_chain_support = query_swap_chain_support(physical_device_);
+		VkCommandPool pool;
+		if (vkCreateCommandPool(device_.get(), &pool_info, nullptr, &pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create command pool!");
+		}
 
-		VkSurfaceFormatKHR surface_format = choose_swap_surface_format(swap_chain_support.formats);
-		VkPresentModeKHR present_mode = choose_swap_present_mode(swap_chain_support.present_modes);
-		VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities);
+		return unique_command_pool(device_.get(), pool);
+	}
 
-		uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
-		if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount)
+	void create_command_buffers()
+	{
+		for (auto& frame_commands : frame_commands_)
 		{
-			image_count = swap_chain_support.capabilities.maxImageCount;
-		}
+			VkCommandBufferAllocateInfo alloc_info{};
+			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			alloc_info.commandPool = frame_commands.primary_pool.get();
+			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			alloc_info.commandBufferCount = 1;
 
-		VkSwapchainCreateInfoKHR create_info{};
-		create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-		create_info.surface = surface_;
+			if (vkAllocateCommandBuffers(device_.get(), &alloc_info, &frame_commands.primary_buffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to allocate command buffers!");
+			}
 
-		create_info.minImageCount = image_count;
-		create_info.imageFormat = surface_format.format;
-		create_info.imageColorSpace = surface_format.colorSpace;
-		create_info.imageExtent = extent;
-		create_info.imageArrayLayers = 1;
-		create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+			frame_commands.worker_buffers.resize(frame_commands.worker_pools.size());
+			frame_commands.depth_prepass_buffers.resize(depth_prepass_ ? frame_commands.worker_pools.size() : 0);
+			for (size_t worker = 0; worker < frame_commands.worker_pools.size(); worker++)
+			{
+				alloc_info.commandPool = frame_commands.worker_pools[worker].get();
+				alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
 
-		queue_family_indices indices = find_queue_families(physical_device_);
-		uint32_t queue_family_indices[] = { indices.graphics_family.value(), indices.present_family.value() };
+				if (vkAllocateCommandBuffers(device_.get(), &alloc_info, &frame_commands.worker_buffers[worker]) != VK_SUCCESS)
+				{
+					throw std::runtime_error("Failed to allocate command buffers!");
+				}
+				if (depth_prepass_ && vkAllocateCommandBuffers(device_.get(), &alloc_info, &frame_commands.depth_prepass_buffers[worker]) != VK_SUCCESS)
+				{
+					throw std::runtime_error("Failed to allocate command buffers!");
+				}
+			}
+		}
+	}
 
-		if (indices.graphics_family != indices.present_family)
+	/**
+	 * Re-record the commands of the current frame. The draws are split in contiguous slices, each worker records its slice into the
+	 * secondary command buffer of its own pool, and the primary buffer executes them inside the render pass
+	 */
+	void record_command_buffer(const uint32_t image_index)
+	{
+		frame_command_resources& frame_commands = frame_commands_[current_frame_];
+
+		// Before the async culling, whose uploader_.flush() then submits the texture uploads as well
+		stream_textures();
+		// Frame boundary: no command buffer of this frame references the pipelines yet
+		replaced_pipelines_.clear();
+		pipelines_.swap_reloaded(replaced_pipelines_);
+		for (const VkPipeline pipeline : replaced_pipelines_)
 		{
-			create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-			create_info.queueFamilyIndexCount = 2;
-			create_info.pQueueFamilyIndices = queue_family_indices;
+			deletion_queue_.retire(frame_number_, unique_pipeline(device_.get(), pipeline));
 		}
-		else
+		// Falls back to the opaque variant while the blended one is still compiling
+		recording_pipeline_ = pipelines_.resolve(graphics_pipeline_);
+		recording_depth_pipeline_ = depth_prepass_ ? pipelines_.resolve(depth_prepass_pipeline_) : VK_NULL_HANDLE;
+
+		uniforms_.begin_frame(static_cast<uint32_t>(current_frame_));
+		frame_uniform_offset_ = uniforms_.push(frame_uniforms{ { 1.0f, 1.0f }, { 0.0f, 0.0f } });
+		uniforms_.end_frame();
+
+		// The previous frame of this slot is done, so nothing allocated from these pools is still pending on the GPU
+		vkResetCommandPool(device_.get(), frame_commands.primary_pool.get(), 0);
+
+		// With GPU culling the recorded commands don't depend on the number of draws, a single secondary holds them
+		const uint32_t draw_count = static_cast<uint32_t>(draw_commands_.size());
+		const uint32_t slice_count = gpu_culling_ ? 1 : std::min(jobs_.worker_count(),
+			std::max(1u, (draw_count + MIN_DRAWS_PER_RECORDING_WORKER - 1) / MIN_DRAWS_PER_RECORDING_WORKER));
+		recording_image_index_ = image_index;
+		recording_slice_count_ = slice_count;
+		recording_draws_per_slice_ = (draw_count + slice_count - 1) / slice_count;
+
+		// The workers record the slices, which only bind the buffers, while this thread updates the instances and submits the async
+		// culling that reads them. The uploader and the queues are only ever used from this thread
+		frame_tasks_.clear();
+		for (uint32_t slice = 0; slice < slice_count; slice++)
 		{
-			create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			// Two captures fit the small buffer of std::function, what the slices share is in the recording_ members
+			frame_tasks_.add([this, slice]
+				{
+					const uint32_t draw_count = static_cast<uint32_t>(draw_commands_.size());
+					const uint32_t first_draw = std::min(draw_count, slice * recording_draws_per_slice_);
+					const uint32_t last_draw = std::min(draw_count, first_draw + recording_draws_per_slice_);
+					record_secondary_command_buffer(frame_commands_[current_frame_], slice, recording_image_index_, first_draw, last_draw);
+				});
+		}
+		frame_tasks_.start(jobs_);
+		update_instances();
+		frame_compute_wait_ = async_compute_ ? submit_async_culling() : timeline_wait{};
+		frame_tasks_.wait();
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		begin_info.pInheritanceInfo = nullptr; // Optional
+
+		VkCommandBuffer command_buffer = frame_commands.primary_buffer;
+		if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to begin recording command buffer!");
 		}
 
-		create_info.preTransform = swap_chain_support.capabilities.currentTransform;
-		create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-		create_info.presentMode = present_mode;
-		create_info.clipped = VK_TRUE;
+		gpu_profiler_.begin_frame(command_buffer, static_cast<uint32_t>(current_frame_));
+
+		// Uploads queued since the last frame become visible to this one
+		uploader_.flush();
+		frame_upload_wait_ = uploader_.acquire_submitted_uploads(command_buffer, frame_number_);
 
-		create_info.oldSwapchain = VK_NULL_HANDLE;
+		// Culling, main render pass and readback, with the barriers between them
+		frame_graph_.bind_image(color_target_, swap_chain_images_[image_index]);
+		frame_graph_.bind_targets(render_targets_[image_index]);
+		frame_graph_.execute(command_buffer, frame_arena_);
 
-		if (vkCreateSwapchainKHR(device_, &create_info, nullptr, &swap_chain_) != VK_SUCCESS)
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
 		{
-			throw std::runtime_error("Failed to create swap chain!");
+			throw std::runtime_error("Failed to record command buffer!");
 		}
+	}
 
-		vkGetSwapchainImagesKHR(device_, swap_chain_, &image_count, nullptr);
-		swap_chain_images_.resize(image_count);
-		vkGetSwapchainImagesKHR(device_, swap_chain_, &image_count, swap_chain_images_.data());
+	/**
+	 * Cull the draws of the frame on the async compute queue, as soon as the instance transforms are written. The dispatch runs while
+	 * the graphics queue is still busy with the previous frame, the returned wait is where the graphics submit picks the draws up
+	 */
+	timeline_wait submit_async_culling()
+	{
+		// The culling objects are uploaded to concurrent buffers, the compute queue waits on the transfer timeline on its own
+		uploader_.flush();
 
-		swap_chain_image_format_ = surface_format.format;
-		swap_chain_extent_ = extent;
+		const VkCommandBuffer command_buffer = async_compute_queue_.begin(static_cast<uint32_t>(current_frame_));
+		async_compute_queue_.wait(uploader_.flushed_uploads_wait(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+		culling_.record_culling(command_buffer, static_cast<uint32_t>(current_frame_));
+
+		return async_compute_queue_.submit(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
 	}
 
-	void create_frame_buffers()
+	/**
+	 * The main pass of the frame graph: execute the secondary command buffers recorded for the frame inside the render pass, or
+	 * inside dynamic rendering on the image views of the frame
+	 */
+	void record_main_render_pass(const VkCommandBuffer command_buffer)
 	{
-		swap_chain_frame_buffers_.resize(swap_chain_image_views_.size());
+		frame_command_resources& frame_commands = frame_commands_[current_frame_];
+		const uint32_t render_pass_scope = gpu_profiler_.begin_scope(command_buffer, "main render pass");
 
-		for (size_t i = 0; i < swap_chain_image_views_.size(); i++)
+#ifdef VK_KHR_dynamic_rendering
+		if (dynamic_rendering_)
 		{
-			VkImageView attachments[] = { swap_chain_image_views_[i] };
+			VkImageView* image_views = frame_arena_.allocate<VkImageView>(frame_graph_.attachment_count(main_pass_));
+			main_pass_image_views(recording_image_index_, image_views);
+
+			begin_rendering_(command_buffer, frame_graph_.rendering_info(main_pass_, image_views, swap_chain_extent_,
+				VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR, frame_arena_));
+			execute_draw_slices(command_buffer, frame_commands);
+			end_rendering_(command_buffer);
+			gpu_profiler_.end_scope(command_buffer, render_pass_scope);
+			return;
+		}
+#endif
 
-			VkFramebufferCreateInfo framebuffer_info{};
-			framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebuffer_info.renderPass = render_pass_;
-			framebuffer_info.attachmentCount = 1;
-			framebuffer_info.pAttachments = attachments;
-			framebuffer_info.width = swap_chain_extent_.width;
-			framebuffer_info.height = swap_chain_extent_.height;
-			framebuffer_info.layers = 1;
+		VkRenderPassBeginInfo render_pass_info{};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_info.renderPass = render_pass_.get();
+		render_pass_info.framebuffer = swap_chain_frame_buffers_[recording_image_index_].get();
+		render_pass_info.renderArea.offset = { 0, 0 };
+		render_pass_info.renderArea.extent = swap_chain_extent_;
+
+		// Indexed by attachment, the value of an attachment that isn't cleared is ignored
+		render_pass_info.clearValueCount = frame_graph_.attachment_count(main_pass_);
+		render_pass_info.pClearValues = frame_graph_.clear_values(main_pass_, frame_arena_);
+
+		vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		execute_draw_slices(command_buffer, frame_commands);
+		vkCmdEndRenderPass(command_buffer);
+		gpu_profiler_.end_scope(command_buffer, render_pass_scope);
+	}
 
-			if (vkCreateFramebuffer(device_, &framebuffer_info, nullptr, &swap_chain_frame_buffers_[i]) != VK_SUCCESS)
-			{
-				throw std::runtime_error("Failed to create framebuffer!");
-			}
+	void execute_draw_slices(const VkCommandBuffer command_buffer, frame_command_resources& frame_commands)
+	{
+		if (depth_prepass_)
+		{
+			// The depth of every slice is laid down before any slice is shaded
+			vkCmdExecuteCommands(command_buffer, recording_slice_count_, frame_commands.depth_prepass_buffers.data());
 		}
+		vkCmdExecuteCommands(command_buffer, recording_slice_count_, frame_commands.worker_buffers.data());
 	}
 
-	//	*****************************************************
-	//	******** GRAPHICS PIPELINE RELATED FUNCTIONS ********
-	//	*****************************************************
-
-	void create_graphics_pipeline()
+	/**
+	 * Runs on a recording worker. Secondary command buffers don't inherit any state from the primary one,
+	 * so every slice binds the pipeline and sets the dynamic state again. With --depth-prepass the slice is recorded twice,
+	 * once with the depth-only pipeline and once with the color one
+	 */
+	void record_secondary_command_buffer(frame_command_resources& frame_commands, const uint32_t worker, const uint32_t image_index,
+		const uint32_t first_draw, const uint32_t last_draw)
 	{
-		auto vert_shader_code = read_file("shaders/vert.spv");
-		auto frag_shader_code = read_file("shaders/frag.spv");
+		vkResetCommandPool(device_.get(), frame_commands.worker_pools[worker].get(), 0);
+
+		if (depth_prepass_)
+		{
+			record_draw_slice(frame_commands.depth_prepass_buffers[worker], recording_depth_pipeline_, image_index, first_draw, last_draw);
+		}
+		record_draw_slice(frame_commands.worker_buffers[worker], recording_pipeline_, image_index, first_draw, last_draw);
+	}
 
-		VkShaderModule vert_shader_module = create_shader_module(vert_shader_code);
-		VkShaderModule frag_shader_module = create_shader_module(frag_shader_code);
+	void record_draw_slice(const VkCommandBuffer command_buffer, const VkPipeline pipeline, const uint32_t image_index, const uint32_t first_draw,
+		const uint32_t last_draw)
+	{
+		VkCommandBufferInheritanceInfo inheritance_info{};
+		inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance_info.renderPass = render_pass_.get();
+		inheritance_info.subpass = 0;
+		inheritance_info.framebuffer = dynamic_rendering_ ? VK_NULL_HANDLE : swap_chain_frame_buffers_[image_index].get();
+
+#ifdef VK_KHR_dynamic_rendering
+		// Without a render pass to inherit, the secondary is told the formats of the attachments it draws to
+		VkCommandBufferInheritanceRenderingInfoKHR rendering_inheritance_info{};
+		rendering_inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+		rendering_inheritance_info.colorAttachmentCount = static_cast<uint32_t>(main_pass_formats_.color_formats.size());
+		rendering_inheritance_info.pColorAttachmentFormats = main_pass_formats_.color_formats.data();
+		rendering_inheritance_info.depthAttachmentFormat = main_pass_formats_.depth_format;
+		rendering_inheritance_info.rasterizationSamples = main_pass_formats_.samples;
+		if (dynamic_rendering_)
+		{
+			inheritance_info.pNext = &rendering_inheritance_info;
+		}
+#endif
 
-		VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
-		vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vert_shader_stage_info.module = vert_shader_module;
-		vert_shader_stage_info.pName = "main";
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		begin_info.pInheritanceInfo = &inheritance_info;
 
-		VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
-		frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		frag_shader_stage_info.module = frag_shader_module;
-		frag_shader_stage_info.pName = "main";
+		if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to begin recording command buffer!");
+		}
 
-		VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_stage_info, frag_shader_stage_info };
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-		VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-		vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertex_input_info.vertexBindingDescriptionCount = 0;
-		vertex_input_info.vertexAttributeDescriptionCount = 0;
+		// Bound once per slice, the draws only differ by their push constants and instance ranges
+		const std::array<VkDescriptorSet, 2> descriptor_sets = { uniforms_.descriptor_set(), bindless_.descriptor_set() };
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_.get(), 0, static_cast<uint32_t>(descriptor_sets.size()),
+			descriptor_sets.data(), 1, &frame_uniform_offset_);
 
-		VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-		input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		input_assembly.primitiveRestartEnable = VK_FALSE;
+		const draw_push_constants push_constants{ material_buffer_slot_, textures_.slot_table(static_cast<uint32_t>(current_frame_)) };
+		vkCmdPushConstants(command_buffer, pipeline_layout_.get(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push_constants),
+			&push_constants);
 
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -887,301 +3498,259 @@ private:
 		viewport.height = static_cast<float>(swap_chain_extent_.height);
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
 		VkRect2D scissor{};
 		scissor.offset = { 0, 0 };
 		scissor.extent = swap_chain_extent_;
+		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-		VkPipelineViewportStateCreateInfo viewport_state{};
-		viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewport_state.viewportCount = 1;
-		viewport_state.pViewports = &viewport;
-		viewport_state.scissorCount = 1;
-		viewport_state.pScissors = &scissor;
-
-		VkPipelineRasterizationStateCreateInfo rasterizer{};
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-		rasterizer.depthBiasEnable = VK_FALSE;
-
-		VkPipelineMultisampleStateCreateInfo multisampling{};
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-		VkPipelineColorBlendAttachmentState color_blend_attachment{};
-		color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		color_blend_attachment.blendEnable = VK_TRUE; // disable this and comment the following code of this struct, to dont do the alpha blend colors
-		color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-		color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-		color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-		color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-		VkPipelineColorBlendStateCreateInfo color_blending{};
-		color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		color_blending.logicOpEnable = VK_FALSE; // set this to false if you don't want alpha blend to work
-		color_blending.logicOp = VK_LOGIC_OP_COPY;
-		color_blending.attachmentCount = 1;
-		color_blending.pAttachments = &color_blend_attachment;
-		color_blending.blendConstants[0] = 0.0f;
-		color_blending.blendConstants[1] = 0.0f;
-		color_blending.blendConstants[2] = 0.0f;
-		color_blending.blendConstants[3] = 0.0f;
-
-		VkPipelineLayoutCreateInfo pipeline_layout_info{};
-		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipeline_layout_info.setLayoutCount = 0;
-		pipeline_layout_info.pushConstantRangeCount = 0;
+		const VkDeviceSize vertex_offset = 0;
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, &mesh_.vertex_buffer, &vertex_offset);
+		vkCmdBindIndexBuffer(command_buffer, mesh_.index_buffer, 0, VK_INDEX_TYPE_UINT32);
+		instances_.bind(command_buffer, static_cast<uint32_t>(current_frame_), INSTANCE_FIRST_BINDING);
 
-		if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS)
+		if (gpu_culling_)
 		{
-			throw std::runtime_error("Failed to create pipeline layout!");
+			culling_.record_draws(command_buffer, static_cast<uint32_t>(current_frame_));
 		}
-
-		VkGraphicsPipelineCreateInfo pipeline_info{};
-		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipeline_info.stageCount = 2;
-		pipeline_info.pStages = shader_stages;
-		pipeline_info.pVertexInputState = &vertex_input_info;
-		pipeline_info.pInputAssemblyState = &input_assembly;
-		pipeline_info.pViewportState = &viewport_state;
-		pipeline_info.pRasterizationState = &rasterizer;
-		pipeline_info.pMultisampleState = &multisampling;
-		pipeline_info.pColorBlendState = &color_blending;
-		pipeline_info.layout = pipeline_layout_;
-		pipeline_info.renderPass = render_pass_;
-		pipeline_info.subpass = 0;
-		pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-
-		if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline_) != VK_SUCCESS)
+		else
 		{
-			throw std::runtime_error("Failed to create graphics pipeline!");
+			for (uint32_t draw = first_draw; draw < last_draw; draw++)
+			{
+				const draw_command& command = draw_commands_[draw];
+				vkCmdDrawIndexed(command_buffer, command.index_count, command.instance_count, command.first_index, command.vertex_offset,
+					command.first_instance);
+			}
 		}
 
-		vkDestroyShaderModule(device_, frag_shader_module, nullptr);
-		vkDestroyShaderModule(device_, vert_shader_module, nullptr);
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record command buffer!");
+		}
 	}
 
-	VkShaderModule create_shader_module(const std::vector<char>& code)
+	/**
+	 * Frames numbered below the returned value are done on the GPU
+	 */
+	uint64_t completed_frame_count()
 	{
-		VkShaderModuleCreateInfo create_info{};
-		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		create_info.codeSize = code.size();
-		create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		return graphics_timeline_.completed();
+	}
 
-		VkShaderModule shader_module;
-		if (vkCreateShaderModule(device_, &create_info, nullptr, &shader_module) != VK_SUCCESS)
+	/**
+	 * Block until the previous frame of the current slot is done, every resource owned by the slot can then be rewritten, starting
+	 * with its frame arena block
+	 */
+	void wait_for_frame_slot()
+	{
+		if (frame_number_ >= max_frames_in_flight_)
 		{
-			throw std::runtime_error("Failed to create shader module!");
+			graphics_timeline_.wait(frame_number_ - max_frames_in_flight_ + 1);
 		}
-
-		return shader_module;
+		frame_arena_.begin_frame(static_cast<uint32_t>(current_frame_));
 	}
 
-	void create_render_pass()
+	/*
+	 * 1-> Acquire an image from the swap chain
+	 * 2-> Execute the command buffer with that image as attachment in the framebuffer
+	 * 3-> Return the image to the swap chain for presentation
+	 * Input is sampled after the waits, right before recording, so the frame shows the newest input it can
+	 */
+	void draw_frame()
 	{
-		VkAttachmentDescription color_attachment{};
-		color_attachment.format = swap_chain_image_format_;
-		color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-		VkAttachmentReference color_attachment_ref{};
-		color_attachment_ref.attachment = 0;
-		color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-		VkSubpassDescription subpass{};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &color_attachment_ref;
+		frame_stats_.begin_frame();
 
-		VkRenderPassCreateInfo render_pass_info{};
-		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		render_pass_info.attachmentCount = 1;
-		render_pass_info.pAttachments = &color_attachment;
-		render_pass_info.subpassCount = 1;
-		render_pass_info.pSubpasses = &subpass;
+		frame_stats_.begin_phase(frame_phase::frame_fence_wait);
+		wait_for_frame_slot();
+		frame_stats_.end_phase();
 
-		if (vkCreateRenderPass(device_, &render_pass_info, nullptr, &render_pass_) != VK_SUCCESS)
+		if (present_wait_enabled_)
 		{
-			throw std::runtime_error("Failed to create render pass!");
+			frame_stats_.begin_phase(frame_phase::present_wait);
+			wait_for_queued_presents();
+			frame_stats_.end_phase();
 		}
 
-		VkSubpassDependency dependency{};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		glfwPollEvents();
 
-		render_pass_info.dependencyCount = 1;
-		render_pass_info.pDependencies = &dependency;
-	}
-
-	//	*******************************************
-	//	******** DRAWING RELATED FUNCTIONS ********
-	//	*******************************************
-
-	void create_command_pool()
-	{
-		queue_family_indices queue_family_indices = find_queue_families(physical_device_);
+		deletion_queue_.flush(completed_frame_count());
+		uploader_.release_completed(completed_frame_count());
 
-		VkCommandPoolCreateInfo pool_info{};
-		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
-		pool_info.flags = 0; // Optional
+		uint32_t image_index;
+		frame_stats_.begin_phase(frame_phase::acquire);
+		VkResult result = vkAcquireNextImageKHR(device_.get(), swap_chain_.get(), UINT64_MAX, image_avaiable_semaphores_[current_frame_].get(), VK_NULL_HANDLE, &image_index);
+		frame_stats_.end_phase();
 
-		if (vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool_) != VK_SUCCESS)
+		// On out of date nothing was acquired and the semaphore stays unsignaled, so the frame slot can be reused as is.
+		// A suboptimal image is still presentable, it is rendered and the swapchain is rebuilt after presenting it
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
 		{
-			throw std::runtime_error("Failed to create command pool!");
+			recreate_swap_chain();
+			return;
 		}
-	}
-
-	void create_command_buffers()
-	{
-		command_buffers_.resize(swap_chain_frame_buffers_.size());
-
-		VkCommandBufferAllocateInfo alloc_info{};
-		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		alloc_info.commandPool = command_pool_;
-		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		alloc_info.commandBufferCount = (uint32_t)command_buffers_.size();
-
-		if (vkAllocateCommandBuffers(device_, &alloc_info, command_buffers_.data()) != VK_SUCCESS)
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
 		{
-			throw std::runtime_error("Failed to allocate command buffers!");
+			throw std::runtime_error("Failed to acquire swap chain image!");
 		}
 
-		for (size_t i = 0; i < command_buffers_.size(); i++)
+		// Check if a previous frame is still rendering to this image
+		if (!graphics_timeline_.is_complete(images_in_flight_[image_index]))
+		{
+			frame_stats_.begin_phase(frame_phase::image_fence_wait);
+			graphics_timeline_.wait(images_in_flight_[image_index]);
+			frame_stats_.end_phase();
+		}
+		// Mark the image as now being in use by this frame
+		const uint64_t frame_value = graphics_timeline_.signal_next();
+		images_in_flight_[image_index] = frame_value;
+
+		frame_stats_.begin_phase(frame_phase::record);
+		record_command_buffer(image_index);
+		frame_stats_.end_phase();
+
+		queue_submission submission;
+		submission.wait(image_avaiable_semaphores_[current_frame_].get(), VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		submission.wait(frame_upload_wait_);
+		submission.wait(frame_compute_wait_);
+		submission.signal(render_finished_semaphores_[current_frame_].get());
+		submission.signal(graphics_timeline_.semaphore(), frame_value);
+
+		frame_stats_.begin_phase(frame_phase::submit);
+		if (submission.submit(graphics_queue_, 1, &frame_commands_[current_frame_].primary_buffer) != VK_SUCCESS)
 		{
-			VkCommandBufferBeginInfo begin_info{};
-			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			begin_info.flags = 0; // Optional
-			begin_info.pInheritanceInfo = nullptr; // Optional
+			throw std::runtime_error("Failed to submit draw command buffer!");
+		}
+		frame_stats_.end_phase();
 
-			if (vkBeginCommandBuffer(command_buffers_[i], &begin_info) != VK_SUCCESS)
-			{
-				throw std::runtime_error("Failed to begin recording command buffer!");
-			}
+		VkPresentInfoKHR present_info{};
+		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		present_info.waitSemaphoreCount = 1;
+		const VkSemaphore render_finished_semaphore = render_finished_semaphores_[current_frame_].get();
+		present_info.pWaitSemaphores = &render_finished_semaphore;
 
-			VkRenderPassBeginInfo render_pass_info{};
-			render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			render_pass_info.renderPass = render_pass_;
-			render_pass_info.framebuffer = swap_chain_frame_buffers_[i];
-			render_pass_info.renderArea.offset = { 0, 0 };
-			render_pass_info.renderArea.extent = swap_chain_extent_;
+		VkSwapchainKHR swap_chains[] = { swap_chain_.get() };
+		present_info.swapchainCount = 1;
+		present_info.pSwapchains = swap_chains;
+		present_info.pImageIndices = &image_index;
+		present_info.pResults = nullptr; // Optional
 
-			VkClearValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			render_pass_info.clearValueCount = 1;
-			render_pass_info.pClearValues = &clear_color;
+#ifdef VK_KHR_present_wait
+		const uint64_t present_id = present_id_ + 1;
+		VkPresentIdKHR present_id_info{};
+		present_id_info.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		present_id_info.swapchainCount = 1;
+		present_id_info.pPresentIds = &present_id;
+		if (present_wait_enabled_)
+		{
+			present_info.pNext = &present_id_info;
+			present_id_ = present_id;
+		}
+#endif
 
-			vkCmdBeginRenderPass(command_buffers_[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+		frame_stats_.begin_phase(frame_phase::present);
+		result = vkQueuePresentKHR(present_queue_, &present_info);
+		frame_stats_.end_phase();
 
-			vkCmdBindPipeline(command_buffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+		frame_stats_.end_frame(frame_number_);
+		frame_number_++;
+		// No queue idle here: the timeline waits on the frame slot and images_in_flight_ keep the CPU at most max_frames_in_flight_ frames ahead
+		current_frame_ = (current_frame_ + 1) % max_frames_in_flight_;
 
-			vkCmdDraw(command_buffers_[i], 3, 1, 0, 0);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized_)
+		{
+			framebuffer_resized_ = false;
+			recreate_swap_chain();
+		}
+		else if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to present swap chain image!");
+		}
+	}
 
-			vkCmdEndRenderPass(command_buffers_[i]);
+	/**
+	 * Low latency pacing: block until at most LOW_LATENCY_QUEUED_PRESENTS presents are waiting for the display. Without it, the
+	 * frame slot waits let the CPU run a whole swapchain ahead of what is on screen, and every queued image adds a refresh of latency
+	 */
+	void wait_for_queued_presents()
+	{
+#ifdef VK_KHR_present_wait
+		if (present_id_ <= LOW_LATENCY_QUEUED_PRESENTS)
+		{
+			return;
+		}
 
-			if (vkEndCommandBuffer(command_buffers_[i]) != VK_SUCCESS)
-			{
-				throw std::runtime_error("Failed to record command buffer!");
-			}
+		// A timeout only means the display is not refreshing, out of date is handled when presenting
+		const VkResult result = wait_for_present_(device_.get(), swap_chain_.get(), present_id_ - LOW_LATENCY_QUEUED_PRESENTS, PRESENT_WAIT_TIMEOUT_NS);
+		if (result != VK_SUCCESS && result != VK_TIMEOUT && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			throw std::runtime_error("Failed to wait for present!");
 		}
+#endif
 	}
 
-	/*
-	 * 1-> Acquire an image from the swap chain
-	 * 2-> Execute the command buffer with that image as attachment in the framebuffer
-	 * 3-> Return the image to the swap chain for presentation
+	/**
+	 * Headless counterpart of draw_frame(): there is nothing to acquire or present, so the frame slot picks the offscreen image
+	 * and the graphics timeline is the only synchronization
 	 */
-	void draw_frame()
+	void draw_offscreen_frame()
 	{
-		vkWaitForFences(device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX);
+		frame_stats_.begin_frame();
 
-		uint32_t image_index;
-		vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, image_avaiable_semaphores_[current_frame_], VK_NULL_HANDLE, &image_index);
+		frame_stats_.begin_phase(frame_phase::frame_fence_wait);
+		wait_for_frame_slot();
+		frame_stats_.end_phase();
 
-		// Check if a previous frame is using this image (i.e. there is its fence to wait on)
-		if (images_in_flight_[image_index] != VK_NULL_HANDLE)
-		{
-			vkWaitForFences(device_, 1, &images_in_flight_[image_index], VK_TRUE, UINT64_MAX);
-		}
-		// Mark the image as now being in use by this frame
-		images_in_flight_[image_index] = in_flight_fences_[current_frame_];
+		deletion_queue_.flush(completed_frame_count());
+		uploader_.release_completed(completed_frame_count());
 
-		VkSubmitInfo submit_info{};
-		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		offscreen_readback& readback = readbacks_[current_frame_];
+		read_back_frame(readback);
 
-		VkSemaphore wait_semaphores[] = { image_avaiable_semaphores_[current_frame_] };
-		VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submit_info.waitSemaphoreCount = 1;
-		submit_info.pWaitSemaphores = wait_semaphores;
-		submit_info.pWaitDstStageMask = wait_stages;
-		submit_info.commandBufferCount = 1;
-		submit_info.pCommandBuffers = &command_buffers_[image_index];
-		VkSemaphore signal_semaphores[] = { render_finished_semaphores_[current_frame_] };
-		submit_info.signalSemaphoreCount = 1;
-		submit_info.pSignalSemaphores = signal_semaphores;
+		const uint32_t image_index = static_cast<uint32_t>(current_frame_);
 
-		vkResetFences(device_, 1, &in_flight_fences_[current_frame_]);
+		frame_stats_.begin_phase(frame_phase::record);
+		record_command_buffer(image_index);
+		frame_stats_.end_phase();
 
-		if (vkQueueSubmit(graphics_queue_, 1, &submit_info, in_flight_fences_[current_frame_]) != VK_SUCCESS)
+		queue_submission submission;
+		submission.wait(frame_upload_wait_);
+		submission.wait(frame_compute_wait_);
+		submission.signal(graphics_timeline_.semaphore(), graphics_timeline_.signal_next());
+
+		frame_stats_.begin_phase(frame_phase::submit);
+		if (submission.submit(graphics_queue_, 1, &frame_commands_[current_frame_].primary_buffer) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to submit draw command buffer!");
 		}
+		frame_stats_.end_phase();
 
-		VkPresentInfoKHR present_info{};
-		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-		present_info.waitSemaphoreCount = 1;
-		present_info.pWaitSemaphores = signal_semaphores;
-
-		VkSwapchainKHR swap_chains[] = { swap_chain_ };
-		present_info.swapchainCount = 1;
-		present_info.pSwapchains = swap_chains;
-		present_info.pImageIndices = &image_index;
-		present_info.pResults = nullptr; // Optional
-
-		vkQueuePresentKHR(present_queue_, &present_info);
+		readback.frame_number = frame_number_;
+		readback.pending = true;
 
-		vkQueueWaitIdle(present_queue_);
-
-		current_frame_ = (current_frame_ + 1) % MAX_FRAMES_IN_FLIGHT;
+		frame_stats_.end_frame(frame_number_);
+		frame_number_++;
+		current_frame_ = (current_frame_ + 1) % max_frames_in_flight_;
 	}
 
 	void create_sync_objects()
 	{
-		image_avaiable_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-		render_finished_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-		in_flight_fences_.resize(MAX_FRAMES_IN_FLIGHT);
-		images_in_flight_.resize(swap_chain_images_.size(), VK_NULL_HANDLE);
+		images_in_flight_.resize(swap_chain_images_.size(), 0);
+		graphics_timeline_.init(device_.get());
 
 		VkSemaphoreCreateInfo semaphore_info{};
 		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		VkFenceCreateInfo fence_info{};
-		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (size_t i = 0; i < max_frames_in_flight_; i++)
 		{
-			if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &image_avaiable_semaphores_[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(device_, &semaphore_info, nullptr, &render_finished_semaphores_[i]) != VK_SUCCESS ||
-				vkCreateFence(device_, &fence_info, nullptr, &in_flight_fences_[i]) != VK_SUCCESS)
+			for (auto* semaphores : { &image_avaiable_semaphores_, &render_finished_semaphores_ })
 			{
-				throw std::runtime_error("Failed to create synchronization objects for a frame!");
+				VkSemaphore semaphore;
+				if (vkCreateSemaphore(device_.get(), &semaphore_info, nullptr, &semaphore) != VK_SUCCESS)
+				{
+					throw std::runtime_error("Failed to create synchronization objects for a frame!");
+				}
+				semaphores->emplace_back(device_.get(), semaphore);
 			}
 		}
 	}
@@ -1190,24 +3759,45 @@ private:
 	//	******** HELPER FUNCTIONS ********
 	//	**********************************
 
-	static std::vector<char> read_file(const std::string& filename)
+	static const char* present_mode_name(const VkPresentModeKHR present_mode)
 	{
-		std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-		if (!file.is_open())
+		switch (present_mode)
 		{
-			throw std::runtime_error("Failed to open file!");
+		case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+		case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+		case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo_relaxed";
+		default: return "unknown";
 		}
+	}
 
-		const size_t file_size = static_cast<size_t>(file.tellg());
-		std::vector<char> buffer(file_size);
+	static const char* present_policy_name(const present_policy policy)
+	{
+		switch (policy)
+		{
+		case present_policy::low_latency: return "low_latency";
+		case present_policy::throughput: return "throughput";
+		case present_policy::power_saving: return "power_saving";
+		default: return "balanced";
+		}
+	}
 
-		file.seekg(0);
-		file.read(buffer.data(), file_size);
+	static std::string format_uuid(const uint8_t (&uuid)[VK_UUID_SIZE])
+	{
+		static const char hex_digits[] = "0123456789abcdef";
 
-		file.close();
+		std::string formatted;
+		for (size_t i = 0; i < VK_UUID_SIZE; i++)
+		{
+			if (i == 4 || i == 6 || i == 8 || i == 10)
+			{
+				formatted += '-';
+			}
+			formatted += hex_digits[uuid[i] >> 4];
+			formatted += hex_digits[uuid[i] & 0xf];
+		}
 
-		return buffer;
+		return formatted;
 	}
 };
 
@@ -1215,12 +3805,11 @@ private:
 //	******** MAIN ********
 //	**********************
 
-int main()
+int main(int argc, char* argv[])
 {
-	hello_triangle_application app;
-
 	try
 	{
+		hello_triangle_application app(parse_command_line(argc, argv));
 		app.run();
 	}
 	catch (const std::exception& e)
@@ -0,0 +1,180 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Read-only memory mapping of a whole file, unmapped when it goes out of scope. The view is page aligned, so SPIR-V words can be read
+ * in place without copying the file into a buffer first, and the last page is zero filled past the end of the file, so the whole
+ * mapped_size() can back a host pointer import. Move-only
+ */
+class mapped_file
+{
+public:
+	mapped_file() = default;
+
+	explicit mapped_file(const std::string& filename)
+	{
+#ifdef _WIN32
+		SYSTEM_INFO system_info;
+		GetSystemInfo(&system_info);
+		page_size_ = system_info.dwPageSize;
+
+		file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file_ == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Failed to open file!");
+		}
+
+		LARGE_INTEGER file_size{};
+		GetFileSizeEx(file_, &file_size);
+		size_ = static_cast<size_t>(file_size.QuadPart);
+		if (size_ == 0)
+		{
+			return;
+		}
+
+		mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		data_ = mapping_ != nullptr ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+		page_size_ = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+		file_ = open(filename.c_str(), O_RDONLY);
+		if (file_ < 0)
+		{
+			throw std::runtime_error("Failed to open file!");
+		}
+
+		struct stat file_status{};
+		fstat(file_, &file_status);
+		size_ = static_cast<size_t>(file_status.st_size);
+		if (size_ == 0)
+		{
+			return;
+		}
+
+		data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
+		if (data_ == MAP_FAILED)
+		{
+			data_ = nullptr;
+		}
+#endif
+		if (data_ == nullptr)
+		{
+			close_file();
+			throw std::runtime_error("Failed to map file!");
+		}
+	}
+
+	mapped_file(mapped_file&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	mapped_file& operator=(mapped_file&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close_file();
+			std::swap(file_, other.file_);
+#ifdef _WIN32
+			std::swap(mapping_, other.mapping_);
+#endif
+			std::swap(data_, other.data_);
+			std::swap(size_, other.size_);
+			std::swap(page_size_, other.page_size_);
+		}
+
+		return *this;
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	~mapped_file()
+	{
+		close_file();
+	}
+
+	const void* data() const
+	{
+		return data_;
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+	/**
+	 * Bytes actually mapped, the file size rounded up to whole pages
+	 */
+	size_t mapped_size() const
+	{
+		return (size_ + page_size_ - 1) / page_size_ * page_size_;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+	HANDLE mapping_ = nullptr;
+#else
+	int file_ = -1;
+#endif
+	void* data_ = nullptr;
+	size_t size_ = 0;
+	size_t page_size_ = 1;
+
+	void close_file()
+	{
+#ifdef _WIN32
+		if (data_ != nullptr)
+		{
+			UnmapViewOfFile(data_);
+		}
+		if (mapping_ != nullptr)
+		{
+			CloseHandle(mapping_);
+		}
+		if (file_ != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file_);
+		}
+		mapping_ = nullptr;
+		file_ = INVALID_HANDLE_VALUE;
+#else
+		if (data_ != nullptr)
+		{
+			munmap(data_, size_);
+		}
+		if (file_ >= 0)
+		{
+			close(file_);
+		}
+		file_ = -1;
+#endif
+		data_ = nullptr;
+		size_ = 0;
+	}
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "gpu_memory_allocator.h"
+#include "staging_uploader.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * Interleaved vertex layout of every mesh, matching the inputs of shader.vert
+ */
+struct mesh_vertex
+{
+	float position[2];
+	float color[3];
+
+	static VkVertexInputBindingDescription get_binding_description()
+	{
+		VkVertexInputBindingDescription binding_description{};
+		binding_description.binding = 0;
+		binding_description.stride = sizeof(mesh_vertex);
+		binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return binding_description;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, 2> get_attribute_descriptions()
+	{
+		std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
+
+		attribute_descriptions[0].binding = 0;
+		attribute_descriptions[0].location = 0;
+		attribute_descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+		attribute_descriptions[0].offset = offsetof(mesh_vertex, position);
+
+		attribute_descriptions[1].binding = 0;
+		attribute_descriptions[1].location = 1;
+		attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+		attribute_descriptions[1].offset = offsetof(mesh_vertex, color);
+
+		return attribute_descriptions;
+	}
+};
+
+/**
+ * Device local vertex and index buffers of a mesh, indexed with 32 bit indices
+ */
+struct gpu_mesh
+{
+	VkBuffer vertex_buffer = VK_NULL_HANDLE;
+	gpu_allocation vertex_allocation;
+	VkBuffer index_buffer = VK_NULL_HANDLE;
+	gpu_allocation index_allocation;
+	VkBuffer meshlet_buffer = VK_NULL_HANDLE; // Storage buffer of mesh_file_meshlet, only for meshes loaded from a file that has meshlets
+	gpu_allocation meshlet_allocation;
+	uint32_t vertex_count = 0;
+	uint32_t index_count = 0;
+	uint32_t meshlet_count = 0;
+	float bounding_radius = 0.0f; // Of the circle centered on the origin that contains every vertex
+};
+
+//	***************************************
+//	******** MESH GLOBAL VARIABLES ********
+//	***************************************
+
+const std::vector<mesh_vertex> TRIANGLE_VERTICES = {
+	{ { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+	{ { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+	{ { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } }
+};
+
+const std::vector<uint32_t> TRIANGLE_INDICES = { 0, 1, 2 };
+
+//	***************************
+//	******** FUNCTIONS ********
+//	***************************
+
+inline VkBuffer create_device_local_buffer(gpu_memory_allocator& allocator, const VkDeviceSize size, const VkBufferUsageFlags usage,
+	gpu_allocation& allocation)
+{
+	VkBufferCreateInfo buffer_info{};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // Uploads move the ownership to the graphics queue family explicitly
+
+	VkBuffer buffer;
+	if (vkCreateBuffer(allocator.device(), &buffer_info, nullptr, &buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create buffer!");
+	}
+	allocation = allocator.allocate_for_buffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	return buffer;
+}
+
+/**
+ * Create the buffers of a mesh and queue the upload of its data. The mesh can be drawn by any frame recorded after the
+ * next uploader.flush()
+ */
+inline gpu_mesh create_gpu_mesh(gpu_memory_allocator& allocator, staging_uploader& uploader, const std::vector<mesh_vertex>& vertices,
+	const std::vector<uint32_t>& indices)
+{
+	gpu_mesh mesh;
+	mesh.vertex_count = static_cast<uint32_t>(vertices.size());
+	mesh.index_count = static_cast<uint32_t>(indices.size());
+	for (const auto& vertex : vertices)
+	{
+		mesh.bounding_radius = std::max(mesh.bounding_radius, std::hypot(vertex.position[0], vertex.position[1]));
+	}
+
+	const VkDeviceSize vertex_size = sizeof(mesh_vertex) * vertices.size();
+	const VkDeviceSize index_size = sizeof(uint32_t) * indices.size();
+
+	mesh.vertex_buffer = create_device_local_buffer(allocator, vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, mesh.vertex_allocation);
+	mesh.index_buffer = create_device_local_buffer(allocator, index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, mesh.index_allocation);
+
+	uploader.upload_buffer(mesh.vertex_buffer, 0, vertices.data(), vertex_size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	uploader.upload_buffer(mesh.index_buffer, 0, indices.data(), index_size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+	return mesh;
+}
+
+inline void destroy_gpu_mesh(gpu_memory_allocator& allocator, gpu_mesh& mesh)
+{
+	vkDestroyBuffer(allocator.device(), mesh.vertex_buffer, nullptr);
+	allocator.free(mesh.vertex_allocation);
+	vkDestroyBuffer(allocator.device(), mesh.index_buffer, nullptr);
+	allocator.free(mesh.index_allocation);
+	vkDestroyBuffer(allocator.device(), mesh.meshlet_buffer, nullptr);
+	allocator.free(mesh.meshlet_allocation);
+	mesh = gpu_mesh{};
+}
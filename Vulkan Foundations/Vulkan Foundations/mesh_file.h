@@ -0,0 +1,327 @@
+#pragma once
+
+#include "deletion_queue.h"
+#include "gpu_memory_allocator.h"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "staging_uploader.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//	********************************************
+//	******** MESH FILE GLOBAL VARIABLES ********
+//	********************************************
+
+const uint32_t MESH_FILE_MAGIC = 0x534D4656; // "VFMS" read as a little endian uint32
+const uint32_t MESH_FILE_VERSION = 1;
+const uint64_t MESH_FILE_SECTION_ALIGNMENT = 256; // Of every stream in the file, also a valid storage buffer offset alignment everywhere
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * Start of a mesh file. The file is the GPU layout itself: the header, then the mesh_vertex stream, the uint32_t index stream and the
+ * meshlet table, each at an offset aligned to MESH_FILE_SECTION_ALIGNMENT, in that order. Little endian, no compression, so loading
+ * it is mapping it and copying the streams as they are
+ */
+struct mesh_file_header
+{
+	uint32_t magic = MESH_FILE_MAGIC;
+	uint32_t version = MESH_FILE_VERSION;
+	uint32_t vertex_stride = sizeof(mesh_vertex); // Rejected unless it matches the mesh_vertex this build draws with
+	uint32_t vertex_count = 0;
+	uint32_t index_count = 0; // Triangle list, a multiple of 3
+	uint32_t meshlet_count = 0; // 0 when the file has no meshlet table
+	float bounding_radius = 0.0f; // Same as gpu_mesh::bounding_radius, precomputed so loading never reads the vertices
+	uint32_t reserved = 0;
+	uint64_t vertex_offset = 0;
+	uint64_t index_offset = 0;
+	uint64_t meshlet_offset = 0;
+};
+static_assert(sizeof(mesh_file_header) == 56, "mesh_file_header is part of the file format");
+
+/**
+ * Run of consecutive triangles of the index stream with its bounding circle, laid out for a std430 storage buffer
+ */
+struct mesh_file_meshlet
+{
+	uint32_t first_index = 0; // Multiple of 3
+	uint32_t triangle_count = 0;
+	float center[2] = { 0.0f, 0.0f };
+	float radius = 0.0f;
+	uint32_t padding[3] = { 0, 0, 0 };
+};
+static_assert(sizeof(mesh_file_meshlet) == 32, "mesh_file_meshlet is part of the file format");
+
+/**
+ * Mapped mesh file whose header was checked, the stream pointers point into the mapping
+ */
+struct mesh_file_view
+{
+	mapped_file file;
+	mesh_file_header header;
+	const uint8_t* vertices = nullptr;
+	const uint8_t* indices = nullptr;
+	const uint8_t* meshlets = nullptr;
+};
+
+/**
+ * What VK_EXT_external_memory_host needs to import a host pointer, left empty when the extension is not enabled
+ */
+struct host_memory_import_support
+{
+	PFN_vkGetMemoryHostPointerPropertiesEXT get_memory_host_pointer_properties = nullptr;
+	VkDeviceSize min_pointer_alignment = 0; // minImportedHostPointerAlignment, host pointer and size must both be multiples of it
+
+	bool is_enabled() const
+	{
+		return get_memory_host_pointer_properties != nullptr;
+	}
+};
+
+/**
+ * Transfer source buffer bound to imported host memory. It has its own VkDeviceMemory outside of gpu_memory_allocator, there is one
+ * per file load and it only lives until the copies out of it are done
+ */
+struct imported_host_buffer
+{
+	VkDevice device = VK_NULL_HANDLE;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+};
+
+//	***************************
+//	******** FUNCTIONS ********
+//	***************************
+
+/**
+ * Map a mesh file and check its layout. Only the header and the meshlet table are read, the indices are trusted like the SPIR-V of
+ * the shaders: checking them would read the whole index stream on the CPU, which is what the format is there to avoid
+ */
+inline mesh_file_view open_mesh_file(const std::string& path)
+{
+	mesh_file_view view;
+	view.file = mapped_file(path);
+
+	const uint64_t file_size = view.file.size();
+	if (file_size < sizeof(mesh_file_header))
+	{
+		throw std::runtime_error("Failed to read mesh file " + path + ", the file is truncated!");
+	}
+	std::memcpy(&view.header, view.file.data(), sizeof(mesh_file_header));
+	const mesh_file_header& header = view.header;
+
+	if (header.magic != MESH_FILE_MAGIC || header.version != MESH_FILE_VERSION)
+	{
+		throw std::runtime_error("Failed to read mesh file " + path + ", not a version " + std::to_string(MESH_FILE_VERSION) + " mesh file!");
+	}
+	if (header.vertex_stride != sizeof(mesh_vertex))
+	{
+		throw std::runtime_error("Failed to read mesh file " + path + ", its vertex layout does not match mesh_vertex!");
+	}
+	if (header.vertex_count == 0 || header.index_count == 0 || header.index_count % 3 != 0)
+	{
+		throw std::runtime_error("Failed to read mesh file " + path + ", it has no triangle list!");
+	}
+
+	if (header.vertex_offset > file_size || header.index_offset > file_size || header.meshlet_offset > file_size)
+	{
+		throw std::runtime_error("Failed to read mesh file " + path + ", its streams are not laid out as expected!");
+	}
+
+	// Sections in file order, each aligned and ending before the next one starts
+	const uint64_t vertex_end = header.vertex_offset + uint64_t(header.vertex_count) * sizeof(mesh_vertex);
+	const uint64_t index_end = header.index_offset + uint64_t(header.index_count) * sizeof(uint32_t);
+	const uint64_t meshlet_end = header.meshlet_offset + uint64_t(header.meshlet_count) * sizeof(mesh_file_meshlet);
+	const bool aligned = header.vertex_offset % MESH_FILE_SECTION_ALIGNMENT == 0 && header.index_offset % MESH_FILE_SECTION_ALIGNMENT == 0 &&
+		header.meshlet_offset % MESH_FILE_SECTION_ALIGNMENT == 0;
+	const bool ordered = header.vertex_offset >= sizeof(mesh_file_header) && header.index_offset >= vertex_end &&
+		(header.meshlet_count == 0 || header.meshlet_offset >= index_end);
+	const bool in_file = index_end <= file_size && vertex_end <= file_size && (header.meshlet_count == 0 || meshlet_end <= file_size);
+	if (!aligned || !ordered || !in_file)
+	{
+		throw std::runtime_error("Failed to read mesh file " + path + ", its streams are not laid out as expected!");
+	}
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(view.file.data());
+	view.vertices = bytes + header.vertex_offset;
+	view.indices = bytes + header.index_offset;
+	view.meshlets = header.meshlet_count > 0 ? bytes + header.meshlet_offset : nullptr;
+
+	for (uint32_t meshlet_index = 0; meshlet_index < header.meshlet_count; meshlet_index++)
+	{
+		mesh_file_meshlet meshlet;
+		std::memcpy(&meshlet, view.meshlets + sizeof(mesh_file_meshlet) * meshlet_index, sizeof(mesh_file_meshlet));
+		if (meshlet.first_index % 3 != 0 || uint64_t(meshlet.first_index) + uint64_t(meshlet.triangle_count) * 3 > header.index_count)
+		{
+			throw std::runtime_error("Failed to read mesh file " + path + ", meshlet " + std::to_string(meshlet_index) + " is out of the index stream!");
+		}
+	}
+
+	return view;
+}
+
+/**
+ * Wrap size bytes of host memory at data in a transfer source buffer, without copying them. The range may be rounded up to
+ * min_pointer_alignment as long as the result stays within available bytes. False when the extension is not enabled, the pointer is
+ * not aligned or the driver refuses the memory, which it may do for file backed pages: the caller then goes through staging memory
+ */
+inline bool import_host_buffer(const gpu_memory_allocator& allocator, const host_memory_import_support& support, const void* data,
+	const VkDeviceSize size, const VkDeviceSize available, imported_host_buffer& imported)
+{
+	if (!support.is_enabled() || reinterpret_cast<uintptr_t>(data) % support.min_pointer_alignment != 0)
+	{
+		return false;
+	}
+
+	const VkDeviceSize import_size = (size + support.min_pointer_alignment - 1) / support.min_pointer_alignment * support.min_pointer_alignment;
+	if (import_size > available)
+	{
+		return false;
+	}
+
+	const VkDevice device = allocator.device();
+	VkMemoryHostPointerPropertiesEXT pointer_properties{};
+	pointer_properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+	if (support.get_memory_host_pointer_properties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, data, &pointer_properties) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	VkExternalMemoryBufferCreateInfo external_info{};
+	external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+	external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+	VkBufferCreateInfo buffer_info{};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.pNext = &external_info;
+	buffer_info.size = import_size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // Only ever read by the transfer queue
+
+	VkBuffer buffer;
+	if (vkCreateBuffer(device, &buffer_info, nullptr, &buffer) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+	const uint32_t type_bits = requirements.memoryTypeBits & pointer_properties.memoryTypeBits;
+	if (type_bits == 0 || requirements.size > import_size)
+	{
+		vkDestroyBuffer(device, buffer, nullptr);
+		return false;
+	}
+
+	VkImportMemoryHostPointerInfoEXT import_info{};
+	import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+	import_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	import_info.pHostPointer = const_cast<void*>(data);
+
+	VkMemoryAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.pNext = &import_info;
+	alloc_info.allocationSize = import_size;
+	alloc_info.memoryTypeIndex = allocator.find_memory_type(type_bits, 0, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &alloc_info, nullptr, &memory) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device, buffer, nullptr);
+		return false;
+	}
+	if (vkBindBufferMemory(device, buffer, memory, 0) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device, buffer, nullptr);
+		vkFreeMemory(device, memory, nullptr);
+		return false;
+	}
+
+	imported = { device, buffer, memory };
+	return true;
+}
+
+inline void destroy_imported_host_buffer(imported_host_buffer& imported)
+{
+	vkDestroyBuffer(imported.device, imported.buffer, nullptr);
+	vkFreeMemory(imported.device, imported.memory, nullptr);
+	imported = imported_host_buffer{};
+}
+
+/**
+ * Create the buffers of the mesh stored at path and queue the copies of its streams, which go from the mapped file to the GPU with
+ * no parse step. With host memory import the transfer queue reads the file pages directly and the mapping is handed to retired,
+ * keyed on retire_value, the graphics timeline value of the first frame that can wait on the copies. Otherwise the streams are
+ * copied from the mapping straight into the staging ring. imported tells which path was taken. Like create_gpu_mesh(), the mesh
+ * can be drawn by any frame recorded after the next uploader.flush()
+ */
+inline gpu_mesh load_gpu_mesh(gpu_memory_allocator& allocator, staging_uploader& uploader, const host_memory_import_support& import_support,
+	const std::string& path, deletion_queue& retired, const uint64_t retire_value, bool& imported)
+{
+	auto view = std::make_shared<mesh_file_view>(open_mesh_file(path));
+	const mesh_file_header& header = view->header;
+
+	gpu_mesh mesh;
+	mesh.vertex_count = header.vertex_count;
+	mesh.index_count = header.index_count;
+	mesh.meshlet_count = header.meshlet_count;
+	mesh.bounding_radius = header.bounding_radius;
+
+	struct mesh_stream
+	{
+		VkBuffer buffer;
+		uint64_t file_offset;
+		VkDeviceSize size;
+		VkPipelineStageFlags dst_stage;
+		VkAccessFlags dst_access;
+	};
+	std::vector<mesh_stream> streams;
+
+	const VkDeviceSize vertex_size = sizeof(mesh_vertex) * VkDeviceSize(header.vertex_count);
+	const VkDeviceSize index_size = sizeof(uint32_t) * VkDeviceSize(header.index_count);
+	mesh.vertex_buffer = create_device_local_buffer(allocator, vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, mesh.vertex_allocation);
+	mesh.index_buffer = create_device_local_buffer(allocator, index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, mesh.index_allocation);
+	streams.push_back({ mesh.vertex_buffer, header.vertex_offset, vertex_size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT });
+	streams.push_back({ mesh.index_buffer, header.index_offset, index_size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT });
+
+	if (header.meshlet_count > 0)
+	{
+		const VkDeviceSize meshlet_size = sizeof(mesh_file_meshlet) * VkDeviceSize(header.meshlet_count);
+		mesh.meshlet_buffer = create_device_local_buffer(allocator, meshlet_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.meshlet_allocation);
+		streams.push_back({ mesh.meshlet_buffer, header.meshlet_offset, meshlet_size,
+			VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT });
+	}
+
+	imported_host_buffer host_buffer;
+	imported = import_host_buffer(allocator, import_support, view->file.data(), view->file.size(), view->file.mapped_size(), host_buffer);
+
+	for (const auto& stream : streams)
+	{
+		if (imported)
+		{
+			uploader.copy_buffer(host_buffer.buffer, stream.file_offset, stream.buffer, 0, stream.size, stream.dst_stage, stream.dst_access);
+		}
+		else
+		{
+			uploader.upload_buffer(stream.buffer, 0, static_cast<const uint8_t*>(view->file.data()) + stream.file_offset, stream.size, stream.dst_stage, stream.dst_access);
+		}
+	}
+
+	if (imported)
+	{
+		// The pages back the imported memory until the copies are done, the mapping goes with it
+		retired.push(retire_value, [view, host_buffer]() mutable { destroy_imported_host_buffer(host_buffer); });
+	}
+
+	return mesh;
+}
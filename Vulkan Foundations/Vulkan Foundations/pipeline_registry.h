@@ -0,0 +1,661 @@
+#pragma once
+
+#include "job_system.h"
+#include "shader_module_cache.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+using pipeline_handle = uint32_t;
+const pipeline_handle INVALID_PIPELINE_HANDLE = UINT32_MAX;
+
+/**
+ * Value of a layout(constant_id = ...) constant, bool, int, uint and float constants are all 32 bits wide. The same constants are
+ * given to every stage, a stage simply ignores the ids it doesn't declare
+ */
+struct specialization_constant
+{
+	uint32_t constant_id;
+	uint32_t value; // VK_TRUE/VK_FALSE for a bool constant, the bit pattern for a float one
+};
+
+/**
+ * Everything a graphics pipeline variant is built from. Viewport and scissor are always dynamic, so the swapchain extent is not part of it
+ */
+struct graphics_pipeline_state
+{
+	std::string vertex_shader_path;
+	std::string fragment_shader_path;
+	std::vector<VkVertexInputBindingDescription> vertex_bindings;
+	std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace front_face = VK_FRONT_FACE_CLOCKWISE;
+	bool blend_enable = true; // Straight alpha blending of the color attachment
+	bool color_write_enable = true; // Off for the depth pre-pass variants
+	bool depth_test_enable = true;
+	bool depth_write_enable = true;
+	VkCompareOp depth_compare_op = VK_COMPARE_OP_LESS_OR_EQUAL;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT; // Must match the attachments of the subpass
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass render_pass = VK_NULL_HANDLE; // VK_NULL_HANDLE for dynamic rendering, the pipeline is then built for the formats below
+	uint32_t subpass = 0;
+	VkFormat color_format = VK_FORMAT_UNDEFINED; // Only used without a render pass
+	VkFormat depth_format = VK_FORMAT_UNDEFINED;
+	std::vector<specialization_constant> specialization_constants;
+
+	void set_specialization_constant(const uint32_t constant_id, const uint32_t value)
+	{
+		for (auto& constant : specialization_constants)
+		{
+			if (constant.constant_id == constant_id)
+			{
+				constant.value = value;
+				return;
+			}
+		}
+		specialization_constants.push_back({ constant_id, value });
+	}
+
+	bool operator==(const graphics_pipeline_state& other) const
+	{
+		auto same_binding = [](const VkVertexInputBindingDescription& a, const VkVertexInputBindingDescription& b)
+		{
+			return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+		};
+		auto same_attribute = [](const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b)
+		{
+			return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+		};
+		auto same_constant = [](const specialization_constant& a, const specialization_constant& b)
+		{
+			return a.constant_id == b.constant_id && a.value == b.value;
+		};
+
+		return vertex_shader_path == other.vertex_shader_path && fragment_shader_path == other.fragment_shader_path &&
+			std::equal(vertex_bindings.begin(), vertex_bindings.end(), other.vertex_bindings.begin(), other.vertex_bindings.end(), same_binding) &&
+			std::equal(vertex_attributes.begin(), vertex_attributes.end(), other.vertex_attributes.begin(), other.vertex_attributes.end(), same_attribute) &&
+			topology == other.topology && polygon_mode == other.polygon_mode && cull_mode == other.cull_mode && front_face == other.front_face &&
+			blend_enable == other.blend_enable && color_write_enable == other.color_write_enable && depth_test_enable == other.depth_test_enable &&
+			depth_write_enable == other.depth_write_enable && depth_compare_op == other.depth_compare_op && samples == other.samples && layout == other.layout && render_pass == other.render_pass && subpass == other.subpass &&
+			color_format == other.color_format && depth_format == other.depth_format &&
+			std::equal(specialization_constants.begin(), specialization_constants.end(), other.specialization_constants.begin(),
+				other.specialization_constants.end(), same_constant);
+	}
+};
+
+/**
+ * FNV-1a over every field of the state. The vertex input descriptions and the specialization constants have no padding, so hashing
+ * their bytes is well defined
+ */
+struct graphics_pipeline_state_hash
+{
+	size_t operator()(const graphics_pipeline_state& state) const
+	{
+		uint64_t hash = FNV_OFFSET_BASIS;
+		auto add = [&hash](const void* data, const size_t size)
+		{
+			hash = fnv1a_append(hash, data, size);
+		};
+
+		add(state.vertex_shader_path.data(), state.vertex_shader_path.size());
+		add(state.fragment_shader_path.data(), state.fragment_shader_path.size());
+		add(state.vertex_bindings.data(), state.vertex_bindings.size() * sizeof(VkVertexInputBindingDescription));
+		add(state.vertex_attributes.data(), state.vertex_attributes.size() * sizeof(VkVertexInputAttributeDescription));
+		add(&state.topology, sizeof(state.topology));
+		add(&state.polygon_mode, sizeof(state.polygon_mode));
+		add(&state.cull_mode, sizeof(state.cull_mode));
+		add(&state.front_face, sizeof(state.front_face));
+		add(&state.blend_enable, sizeof(state.blend_enable));
+		add(&state.color_write_enable, sizeof(state.color_write_enable));
+		add(&state.depth_test_enable, sizeof(state.depth_test_enable));
+		add(&state.depth_write_enable, sizeof(state.depth_write_enable));
+		add(&state.depth_compare_op, sizeof(state.depth_compare_op));
+		add(&state.samples, sizeof(state.samples));
+		add(&state.layout, sizeof(state.layout));
+		add(&state.render_pass, sizeof(state.render_pass));
+		add(&state.subpass, sizeof(state.subpass));
+		add(&state.color_format, sizeof(state.color_format));
+		add(&state.depth_format, sizeof(state.depth_format));
+		add(state.specialization_constants.data(), state.specialization_constants.size() * sizeof(specialization_constant));
+
+		return static_cast<size_t>(hash);
+	}
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Owns every graphics pipeline variant, each one created once per distinct graphics_pipeline_state. request() queues the compile as
+ * a background job of the shared job_system and returns at once, resolve() gives the fallback pipeline of a variant until the variant itself is ready, so
+ * the render thread never blocks on a compile. Every compile goes through the same VkPipelineCache, which Vulkan allows from any thread.
+ * reload() rebuilds the variants using changed shaders in the background, swap_reloaded() puts them in use at a frame boundary.
+ * Every public function is called from the render thread, only the compiles run elsewhere
+ */
+class pipeline_registry
+{
+public:
+	/**
+	 * jobs runs the compiles, the job system caps how many run at once so they never take every worker from the frame
+	 */
+	void init(const VkDevice device, const VkPipelineCache pipeline_cache, shader_module_cache& shader_modules, job_system& jobs)
+	{
+		device_ = device;
+		pipeline_cache_ = pipeline_cache;
+		shader_modules_ = &shader_modules;
+		jobs_ = &jobs;
+	}
+
+	void destroy()
+	{
+		{
+			// Queued variants are dropped, only the compiles already running are waited for. The jobs of the dropped ones find
+			// the queue empty and return
+			std::lock_guard<std::mutex> lock(mutex_);
+			pending_compiles_ -= static_cast<uint32_t>(compile_queue_.size());
+			compile_queue_.clear();
+		}
+		wait_idle();
+
+		for (auto& entry : entries_)
+		{
+			vkDestroyPipeline(device_, entry.pipeline, nullptr);
+			vkDestroyPipeline(device_, entry.replacement, nullptr);
+		}
+		entries_.clear();
+		handles_.clear();
+		ready_replacements_ = 0;
+	}
+
+	/**
+	 * Handle of the variant for state, queuing its compile the first time. fallback is what resolve() returns while it compiles
+	 */
+	pipeline_handle request(const graphics_pipeline_state& state, const pipeline_handle fallback = INVALID_PIPELINE_HANDLE)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		const auto existing = handles_.find(state);
+		if (existing != handles_.end())
+		{
+			return existing->second;
+		}
+
+		const pipeline_handle handle = add_entry(state, fallback);
+		compile_queue_.push_back({ handle, 0 });
+		pending_compiles_++;
+		lock.unlock();
+
+		submit_compile();
+		return handle;
+	}
+
+	/**
+	 * Handle of the variant for state, compiled on the calling thread if it doesn't exist yet. Meant for the fallback pipelines
+	 */
+	pipeline_handle create(const graphics_pipeline_state& state)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		const auto existing = handles_.find(state);
+		if (existing != handles_.end())
+		{
+			const pipeline_handle handle = existing->second;
+			lock.unlock();
+			wait(handle);
+			return handle;
+		}
+
+		const pipeline_handle handle = add_entry(state, INVALID_PIPELINE_HANDLE);
+		pipeline_entry& entry = entries_[handle];
+		lock.unlock();
+
+		// Unlike background compiles, failing here is fatal: there is nothing to fall back to
+		entry.pipeline = compile(entry.state);
+		entry.status.store(pipeline_status::ready, std::memory_order_release);
+		return handle;
+	}
+
+	/**
+	 * The pipeline to bind for handle: the variant once compiled, otherwise the resolved fallback. VK_NULL_HANDLE when neither is ready
+	 */
+	VkPipeline resolve(pipeline_handle handle) const
+	{
+		while (handle != INVALID_PIPELINE_HANDLE)
+		{
+			const pipeline_entry& entry = entries_[handle];
+			if (entry.status.load(std::memory_order_acquire) == pipeline_status::ready)
+			{
+				return entry.pipeline;
+			}
+			handle = entry.fallback;
+		}
+
+		return VK_NULL_HANDLE;
+	}
+
+	bool is_ready(const pipeline_handle handle) const
+	{
+		return entries_[handle].status.load(std::memory_order_acquire) == pipeline_status::ready;
+	}
+
+	/**
+	 * Queue a rebuild of every variant using one of shader_paths. The current pipelines stay in use until swap_reloaded()
+	 */
+	void reload(const std::vector<std::string>& shader_paths)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		uint32_t queued = 0;
+		for (pipeline_handle handle = 0; handle < static_cast<pipeline_handle>(entries_.size()); handle++)
+		{
+			pipeline_entry& entry = entries_[handle];
+			const bool uses_shader = std::any_of(shader_paths.begin(), shader_paths.end(), [&](const std::string& path)
+			{
+				return entry.state.vertex_shader_path == path || entry.state.fragment_shader_path == path;
+			});
+			if (!uses_shader || entry.status.load(std::memory_order_relaxed) == pipeline_status::retired)
+			{
+				continue;
+			}
+
+			// Numbered so a rebuild that finishes after a more recent one is dropped
+			compile_queue_.push_back({ handle, ++entry.reload_count });
+			pending_compiles_++;
+			queued++;
+		}
+		lock.unlock();
+
+		for (uint32_t compile = 0; compile < queued; compile++)
+		{
+			submit_compile();
+		}
+	}
+
+	/**
+	 * Put the rebuilt variants in use, called once per frame before resolve(). The replaced pipelines are appended to replaced, a
+	 * vector the caller keeps from frame to frame. Frames in flight may still use them so destroying them is left to the caller
+	 */
+	void swap_reloaded(std::vector<VkPipeline>& replaced)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if (ready_replacements_ == 0)
+		{
+			return;
+		}
+
+		for (auto& entry : entries_)
+		{
+			// A first compile still running would overwrite the pipeline, that variant is swapped on a later frame
+			const pipeline_status status = entry.status.load(std::memory_order_relaxed);
+			if (entry.replacement == VK_NULL_HANDLE || status == pipeline_status::pending)
+			{
+				continue;
+			}
+
+			if (entry.pipeline != VK_NULL_HANDLE)
+			{
+				replaced.push_back(entry.pipeline);
+			}
+			entry.pipeline = std::exchange(entry.replacement, VK_NULL_HANDLE);
+			entry.status.store(pipeline_status::ready, std::memory_order_release); // A failed variant may have been fixed by the edit
+			ready_replacements_--;
+		}
+	}
+
+	/**
+	 * Block until every queued compile finished
+	 */
+	void wait_idle()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		compile_done_.wait(lock, [this] { return pending_compiles_ == 0; });
+	}
+
+	/**
+	 * Forget every variant built for render_pass, e.g. when the render pass is recreated. VK_NULL_HANDLE forgets the variants built for
+	 * dynamic rendering, e.g. when the attachment formats change. The returned pipelines may still be used by frames in flight,
+	 * destroying them is left to the caller
+	 */
+	std::vector<VkPipeline> retire(const VkRenderPass render_pass)
+	{
+		wait_idle();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::vector<VkPipeline> retired;
+
+		for (auto& entry : entries_)
+		{
+			if (entry.state.render_pass != render_pass || entry.status.load(std::memory_order_relaxed) == pipeline_status::retired)
+			{
+				continue;
+			}
+
+			for (const VkPipeline pipeline : { entry.pipeline, entry.replacement })
+			{
+				if (pipeline != VK_NULL_HANDLE)
+				{
+					retired.push_back(pipeline);
+				}
+			}
+			if (entry.replacement != VK_NULL_HANDLE)
+			{
+				ready_replacements_--;
+			}
+			entry.pipeline = VK_NULL_HANDLE;
+			entry.replacement = VK_NULL_HANDLE;
+			entry.status.store(pipeline_status::retired, std::memory_order_release);
+			handles_.erase(entry.state);
+		}
+
+		return retired;
+	}
+
+private:
+	enum class pipeline_status
+	{
+		pending,
+		ready,
+		failed, // Kept on its fallback for good
+		retired
+	};
+
+	struct pipeline_entry
+	{
+		graphics_pipeline_state state;
+		pipeline_handle fallback = INVALID_PIPELINE_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE; // Written before status becomes ready, then only by swap_reloaded()
+		std::atomic<pipeline_status> status{ pipeline_status::pending };
+		VkPipeline replacement = VK_NULL_HANDLE; // Rebuilt after a shader change, waiting for swap_reloaded(). Guarded by mutex_
+		uint64_t reload_count = 0; // Rebuilds queued so far. Guarded by mutex_
+		uint64_t replacement_reload = 0; // Rebuild that produced replacement. Guarded by mutex_
+	};
+
+	struct compile_job
+	{
+		pipeline_handle handle;
+		uint64_t reload; // 0 for the first compile of the variant
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
+	shader_module_cache* shader_modules_ = nullptr;
+	job_system* jobs_ = nullptr;
+
+	std::mutex mutex_;
+	std::condition_variable compile_done_;
+	std::deque<pipeline_entry> entries_; // Indexed by handle, a deque so growing it never moves an entry a compile thread is writing
+	std::unordered_map<graphics_pipeline_state, pipeline_handle, graphics_pipeline_state_hash> handles_;
+	std::deque<compile_job> compile_queue_;
+	uint32_t pending_compiles_ = 0; // Queued or being compiled
+	uint32_t ready_replacements_ = 0; // Entries with a replacement
+
+	/**
+	 * Caller holds mutex_
+	 */
+	pipeline_handle add_entry(const graphics_pipeline_state& state, const pipeline_handle fallback)
+	{
+		const pipeline_handle handle = static_cast<pipeline_handle>(entries_.size());
+		entries_.emplace_back();
+		entries_.back().state = state;
+		entries_.back().fallback = fallback;
+		handles_.emplace(state, handle);
+
+		return handle;
+	}
+
+	void wait(const pipeline_handle handle)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		compile_done_.wait(lock, [&] { return entries_[handle].status.load(std::memory_order_acquire) != pipeline_status::pending; });
+	}
+
+	/**
+	 * One background job per queued compile, each job takes the compile at the front of the queue so they run in request order
+	 */
+	void submit_compile()
+	{
+		jobs_->submit([this] { run_compile(); }, nullptr, job_priority::background);
+	}
+
+	void run_compile()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (compile_queue_.empty())
+		{
+			return;
+		}
+
+		const compile_job job = compile_queue_.front();
+		compile_queue_.pop_front();
+		pipeline_entry& entry = entries_[job.handle];
+		lock.unlock();
+
+		if (job.reload == 0)
+		{
+			pipeline_status status = pipeline_status::ready;
+			try
+			{
+				entry.pipeline = compile(entry.state);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "Background pipeline compile failed, keeping its fallback: " << e.what() << std::endl;
+				status = pipeline_status::failed;
+			}
+
+			lock.lock();
+			entry.status.store(status, std::memory_order_release);
+		}
+		else
+		{
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			try
+			{
+				pipeline = compile(entry.state);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "Pipeline rebuild after a shader change failed, keeping the current one: " << e.what() << std::endl;
+			}
+
+			lock.lock();
+			store_replacement(entry, job.reload, pipeline);
+		}
+		pending_compiles_--;
+		lock.unlock();
+		compile_done_.notify_all();
+	}
+
+	/**
+	 * Caller holds mutex_. A replacement not swapped in yet has never been bound, so the one it supersedes is destroyed right away
+	 */
+	void store_replacement(pipeline_entry& entry, const uint64_t reload, const VkPipeline pipeline)
+	{
+		const bool is_stale = reload < entry.replacement_reload || entry.status.load(std::memory_order_relaxed) == pipeline_status::retired;
+		if (pipeline == VK_NULL_HANDLE || is_stale)
+		{
+			vkDestroyPipeline(device_, pipeline, nullptr);
+			return;
+		}
+
+		if (entry.replacement != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(device_, entry.replacement, nullptr);
+			ready_replacements_--;
+		}
+		entry.replacement = pipeline;
+		entry.replacement_reload = reload;
+		ready_replacements_++;
+	}
+
+	VkPipeline compile(const graphics_pipeline_state& state) const
+	{
+		// Owned by the cache, loaded once and shared by every variant
+		const VkShaderModule vert_shader_module = shader_modules_->acquire(state.vertex_shader_path);
+		const VkShaderModule frag_shader_module = shader_modules_->acquire(state.fragment_shader_path);
+
+		// Map entries point straight into the constants array, the values are read in place
+		std::vector<VkSpecializationMapEntry> specialization_entries;
+		specialization_entries.reserve(state.specialization_constants.size());
+		for (size_t i = 0; i < state.specialization_constants.size(); i++)
+		{
+			const uint32_t offset = static_cast<uint32_t>(i * sizeof(specialization_constant) + offsetof(specialization_constant, value));
+			specialization_entries.push_back({ state.specialization_constants[i].constant_id, offset, sizeof(uint32_t) });
+		}
+
+		VkSpecializationInfo specialization_info{};
+		specialization_info.mapEntryCount = static_cast<uint32_t>(specialization_entries.size());
+		specialization_info.pMapEntries = specialization_entries.data();
+		specialization_info.dataSize = state.specialization_constants.size() * sizeof(specialization_constant);
+		specialization_info.pData = state.specialization_constants.data();
+
+		const VkSpecializationInfo* stage_specialization = specialization_entries.empty() ? nullptr : &specialization_info;
+
+		VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
+		vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		vert_shader_stage_info.module = vert_shader_module;
+		vert_shader_stage_info.pName = "main";
+		vert_shader_stage_info.pSpecializationInfo = stage_specialization;
+
+		VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
+		frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		frag_shader_stage_info.module = frag_shader_module;
+		frag_shader_stage_info.pName = "main";
+		frag_shader_stage_info.pSpecializationInfo = stage_specialization;
+
+		VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_stage_info, frag_shader_stage_info };
+
+		VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+		vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(state.vertex_bindings.size());
+		vertex_input_info.pVertexBindingDescriptions = state.vertex_bindings.data();
+		vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(state.vertex_attributes.size());
+		vertex_input_info.pVertexAttributeDescriptions = state.vertex_attributes.data();
+
+		VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+		input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		input_assembly.topology = state.topology;
+		input_assembly.primitiveRestartEnable = VK_FALSE;
+
+		// Viewport and scissor are set while recording the command buffers, so the pipeline doesn't depend on the swapchain extent
+		VkPipelineViewportStateCreateInfo viewport_state{};
+		viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewport_state.viewportCount = 1;
+		viewport_state.pViewports = nullptr;
+		viewport_state.scissorCount = 1;
+		viewport_state.pScissors = nullptr;
+
+		const VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamic_state{};
+		dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamic_state.dynamicStateCount = static_cast<uint32_t>(std::size(dynamic_states));
+		dynamic_state.pDynamicStates = dynamic_states;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.depthClampEnable = VK_FALSE;
+		rasterizer.rasterizerDiscardEnable = VK_FALSE;
+		rasterizer.polygonMode = state.polygon_mode;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = state.cull_mode;
+		rasterizer.frontFace = state.front_face;
+		rasterizer.depthBiasEnable = VK_FALSE;
+
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.sampleShadingEnable = VK_FALSE;
+		multisampling.rasterizationSamples = state.samples;
+
+		VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+		depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depth_stencil.depthTestEnable = state.depth_test_enable ? VK_TRUE : VK_FALSE;
+		depth_stencil.depthWriteEnable = state.depth_write_enable ? VK_TRUE : VK_FALSE;
+		depth_stencil.depthCompareOp = state.depth_compare_op;
+		depth_stencil.depthBoundsTestEnable = VK_FALSE;
+		depth_stencil.stencilTestEnable = VK_FALSE;
+
+		VkPipelineColorBlendAttachmentState color_blend_attachment{};
+		color_blend_attachment.colorWriteMask = state.color_write_enable ?
+			VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT : 0;
+		color_blend_attachment.blendEnable = state.blend_enable ? VK_TRUE : VK_FALSE;
+		color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+		color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+		VkPipelineColorBlendStateCreateInfo color_blending{};
+		color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		color_blending.logicOpEnable = VK_FALSE;
+		color_blending.logicOp = VK_LOGIC_OP_COPY;
+		color_blending.attachmentCount = 1;
+		color_blending.pAttachments = &color_blend_attachment;
+		color_blending.blendConstants[0] = 0.0f;
+		color_blending.blendConstants[1] = 0.0f;
+		color_blending.blendConstants[2] = 0.0f;
+		color_blending.blendConstants[3] = 0.0f;
+
+		VkGraphicsPipelineCreateInfo pipeline_info{};
+		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipeline_info.stageCount = 2;
+		pipeline_info.pStages = shader_stages;
+		pipeline_info.pVertexInputState = &vertex_input_info;
+		pipeline_info.pInputAssemblyState = &input_assembly;
+		pipeline_info.pViewportState = &viewport_state;
+		pipeline_info.pRasterizationState = &rasterizer;
+		pipeline_info.pMultisampleState = &multisampling;
+		pipeline_info.pDepthStencilState = &depth_stencil;
+		pipeline_info.pColorBlendState = &color_blending;
+		pipeline_info.pDynamicState = &dynamic_state;
+		pipeline_info.layout = state.layout;
+		pipeline_info.renderPass = state.render_pass;
+		pipeline_info.subpass = state.subpass;
+		pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+#ifdef VK_KHR_dynamic_rendering
+		VkPipelineRenderingCreateInfoKHR rendering_info{};
+		rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+		rendering_info.colorAttachmentCount = 1;
+		rendering_info.pColorAttachmentFormats = &state.color_format;
+		rendering_info.depthAttachmentFormat = state.depth_format;
+		if (state.render_pass == VK_NULL_HANDLE)
+		{
+			pipeline_info.pNext = &rendering_info;
+		}
+#endif
+
+		VkPipeline pipeline;
+		if (vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create graphics pipeline!");
+		}
+
+		return pipeline;
+	}
+};
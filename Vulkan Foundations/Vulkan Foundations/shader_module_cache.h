@@ -0,0 +1,213 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//	******************************************************
+//	******** SHADER MODULE CACHE GLOBAL VARIABLES ********
+//	******************************************************
+
+const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+const uint64_t FNV_PRIME = 0x100000001b3ull;
+const uint32_t SPIRV_MAGIC = 0x07230203;
+
+//	***************************
+//	******** FUNCTIONS ********
+//	***************************
+
+/**
+ * 64 bit FNV-1a of size bytes, continuing from hash
+ */
+inline uint64_t fnv1a_append(uint64_t hash, const void* data, const size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Shader modules created once per SPIR-V file and shared by every pipeline built from it. Files are memory mapped and modules are
+ * keyed by a hash of their content, so two paths holding the same SPIR-V share one module. SPIR-V embedded in the executable is
+ * registered under the path of its file with add_embedded(), and acquiring it reads nothing from disk.
+ * poll_changes() checks the write times of the loaded files and reloads the ones whose content changed. Modules that were replaced
+ * stay alive until destroy(), a pipeline compile running on another thread may still be reading them
+ */
+class shader_module_cache
+{
+public:
+	void init(const VkDevice device)
+	{
+		device_ = device;
+	}
+
+	void destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		for (const auto& module : modules_)
+		{
+			vkDestroyShaderModule(device_, module.second, nullptr);
+		}
+		modules_.clear();
+		files_.clear();
+	}
+
+	/**
+	 * Serve path from code instead of the file. The write time of the file is still recorded, so it can be watched for changes
+	 */
+	void add_embedded(const std::string& path, const uint32_t* code, const size_t size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		std::error_code error;
+		shader_file& entry = files_[path];
+		entry.write_time = std::filesystem::last_write_time(path, error);
+		entry.content_hash = fnv1a_append(FNV_OFFSET_BASIS, code, size);
+		entry.module = find_or_create_module(entry.content_hash, code, size);
+	}
+
+	/**
+	 * Module of a SPIR-V file, embedded or loaded on the first call. Safe to call from any thread
+	 */
+	VkShaderModule acquire(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		const auto existing = files_.find(path);
+		if (existing != files_.end())
+		{
+			return existing->second.module;
+		}
+
+		std::error_code error;
+		const auto write_time = std::filesystem::last_write_time(path, error);
+		if (error)
+		{
+			throw std::runtime_error("Failed to load shader, " + path + " is neither embedded nor on disk!");
+		}
+
+		mapped_file file(path);
+		if (!is_spirv(file))
+		{
+			throw std::runtime_error("Failed to load shader, " + path + " is not SPIR-V!");
+		}
+
+		shader_file& entry = files_[path];
+		entry.write_time = write_time;
+		entry.content_hash = fnv1a_append(FNV_OFFSET_BASIS, file.data(), file.size());
+		entry.module = find_or_create_module(entry.content_hash, file.data(), file.size());
+
+		return entry.module;
+	}
+
+	/**
+	 * Reload the files written since the last call and return the paths whose content changed. A file caught halfway through
+	 * being written is not valid SPIR-V yet, it is retried on the next call
+	 */
+	std::vector<std::string> poll_changes()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::vector<std::string> changed;
+
+		for (auto& file_entry : files_)
+		{
+			shader_file& entry = file_entry.second;
+
+			std::error_code error;
+			const auto write_time = std::filesystem::last_write_time(file_entry.first, error);
+			if (error || write_time == entry.write_time)
+			{
+				continue;
+			}
+
+			try
+			{
+				mapped_file file(file_entry.first);
+				if (!is_spirv(file))
+				{
+					continue;
+				}
+
+				entry.write_time = write_time;
+				const uint64_t content_hash = fnv1a_append(FNV_OFFSET_BASIS, file.data(), file.size());
+				if (content_hash == entry.content_hash)
+				{
+					continue; // Touched or rebuilt to the same binary
+				}
+
+				entry.module = find_or_create_module(content_hash, file.data(), file.size());
+				entry.content_hash = content_hash;
+				changed.push_back(file_entry.first);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "Shader reload of " << file_entry.first << " failed: " << e.what() << std::endl;
+			}
+		}
+
+		return changed;
+	}
+
+private:
+	struct shader_file
+	{
+		std::filesystem::file_time_type write_time;
+		uint64_t content_hash = 0;
+		VkShaderModule module = VK_NULL_HANDLE;
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+
+	std::mutex mutex_;
+	std::unordered_map<std::string, shader_file> files_; // Keyed by path
+	std::unordered_map<uint64_t, VkShaderModule> modules_; // Keyed by content hash
+
+	static bool is_spirv(const mapped_file& file)
+	{
+		return file.size() >= sizeof(uint32_t) && file.size() % sizeof(uint32_t) == 0 && *static_cast<const uint32_t*>(file.data()) == SPIRV_MAGIC;
+	}
+
+	/**
+	 * Caller holds mutex_
+	 */
+	VkShaderModule find_or_create_module(const uint64_t content_hash, const void* code, const size_t size)
+	{
+		const auto existing = modules_.find(content_hash);
+		if (existing != modules_.end())
+		{
+			return existing->second;
+		}
+
+		VkShaderModuleCreateInfo create_info{};
+		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		create_info.codeSize = size;
+		create_info.pCode = static_cast<const uint32_t*>(code);
+
+		VkShaderModule shader_module;
+		if (vkCreateShaderModule(device_, &create_info, nullptr, &shader_module) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create shader module!");
+		}
+		modules_.emplace(content_hash, shader_module);
+
+		return shader_module;
+	}
+};
@@ -0,0 +1,25 @@
+// Instance transform of instance_buffer.h, xy offset, z scale, w rotation in radians. Shared by shader.vert, which draws the
+// instances, and cull.comp, which tests them against the viewport, so both always agree on where an instance is
+#ifndef INSTANCE_TRANSFORM_GLSL
+#define INSTANCE_TRANSFORM_GLSL
+
+vec2 apply_instance_transform(const vec2 position, const vec4 transform, const bool rotate)
+{
+	vec2 rotated = position;
+	if (rotate)
+	{
+		const float c = cos(transform.w);
+		const float s = sin(transform.w);
+		rotated = mat2(c, s, -s, c) * position;
+	}
+
+	return rotated * transform.z + transform.xy;
+}
+
+// The rotation doesn't move a bounding circle around the origin of the instance, only the scale changes its radius
+float instance_bounding_radius(const float bounding_radius, const vec4 transform)
+{
+	return bounding_radius * abs(transform.z);
+}
+
+#endif
@@ -1,11 +1,48 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 frag_color;
+layout(location = 1) flat in uint frag_material;
+layout(location = 2) in vec2 frag_uv;
 
 layout(location = 0) out vec4 out_color;
 
+const uint NO_TEXTURE = 0xffffffff;
+
+struct material
+{
+	vec4 tint;
+	uint texture; // Index in the texture slot table, see texture_streamer.h
+};
+
+// Every storage buffer of the application, see bindless_descriptors.h
+layout(set = 1, binding = 0) readonly buffer material_buffer
+{
+	material materials[];
+} bindless_buffers[];
+
+// Same binding, the slot table of the frame maps the texture of a material to its current slot in bindless_textures
+layout(set = 1, binding = 0) readonly buffer texture_slot_table
+{
+	uint slots[];
+} bindless_slot_tables[];
+
+layout(set = 1, binding = 1) uniform sampler2D bindless_textures[];
+
+layout(push_constant) uniform draw_push_constants
+{
+	uint material_buffer;
+	uint texture_table;
+} draw;
+
 void main()
 {
-	out_color = vec4(frag_color, 1.0);
+	const material m = bindless_buffers[draw.material_buffer].materials[frag_material];
+	out_color = vec4(frag_color, 1.0) * m.tint;
+	if (m.texture != NO_TEXTURE)
+	{
+		const uint slot = bindless_slot_tables[draw.texture_table].slots[m.texture];
+		out_color *= texture(bindless_textures[nonuniformEXT(slot)], frag_uv);
+	}
 }
\ No newline at end of file
@@ -1,22 +1,40 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "instance_transform.glsl"
+
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in vec3 in_color;
+
+// Per-instance streams, see instance_buffer.h
+layout(location = 2) in vec4 instance_transform; // xy offset, z scale, w rotation in radians
+layout(location = 3) in vec4 instance_color;
+layout(location = 4) in uint instance_material; // Index in the material buffer
 
 layout(location = 0) out vec3 frag_color;
+layout(location = 1) flat out uint frag_material;
+layout(location = 2) out vec2 frag_uv;
 
-vec2 positions[3] = vec2[](
-	vec2(0.0, -0.5),
-	vec2(0.5, 0.5),
-	vec2(-0.5, 0.5)
-	);
+// The depth pre-pass and the main pass run this shader in different pipelines and the main pass tests with VK_COMPARE_OP_EQUAL, so
+// both must compute bit identical positions
+invariant gl_Position;
+
+// Per-frame data from the uniform ring, see uniform_ring.h
+layout(set = 0, binding = 0) uniform frame_uniforms
+{
+	vec2 view_scale;
+	vec2 view_offset;
+} frame;
 
-vec3 colors[3] = vec3[](
-	vec3(1.0, 0.0, 0.0),
-	vec3(0.0, 1.0, 0.0),
-	vec3(0.0, 0.0, 1.0)
-	);
+// Specialized to false when no instance is rotated, the pipeline compiler then drops the rotation entirely
+layout(constant_id = 0) const bool ROTATE_INSTANCES = true;
 
 void main()
 {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	frag_color = colors[gl_VertexIndex];
+	const vec2 position = apply_instance_transform(in_position, instance_transform, ROTATE_INSTANCES);
+	gl_Position = vec4(position * frame.view_scale + frame.view_offset, 0.0, 1.0);
+	frag_color = in_color * instance_color.rgb;
+	frag_material = instance_material;
+	frag_uv = in_position + 0.5; // The triangle spans the unit square around its origin
 }
\ No newline at end of file
@@ -0,0 +1,516 @@
+#pragma once
+
+#include "gpu_memory_allocator.h"
+#include "timeline_semaphore.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+//	*******************************************
+//	******** UPLOADER GLOBAL VARIABLES ********
+//	*******************************************
+
+const VkDeviceSize DEFAULT_STAGING_RING_SIZE = VkDeviceSize(16) << 20; // 16 mb, bigger uploads are split across batches
+const VkDeviceSize STAGING_COPY_ALIGNMENT = 16; // Keeps every source offset valid for any vkCmdCopyBuffer* texel alignment
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * One mip level of an image upload, stored as tightly packed rows of texel blocks
+ */
+struct image_upload_level
+{
+	uint32_t mip_level = 0;
+	VkExtent2D extent{}; // In texels
+	const void* data = nullptr;
+	VkDeviceSize row_pitch = 0; // Bytes of one row of blocks
+	uint32_t block_height = 1; // Texel rows per block row, a block row is never split between copies
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Streams data into device local resources through a host visible staging ring. Copies are recorded into batches submitted to
+ * the transfer queue, which is a dedicated transfer-only family when the device has one, so uploads run on the copy engine next
+ * to rendering instead of stalling it. When the families differ, the uploaded ranges are released by the transfer queue and
+ * acquired by the graphics queue. Every batch signals the next value of the transfer timeline, the graphics frame that first uses
+ * the data waits on it and the batch is recycled once the timeline passed it. Not thread safe, everything runs on the render thread
+ */
+class staging_uploader
+{
+public:
+	void init(gpu_memory_allocator& allocator, const uint32_t transfer_family, const VkQueue transfer_queue, const uint32_t graphics_family,
+		const VkDeviceSize ring_size = DEFAULT_STAGING_RING_SIZE)
+	{
+		allocator_ = &allocator;
+		device_ = allocator.device();
+		transfer_family_ = transfer_family;
+		transfer_queue_ = transfer_queue;
+		graphics_family_ = graphics_family;
+		ring_size_ = ring_size;
+
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = ring_size_;
+		buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(device_, &buffer_info, nullptr, &ring_buffer_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create staging buffer!");
+		}
+		// Written once sequentially by the CPU, so write-combined coherent memory is the best fit
+		ring_allocation_ = allocator_->allocate_for_buffer(ring_buffer_, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		VkCommandPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		pool_info.queueFamilyIndex = transfer_family_;
+
+		if (vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create upload command pool!");
+		}
+
+		timeline_.init(device_);
+	}
+
+	void destroy()
+	{
+		timeline_.wait(timeline_.submitted());
+		in_flight_.clear();
+		free_batches_.clear();
+		current_ = upload_batch{};
+
+		timeline_.destroy();
+		vkDestroyCommandPool(device_, command_pool_, nullptr);
+		vkDestroyBuffer(device_, ring_buffer_, nullptr);
+		allocator_->free(ring_allocation_);
+	}
+
+	bool uses_ownership_transfer() const
+	{
+		return transfer_family_ != graphics_family_;
+	}
+
+	/**
+	 * Copy size bytes of data to dst_buffer at dst_offset. dst_stage and dst_access describe how the graphics queue reads the buffer
+	 * afterwards. The copy only reaches the GPU with the next flush(). A VK_SHARING_MODE_CONCURRENT buffer has no owner to transfer,
+	 * so no ownership barrier is recorded for it
+	 */
+	void upload_buffer(const VkBuffer dst_buffer, const VkDeviceSize dst_offset, const void* data, const VkDeviceSize size,
+		const VkPipelineStageFlags dst_stage, const VkAccessFlags dst_access, const bool concurrent = false)
+	{
+		const uint8_t* source = static_cast<const uint8_t*>(data);
+		VkDeviceSize uploaded = 0;
+
+		while (uploaded < size)
+		{
+			const VkDeviceSize chunk_size = std::min(size - uploaded, ring_size_ / 2);
+			const VkDeviceSize staging_offset = allocate_staging(chunk_size);
+
+			std::memcpy(static_cast<uint8_t*>(ring_allocation_.mapped) + staging_offset, source + uploaded, static_cast<size_t>(chunk_size));
+
+			VkBufferCopy region{};
+			region.srcOffset = staging_offset;
+			region.dstOffset = dst_offset + uploaded;
+			region.size = chunk_size;
+			record_buffer_copy(ring_buffer_, dst_buffer, region, dst_stage, dst_access, concurrent);
+
+			uploaded += chunk_size;
+		}
+	}
+
+	/**
+	 * Copy size bytes of src_buffer, a transfer source that stays alive until the graphics frame waiting on the copy is done, without
+	 * going through the staging ring. Meant for imported host memory, where the GPU reads the data where it already is
+	 */
+	void copy_buffer(const VkBuffer src_buffer, const VkDeviceSize src_offset, const VkBuffer dst_buffer, const VkDeviceSize dst_offset,
+		const VkDeviceSize size, const VkPipelineStageFlags dst_stage, const VkAccessFlags dst_access, const bool concurrent = false)
+	{
+		VkBufferCopy region{};
+		region.srcOffset = src_offset;
+		region.dstOffset = dst_offset;
+		region.size = size;
+		record_buffer_copy(src_buffer, dst_buffer, region, dst_stage, dst_access, concurrent);
+	}
+
+	/**
+	 * Fill every mip level of a color image that was just created: levels from memory, copies from src_image. src_image must be in
+	 * VK_IMAGE_LAYOUT_GENERAL and written by an earlier call, it is only read, so frames in flight can keep sampling it. The image
+	 * ends up in final_layout, dst_stage and dst_access describe how the graphics queue reads it. There is no ownership transfer
+	 * for images, when the families differ the image must be VK_SHARING_MODE_CONCURRENT
+	 */
+	void upload_image(const VkImage image, const uint32_t mip_levels, const std::vector<image_upload_level>& levels,
+		const VkPipelineStageFlags dst_stage, const VkAccessFlags dst_access, const VkImageLayout final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		const VkImage src_image = VK_NULL_HANDLE, const std::vector<VkImageCopy>& copies = {})
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mip_levels, 0, 1 };
+		if (copies.empty())
+		{
+			vkCmdPipelineBarrier(begin_batch(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+		else
+		{
+			// src_image was written and moved to GENERAL earlier on this queue, the all commands scope orders the copy after both
+			VkMemoryBarrier source_barrier{};
+			source_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			source_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			source_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(begin_batch(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &source_barrier, 0, nullptr, 1, &barrier);
+			vkCmdCopyImage(begin_batch(), src_image, VK_IMAGE_LAYOUT_GENERAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(copies.size()), copies.data());
+		}
+
+		for (const auto& level : levels)
+		{
+			// Split in bands of whole block rows when the level is larger than half the ring
+			const uint32_t block_rows = (level.extent.height + level.block_height - 1) / level.block_height;
+			const uint32_t rows_per_copy = static_cast<uint32_t>(std::max<VkDeviceSize>(1, (ring_size_ / 2) / level.row_pitch));
+			const uint8_t* source = static_cast<const uint8_t*>(level.data);
+
+			for (uint32_t row = 0; row < block_rows; row += rows_per_copy)
+			{
+				const uint32_t row_count = std::min(rows_per_copy, block_rows - row);
+				const VkDeviceSize size = level.row_pitch * row_count;
+				const VkDeviceSize staging_offset = allocate_staging(size);
+
+				std::memcpy(static_cast<uint8_t*>(ring_allocation_.mapped) + staging_offset, source + level.row_pitch * row, static_cast<size_t>(size));
+
+				const uint32_t first_texel_row = row * level.block_height;
+				VkBufferImageCopy region{};
+				region.bufferOffset = staging_offset;
+				region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level.mip_level, 0, 1 };
+				region.imageOffset = { 0, static_cast<int32_t>(first_texel_row), 0 };
+				region.imageExtent = { level.extent.width, std::min(row_count * level.block_height, level.extent.height - first_texel_row), 1 };
+				vkCmdCopyBufferToImage(begin_batch(), ring_buffer_, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+			}
+		}
+
+		// The transition is the last command on the image, the graphics queue sees the layout once it waited on the batch
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = final_layout;
+		vkCmdPipelineBarrier(begin_batch(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		current_.wait_stage |= dst_stage;
+		current_.dst_access |= dst_access;
+	}
+
+	/**
+	 * Submit the copies recorded since the last flush to the transfer queue
+	 */
+	void flush()
+	{
+		if (!current_.recording)
+		{
+			return;
+		}
+
+		if (uses_ownership_transfer() && !current_.ownership_barriers.empty())
+		{
+			// Release half of the queue family ownership transfers, the graphics queue records the acquire half
+			for (auto& barrier : current_.ownership_barriers)
+			{
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+				barrier.srcQueueFamilyIndex = transfer_family_;
+				barrier.dstQueueFamilyIndex = graphics_family_;
+			}
+			vkCmdPipelineBarrier(current_.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, static_cast<uint32_t>(current_.ownership_barriers.size()), current_.ownership_barriers.data(), 0, nullptr);
+		}
+
+		if (vkEndCommandBuffer(current_.command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record upload command buffer!");
+		}
+
+		current_.timeline_value = timeline_.signal_next();
+		queue_submission submission;
+		submission.signal(timeline_.semaphore(), current_.timeline_value);
+
+		if (submission.submit(transfer_queue_, 1, &current_.command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit upload command buffer!");
+		}
+
+		current_.recording = false;
+		current_.ring_end = ring_head_;
+		in_flight_.push_back(current_);
+		current_ = upload_batch{};
+	}
+
+	/**
+	 * Called while recording a graphics command buffer outside of a render pass. Records the acquire half of the ownership transfers
+	 * of every batch submitted since the last call and returns the timeline value the graphics submit must wait on
+	 */
+	timeline_wait acquire_submitted_uploads(const VkCommandBuffer graphics_command_buffer, const uint64_t frame_number)
+	{
+		timeline_wait wait;
+
+		for (auto& batch : in_flight_)
+		{
+			if (batch.acquired)
+			{
+				continue;
+			}
+
+			if (uses_ownership_transfer() && !batch.ownership_barriers.empty())
+			{
+				for (auto& barrier : batch.ownership_barriers)
+				{
+					barrier.srcAccessMask = 0;
+					barrier.dstAccessMask = batch.dst_access;
+				}
+				vkCmdPipelineBarrier(graphics_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, batch.wait_stage, 0,
+					0, nullptr, static_cast<uint32_t>(batch.ownership_barriers.size()), batch.ownership_barriers.data(), 0, nullptr);
+			}
+
+			// Same family: the semaphore wait alone makes the copies visible to the wait stage. Batches are submitted in order, so
+			// waiting for the newest one covers them all
+			wait.semaphore = timeline_.semaphore();
+			wait.value = std::max(wait.value, batch.timeline_value);
+			wait.stages |= batch.wait_stage;
+			batch.acquired = true;
+			batch.acquire_frame = frame_number;
+		}
+
+		return wait;
+	}
+
+	/**
+	 * What another queue waits on before it reads the VK_SHARING_MODE_CONCURRENT buffers uploaded so far. Nothing to wait on once
+	 * every flushed batch is done
+	 */
+	timeline_wait flushed_uploads_wait(const VkPipelineStageFlags stages)
+	{
+		if (timeline_.is_complete(timeline_.submitted()))
+		{
+			return {};
+		}
+
+		return { timeline_.semaphore(), timeline_.submitted(), stages };
+	}
+
+	/**
+	 * Recycle the batches the GPU is done with. Every graphics frame numbered below completed_frames must have finished, a batch is only
+	 * reused once the frame that waited on it is done with it
+	 */
+	void release_completed(const uint64_t completed_frames)
+	{
+		while (!in_flight_.empty())
+		{
+			upload_batch& batch = in_flight_.front();
+			if (!batch.acquired || batch.acquire_frame >= completed_frames || !timeline_.is_complete(batch.timeline_value))
+			{
+				break;
+			}
+
+			release_staging(batch);
+			recycle(batch);
+			in_flight_.pop_front();
+		}
+
+		const bool staging_in_use = current_.recording ||
+			std::any_of(in_flight_.begin(), in_flight_.end(), [](const upload_batch& batch) { return !batch.staging_released; });
+		if (!staging_in_use)
+		{
+			ring_head_ = 0;
+			ring_tail_ = 0;
+		}
+	}
+
+private:
+	struct upload_batch
+	{
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		uint64_t timeline_value = 0; // Signaled on timeline_ once the copies are done
+		bool recording = false;
+		bool acquired = false; // A graphics command buffer recorded the acquire and waits on the timeline value
+		uint64_t acquire_frame = 0;
+		VkDeviceSize ring_end = 0; // Ring head once the batch was submitted, the ring tail moves there once the copies are done
+		bool staging_released = false;
+		VkPipelineStageFlags wait_stage = 0;
+		VkAccessFlags dst_access = 0;
+		std::vector<VkBufferMemoryBarrier> ownership_barriers;
+	};
+
+	gpu_memory_allocator* allocator_ = nullptr;
+	VkDevice device_ = VK_NULL_HANDLE;
+	uint32_t transfer_family_ = 0;
+	uint32_t graphics_family_ = 0;
+	VkQueue transfer_queue_ = VK_NULL_HANDLE;
+	VkCommandPool command_pool_ = VK_NULL_HANDLE;
+	gpu_timeline timeline_; // Of the transfer queue, one value per submitted batch
+
+	VkBuffer ring_buffer_ = VK_NULL_HANDLE;
+	gpu_allocation ring_allocation_;
+	VkDeviceSize ring_size_ = 0;
+	VkDeviceSize ring_head_ = 0; // Next free byte
+	VkDeviceSize ring_tail_ = 0; // First byte still read by an in flight batch, head == tail means the ring is empty
+
+	upload_batch current_;
+	std::deque<upload_batch> in_flight_; // Submission order, which is also the order their staging ranges were carved
+	std::vector<upload_batch> free_batches_;
+
+	VkCommandBuffer begin_batch()
+	{
+		if (current_.recording)
+		{
+			return current_.command_buffer;
+		}
+
+		if (current_.command_buffer == VK_NULL_HANDLE)
+		{
+			if (!free_batches_.empty())
+			{
+				current_ = free_batches_.back();
+				free_batches_.pop_back();
+			}
+			else
+			{
+				create_batch(current_);
+			}
+		}
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkResetCommandBuffer(current_.command_buffer, 0);
+		if (vkBeginCommandBuffer(current_.command_buffer, &begin_info) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to begin recording upload command buffer!");
+		}
+		current_.recording = true;
+
+		return current_.command_buffer;
+	}
+
+	void create_batch(upload_batch& batch)
+	{
+		VkCommandBufferAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = command_pool_;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device_, &alloc_info, &batch.command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create upload batch!");
+		}
+	}
+
+	void recycle(upload_batch& batch)
+	{
+		upload_batch recycled;
+		recycled.command_buffer = batch.command_buffer;
+		recycled.ownership_barriers = std::move(batch.ownership_barriers);
+		recycled.ownership_barriers.clear();
+		free_batches_.push_back(std::move(recycled));
+	}
+
+	void record_buffer_copy(const VkBuffer src_buffer, const VkBuffer dst_buffer, const VkBufferCopy& region, const VkPipelineStageFlags dst_stage,
+		const VkAccessFlags dst_access, const bool concurrent)
+	{
+		vkCmdCopyBuffer(begin_batch(), src_buffer, dst_buffer, 1, &region);
+
+		if (!concurrent)
+		{
+			VkBufferMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.buffer = dst_buffer;
+			barrier.offset = region.dstOffset;
+			barrier.size = region.size;
+			current_.ownership_barriers.push_back(barrier);
+		}
+		current_.wait_stage |= dst_stage;
+		current_.dst_access |= dst_access;
+	}
+
+	void release_staging(upload_batch& batch)
+	{
+		if (!batch.staging_released)
+		{
+			ring_tail_ = batch.ring_end;
+			batch.staging_released = true;
+		}
+	}
+
+	/**
+	 * Carve size bytes out of the ring, submitting the current batch and waiting for the oldest copies when the ring is full
+	 */
+	VkDeviceSize allocate_staging(const VkDeviceSize size)
+	{
+		for (;;)
+		{
+			const VkDeviceSize offset = (ring_head_ + STAGING_COPY_ALIGNMENT - 1) & ~(STAGING_COPY_ALIGNMENT - 1);
+
+			if (ring_head_ >= ring_tail_)
+			{
+				// Free space is [head, end) then [0, tail)
+				if (offset + size <= ring_size_)
+				{
+					ring_head_ = offset + size;
+					return offset;
+				}
+				// Stopping short of the tail keeps head == tail meaning empty
+				if (size < ring_tail_)
+				{
+					ring_head_ = size;
+					return 0;
+				}
+			}
+			else if (offset + size < ring_tail_)
+			{
+				ring_head_ = offset + size;
+				return offset;
+			}
+
+			wait_for_staging_space();
+		}
+	}
+
+	/**
+	 * Blocking slow path, only taken when more is uploaded at once than the ring holds. The staging range of a batch is free once its
+	 * copies are done, even if no graphics frame acquired the batch yet
+	 */
+	void wait_for_staging_space()
+	{
+		const auto oldest = std::find_if(in_flight_.begin(), in_flight_.end(), [](const upload_batch& batch) { return !batch.staging_released; });
+		if (oldest == in_flight_.end())
+		{
+			if (!current_.recording)
+			{
+				throw std::runtime_error("Upload does not fit in the staging ring!");
+			}
+			flush();
+			wait_for_staging_space();
+			return;
+		}
+
+		timeline_.wait(oldest->timeline_value);
+		release_staging(*oldest);
+	}
+};
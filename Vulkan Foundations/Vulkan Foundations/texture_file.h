@@ -0,0 +1,388 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+//	***********************************************
+//	******** TEXTURE FILE GLOBAL VARIABLES ********
+//	***********************************************
+
+const uint32_t MAX_TEXTURE_MIP_LEVELS = 16; // Up to 32k x 32k
+
+const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+const size_t KTX2_HEADER_SIZE = 80; // Identifier, header and index, the level index follows
+const size_t KTX2_LEVEL_INDEX_ENTRY_SIZE = 24;
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+const size_t DDS_HEADER_SIZE = 128; // Magic and DDS_HEADER
+const size_t DDS_DX10_HEADER_SIZE = 20;
+const uint32_t DDS_FLAG_MIPMAP_COUNT = 0x20000;
+const uint32_t DDS_PIXEL_FORMAT_FOURCC = 0x4;
+const uint32_t DDS_PIXEL_FORMAT_RGB = 0x40;
+const uint32_t DDS_CAPS2_CUBEMAP = 0x200;
+const uint32_t DDS_CAPS2_VOLUME = 0x200000;
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * Size of the blocks a format is stored in, 1x1 texels for the uncompressed formats. No bytes means a format the loader doesn't handle
+ */
+struct texture_block_info
+{
+	uint32_t width = 1;
+	uint32_t height = 1;
+	uint32_t bytes = 0;
+};
+
+/**
+ * Where a mip level is stored in its file
+ */
+struct texture_file_level
+{
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+/**
+ * Header of a 2D texture stored with its mip chain, already block compressed by the asset pipeline. Only the header is read,
+ * the levels are read from the file when they are streamed in
+ */
+struct texture_file
+{
+	std::string path;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	std::vector<texture_file_level> levels; // Level 0 is the full resolution
+};
+
+//	***************************
+//	******** FUNCTIONS ********
+//	***************************
+
+inline texture_block_info get_texture_block_info(const VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		return { 1, 1, 4 };
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+		return { 4, 4, 8 };
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+		return { 4, 4, 16 };
+	default:
+		break;
+	}
+
+	// Every ASTC block is 16 bytes, the UNORM and SRGB variant of each footprint follow each other from 4x4 to 12x12
+	if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+	{
+		static const uint32_t footprints[][2] = { { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 }, { 8, 8 },
+			{ 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 } };
+		const uint32_t* footprint = footprints[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+		return { footprint[0], footprint[1], 16 };
+	}
+
+	return { 1, 1, 0 };
+}
+
+/**
+ * Bytes of one tightly packed level, partial blocks at the right and bottom edges are stored whole
+ */
+inline uint64_t get_texture_level_size(const texture_block_info& block, const uint32_t width, const uint32_t height)
+{
+	const uint64_t blocks_wide = (width + block.width - 1) / block.width;
+	const uint64_t blocks_high = (height + block.height - 1) / block.height;
+
+	return blocks_wide * blocks_high * block.bytes;
+}
+
+/**
+ * KTX2 stores the Vulkan format and a level index with the offset and size of every level. Supercompressed files (Basis, zstd) would
+ * have to be transcoded first and are rejected, like arrays, cube maps and 3D textures
+ */
+inline texture_file read_ktx2_header(std::ifstream& file, const std::string& path)
+{
+	uint8_t header[KTX2_HEADER_SIZE];
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(header), sizeof(header)))
+	{
+		throw std::runtime_error("Failed to read KTX2 header of " + path + "!");
+	}
+
+	const auto read_u32 = [&](const size_t offset)
+	{
+		uint32_t value;
+		std::memcpy(&value, header + offset, sizeof(value));
+		return value;
+	};
+
+	const uint32_t vk_format = read_u32(12);
+	const uint32_t width = read_u32(20);
+	const uint32_t height = read_u32(24);
+	const uint32_t depth = read_u32(28);
+	const uint32_t layer_count = read_u32(32);
+	const uint32_t face_count = read_u32(36);
+	const uint32_t level_count = std::max(read_u32(40), 1u); // 0 asks the loader to generate the mips, there is only the base level
+	const uint32_t supercompression = read_u32(44);
+
+	if (depth > 1 || layer_count > 1 || face_count != 1 || supercompression != 0)
+	{
+		throw std::runtime_error("Failed to load " + path + ", only uncompressed 2D KTX2 textures are supported!");
+	}
+	if (width == 0 || height == 0 || level_count > MAX_TEXTURE_MIP_LEVELS)
+	{
+		throw std::runtime_error("Failed to load " + path + ", invalid texture size!");
+	}
+
+	std::vector<uint8_t> level_index(level_count * KTX2_LEVEL_INDEX_ENTRY_SIZE);
+	if (!file.read(reinterpret_cast<char*>(level_index.data()), static_cast<std::streamsize>(level_index.size())))
+	{
+		throw std::runtime_error("Failed to read KTX2 level index of " + path + "!");
+	}
+
+	texture_file texture;
+	texture.path = path;
+	texture.format = static_cast<VkFormat>(vk_format);
+	for (uint32_t level = 0; level < level_count; level++)
+	{
+		texture_file_level file_level;
+		std::memcpy(&file_level.offset, level_index.data() + level * KTX2_LEVEL_INDEX_ENTRY_SIZE, sizeof(uint64_t));
+		std::memcpy(&file_level.size, level_index.data() + level * KTX2_LEVEL_INDEX_ENTRY_SIZE + 8, sizeof(uint64_t));
+		file_level.width = std::max(width >> level, 1u);
+		file_level.height = std::max(height >> level, 1u);
+		texture.levels.push_back(file_level);
+	}
+
+	return texture;
+}
+
+/**
+ * DXGI formats of the DX10 extension header the loader handles
+ */
+inline VkFormat get_dxgi_format(const uint32_t dxgi_format)
+{
+	switch (dxgi_format)
+	{
+	case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+	case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+	case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+	case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+	case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+	case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+	case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+	case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+	case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+	case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+	case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+	case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+	case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+	case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+	case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+	default: return VK_FORMAT_UNDEFINED;
+	}
+}
+
+/**
+ * DDS stores the levels tightly packed after the header, the format is a FourCC code, a DX10 header with a DXGI format, or RGBA8
+ * described by its channel masks
+ */
+inline texture_file read_dds_header(std::ifstream& file, const std::string& path)
+{
+	uint8_t header[DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE] = {};
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(header), DDS_HEADER_SIZE))
+	{
+		throw std::runtime_error("Failed to read DDS header of " + path + "!");
+	}
+
+	const auto read_u32 = [&](const size_t offset)
+	{
+		uint32_t value;
+		std::memcpy(&value, header + offset, sizeof(value));
+		return value;
+	};
+
+	const uint32_t flags = read_u32(8);
+	const uint32_t height = read_u32(12);
+	const uint32_t width = read_u32(16);
+	const uint32_t level_count = (flags & DDS_FLAG_MIPMAP_COUNT) ? std::max(read_u32(28), 1u) : 1;
+	const uint32_t pixel_format_flags = read_u32(80);
+	const uint32_t four_cc = read_u32(84);
+	const uint32_t caps2 = read_u32(112);
+
+	if (caps2 & (DDS_CAPS2_CUBEMAP | DDS_CAPS2_VOLUME))
+	{
+		throw std::runtime_error("Failed to load " + path + ", only 2D DDS textures are supported!");
+	}
+	if (width == 0 || height == 0 || level_count > MAX_TEXTURE_MIP_LEVELS)
+	{
+		throw std::runtime_error("Failed to load " + path + ", invalid texture size!");
+	}
+
+	texture_file texture;
+	texture.path = path;
+	uint64_t offset = DDS_HEADER_SIZE;
+
+	const auto make_four_cc = [](const char* code)
+	{
+		return uint32_t(uint8_t(code[0])) | uint32_t(uint8_t(code[1])) << 8 | uint32_t(uint8_t(code[2])) << 16 | uint32_t(uint8_t(code[3])) << 24;
+	};
+
+	if ((pixel_format_flags & DDS_PIXEL_FORMAT_FOURCC) && four_cc == make_four_cc("DX10"))
+	{
+		if (!file.read(reinterpret_cast<char*>(header + DDS_HEADER_SIZE), DDS_DX10_HEADER_SIZE))
+		{
+			throw std::runtime_error("Failed to read DDS DX10 header of " + path + "!");
+		}
+		if (read_u32(DDS_HEADER_SIZE + 12) > 1)
+		{
+			throw std::runtime_error("Failed to load " + path + ", texture arrays are not supported!");
+		}
+		texture.format = get_dxgi_format(read_u32(DDS_HEADER_SIZE));
+		offset += DDS_DX10_HEADER_SIZE;
+	}
+	else if (pixel_format_flags & DDS_PIXEL_FORMAT_FOURCC)
+	{
+		texture.format = four_cc == make_four_cc("DXT1") ? VK_FORMAT_BC1_RGBA_UNORM_BLOCK :
+			four_cc == make_four_cc("DXT3") ? VK_FORMAT_BC2_UNORM_BLOCK :
+			four_cc == make_four_cc("DXT5") ? VK_FORMAT_BC3_UNORM_BLOCK :
+			four_cc == make_four_cc("ATI1") || four_cc == make_four_cc("BC4U") ? VK_FORMAT_BC4_UNORM_BLOCK :
+			four_cc == make_four_cc("ATI2") || four_cc == make_four_cc("BC5U") ? VK_FORMAT_BC5_UNORM_BLOCK : VK_FORMAT_UNDEFINED;
+	}
+	else if ((pixel_format_flags & DDS_PIXEL_FORMAT_RGB) && read_u32(88) == 32 && read_u32(92) == 0x000000ff && read_u32(96) == 0x0000ff00 &&
+		read_u32(100) == 0x00ff0000)
+	{
+		texture.format = VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	const texture_block_info block = get_texture_block_info(texture.format);
+	if (block.bytes == 0)
+	{
+		throw std::runtime_error("Failed to load " + path + ", unsupported DDS format!");
+	}
+
+	for (uint32_t level = 0; level < level_count; level++)
+	{
+		texture_file_level file_level;
+		file_level.width = std::max(width >> level, 1u);
+		file_level.height = std::max(height >> level, 1u);
+		file_level.offset = offset;
+		file_level.size = get_texture_level_size(block, file_level.width, file_level.height);
+		texture.levels.push_back(file_level);
+		offset += file_level.size;
+	}
+
+	return texture;
+}
+
+/**
+ * Read the header of a KTX2 or DDS file, told apart by their magic rather than their extension. Every level must be stored
+ * tightly packed in the format of the file
+ */
+inline texture_file read_texture_file(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open texture " + path + "!");
+	}
+
+	uint8_t magic[sizeof(KTX2_IDENTIFIER)] = {};
+	file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+	file.clear();
+
+	uint32_t dds_magic;
+	std::memcpy(&dds_magic, magic, sizeof(dds_magic));
+
+	texture_file texture;
+	if (std::memcmp(magic, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0)
+	{
+		texture = read_ktx2_header(file, path);
+	}
+	else if (dds_magic == DDS_MAGIC)
+	{
+		texture = read_dds_header(file, path);
+	}
+	else
+	{
+		throw std::runtime_error("Failed to load " + path + ", not a KTX2 or DDS file!");
+	}
+
+	const texture_block_info block = get_texture_block_info(texture.format);
+	file.seekg(0, std::ios::end);
+	const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+	for (const auto& level : texture.levels)
+	{
+		if (block.bytes == 0 || level.size != get_texture_level_size(block, level.width, level.height) || level.offset + level.size > file_size)
+		{
+			throw std::runtime_error("Failed to load " + path + ", invalid mip level layout!");
+		}
+	}
+
+	return texture;
+}
+
+/**
+ * Read the levels [first_level, last_level] of a texture, each in its own vector
+ */
+inline std::vector<std::vector<uint8_t>> read_texture_levels(const texture_file& texture, const uint32_t first_level, const uint32_t last_level)
+{
+	std::ifstream file(texture.path, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open texture " + texture.path + "!");
+	}
+
+	std::vector<std::vector<uint8_t>> levels;
+	for (uint32_t level = first_level; level <= last_level; level++)
+	{
+		const texture_file_level& file_level = texture.levels[level];
+		std::vector<uint8_t> data(static_cast<size_t>(file_level.size));
+
+		file.seekg(static_cast<std::streamoff>(file_level.offset));
+		if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size())))
+		{
+			throw std::runtime_error("Failed to read mip level " + std::to_string(level) + " of " + texture.path + "!");
+		}
+		levels.push_back(std::move(data));
+	}
+
+	return levels;
+}
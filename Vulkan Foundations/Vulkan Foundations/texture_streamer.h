@@ -0,0 +1,660 @@
+#pragma once
+
+#include "bindless_descriptors.h"
+#include "deletion_queue.h"
+#include "gpu_memory_allocator.h"
+#include "job_system.h"
+#include "staging_uploader.h"
+#include "texture_file.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//	****************************************************
+//	******** TEXTURE STREAMING GLOBAL VARIABLES ********
+//	****************************************************
+
+using texture_handle = uint32_t;
+const texture_handle NO_TEXTURE = UINT32_MAX; // Material without a texture, also tested by shader.frag
+
+const VkDeviceSize DEFAULT_TEXTURE_BUDGET = VkDeviceSize(256) << 20; // 256 mb of resident mip levels
+const VkDeviceSize MAX_TEXTURE_UPLOAD_PER_FRAME = VkDeviceSize(4) << 20; // The frame waits on the copies, this keeps the wait short
+const VkDeviceSize MAX_TEXTURE_READ_PER_FRAME = MAX_TEXTURE_UPLOAD_PER_FRAME; // Reads started per frame, no faster than the uploads drain them
+const uint32_t MAX_STREAMED_TEXTURES = 1024; // Entries of the slot table
+const uint32_t MIN_RESIDENT_TEXTURE_SIZE = 64; // Levels this size and below stay resident, so a texture always has something to sample
+const uint64_t TEXTURE_DEMAND_TIMEOUT_FRAMES = 120; // A texture nothing requested for this long drops back to its resident tail
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Block compressed textures whose mip levels are streamed in and out of a fixed memory budget. Every texture keeps the tail of its
+ * chain resident, the levels at or below MIN_RESIDENT_TEXTURE_SIZE, and gets finer levels when request() reports it covers more
+ * pixels on screen. A change of residency creates a new image in a new bindless slot: the transfer queue copies the levels it keeps
+ * from the old image and uploads the one new level, the only one read from disk. The images stay in VK_IMAGE_LAYOUT_GENERAL, so the
+ * copies read the old image while frames in flight keep sampling it, until the deletion queue frees it with its slot. Block
+ * compressed images have no framebuffer compression for the general layout to turn off.
+ * The new level is read from disk by a background job of the job system, the change waits for a later frame once the read is done.
+ * Shaders reach a texture through the slot table of their frame: texture handle in, bindless texture slot out.
+ * Not thread safe, only the level reads run off the render thread
+ */
+class texture_streamer
+{
+public:
+	/**
+	 * Turn on every block compression family the device supports, load() only picks formats of the enabled ones
+	 */
+	static void enable_features(const VkPhysicalDevice physical_device, VkPhysicalDeviceFeatures& device_features)
+	{
+		VkPhysicalDeviceFeatures supported_features;
+		vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+
+		device_features.textureCompressionBC = supported_features.textureCompressionBC;
+		device_features.textureCompressionASTC_LDR = supported_features.textureCompressionASTC_LDR;
+		device_features.textureCompressionETC2 = supported_features.textureCompressionETC2;
+	}
+
+	/**
+	 * With two or more sharing_families the images are VK_SHARING_MODE_CONCURRENT, the transfer queue writes them for the graphics queue
+	 */
+	void init(const VkPhysicalDevice physical_device, gpu_memory_allocator& allocator, staging_uploader& uploader, bindless_descriptors& bindless,
+		job_system& jobs, const uint32_t frame_count, const std::vector<uint32_t>& sharing_families, const VkDeviceSize budget = DEFAULT_TEXTURE_BUDGET)
+	{
+		physical_device_ = physical_device;
+		allocator_ = &allocator;
+		uploader_ = &uploader;
+		bindless_ = &bindless;
+		jobs_ = &jobs;
+		sharing_families_ = sharing_families;
+		budget_ = budget;
+		textures_.reserve(MAX_STREAMED_TEXTURES); // Never moves, the reads keep pointers to the files
+		targets_.reserve(MAX_STREAMED_TEXTURES);
+		changes_.reserve(MAX_STREAMED_TEXTURES);
+
+		vkGetPhysicalDeviceFeatures(physical_device_, &features_);
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
+		max_image_dimension_ = device_properties.limits.maxImageDimension2D;
+
+		create_sampler();
+		create_slot_tables(frame_count, device_properties.limits.minStorageBufferOffsetAlignment);
+	}
+
+	/**
+	 * The device must be idle and the deletion queue flushed. Waits for the reads still running
+	 */
+	void destroy()
+	{
+		for (auto& texture : textures_)
+		{
+			if (texture.read)
+			{
+				try
+				{
+					jobs_->wait(texture.read->done);
+				}
+				catch (const std::exception&)
+				{
+					// The texture goes away, a failed read of it no longer matters
+				}
+			}
+			destroy_image(texture.image);
+		}
+		textures_.clear();
+
+		for (const uint32_t slot : table_slots_)
+		{
+			bindless_->release_storage_buffer(slot);
+		}
+		table_slots_.clear();
+		vkDestroyBuffer(allocator_->device(), table_buffer_, nullptr);
+		allocator_->free(table_allocation_);
+		vkDestroySampler(allocator_->device(), sampler_, nullptr);
+	}
+
+	/**
+	 * Load the texture from the candidate file whose format suits the device best, e.g. the BC7, ASTC and ETC2 encodings of the
+	 * same image. Only the resident tail is uploaded, the finer levels stream in once the texture is requested
+	 */
+	texture_handle load(const std::vector<std::string>& candidate_paths)
+	{
+		if (textures_.size() == MAX_STREAMED_TEXTURES)
+		{
+			throw std::runtime_error("Too many streamed textures!");
+		}
+
+		streamed_texture texture;
+		int best_rank = 0;
+		for (const auto& path : candidate_paths)
+		{
+			texture_file file = read_texture_file(path);
+			const int rank = get_format_rank(file.format);
+			const bool smaller = rank == best_rank && rank > 0 && get_bits_per_texel(file.format) < get_bits_per_texel(texture.file.format);
+			if (rank > best_rank || smaller)
+			{
+				best_rank = rank;
+				texture.file = std::move(file);
+			}
+		}
+
+		if (best_rank == 0)
+		{
+			throw std::runtime_error("Failed to load texture " + (candidate_paths.empty() ? std::string() : candidate_paths.front()) +
+				", no candidate has a format the device can sample!");
+		}
+		if (std::max(texture.file.levels[0].width, texture.file.levels[0].height) > max_image_dimension_)
+		{
+			throw std::runtime_error("Failed to load texture " + texture.file.path + ", larger than the device supports!");
+		}
+
+		const auto tail = std::find_if(texture.file.levels.begin(), texture.file.levels.end(), [](const texture_file_level& level)
+			{
+				return std::max(level.width, level.height) <= MIN_RESIDENT_TEXTURE_SIZE;
+			});
+		texture.tail_level = tail == texture.file.levels.end() ? static_cast<uint32_t>(texture.file.levels.size() - 1) :
+			static_cast<uint32_t>(tail - texture.file.levels.begin());
+		for (uint32_t level = 0; level <= texture.tail_level; level++)
+		{
+			texture.image_sizes.push_back(get_image_size(texture.file, level));
+		}
+
+		texture.image = create_image(texture.file, texture.tail_level,
+			read_texture_levels(texture.file, texture.tail_level, static_cast<uint32_t>(texture.file.levels.size() - 1)));
+		texture.resident_level = texture.tail_level;
+		textures_.push_back(std::move(texture));
+
+		return static_cast<texture_handle>(textures_.size() - 1);
+	}
+
+	/**
+	 * Report that texture covers screen_size pixels along its longest side in the frame being recorded. Several requests keep the largest
+	 */
+	void request(const texture_handle texture, const float screen_size, const uint64_t frame_number)
+	{
+		streamed_texture& streamed = textures_[texture];
+		if (streamed.demand_frame != frame_number)
+		{
+			streamed.demand = 0.0f;
+			streamed.demand_frame = frame_number;
+		}
+		streamed.demand = std::max(streamed.demand, screen_size);
+	}
+
+	/**
+	 * Once per frame, after the requests and before the uploads are flushed: fit the requested levels in the budget, start the reads
+	 * of the levels to refine, queue the copies and uploads of the textures whose residency changes and write the slot table of the
+	 * frame. frame_number counts the frames submitted so far, replaced images go to retired at frame_number + 1. Rethrows the
+	 * exception of a failed read
+	 */
+	void update(deletion_queue& retired, const uint64_t frame_number, const uint32_t frame_index)
+	{
+		targets_.resize(textures_.size());
+		VkDeviceSize total = 0;
+		for (size_t i = 0; i < textures_.size(); i++)
+		{
+			targets_[i] = get_requested_level(textures_[i], frame_number);
+			total += textures_[i].image_sizes[targets_[i]];
+		}
+
+		// Over budget: drop the largest finest level until the rest fits, which evens the quality out instead of starving one texture
+		while (total > budget_)
+		{
+			size_t coarsened = textures_.size();
+			for (size_t i = 0; i < textures_.size(); i++)
+			{
+				if (targets_[i] < textures_[i].tail_level && (coarsened == textures_.size() ||
+					get_level_memory(textures_[i], targets_[i]) > get_level_memory(textures_[coarsened], targets_[coarsened])))
+				{
+					coarsened = i;
+				}
+			}
+			if (coarsened == textures_.size())
+			{
+				break;
+			}
+			total -= get_level_memory(textures_[coarsened], targets_[coarsened]);
+			targets_[coarsened]++;
+		}
+
+		// Evictions first, they free the memory the refinements use. Refinements go one level at a time, largest gap first.
+		// A texture with a read also comes along, its read is finished or dropped
+		changes_.clear();
+		for (size_t i = 0; i < textures_.size(); i++)
+		{
+			if (targets_[i] != textures_[i].resident_level || textures_[i].read)
+			{
+				changes_.push_back(i);
+			}
+		}
+		// std::sort with the index as the last key, std::stable_sort would allocate its buffer every frame
+		std::sort(changes_.begin(), changes_.end(), [&](const size_t a, const size_t b)
+			{
+				const int gap_a = static_cast<int>(targets_[a]) - static_cast<int>(textures_[a].resident_level);
+				const int gap_b = static_cast<int>(targets_[b]) - static_cast<int>(textures_[b].resident_level);
+				if ((gap_a > 0) != (gap_b > 0))
+				{
+					return gap_a > 0;
+				}
+				if (std::abs(gap_a) != std::abs(gap_b))
+				{
+					return std::abs(gap_a) > std::abs(gap_b);
+				}
+				return a < b;
+			});
+
+		VkDeviceSize read_bytes = 0;
+		VkDeviceSize uploaded = 0;
+		for (const size_t i : changes_)
+		{
+			streamed_texture& texture = textures_[i];
+			const bool refines = targets_[i] < texture.resident_level;
+			const uint32_t level = refines ? texture.resident_level - 1 : targets_[i];
+			const VkDeviceSize level_size = texture.file.levels[level].size;
+
+			// The budget check is repeated once the level is read, the frames between can change resident_bytes_
+			if (refines && !texture.read && (read_bytes == 0 || read_bytes + level_size <= MAX_TEXTURE_READ_PER_FRAME) &&
+				resident_bytes_ + texture.image_sizes[level] <= budget_)
+			{
+				start_read(texture, level);
+				read_bytes += level_size;
+			}
+			if (texture.read && texture.read->done.is_done())
+			{
+				jobs_->wait(texture.read->done);
+				if (!refines || texture.read->level != level)
+				{
+					texture.read.reset(); // No longer requested, or evicted since the read started
+				}
+			}
+
+			// An eviction only copies on the GPU, a refinement uploads the level it read
+			if (!refines)
+			{
+				if (level != texture.resident_level)
+				{
+					replace_image(texture, level, {}, retired, frame_number);
+				}
+				continue;
+			}
+			if (!texture.read || !texture.read->done.is_done())
+			{
+				continue;
+			}
+			if (uploaded > 0 && uploaded + level_size > MAX_TEXTURE_UPLOAD_PER_FRAME)
+			{
+				continue;
+			}
+			// The replaced image stays in resident_bytes_ until the deletion queue frees it, both live at once until then
+			if (resident_bytes_ + texture.image_sizes[level] > budget_)
+			{
+				continue;
+			}
+
+			replace_image(texture, level, texture.read->data, retired, frame_number);
+			texture.read.reset();
+			uploaded += level_size;
+		}
+
+		write_slot_table(frame_index);
+	}
+
+	/**
+	 * Bindless storage buffer slot of the slot table of a frame slot, pushed to the shaders that sample streamed textures
+	 */
+	uint32_t slot_table(const uint32_t frame_index) const
+	{
+		return table_slots_[frame_index];
+	}
+
+	size_t texture_count() const
+	{
+		return textures_.size();
+	}
+
+	/**
+	 * Memory of the resident levels, including the replaced images frames in flight still sample
+	 */
+	VkDeviceSize resident_bytes() const
+	{
+		return resident_bytes_;
+	}
+
+	VkDeviceSize budget() const
+	{
+		return budget_;
+	}
+
+private:
+	struct resident_image
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		gpu_allocation allocation;
+		uint32_t slot = 0; // Bindless texture slot
+	};
+
+	/**
+	 * Level read from the file by a background job, data is only touched once done is
+	 */
+	struct level_read
+	{
+		uint32_t level = 0;
+		std::vector<std::vector<uint8_t>> data;
+		job_counter done;
+	};
+
+	struct streamed_texture
+	{
+		texture_file file;
+		uint32_t tail_level = 0; // First level of the tail that never leaves memory
+		uint32_t resident_level = 0; // Finest level in memory, the image holds this level down to the last one
+		float demand = 0.0f; // Largest screen size requested for demand_frame
+		uint64_t demand_frame = 0;
+		resident_image image;
+		std::vector<VkDeviceSize> image_sizes; // Allocation size of the image starting at each level, up to tail_level
+		std::unique_ptr<level_read> read; // The next finer level while it is read, at most one per texture
+	};
+
+	VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
+	gpu_memory_allocator* allocator_ = nullptr;
+	staging_uploader* uploader_ = nullptr;
+	bindless_descriptors* bindless_ = nullptr;
+	job_system* jobs_ = nullptr;
+	std::vector<uint32_t> sharing_families_;
+	VkPhysicalDeviceFeatures features_{};
+	uint32_t max_image_dimension_ = 0;
+
+	VkDeviceSize budget_ = 0;
+	VkDeviceSize resident_bytes_ = 0;
+	std::vector<streamed_texture> textures_; // Indexed by texture_handle
+	std::vector<uint32_t> targets_; // Scratch of update(), reserved for every texture so a frame never allocates
+	std::vector<size_t> changes_;
+	VkSampler sampler_ = VK_NULL_HANDLE;
+
+	VkBuffer table_buffer_ = VK_NULL_HANDLE; // One slot table per frame in flight, each holding MAX_STREAMED_TEXTURES slots
+	gpu_allocation table_allocation_;
+	VkDeviceSize table_stride_ = 0;
+	std::vector<uint32_t> table_slots_; // Bindless storage buffer slot of every table
+
+	/**
+	 * 0 for a format the device can't sample. Otherwise the best quality per bit first: BC7, BC6H and ASTC 4x4, then the other block
+	 * formats, then uncompressed RGBA8 as the last resort, four to eight times the memory and bandwidth
+	 */
+	int get_format_rank(const VkFormat format) const
+	{
+		const texture_block_info block = get_texture_block_info(format);
+		if (block.bytes == 0)
+		{
+			return 0;
+		}
+
+		const bool bc = format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+		const bool etc2 = format >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK && format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK;
+		const bool astc = format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+		if ((bc && !features_.textureCompressionBC) || (etc2 && !features_.textureCompressionETC2) || (astc && !features_.textureCompressionASTC_LDR))
+		{
+			return 0;
+		}
+
+		VkFormatProperties format_properties;
+		vkGetPhysicalDeviceFormatProperties(physical_device_, format, &format_properties);
+		const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT |
+			VK_FORMAT_FEATURE_TRANSFER_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+		if ((format_properties.optimalTilingFeatures & required) != required)
+		{
+			return 0;
+		}
+
+		if (format == VK_FORMAT_BC7_UNORM_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK || format == VK_FORMAT_BC6H_UFLOAT_BLOCK ||
+			format == VK_FORMAT_BC6H_SFLOAT_BLOCK || format == VK_FORMAT_ASTC_4x4_UNORM_BLOCK || format == VK_FORMAT_ASTC_4x4_SRGB_BLOCK)
+		{
+			return 3;
+		}
+
+		return bc || etc2 || astc ? 2 : 1;
+	}
+
+	static uint32_t get_bits_per_texel(const VkFormat format)
+	{
+		const texture_block_info block = get_texture_block_info(format);
+		return block.bytes * 8 / (block.width * block.height);
+	}
+
+	/**
+	 * Finest level the texture needs, one texel per pixel of the screen size it was last requested with
+	 */
+	static uint32_t get_requested_level(const streamed_texture& texture, const uint64_t frame_number)
+	{
+		if (texture.demand <= 0.0f || texture.demand_frame + TEXTURE_DEMAND_TIMEOUT_FRAMES < frame_number)
+		{
+			return texture.tail_level;
+		}
+
+		const float full_size = static_cast<float>(std::max(texture.file.levels[0].width, texture.file.levels[0].height));
+		const float level = std::floor(std::log2(std::max(full_size / texture.demand, 1.0f)));
+
+		return std::min(static_cast<uint32_t>(level), texture.tail_level);
+	}
+
+	/**
+	 * Memory the finest level adds to the image of the coarser ones, level being finer than the tail
+	 */
+	static VkDeviceSize get_level_memory(const streamed_texture& texture, const uint32_t level)
+	{
+		return texture.image_sizes[level] - texture.image_sizes[level + 1];
+	}
+
+	/**
+	 * Info of the image with the levels from first_level to the end of the chain
+	 */
+	VkImageCreateInfo get_image_info(const texture_file& file, const uint32_t first_level) const
+	{
+		VkImageCreateInfo image_info{};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = file.format;
+		image_info.extent = { file.levels[first_level].width, file.levels[first_level].height, 1 };
+		image_info.mipLevels = static_cast<uint32_t>(file.levels.size()) - first_level;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		image_info.sharingMode = sharing_families_.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		image_info.queueFamilyIndexCount = sharing_families_.size() > 1 ? static_cast<uint32_t>(sharing_families_.size()) : 0;
+		image_info.pQueueFamilyIndices = sharing_families_.data();
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		return image_info;
+	}
+
+	/**
+	 * Size of the allocation of the image starting at first_level, what it adds to resident_bytes_: the memory requirements, asked
+	 * from an image created and destroyed for it, rounded like the allocator rounds them. The file sizes leave out the alignment and
+	 * padding of the device and the power of two nodes of the allocator
+	 */
+	VkDeviceSize get_image_size(const texture_file& file, const uint32_t first_level) const
+	{
+		const VkImageCreateInfo image_info = get_image_info(file, first_level);
+		VkImage image;
+		if (vkCreateImage(allocator_->device(), &image_info, nullptr, &image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture image!");
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(allocator_->device(), image, &requirements);
+		vkDestroyImage(allocator_->device(), image, nullptr);
+
+		return allocator_->get_allocation_size(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	/**
+	 * Image with the levels from first_level to the end of the chain, its upload queued and a bindless slot written for it. data
+	 * holds the finest levels as read from the file, the levels after them are copied from source, whose finest level is source_level
+	 */
+	resident_image create_image(const texture_file& file, const uint32_t first_level, const std::vector<std::vector<uint8_t>>& data,
+		const resident_image* source = nullptr, const uint32_t source_level = 0)
+	{
+		const VkImageCreateInfo image_info = get_image_info(file, first_level);
+		const uint32_t mip_levels = image_info.mipLevels;
+
+		resident_image resident;
+		if (vkCreateImage(allocator_->device(), &image_info, nullptr, &resident.image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture image!");
+		}
+		resident.allocation = allocator_->allocate_for_image(resident.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		resident_bytes_ += resident.allocation.size;
+
+		VkImageViewCreateInfo view_info{};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = resident.image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = file.format;
+		view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mip_levels, 0, 1 };
+
+		if (vkCreateImageView(allocator_->device(), &view_info, nullptr, &resident.view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture image view!");
+		}
+
+		const texture_block_info block = get_texture_block_info(file.format);
+		std::vector<image_upload_level> levels;
+		for (uint32_t level = 0; level < static_cast<uint32_t>(data.size()); level++)
+		{
+			const texture_file_level& file_level = file.levels[first_level + level];
+
+			image_upload_level upload;
+			upload.mip_level = level;
+			upload.extent = { file_level.width, file_level.height };
+			upload.data = data[level].data();
+			upload.row_pitch = VkDeviceSize((file_level.width + block.width - 1) / block.width) * block.bytes;
+			upload.block_height = block.height;
+			levels.push_back(upload);
+		}
+
+		std::vector<VkImageCopy> copies;
+		for (uint32_t level = static_cast<uint32_t>(data.size()); level < mip_levels; level++)
+		{
+			const texture_file_level& file_level = file.levels[first_level + level];
+
+			VkImageCopy copy{};
+			copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, first_level + level - source_level, 0, 1 };
+			copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			copy.extent = { file_level.width, file_level.height, 1 };
+			copies.push_back(copy);
+		}
+		uploader_->upload_image(resident.image, mip_levels, levels, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, source != nullptr ? source->image : VK_NULL_HANDLE, copies);
+
+		// The frame that first reads the new slot waits on the upload batch like on any other upload
+		resident.slot = bindless_->register_texture(resident.view, sampler_, VK_IMAGE_LAYOUT_GENERAL);
+
+		return resident;
+	}
+
+	/**
+	 * Move texture to the image starting at level, data being the new finest levels. The replaced image goes to retired
+	 */
+	void replace_image(streamed_texture& texture, const uint32_t level, const std::vector<std::vector<uint8_t>>& data, deletion_queue& retired,
+		const uint64_t frame_number)
+	{
+		const resident_image replaced = texture.image;
+		texture.image = create_image(texture.file, level, data, &replaced, texture.resident_level);
+		texture.resident_level = level;
+
+		// The copies read the replaced image in the upload batch of the frame being recorded, frame_number + 1, not the last one submitted
+		retired.push(frame_number + 1, [this, replaced] { destroy_image(replaced); });
+	}
+
+	void start_read(streamed_texture& texture, const uint32_t level)
+	{
+		texture.read = std::make_unique<level_read>();
+		texture.read->level = level;
+
+		level_read* read = texture.read.get();
+		const texture_file* file = &texture.file;
+		jobs_->submit([read, file] { read->data = read_texture_levels(*file, read->level, read->level); }, &read->done, job_priority::background);
+	}
+
+	void destroy_image(resident_image image)
+	{
+		bindless_->release_texture(image.slot);
+		vkDestroyImageView(allocator_->device(), image.view, nullptr);
+		vkDestroyImage(allocator_->device(), image.image, nullptr);
+		resident_bytes_ -= image.allocation.size;
+		allocator_->free(image.allocation);
+	}
+
+	void create_sampler()
+	{
+		VkSamplerCreateInfo sampler_info{};
+		sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler_info.magFilter = VK_FILTER_LINEAR;
+		sampler_info.minFilter = VK_FILTER_LINEAR;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler_info.minLod = 0.0f;
+		sampler_info.maxLod = VK_LOD_CLAMP_NONE; // The views only hold the resident levels, the sampler never clamps them further
+
+		if (vkCreateSampler(allocator_->device(), &sampler_info, nullptr, &sampler_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture sampler!");
+		}
+	}
+
+	void create_slot_tables(const uint32_t frame_count, const VkDeviceSize min_offset_alignment)
+	{
+		const VkDeviceSize alignment = std::max<VkDeviceSize>(min_offset_alignment, 1);
+		const VkDeviceSize table_size = sizeof(uint32_t) * MAX_STREAMED_TEXTURES;
+		table_stride_ = (table_size + alignment - 1) / alignment * alignment;
+
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = table_stride_ * frame_count;
+		buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(allocator_->device(), &buffer_info, nullptr, &table_buffer_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture slot table!");
+		}
+		// Rewritten by the CPU every frame, like the uniform ring
+		table_allocation_ = allocator_->allocate_for_buffer(table_buffer_, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		for (uint32_t frame = 0; frame < frame_count; frame++)
+		{
+			table_slots_.push_back(bindless_->register_storage_buffer({ table_buffer_, table_stride_ * frame, table_size }));
+		}
+	}
+
+	/**
+	 * The previous frame of the slot must be done on the GPU, which the frame slot wait of the caller guarantees
+	 */
+	void write_slot_table(const uint32_t frame_index)
+	{
+		uint32_t* table = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(table_allocation_.mapped) + table_stride_ * frame_index);
+		for (size_t i = 0; i < textures_.size(); i++)
+		{
+			table[i] = textures_[i].image.slot;
+		}
+
+		if (!textures_.empty())
+		{
+			allocator_->flush(table_allocation_, table_stride_ * frame_index, sizeof(uint32_t) * textures_.size());
+		}
+	}
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+//	*****************************************************
+//	******** TIMELINE SEMAPHORE GLOBAL VARIABLES ********
+//	*****************************************************
+
+// Waits, and signals, a single queue_submission holds. The busiest submit is the frame: acquire, uploads and async compute
+const uint32_t MAX_QUEUE_SUBMISSION_SEMAPHORES = 8;
+
+//	*************************
+//	******** STRUCTS ********
+//	*************************
+
+/**
+ * Timeline value a submit has to wait on, at the stages it first needs the work behind it. No semaphore means nothing to wait on
+ */
+struct timeline_wait
+{
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t value = 0;
+	VkPipelineStageFlags stages = 0;
+};
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Timeline semaphore of one queue, every submit to the queue signals the next value. The counter replaces both the fences and the
+ * binary semaphores between queues: the CPU waits for a value, another queue waits for a value, and whatever a submit used can be
+ * reused once completed() reached the value of that submit. Not thread safe, submits and waits happen on the render thread
+ */
+class gpu_timeline
+{
+public:
+	/**
+	 * Timeline semaphores are core in Vulkan 1.2, the feature still has to be there and turned on
+	 */
+	static bool is_supported(const VkPhysicalDevice physical_device)
+	{
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+		if (device_properties.apiVersion < VK_API_VERSION_1_2)
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features{};
+		timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &timeline_features;
+		vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+		return timeline_features.timelineSemaphore == VK_TRUE;
+	}
+
+	/**
+	 * Turn on the feature checked by is_supported(), timeline_features goes in the pNext chain of VkDeviceCreateInfo
+	 */
+	static void enable_features(VkPhysicalDeviceTimelineSemaphoreFeatures& timeline_features)
+	{
+		timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		timeline_features.timelineSemaphore = VK_TRUE;
+	}
+
+	void init(const VkDevice device)
+	{
+		device_ = device;
+
+		VkSemaphoreTypeCreateInfo type_info{};
+		type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		type_info.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphore_info{};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphore_info.pNext = &type_info;
+
+		if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &semaphore_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create timeline semaphore!");
+		}
+	}
+
+	void destroy()
+	{
+		vkDestroySemaphore(device_, semaphore_, nullptr);
+		semaphore_ = VK_NULL_HANDLE;
+	}
+
+	VkSemaphore semaphore() const
+	{
+		return semaphore_;
+	}
+
+	/**
+	 * Value for the next submit to signal, the submit has to be made before the next call
+	 */
+	uint64_t signal_next()
+	{
+		return ++submitted_;
+	}
+
+	/**
+	 * Value signaled by the last submit
+	 */
+	uint64_t submitted() const
+	{
+		return submitted_;
+	}
+
+	/**
+	 * Highest value the GPU signaled so far, without blocking
+	 */
+	uint64_t completed()
+	{
+		uint64_t value = 0;
+		if (vkGetSemaphoreCounterValue(device_, semaphore_, &value) == VK_SUCCESS)
+		{
+			completed_ = std::max(completed_, value);
+		}
+
+		return completed_;
+	}
+
+	bool is_complete(const uint64_t value)
+	{
+		return value <= completed_ || value <= completed();
+	}
+
+	/**
+	 * Block until the GPU signaled value, 0 returns at once
+	 */
+	void wait(const uint64_t value)
+	{
+		if (value <= completed_)
+		{
+			return;
+		}
+
+		VkSemaphoreWaitInfo wait_info{};
+		wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &semaphore_;
+		wait_info.pValues = &value;
+
+		if (vkWaitSemaphores(device_, &wait_info, UINT64_MAX) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to wait for timeline semaphore!");
+		}
+		completed_ = std::max(completed_, value);
+	}
+
+private:
+	VkDevice device_ = VK_NULL_HANDLE;
+	VkSemaphore semaphore_ = VK_NULL_HANDLE;
+	uint64_t submitted_ = 0;
+	uint64_t completed_ = 0; // Cached, only ever behind the real counter
+};
+
+/**
+ * Waits and signals of one vkQueueSubmit, binary and timeline semaphores mixed. The values of the binary ones are ignored. Stored
+ * inline, a submit never allocates
+ */
+class queue_submission
+{
+public:
+	void wait(const VkSemaphore semaphore, const VkPipelineStageFlags stages, const uint64_t value = 0)
+	{
+		if (wait_count_ == MAX_QUEUE_SUBMISSION_SEMAPHORES)
+		{
+			throw std::runtime_error("Failed to add a wait to the submission, it is full!");
+		}
+		wait_semaphores_[wait_count_] = semaphore;
+		wait_stages_[wait_count_] = stages;
+		wait_values_[wait_count_] = value;
+		wait_count_++;
+	}
+
+	void wait(const timeline_wait& dependency)
+	{
+		if (dependency.semaphore != VK_NULL_HANDLE)
+		{
+			wait(dependency.semaphore, dependency.stages, dependency.value);
+		}
+	}
+
+	void signal(const VkSemaphore semaphore, const uint64_t value = 0)
+	{
+		if (signal_count_ == MAX_QUEUE_SUBMISSION_SEMAPHORES)
+		{
+			throw std::runtime_error("Failed to add a signal to the submission, it is full!");
+		}
+		signal_semaphores_[signal_count_] = semaphore;
+		signal_values_[signal_count_] = value;
+		signal_count_++;
+	}
+
+	VkResult submit(const VkQueue queue, const uint32_t command_buffer_count, const VkCommandBuffer* command_buffers) const
+	{
+		VkTimelineSemaphoreSubmitInfo timeline_info{};
+		timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timeline_info.waitSemaphoreValueCount = wait_count_;
+		timeline_info.pWaitSemaphoreValues = wait_values_.data();
+		timeline_info.signalSemaphoreValueCount = signal_count_;
+		timeline_info.pSignalSemaphoreValues = signal_values_.data();
+
+		VkSubmitInfo submit_info{};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.pNext = &timeline_info;
+		submit_info.waitSemaphoreCount = wait_count_;
+		submit_info.pWaitSemaphores = wait_semaphores_.data();
+		submit_info.pWaitDstStageMask = wait_stages_.data();
+		submit_info.commandBufferCount = command_buffer_count;
+		submit_info.pCommandBuffers = command_buffers;
+		submit_info.signalSemaphoreCount = signal_count_;
+		submit_info.pSignalSemaphores = signal_semaphores_.data();
+
+		// No fence, the timeline semaphores signaled here are what the CPU waits on
+		return vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+	}
+
+private:
+	std::array<VkSemaphore, MAX_QUEUE_SUBMISSION_SEMAPHORES> wait_semaphores_{};
+	std::array<VkPipelineStageFlags, MAX_QUEUE_SUBMISSION_SEMAPHORES> wait_stages_{};
+	std::array<uint64_t, MAX_QUEUE_SUBMISSION_SEMAPHORES> wait_values_{};
+	uint32_t wait_count_ = 0;
+	std::array<VkSemaphore, MAX_QUEUE_SUBMISSION_SEMAPHORES> signal_semaphores_{};
+	std::array<uint64_t, MAX_QUEUE_SUBMISSION_SEMAPHORES> signal_values_{};
+	uint32_t signal_count_ = 0;
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "gpu_memory_allocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+//	***********************************************
+//	******** UNIFORM RING GLOBAL VARIABLES ********
+//	***********************************************
+
+const VkDeviceSize DEFAULT_UNIFORM_RING_FRAME_SIZE = VkDeviceSize(64) << 10; // 64 kb of uniforms per frame in flight
+const VkDeviceSize UNIFORM_RING_BINDING_RANGE = 256; // Largest uniform block a single push() can hold
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Per-frame uniform data bumped out of one persistently mapped buffer, split in one region per frame in flight. A single descriptor set
+ * with a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC binding covers the whole buffer, push() returns the dynamic offset to bind it with,
+ * so no descriptor set is allocated or written while recording. The region of a frame is only rewritten once that frame is done on the GPU
+ */
+class uniform_ring
+{
+public:
+	void init(gpu_memory_allocator& allocator, const VkDeviceSize min_offset_alignment, const uint32_t frame_count,
+		const VkShaderStageFlags stages, const VkDeviceSize frame_size = DEFAULT_UNIFORM_RING_FRAME_SIZE)
+	{
+		allocator_ = &allocator;
+		alignment_ = std::max<VkDeviceSize>(min_offset_alignment, 1);
+		frame_size_ = align_up(std::max(frame_size, UNIFORM_RING_BINDING_RANGE), alignment_);
+
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = frame_size_ * frame_count;
+		buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(allocator_->device(), &buffer_info, nullptr, &buffer_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create uniform ring buffer!");
+		}
+		allocation_ = allocator_->allocate_for_buffer(buffer_, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		create_descriptor_set(stages);
+	}
+
+	void destroy()
+	{
+		vkDestroyDescriptorPool(allocator_->device(), descriptor_pool_, nullptr);
+		vkDestroyDescriptorSetLayout(allocator_->device(), descriptor_set_layout_, nullptr);
+		vkDestroyBuffer(allocator_->device(), buffer_, nullptr);
+		allocator_->free(allocation_);
+	}
+
+	VkDescriptorSetLayout descriptor_set_layout() const
+	{
+		return descriptor_set_layout_;
+	}
+
+	VkDescriptorSet descriptor_set() const
+	{
+		return descriptor_set_;
+	}
+
+	/**
+	 * Start writing the region of a frame slot. The previous frame of the slot must be done on the GPU
+	 */
+	void begin_frame(const uint32_t frame_index)
+	{
+		frame_begin_ = frame_size_ * frame_index;
+		cursor_ = frame_begin_;
+	}
+
+	/**
+	 * Copy data into the current frame region and return the dynamic offset of the copy
+	 */
+	template <typename T>
+	uint32_t push(const T& data)
+	{
+		static_assert(sizeof(T) <= UNIFORM_RING_BINDING_RANGE, "Uniform block larger than the binding range of the ring");
+
+		// Every descriptor read covers UNIFORM_RING_BINDING_RANGE bytes, which must stay inside the frame region
+		if (cursor_ + UNIFORM_RING_BINDING_RANGE > frame_begin_ + frame_size_)
+		{
+			throw std::runtime_error("Uniform ring frame region is full!");
+		}
+
+		const VkDeviceSize offset = cursor_;
+		std::memcpy(static_cast<uint8_t*>(allocation_.mapped) + offset, &data, sizeof(T));
+		cursor_ = align_up(cursor_ + sizeof(T), alignment_);
+
+		return static_cast<uint32_t>(offset);
+	}
+
+	/**
+	 * Make the writes of the current frame visible to the GPU, before the frame is submitted
+	 */
+	void end_frame()
+	{
+		if (cursor_ > frame_begin_)
+		{
+			allocator_->flush(allocation_, frame_begin_, cursor_ - frame_begin_);
+		}
+	}
+
+private:
+	gpu_memory_allocator* allocator_ = nullptr;
+	VkBuffer buffer_ = VK_NULL_HANDLE;
+	gpu_allocation allocation_;
+	VkDeviceSize alignment_ = 1;
+	VkDeviceSize frame_size_ = 0;
+	VkDeviceSize frame_begin_ = 0;
+	VkDeviceSize cursor_ = 0;
+
+	VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+	VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+	VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+
+	void create_descriptor_set(const VkShaderStageFlags stages)
+	{
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		binding.descriptorCount = 1;
+		binding.stageFlags = stages;
+
+		VkDescriptorSetLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.bindingCount = 1;
+		layout_info.pBindings = &binding;
+
+		if (vkCreateDescriptorSetLayout(allocator_->device(), &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create uniform ring descriptor set layout!");
+		}
+
+		VkDescriptorPoolSize pool_size{};
+		pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		pool_size.descriptorCount = 1;
+
+		VkDescriptorPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = 1;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes = &pool_size;
+
+		if (vkCreateDescriptorPool(allocator_->device(), &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create uniform ring descriptor pool!");
+		}
+
+		VkDescriptorSetAllocateInfo allocate_info{};
+		allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocate_info.descriptorPool = descriptor_pool_;
+		allocate_info.descriptorSetCount = 1;
+		allocate_info.pSetLayouts = &descriptor_set_layout_;
+
+		if (vkAllocateDescriptorSets(allocator_->device(), &allocate_info, &descriptor_set_) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate uniform ring descriptor set!");
+		}
+
+		VkDescriptorBufferInfo buffer_info{};
+		buffer_info.buffer = buffer_;
+		buffer_info.offset = 0;
+		buffer_info.range = UNIFORM_RING_BINDING_RANGE;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptor_set_;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		write.pBufferInfo = &buffer_info;
+
+		vkUpdateDescriptorSets(allocator_->device(), 1, &write, 0, nullptr);
+	}
+
+	static VkDeviceSize align_up(const VkDeviceSize value, const VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <utility>
+
+//	*************************
+//	******** CLASSES ********
+//	*************************
+
+/**
+ * Owner of one Vulkan handle created from parent, a VkDevice or a VkInstance: move-only, destroys the handle with Destroy when it
+ * goes out of scope, is reset or is assigned another handle. Nothing else waits for the GPU, a handle a frame in flight may still
+ * use has to be released into a deletion_queue instead of being reset
+ */
+template <typename Parent, typename Handle, void (VKAPI_PTR* Destroy)(Parent, Handle, const VkAllocationCallbacks*)>
+class basic_unique_handle
+{
+public:
+	basic_unique_handle() = default;
+
+	basic_unique_handle(const Parent parent, const Handle handle) : parent_(parent), handle_(handle)
+	{
+	}
+
+	basic_unique_handle(basic_unique_handle&& other) noexcept : parent_(other.parent_), handle_(other.release())
+	{
+	}
+
+	basic_unique_handle& operator=(basic_unique_handle&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			parent_ = other.parent_;
+			handle_ = other.release();
+		}
+
+		return *this;
+	}
+
+	basic_unique_handle(const basic_unique_handle&) = delete;
+	basic_unique_handle& operator=(const basic_unique_handle&) = delete;
+
+	~basic_unique_handle()
+	{
+		reset();
+	}
+
+	Handle get() const
+	{
+		return handle_;
+	}
+
+	Parent parent() const
+	{
+		return parent_;
+	}
+
+	explicit operator bool() const
+	{
+		return handle_ != VK_NULL_HANDLE;
+	}
+
+	/**
+	 * Give up the ownership without destroying the handle
+	 */
+	Handle release()
+	{
+		return std::exchange(handle_, VK_NULL_HANDLE);
+	}
+
+	void reset()
+	{
+		if (handle_ != VK_NULL_HANDLE)
+		{
+			Destroy(parent_, handle_, nullptr);
+			handle_ = VK_NULL_HANDLE;
+		}
+	}
+
+private:
+	Parent parent_ = VK_NULL_HANDLE;
+	Handle handle_ = VK_NULL_HANDLE;
+};
+
+/**
+ * Owner of a VkInstance or a VkDevice, the handles that have no parent. Same rules as basic_unique_handle, every handle created
+ * from it must be gone before it is reset
+ */
+template <typename Handle, void (VKAPI_PTR* Destroy)(Handle, const VkAllocationCallbacks*)>
+class unique_dispatchable_handle
+{
+public:
+	unique_dispatchable_handle() = default;
+
+	explicit unique_dispatchable_handle(const Handle handle) : handle_(handle)
+	{
+	}
+
+	unique_dispatchable_handle(unique_dispatchable_handle&& other) noexcept : handle_(other.release())
+	{
+	}
+
+	unique_dispatchable_handle& operator=(unique_dispatchable_handle&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			handle_ = other.release();
+		}
+
+		return *this;
+	}
+
+	unique_dispatchable_handle(const unique_dispatchable_handle&) = delete;
+	unique_dispatchable_handle& operator=(const unique_dispatchable_handle&) = delete;
+
+	~unique_dispatchable_handle()
+	{
+		reset();
+	}
+
+	Handle get() const
+	{
+		return handle_;
+	}
+
+	explicit operator bool() const
+	{
+		return handle_ != VK_NULL_HANDLE;
+	}
+
+	Handle release()
+	{
+		return std::exchange(handle_, VK_NULL_HANDLE);
+	}
+
+	void reset()
+	{
+		if (handle_ != VK_NULL_HANDLE)
+		{
+			Destroy(handle_, nullptr);
+			handle_ = VK_NULL_HANDLE;
+		}
+	}
+
+private:
+	Handle handle_ = VK_NULL_HANDLE;
+};
+
+template <typename Handle, void (VKAPI_PTR* Destroy)(VkDevice, Handle, const VkAllocationCallbacks*)>
+using unique_handle = basic_unique_handle<VkDevice, Handle, Destroy>;
+
+using unique_instance = unique_dispatchable_handle<VkInstance, vkDestroyInstance>;
+using unique_device = unique_dispatchable_handle<VkDevice, vkDestroyDevice>;
+using unique_surface = basic_unique_handle<VkInstance, VkSurfaceKHR, vkDestroySurfaceKHR>;
+
+using unique_swap_chain = unique_handle<VkSwapchainKHR, vkDestroySwapchainKHR>;
+using unique_image_view = unique_handle<VkImageView, vkDestroyImageView>;
+using unique_framebuffer = unique_handle<VkFramebuffer, vkDestroyFramebuffer>;
+using unique_render_pass = unique_handle<VkRenderPass, vkDestroyRenderPass>;
+using unique_pipeline_layout = unique_handle<VkPipelineLayout, vkDestroyPipelineLayout>;
+using unique_pipeline_cache = unique_handle<VkPipelineCache, vkDestroyPipelineCache>;
+using unique_pipeline = unique_handle<VkPipeline, vkDestroyPipeline>;
+using unique_semaphore = unique_handle<VkSemaphore, vkDestroySemaphore>;
+using unique_command_pool = unique_handle<VkCommandPool, vkDestroyCommandPool>;
+using unique_buffer = unique_handle<VkBuffer, vkDestroyBuffer>;
+using unique_image = unique_handle<VkImage, vkDestroyImage>;